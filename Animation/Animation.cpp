@@ -1,4 +1,7 @@
 #include "Animation.h"
+#include <chrono>
+#include <functional>
+#include <numeric>
 
 using namespace DirectX;
 
@@ -8,6 +11,29 @@ namespace Animation
 
 	}
 
+	BoneAnimationSample::BoneAnimationSample(const BoneAnimationSample& other)
+	{
+		*this = other;
+	}
+
+	// Views are only valid as long as their store doesn't move, the copy
+	// owns the keys
+	BoneAnimationSample& BoneAnimationSample::operator=(const BoneAnimationSample& other)
+	{
+		if (this == &other)
+			return *this;
+
+		mName = other.mName;
+		reset_view();
+		mLocalPose.resize(other.get_key_count());
+		for (int i = 0; i < (int)mLocalPose.size(); i++)
+		{
+			mLocalPose[i] = other.get_key(i);
+		}
+
+		return *this;
+	}
+
 
 	float BoneAnimationSample::get_start_time_in_tick() const
 	{
@@ -16,45 +42,125 @@ namespace Animation
 
 	float BoneAnimationSample::get_end_time_in_tick() const
 	{
+		if (is_view())
+			return (float)(mKeyCount - 1);
+
 		return mLocalPose[mLocalPose.size() - 1].mTrans.mTimeTick;
 	}
 
-	int BoneAnimationSample::get_position_index(float tick) const
+	int BoneAnimationSample::get_key_count() const
 	{
-		for (int i = 0; i < mLocalPose.size() - 1; i++)
-		{
-			if (tick < mLocalPose[i + 1].mTrans.mTimeTick)
-				return i;
-		}
+		return is_view() ? mKeyCount : (int)mLocalPose.size();
+	}
+
+	Transform BoneAnimationSample::get_key(int i) const
+	{
+		if (!is_view())
+			return mLocalPose[i];
+
+		size_t index = (size_t)i * mKeyStride;
 
-		assert(false);
-		return -1;
+		Transform key;
+		key.mTrans.mValue = mPositionKeys[index];
+		key.mRot.mValue = mRotationKeys[index];
+		key.mScale.mValue = mScaleKeys[index];
+		key.mTrans.mTimeTick = key.mRot.mTimeTick = key.mScale.mTimeTick = (float)i;
+		return key;
 	}
 
-	int BoneAnimationSample::get_rotation_index(float tick) const
+	void BoneAnimationSample::set_view(const Vector3* positions, const Quaternion* rotations, const Vector3* scales, int count, int stride)
 	{
-		for (int i = 0; i < mLocalPose.size() - 1; i++)
+		std::vector<Transform>().swap(mLocalPose);
+
+		mPositionKeys = positions;
+		mRotationKeys = rotations;
+		mScaleKeys = scales;
+		mKeyCount = count;
+		mKeyStride = stride;
+	}
+
+	void BoneAnimationSample::detach_keys()
+	{
+		if (!is_view())
+			return;
+
+		mLocalPose.resize(mKeyCount);
+		for (int i = 0; i < mKeyCount; i++)
 		{
-			if (tick < mLocalPose[i + 1].mRot.mTimeTick)
-				return i;
+			mLocalPose[i] = get_key(i);
 		}
 
-		assert(false);
-		return -1;
+		reset_view();
+	}
+
+	Transform BoneAnimationSample::sample_at_tick(float tick) const
+	{
+		float end = get_end_time_in_tick();
 
+		Transform t;
+		interpolate(end > 0.0f ? clampf(tick / end, 0.0f, 1.0f) : 0.0f, t);
+		return t;
 	}
 
-	int BoneAnimationSample::get_scale_index(float tick) const
+	void BoneAnimationSample::reset_view()
 	{
-		for (int i = 0; i < mLocalPose.size() - 1; i++)
+		mPositionKeys = nullptr;
+		mRotationKeys = nullptr;
+		mScaleKeys = nullptr;
+		mKeyCount = 0;
+		mKeyStride = 0;
+	}
+
+	// Finds the key i such that time(i) <= tick < time(i + 1). When a cursor is
+	// given, the keys following it are tried first, which makes sequential
+	// playback O(1), and the binary search is only used after a jump.
+	template<typename KeyTime>
+	static inline int find_key_index(const std::vector<Transform>& keys, float tick, int* cursor, KeyTime key_time)
+	{
+		const int last = (int)keys.size() - 2;
+		assert(last >= 0);
+
+		if (cursor)
 		{
-			if (tick < mLocalPose[i + 1].mScale.mTimeTick)
-				return i;
+			int i = clamp(*cursor, 0, last);
+			if (key_time(keys[i]) <= tick)
+			{
+				for (int step = 0; step < 4 && i < last && key_time(keys[i + 1]) <= tick; step++)
+				{
+					i++;
+				}
+
+				if (i == last || tick < key_time(keys[i + 1]))
+				{
+					*cursor = i;
+					return i;
+				}
+			}
 		}
 
-		assert(false);
-		return -1;
+		auto it = std::upper_bound(keys.begin() + 1, keys.end(), tick,
+			[&key_time](float t, const Transform& key) { return t < key_time(key); });
+		int i = clamp((int)(it - keys.begin()) - 1, 0, last);
+
+		if (cursor)
+			*cursor = i;
+
+		return i;
+	}
 
+	int BoneAnimationSample::get_position_index(float tick, int* cursor) const
+	{
+		return find_key_index(mLocalPose, tick, cursor, [](const Transform& key) { return key.mTrans.mTimeTick; });
+	}
+
+	int BoneAnimationSample::get_rotation_index(float tick, int* cursor) const
+	{
+		return find_key_index(mLocalPose, tick, cursor, [](const Transform& key) { return key.mRot.mTimeTick; });
+	}
+
+	int BoneAnimationSample::get_scale_index(float tick, int* cursor) const
+	{
+		return find_key_index(mLocalPose, tick, cursor, [](const Transform& key) { return key.mScale.mTimeTick; });
 	}
 
 	float BoneAnimationSample::get_factor(float last, float next, float t) const
@@ -62,8 +168,16 @@ namespace Animation
 		return (t - last) / (next - last);
 	}
 
-	void BoneAnimationSample::interpolate(float ratio, XMFLOAT4X4& M) const
+	void BoneAnimationSample::interpolate(float ratio, XMFLOAT4X4& M, KeyCursor* cursor) const
 	{
+		if (is_view())
+		{
+			Transform P;
+			interpolate_view(ratio, P);
+			XMStoreFloat4x4(&M, XMMatrixAffineTransformation(P.mScale.mValue, Vector3::Zero, P.mRot.mValue, P.mTrans.mValue));
+			return;
+		}
+
 		float time_in_tick = ratio * (get_end_time_in_tick() - get_start_time_in_tick()) + get_start_time_in_tick();
 
 		if (time_in_tick <= get_start_time_in_tick())
@@ -74,7 +188,7 @@ namespace Animation
 
 			XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, Vector3::Zero, Q, P));
 		}
-		if (time_in_tick >= get_end_time_in_tick())
+		else if (time_in_tick >= get_end_time_in_tick())
 		{
 			Vector3 S = mLocalPose.back().mScale.mValue;
 			Vector3 P = mLocalPose.back().mTrans.mValue;
@@ -86,13 +200,13 @@ namespace Animation
 		{
 			XMVECTOR S, P, Q;
 
-			int scale_index = get_scale_index(time_in_tick);
-			int position_index = get_position_index(time_in_tick);
-			int rotation_index = get_rotation_index(time_in_tick);
+			int scale_index = get_scale_index(time_in_tick, cursor ? &cursor->scale : nullptr);
+			int position_index = get_position_index(time_in_tick, cursor ? &cursor->position : nullptr);
+			int rotation_index = get_rotation_index(time_in_tick, cursor ? &cursor->rotation : nullptr);
 
 			float scale_factor = get_factor(mLocalPose[scale_index].mScale.mTimeTick, mLocalPose[scale_index + 1].mScale.mTimeTick, time_in_tick);
-			float position_factor = get_factor(mLocalPose[scale_index].mTrans.mTimeTick, mLocalPose[scale_index + 1].mTrans.mTimeTick, time_in_tick);
-			float rotation_factor = get_factor(mLocalPose[scale_index].mRot.mTimeTick, mLocalPose[scale_index + 1].mRot.mTimeTick, time_in_tick);
+			float position_factor = get_factor(mLocalPose[position_index].mTrans.mTimeTick, mLocalPose[position_index + 1].mTrans.mTimeTick, time_in_tick);
+			float rotation_factor = get_factor(mLocalPose[rotation_index].mRot.mTimeTick, mLocalPose[rotation_index + 1].mRot.mTimeTick, time_in_tick);
 
 			S = Vector3::Lerp(mLocalPose[scale_index].mScale.mValue, mLocalPose[scale_index + 1].mScale.mValue, scale_factor);
 			P = Vector3::Lerp(mLocalPose[position_index].mTrans.mValue, mLocalPose[position_index + 1].mTrans.mValue, position_factor);
@@ -103,8 +217,14 @@ namespace Animation
 	}
 
 
-	void BoneAnimationSample::interpolate(float ratio, Transform& P) const
+	void BoneAnimationSample::interpolate(float ratio, Transform& P, KeyCursor* cursor) const
 	{
+		if (is_view())
+		{
+			interpolate_view(ratio, P);
+			return;
+		}
+
 		float time_in_tick = ratio * (get_end_time_in_tick() - get_start_time_in_tick()) + get_start_time_in_tick();
 
 		if (time_in_tick <= get_start_time_in_tick())
@@ -113,7 +233,7 @@ namespace Animation
 			P.mTrans.mValue = mLocalPose.front().mTrans.mValue;
 			P.mRot.mValue = mLocalPose.front().mRot.mValue;
 		}
-		if (time_in_tick >= get_end_time_in_tick())
+		else if (time_in_tick >= get_end_time_in_tick())
 		{
 			P.mScale.mValue = mLocalPose.back().mScale.mValue;
 			P.mTrans.mValue = mLocalPose.back().mTrans.mValue;
@@ -121,13 +241,13 @@ namespace Animation
 		}
 		else
 		{
-			int scale_index = get_scale_index(time_in_tick);
-			int position_index = get_position_index(time_in_tick);
-			int rotation_index = get_rotation_index(time_in_tick);
+			int scale_index = get_scale_index(time_in_tick, cursor ? &cursor->scale : nullptr);
+			int position_index = get_position_index(time_in_tick, cursor ? &cursor->position : nullptr);
+			int rotation_index = get_rotation_index(time_in_tick, cursor ? &cursor->rotation : nullptr);
 
 			float scale_factor = get_factor(mLocalPose[scale_index].mScale.mTimeTick, mLocalPose[scale_index + 1].mScale.mTimeTick, time_in_tick);
-			float position_factor = get_factor(mLocalPose[scale_index].mTrans.mTimeTick, mLocalPose[scale_index + 1].mTrans.mTimeTick, time_in_tick);
-			float rotation_factor = get_factor(mLocalPose[scale_index].mRot.mTimeTick, mLocalPose[scale_index + 1].mRot.mTimeTick, time_in_tick);
+			float position_factor = get_factor(mLocalPose[position_index].mTrans.mTimeTick, mLocalPose[position_index + 1].mTrans.mTimeTick, time_in_tick);
+			float rotation_factor = get_factor(mLocalPose[rotation_index].mRot.mTimeTick, mLocalPose[rotation_index + 1].mRot.mTimeTick, time_in_tick);
 
 			P.mScale.mValue = Vector3::Lerp(mLocalPose[scale_index].mScale.mValue, mLocalPose[scale_index + 1].mScale.mValue, scale_factor);
 			P.mTrans.mValue = Vector3::Lerp(mLocalPose[position_index].mTrans.mValue, mLocalPose[position_index + 1].mTrans.mValue, position_factor);
@@ -138,6 +258,27 @@ namespace Animation
 		}
 	}
 
+	// Keys of a view are uniformly spaced, the pair around the time is found
+	// without searching.
+	void BoneAnimationSample::interpolate_view(float ratio, Transform& P) const
+	{
+		float time_in_tick = clampf(ratio, 0.0f, 1.0f) * get_end_time_in_tick();
+
+		int last = mKeyCount - 1;
+		int index = clamp((int)time_in_tick, 0, std::max(last - 1, 0));
+		int next = std::min(index + 1, last);
+		float factor = clampf(time_in_tick - index, 0.0f, 1.0f);
+
+		size_t i0 = (size_t)index * mKeyStride;
+		size_t i1 = (size_t)next * mKeyStride;
+		P.mScale.mValue = Vector3::Lerp(mScaleKeys[i0], mScaleKeys[i1], factor);
+		P.mTrans.mValue = Vector3::Lerp(mPositionKeys[i0], mPositionKeys[i1], factor);
+		P.mRot.mValue = Quaternion::Slerp(mRotationKeys[i0], mRotationKeys[i1], factor);
+		P.mScale.mTimeTick = time_in_tick;
+		P.mTrans.mTimeTick = time_in_tick;
+		P.mRot.mTimeTick = time_in_tick;
+	}
+
 	void BoneAnimationSample::convert_to_fps(float fps, float original_tick_per_second, float duration_tick)
 	{
 		float duration_in_second = duration_tick / original_tick_per_second;
@@ -157,6 +298,7 @@ namespace Animation
 		}
 
 		mLocalPose = new_local_pose;
+		reset_view();
 	}
 
 
@@ -189,7 +331,7 @@ namespace Animation
 		int max = 0;
 		for (UINT i = 0; i < mSamples.size(); ++i)
 		{
-			max = maxf(max, mSamples[i].mLocalPose.size());
+			max = maxf(max, mSamples[i].get_key_count());
 		}
 
 		return max;
@@ -246,9 +388,9 @@ namespace Animation
 		{
 			//transforms.push_back(mSamples[i].mLocalPose[tick]);
 
-			if (!mSamples[i].mLocalPose.empty())
+			if (mSamples[i].get_key_count() > 0)
 			{
-				transforms.push_back(mSamples[i].mLocalPose[tick]);
+				transforms.push_back(mSamples[i].get_key(tick));
 			}
 			else
 			{
@@ -261,5 +403,97 @@ namespace Animation
 
 		return transforms;
 	}
-}
 
+	// The lookup used before the binary search, for comparison.
+	template<typename KeyTime>
+	static inline int find_key_index_linear(const std::vector<Transform>& keys, float tick, KeyTime key_time)
+	{
+		for (int i = 0; i < (int)keys.size() - 1; i++)
+		{
+			if (tick < key_time(keys[i + 1]))
+				return i;
+		}
+
+		return (int)keys.size() - 2;
+	}
+
+	KeyframeSearchBenchmark BenchmarkKeyframeSearch(const AnimationClip& source, int sampleCount, int iterations)
+	{
+		KeyframeSearchBenchmark result;
+		if (sampleCount <= 0 || iterations <= 0 || source.mSamples.empty())
+			return result;
+
+		// Copies own their keys, even those of the clips of a database
+		AnimationClip clip = source;
+
+		auto position_time = [](const Transform& key) { return key.mTrans.mTimeTick; };
+		auto rotation_time = [](const Transform& key) { return key.mRot.mTimeTick; };
+		auto scale_time = [](const Transform& key) { return key.mScale.mTimeTick; };
+
+		const int trackCount = (int)clip.mSamples.size();
+		std::vector<int> expected((size_t)sampleCount * trackCount * 3);
+		std::vector<int> indices(expected.size());
+		std::vector<KeyCursor> cursors(trackCount);
+
+		// mode 0: linear, 1: binary search, 2: binary search and cursors
+		auto run = [&](int mode, std::vector<int>& out)
+		{
+			std::fill(cursors.begin(), cursors.end(), KeyCursor());
+
+			auto start = std::chrono::steady_clock::now();
+
+			size_t n = 0;
+			for (int s = 0; s < sampleCount; s++)
+			{
+				float ratio = (float)s / sampleCount;
+				for (int t = 0; t < trackCount; t++)
+				{
+					const BoneAnimationSample& track = clip.mSamples[t];
+					if (track.mLocalPose.size() < 2)
+					{
+						n += 3;
+						continue;
+					}
+
+					float tick = ratio * (track.get_end_time_in_tick() - track.get_start_time_in_tick()) + track.get_start_time_in_tick();
+					if (mode == 0)
+					{
+						out[n++] = find_key_index_linear(track.mLocalPose, tick, position_time);
+						out[n++] = find_key_index_linear(track.mLocalPose, tick, rotation_time);
+						out[n++] = find_key_index_linear(track.mLocalPose, tick, scale_time);
+					}
+					else
+					{
+						KeyCursor* cursor = mode == 2 ? &cursors[t] : nullptr;
+						out[n++] = track.get_position_index(tick, cursor ? &cursor->position : nullptr);
+						out[n++] = track.get_rotation_index(tick, cursor ? &cursor->rotation : nullptr);
+						out[n++] = track.get_scale_index(tick, cursor ? &cursor->scale : nullptr);
+					}
+				}
+			}
+
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		};
+
+		for (int it = 0; it < iterations; it++)
+		{
+			result.LinearMilliseconds += run(0, expected);
+
+			result.BinaryMilliseconds += run(1, indices);
+			if (it == 0)
+				result.Mismatches += (int)std::inner_product(indices.begin(), indices.end(), expected.begin(), 0,
+					std::plus<int>(), std::not_equal_to<int>());
+
+			result.CursorMilliseconds += run(2, indices);
+			if (it == 0)
+				result.Mismatches += (int)std::inner_product(indices.begin(), indices.end(), expected.begin(), 0,
+					std::plus<int>(), std::not_equal_to<int>());
+		}
+
+		result.LinearMilliseconds /= iterations;
+		result.BinaryMilliseconds /= iterations;
+		result.CursorMilliseconds /= iterations;
+
+		return result;
+	}
+}
@@ -14,6 +14,17 @@ namespace Animation
 	/// We assume an animation always has two keyframes.
 	///</summary>
 
+	// Keys used by the last lookup of a track, from which the next lookup
+	// starts searching.
+	struct KeyCursor
+	{
+		int position = 0;
+
+		int rotation = 0;
+
+		int scale = 0;
+	};
+
 	// The transform series of a joint
 	struct BoneAnimationSample
 	{
@@ -21,25 +32,68 @@ namespace Animation
 
 		std::vector<Transform> mLocalPose;
 
+		// Set instead of mLocalPose when the keys are read from the pose store
+		// of a database, which holds the clips resampled at every tick (see
+		// AnimationDatabase::AppendPoses). Key i is at tick i, mKeyStride
+		// elements after key i - 1. Copies own their keys.
+		const Vector3* mPositionKeys = nullptr;
+
+		const Quaternion* mRotationKeys = nullptr;
+
+		const Vector3* mScaleKeys = nullptr;
+
+		int mKeyCount = 0;
+
+		int mKeyStride = 0;
+
 		BoneAnimationSample();
 
+		BoneAnimationSample(const BoneAnimationSample& other);
+
+		BoneAnimationSample& operator=(const BoneAnimationSample& other);
+
+		BoneAnimationSample(BoneAnimationSample&&) = default;
+
+		BoneAnimationSample& operator=(BoneAnimationSample&&) = default;
+
+		bool is_view() const { return mKeyStride > 0; }
+
+		int get_key_count() const;
+
+		Transform get_key(int i) const;
+
+		// Reads the keys from the arrays instead of mLocalPose, which is freed.
+		void set_view(const Vector3* positions, const Quaternion* rotations, const Vector3* scales, int count, int stride);
+
+		// Copies the keys of a view to mLocalPose, which then owns them.
+		void detach_keys();
+
+		// Transform at the tick, from the start of the clip. Holds the last key
+		// after the end of the track.
+		Transform sample_at_tick(float tick) const;
+
 		float get_start_time_in_tick()const;
 
 		float get_end_time_in_tick()const;
 
-		int get_position_index(float tick) const;
+		int get_position_index(float tick, int* cursor = nullptr) const;
 
-		int get_rotation_index(float tick) const;
+		int get_rotation_index(float tick, int* cursor = nullptr) const;
 
-		int get_scale_index(float tick) const;
+		int get_scale_index(float tick, int* cursor = nullptr) const;
 
 		float get_factor(float last, float next, float t) const;
 
-		void interpolate(float t, DirectX::XMFLOAT4X4& M) const;
+		void interpolate(float t, DirectX::XMFLOAT4X4& M, KeyCursor* cursor = nullptr) const;
 
-		void interpolate(float t, Transform& P) const;
+		void interpolate(float t, Transform& P, KeyCursor* cursor = nullptr) const;
 
 		void convert_to_fps(float fps, float original_tick_per_second, float duration_tick);
+
+	private:
+		void interpolate_view(float ratio, Transform& P) const;
+
+		void reset_view();
 	};
 
 	///<summary>
@@ -76,4 +130,21 @@ namespace Animation
 
 		double mTicksPerSecond;
 	};
+
+	struct KeyframeSearchBenchmark
+	{
+		double LinearMilliseconds = 0.0;
+
+		double BinaryMilliseconds = 0.0;
+
+		double CursorMilliseconds = 0.0;
+
+		// Lookups for which the searches didn't return the same key
+		int Mismatches = 0;
+	};
+
+	// Plays the clip back at sampleCount increasing times and looks up the
+	// position, rotation and scale keys of every track with the former linear
+	// scan, the binary search, and the binary search with key cursors.
+	KeyframeSearchBenchmark BenchmarkKeyframeSearch(const AnimationClip& clip, int sampleCount, int iterations);
 }
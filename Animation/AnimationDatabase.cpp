@@ -1,5 +1,6 @@
 #include "../pch.h"
 #include "AnimationDatabase.h"
+#include <string_view>
 
 using namespace DirectX;
 
@@ -54,7 +55,7 @@ namespace Animation
 
 	void AnimationDatabase::AddAnimation(std::unordered_map<std::string, AnimationClip>& animations)
 	{
-		for (auto [name, animation] : animations)
+		for (auto& [name, animation] : animations)
 		{
 			AddAnimation(name, animation);
 		}
@@ -62,16 +63,204 @@ namespace Animation
 
 	const AnimationClip* AnimationDatabase::AddAnimation(std::string name, AnimationClip animation)
 	{
+		int clipIndex = animation_names.size();
+		animation_names.push_back(name);
+		mAnimations[name] = std::move(animation);
+
+		AnimationClip& clip = mAnimations.at(name);
+		AppendPoses(clipIndex, clip);
+		return &clip;
+	}
+
+	bool AnimationDatabase::RemoveAnimation(const std::string& name)
+	{
+		auto it = std::find(animation_names.begin(), animation_names.end(), name);
+		int firstPose, poseCount;
+		if (it == animation_names.end() || !GetClipPoseRange(name, firstPose, poseCount))
+		{
+			LOG_ERROR("Unknown animation " + name);
+			return false;
+		}
+
+		if (mFile)
+			DetachFile();
+
+		int lastPose = firstPose + poseCount;
+
+		rangeStarts.erase(rangeStarts.begin() + firstPose, rangeStarts.begin() + lastPose);
+		rangeStops.erase(rangeStops.begin() + firstPose, rangeStops.begin() + lastPose);
+		mPoseClipIndex.erase(mPoseClipIndex.begin() + firstPose, mPoseClipIndex.begin() + lastPose);
+
+		size_t first = (size_t)firstPose * mPoseJointCount;
+		size_t last = (size_t)lastPose * mPoseJointCount;
+		mPosePositions.erase(mPosePositions.begin() + first, mPosePositions.begin() + last);
+		mPoseRotations.erase(mPoseRotations.begin() + first, mPoseRotations.begin() + last);
+		mPoseScales.erase(mPoseScales.begin() + first, mPoseScales.begin() + last);
+
+		totalPoseCount -= poseCount;
+		for (int poseId = firstPose; poseId < totalPoseCount; poseId++)
+		{
+			rangeStarts[poseId] -= poseCount;
+			rangeStops[poseId] -= poseCount;
+			mPoseClipIndex[poseId]--;
+		}
+
+		offsets.erase(name);
+		for (auto& [clipName, offset] : offsets)
+		{
+			if (offset >= lastPose)
+				offset -= poseCount;
+		}
+
+		animation_names.erase(it);
+		mAnimations.erase(name);
+
+		UpdatePoseViews();
+		return true;
+	}
+
+	bool AnimationDatabase::GetClipPoseRange(const std::string& name, int& firstPose, int& poseCount) const
+	{
+		auto offset = offsets.find(name);
+		if (offset == offsets.end())
+			return false;
+
+		firstPose = offset->second;
+		poseCount = firstPose < totalPoseCount ? rangeStops[firstPose] - firstPose : 0;
+		return true;
+	}
+
+	void AnimationDatabase::AppendPoses(int clipIndex, AnimationClip& animation)
+	{
+		if (mFile)
+			DetachFile();
+
+		// The clip may be a view of this very store, which is about to grow
+		for (BoneAnimationSample& sample : animation.mSamples)
+		{
+			sample.detach_keys();
+		}
+
+		// The store holds the clip resampled at every tick of its own rate,
+		// from the key times of each track
+		float endTick = 0.0f;
+		bool hasKeys = false;
+		for (const BoneAnimationSample& sample : animation.mSamples)
+		{
+			if (sample.get_key_count() == 0)
+				continue;
+
+			endTick = std::max(endTick, sample.get_end_time_in_tick());
+			hasKeys = true;
+		}
+
+		const std::string& name = animation_names[clipIndex];
+		int poseCount = hasKeys ? (int)ceilf(endTick - 1e-3f) + 1 : 0;
+
+		// The stride is fixed by the first clip when the skeleton isn't set yet
+		if (mPoseJointCount == 0)
+			mPoseJointCount = mJointHierarchy.empty() ? animation.mSamples.size() : mJointHierarchy.size();
+
 		offsets[name] = totalPoseCount;
-		totalPoseCount += animation.get_pose_count();
-		for (int i = 0; i < animation.get_pose_count(); i++)
+		int rangeStart = totalPoseCount;
+		totalPoseCount += poseCount;
+
+		rangeStarts.resize(totalPoseCount, rangeStart);
+		rangeStops.resize(totalPoseCount, totalPoseCount);
+		mPoseClipIndex.resize(totalPoseCount, clipIndex);
+
+		mPosePositions.resize(totalPoseCount * mPoseJointCount, Vector3::Zero);
+		mPoseRotations.resize(totalPoseCount * mPoseJointCount, Quaternion::Identity);
+		mPoseScales.resize(totalPoseCount * mPoseJointCount, Vector3::One);
+
+		int jointCount = std::min(mPoseJointCount, (int)animation.mSamples.size());
+		for (int boneId = 0; boneId < jointCount; boneId++)
 		{
-			rangeStarts.push_back(offsets[name]);
-			rangeStops.push_back(totalPoseCount);
+			const BoneAnimationSample& sample = animation.mSamples[boneId];
+			if (sample.get_key_count() == 0)
+				continue;
+
+			for (int frameId = 0; frameId < poseCount; frameId++)
+			{
+				// Tracks ending before the clip hold their last key
+				Transform t = sample.sample_at_tick(std::min((float)frameId, endTick));
+				int index = (rangeStart + frameId) * mPoseJointCount + boneId;
+				mPosePositions[index] = t.mTrans.mValue;
+				mPoseRotations[index] = t.mRot.mValue;
+				mPoseScales[index] = t.mScale.mValue;
+			}
+
+			// Pointed to the store by UpdatePoseViews
+			animation.mSamples[boneId].set_view(nullptr, nullptr, nullptr, poseCount, mPoseJointCount);
 		}
-		animation_names.push_back(name);
-		mAnimations[name] = animation;
-		return &(mAnimations.at(name));
+
+		UpdatePoseViews();
+	}
+
+	void AnimationDatabase::RebuildPoses()
+	{
+		// The store is emptied, the clips take their keys back first
+		for (auto& [name, animation] : mAnimations)
+		{
+			for (BoneAnimationSample& sample : animation.mSamples)
+			{
+				sample.detach_keys();
+			}
+		}
+
+		totalPoseCount = 0;
+		rangeStarts.clear();
+		rangeStops.clear();
+		mPoseClipIndex.clear();
+		mPosePositions.clear();
+		mPoseRotations.clear();
+		mPoseScales.clear();
+
+		for (int clipIndex = 0; clipIndex < animation_names.size(); clipIndex++)
+		{
+			AppendPoses(clipIndex, mAnimations.at(animation_names[clipIndex]));
+		}
+	}
+
+	void AnimationDatabase::UpdatePoseViews()
+	{
+		mPosePositionsView = mPosePositions.data();
+		mPoseRotationsView = mPoseRotations.data();
+		mPoseScalesView = mPoseScales.data();
+
+		UpdateClipViews();
+	}
+
+	void AnimationDatabase::UpdateClipViews()
+	{
+		for (auto& [name, animation] : mAnimations)
+		{
+			int firstPose, poseCount;
+			if (!GetClipPoseRange(name, firstPose, poseCount) || poseCount == 0)
+				continue;
+
+			int jointCount = std::min(mPoseJointCount, (int)animation.mSamples.size());
+			for (int joint = 0; joint < jointCount; joint++)
+			{
+				BoneAnimationSample& sample = animation.mSamples[joint];
+				if (!sample.is_view())
+					continue;
+
+				size_t first = (size_t)firstPose * mPoseJointCount + joint;
+				sample.set_view(mPosePositionsView + first, mPoseRotationsView + first, mPoseScalesView + first, poseCount, mPoseJointCount);
+			}
+		}
+	}
+
+	void AnimationDatabase::DetachFile()
+	{
+		int count = totalPoseCount * mPoseJointCount;
+		mPosePositions.assign(mPosePositionsView, mPosePositionsView + count);
+		mPoseRotations.assign(mPoseRotationsView, mPoseRotationsView + count);
+		mPoseScales.assign(mPoseScalesView, mPoseScalesView + count);
+		UpdatePoseViews();
+
+		mFile.reset();
 	}
 
 
@@ -85,40 +274,62 @@ namespace Animation
 		return "";
 	}
 
-	std::string AnimationDatabase::GetAnimationClipNameByPoseId(int poseId) const
+	const std::string& AnimationDatabase::GetAnimationClipNameByPoseId(int poseId) const
 	{
-		int rangeStart = rangeStarts[poseId];
-
-		for (auto offset: offsets)
-		{
-			if (rangeStart == offset.second)
-			{
-				return offset.first;				 
-			}
-		}
+		return animation_names[mPoseClipIndex[poseId]];
 	}
 
 	std::vector<Transform> AnimationDatabase::GetTransformsAtPoseId(int poseId) const
 	{
-		std::string name = GetAnimationClipNameByPoseId(poseId);
 		std::vector<Transform> transforms;
-		int rangeStart = rangeStarts[poseId];
-		
-		return mAnimations.at(name).get_transform_at(poseId - rangeStarts[poseId]);
+		GetTransformsAtPoseId(poseId, transforms);
+		return transforms;
 	}
 
-	Vector3 AnimationDatabase::GetBonePosition(int poseId, int boneId) const
+	void AnimationDatabase::GetTransformsAtPoseId(int poseId, std::vector<Transform>& transforms) const
 	{
-		std::string name = GetAnimationClipNameByPoseId(poseId);
 		int frameId = poseId - rangeStarts[poseId];
-		return mAnimations.at(name).mSamples[boneId].mLocalPose[frameId].mTrans.mValue;
+		int base = poseId * mPoseJointCount;
+
+		transforms.resize(mPoseJointCount);
+		for (int boneId = 0; boneId < mPoseJointCount; boneId++)
+		{
+			Transform& t = transforms[boneId];
+			t.mTrans.mValue = mPosePositionsView[base + boneId];
+			t.mRot.mValue = mPoseRotationsView[base + boneId];
+			t.mScale.mValue = mPoseScalesView[base + boneId];
+			t.mTrans.mTimeTick = t.mRot.mTimeTick = t.mScale.mTimeTick = frameId;
+		}
+	}
+
+	Vector3 AnimationDatabase::GetBonePosition(int poseId, int boneId) const
+	{
+		return mPosePositionsView[poseId * mPoseJointCount + boneId];
 	}
 
 	Quaternion AnimationDatabase::GetBoneRotation(int poseId, int boneId) const
 	{
-		std::string name = GetAnimationClipNameByPoseId(poseId);
-		int frameId = poseId - rangeStarts[poseId];
-		return mAnimations.at(name).mSamples[boneId].mLocalPose[frameId].mRot.mValue;
+		return mPoseRotationsView[poseId * mPoseJointCount + boneId];
+	}
+
+	const Vector3* AnimationDatabase::GetPosePositions(int poseId) const
+	{
+		return mPosePositionsView + poseId * mPoseJointCount;
+	}
+
+	const Quaternion* AnimationDatabase::GetPoseRotations(int poseId) const
+	{
+		return mPoseRotationsView + poseId * mPoseJointCount;
+	}
+
+	const Vector3* AnimationDatabase::GetPoseScales(int poseId) const
+	{
+		return mPoseScalesView + poseId * mPoseJointCount;
+	}
+
+	int AnimationDatabase::GetPoseClipIndex(int poseId) const
+	{
+		return mPoseClipIndex[poseId];
 	}
 
 
@@ -150,7 +361,7 @@ namespace Animation
 		return mJointNames[index];
 	}
 
-	Matrix AnimationDatabase::GetJointOffset(int index) const
+	const Matrix& AnimationDatabase::GetJointOffset(int index) const
 	{
 		return mJointOffsets[index];
 	}
@@ -167,33 +378,126 @@ namespace Animation
 
 	int AnimationDatabase::ClampDatabaseTrajectoryIndex(int frame, int offset) const
 	{
-		for (int i = 0; i < this->rangeStarts.size(); i++)
-		{
-			if (frame >= this->rangeStarts[i] && frame < this->rangeStops[i])
-			{
-				return clamp(frame + offset, this->rangeStarts[i], this->rangeStops[i] - 1);
-			}
-		}
-
-		assert(false);
+		assert(frame >= 0 && frame < totalPoseCount);
+		return clamp(frame + offset, this->rangeStarts[frame], this->rangeStops[frame] - 1);
 	}
 
 	void AnimationDatabase::convert_to_fps(float fps)
 	{
-		totalPoseCount = 0;
-		rangeStarts.clear();
-		rangeStops.clear();
+		if (mFile)
+		{
+			LOG_ERROR("Clips of a mapped database can't be resampled.");
+			return;
+		}
+
 		for (auto name : animation_names)
 		{
 			mAnimations.at(name).convert_to_fps(60.0f);
-			offsets[name] = totalPoseCount;
-			totalPoseCount += mAnimations.at(name).get_pose_count();
-			for (int i = 0; i < mAnimations.at(name).get_pose_count(); i++)
+		}
+
+		RebuildPoses();
+	}
+
+
+	bool AnimationDatabase::Load(const std::shared_ptr<AnimationDatabaseFile>& file)
+	{
+		if (!file || !file->IsOpen())
+		{
+			return false;
+		}
+
+		const DatabaseFileHeader& header = file->GetHeader();
+		int jointCount = header.jointCount;
+		int poseCount = header.poseCount;
+
+		// Skeleton and ranges are small, they are copied in bulk
+		const int* parents = file->GetSection<int>(DatabaseSection::JointParents);
+		mJointHierarchy.assign(parents, parents + jointCount);
+
+		const uint32_t* names = file->GetSection<uint32_t>(DatabaseSection::JointNames);
+		mJointNames.clear();
+		for (int i = 0; i < jointCount; i++)
+		{
+			mJointNames.push_back(file->GetString(names[i]));
+		}
+
+		const Matrix* jointOffsets = file->GetSection<Matrix>(DatabaseSection::JointOffsets);
+		mJointOffsets.assign(jointOffsets, jointOffsets + file->GetSectionCount(DatabaseSection::JointOffsets));
+
+		const Transform* bindPose = file->GetSection<Transform>(DatabaseSection::BindPose);
+		mBindPose.assign(bindPose, bindPose + file->GetSectionCount(DatabaseSection::BindPose));
+
+		const SkinnedVertex* vertices = file->GetSection<SkinnedVertex>(DatabaseSection::Vertices);
+		mVertices.assign(vertices, vertices + file->GetSectionCount(DatabaseSection::Vertices));
+
+		const int* starts = file->GetSection<int>(DatabaseSection::RangeStarts);
+		const int* stops = file->GetSection<int>(DatabaseSection::RangeStops);
+		const int* clipIndex = file->GetSection<int>(DatabaseSection::PoseClipIndex);
+		rangeStarts.assign(starts, starts + poseCount);
+		rangeStops.assign(stops, stops + poseCount);
+		mPoseClipIndex.assign(clipIndex, clipIndex + poseCount);
+
+		// The poses are read in place
+		totalPoseCount = poseCount;
+		mPoseJointCount = jointCount;
+		mPosePositions.clear();
+		mPoseRotations.clear();
+		mPoseScales.clear();
+		mPosePositionsView = file->GetSection<Vector3>(DatabaseSection::PosePositions);
+		mPoseRotationsView = file->GetSection<Quaternion>(DatabaseSection::PoseRotations);
+		mPoseScalesView = file->GetSection<Vector3>(DatabaseSection::PoseScales);
+
+		// And so are the keys of the clips, one per pose
+		mAnimations.clear();
+		animation_names.clear();
+		offsets.clear();
+		const DatabaseFileClip* clips = file->GetSection<DatabaseFileClip>(DatabaseSection::Clips);
+		for (uint32_t i = 0; i < header.clipCount; i++)
+		{
+			std::string name = file->GetString(clips[i].name);
+			animation_names.push_back(name);
+			offsets[name] = clips[i].firstPose;
+
+			AnimationClip& clip = mAnimations[name];
+			clip.mName = name;
+			clip.mTicksPerSecond = clips[i].ticksPerSecond;
+			clip.mSamples.resize(jointCount);
+			for (int joint = 0; joint < jointCount; joint++)
 			{
-				rangeStarts.push_back(offsets[name]);
-				rangeStops.push_back(totalPoseCount);
+				clip.mSamples[joint].mName = mJointNames[joint];
+				if (clips[i].poseCount > 0)
+					clip.mSamples[joint].set_view(nullptr, nullptr, nullptr, clips[i].poseCount, jointCount);
 			}
 		}
+		UpdateClipViews();
+
+		mFile = file;
+		return true;
+	}
+
+	bool AnimationDatabase::Save(const std::string& filename, const DatabaseFeatureData* features) const
+	{
+		return AnimationDatabaseFile::Write(filename, *this, features);
+	}
+
+	const AnimationDatabaseFile* AnimationDatabase::GetFile() const
+	{
+		return mFile.get();
+	}
+
+	size_t AnimationDatabase::ComputePoseHash() const
+	{
+		size_t count = (size_t)totalPoseCount * mPoseJointCount;
+		std::hash<std::string_view> hasher;
+
+		size_t seed = ComputeHash(totalPoseCount, mPoseJointCount);
+		HashCombine(seed,
+			hasher(std::string_view((const char*)mPosePositionsView, count * sizeof(Vector3))),
+			hasher(std::string_view((const char*)mPoseRotationsView, count * sizeof(Quaternion))),
+			hasher(std::string_view((const char*)mPoseScalesView, count * sizeof(Vector3))),
+			hasher(std::string_view((const char*)rangeStops.data(), rangeStops.size() * sizeof(int))),
+			hasher(std::string_view((const char*)mJointHierarchy.data(), mJointHierarchy.size() * sizeof(int))));
+		return seed;
 	}
 
 
@@ -2,6 +2,7 @@
 #include "Animation.h"
 #include "../pch.h"
 #include "Common.h"
+#include "AnimationDatabaseFile.h"
 
 using namespace DirectX::SimpleMath;
 
@@ -22,6 +23,13 @@ namespace Animation
 	class AnimationDatabase
 	{
 	public:
+		AnimationDatabase() = default;
+
+		// The pose views point to the arrays of the object itself
+		AnimationDatabase(const AnimationDatabase&) = delete;
+
+		AnimationDatabase& operator=(const AnimationDatabase&) = delete;
+
 		UINT JointCount()const;
 
 		const AnimationClip* GetAnimationClipByName(const std::string& clipName) const;
@@ -43,16 +51,35 @@ namespace Animation
 
 		const AnimationClip* AddAnimation(std::string name, AnimationClip animation);
 
+		// Removes the clip and its poses, the poses of the following clips
+		// move down.
+		bool RemoveAnimation(const std::string& name);
+
+		// Poses of the clip in the pose store.
+		bool GetClipPoseRange(const std::string& name, int& firstPose, int& poseCount) const;
+
 		std::string GetAnimationClipName(UINT i) const;
 
-		std::string GetAnimationClipNameByPoseId(int poseId) const;
+		const std::string& GetAnimationClipNameByPoseId(int poseId) const;
 
 		std::vector<Transform> GetTransformsAtPoseId(int poseId) const;
 
+		void GetTransformsAtPoseId(int poseId, std::vector<Transform>& transforms) const;
+
 		Vector3 GetBonePosition(int poseId, int boneId) const;
 
 		Quaternion GetBoneRotation(int poseId, int boneId) const;
 
+		// Views over the flat pose store, JointCount() elements per pose.
+		const Vector3* GetPosePositions(int poseId) const;
+
+		const Quaternion* GetPoseRotations(int poseId) const;
+
+		const Vector3* GetPoseScales(int poseId) const;
+
+		// Index of the clip (in insertion order) the pose belongs to.
+		int GetPoseClipIndex(int poseId) const;
+
 		std::vector<int> GetJointChildrenIndex(int index) const;
 
 		int GetJointParentIndex(int i) const;
@@ -61,7 +88,7 @@ namespace Animation
 
 		std::string GetJointName(int index) const;
 
-		Matrix GetJointOffset(int index) const;
+		const Matrix& GetJointOffset(int index) const;
 
 		const std::vector<Transform>& GetBindPose() const;
 
@@ -71,6 +98,19 @@ namespace Animation
 
 		void convert_to_fps(float fps);
 
+		// Reads the database from a mapped binary file. The poses are used in
+		// place, the file is kept open as long as the database refers to it.
+		// Like the clips added to it, the clips read their keys from the poses,
+		// which are copied once the database is modified.
+		bool Load(const std::shared_ptr<AnimationDatabaseFile>& file);
+
+		bool Save(const std::string& filename, const DatabaseFeatureData* features = nullptr) const;
+
+		const AnimationDatabaseFile* GetFile() const;
+
+		// Identifies the content of the poses and of their ranges.
+		size_t ComputePoseHash() const;
+
 		bool OnGui();
 
 		int totalPoseCount = 0;
@@ -86,6 +126,8 @@ namespace Animation
 		GraphicDebug* graphic_debug;
 
 	private:
+		friend class AnimationDatabaseFile;
+
 		// Gives parentIndex of ith bone.
 
 		std::vector<std::string> mJointNames;
@@ -100,6 +142,42 @@ namespace Animation
 
 		std::unordered_map<std::string, AnimationClip> mAnimations;
 
+		// Flat SoA store of every pose of every clip, indexed by
+		// [poseId * mPoseJointCount + boneId]. A clip is resampled at every
+		// tick of its ticks per second when it is added, from the key times of
+		// its tracks, and its tracks become views of the store: clips aren't
+		// held twice and per-pose queries don't go through the clip maps.
+		void AppendPoses(int clipIndex, AnimationClip& animation);
+
+		void RebuildPoses();
+
+		// Points the views to the owned pose arrays, and the tracks of the
+		// clips to the store.
+		void UpdatePoseViews();
+
+		void UpdateClipViews();
+
+		// Copies the poses of the mapped file to the owned arrays.
+		void DetachFile();
+
+		int mPoseJointCount = 0;
+
+		std::vector<Vector3> mPosePositions;
+
+		std::vector<Quaternion> mPoseRotations;
+
+		std::vector<Vector3> mPoseScales;
+
+		std::vector<int> mPoseClipIndex;
+
+		// Either the owned arrays above or the sections of the mapped file
+		const Vector3* mPosePositionsView = nullptr;
+
+		const Quaternion* mPoseRotationsView = nullptr;
+
+		const Vector3* mPoseScalesView = nullptr;
+
+		std::shared_ptr<AnimationDatabaseFile> mFile;
 
 	};
 }
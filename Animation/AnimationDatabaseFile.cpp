@@ -0,0 +1,324 @@
+#include "AnimationDatabaseFile.h"
+#include "AnimationDatabase.h"
+
+namespace Animation
+{
+	// Size of the element each section is made of. Checked when opening a
+	// file, so that a file written by a build with a different layout is
+	// rejected instead of being misread.
+	static uint32_t GetSectionStride(DatabaseSection section)
+	{
+		switch (section)
+		{
+		case DatabaseSection::JointParents: return sizeof(int);
+		case DatabaseSection::JointNames: return sizeof(uint32_t);
+		case DatabaseSection::JointOffsets: return sizeof(Matrix);
+		case DatabaseSection::BindPose: return sizeof(Transform);
+		case DatabaseSection::Vertices: return sizeof(SkinnedVertex);
+		case DatabaseSection::Clips: return sizeof(DatabaseFileClip);
+		case DatabaseSection::Strings: return sizeof(char);
+		case DatabaseSection::RangeStarts: return sizeof(int);
+		case DatabaseSection::RangeStops: return sizeof(int);
+		case DatabaseSection::PoseClipIndex: return sizeof(int);
+		case DatabaseSection::PosePositions: return sizeof(Vector3);
+		case DatabaseSection::PoseRotations: return sizeof(Quaternion);
+		case DatabaseSection::PoseScales: return sizeof(Vector3);
+		case DatabaseSection::Features: return sizeof(float);
+		case DatabaseSection::FeatureOffsets: return sizeof(float);
+		case DatabaseSection::FeatureScales: return sizeof(float);
+		default: return 0;
+		}
+	}
+
+	AnimationDatabaseFile::AnimationDatabaseFile()
+		: mFile(INVALID_HANDLE_VALUE), mMapping(nullptr), mData(nullptr), mSize(0) {}
+
+	AnimationDatabaseFile::~AnimationDatabaseFile()
+	{
+		Close();
+	}
+
+	bool AnimationDatabaseFile::Open(const std::string& filename)
+	{
+		Close();
+
+		mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (mFile == INVALID_HANDLE_VALUE)
+		{
+			LOG_ERROR("Failed to open database file " + filename);
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(mFile, &size) || size.QuadPart < (LONGLONG)sizeof(DatabaseFileHeader))
+		{
+			LOG_ERROR("Invalid database file " + filename);
+			Close();
+			return false;
+		}
+		mSize = size.QuadPart;
+
+		mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mMapping)
+		{
+			mData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+		}
+
+		if (!mData)
+		{
+			LOG_ERROR("Failed to map database file " + filename);
+			Close();
+			return false;
+		}
+
+		const DatabaseFileHeader& header = GetHeader();
+		bool valid = header.magic == DATABASE_FILE_MAGIC
+			&& header.version == DATABASE_FILE_VERSION
+			&& header.fileSize == mSize;
+
+		for (int i = 0; i < (int)DatabaseSection::Count && valid; i++)
+		{
+			const DatabaseFileSection& s = header.sections[i];
+			if (s.count == 0)
+				continue;
+
+			valid = s.offset % DATABASE_FILE_ALIGNMENT == 0
+				&& s.stride == GetSectionStride((DatabaseSection)i)
+				&& s.size == (uint64_t)s.count * s.stride
+				&& s.offset <= mSize
+				&& s.size <= mSize - s.offset;
+		}
+
+		uint32_t poseElementCount = header.poseCount * header.jointCount;
+		valid = valid
+			&& GetSectionCount(DatabaseSection::JointParents) == header.jointCount
+			&& GetSectionCount(DatabaseSection::JointNames) == header.jointCount
+			&& GetSectionCount(DatabaseSection::Clips) == header.clipCount
+			&& GetSectionCount(DatabaseSection::RangeStarts) == header.poseCount
+			&& GetSectionCount(DatabaseSection::RangeStops) == header.poseCount
+			&& GetSectionCount(DatabaseSection::PoseClipIndex) == header.poseCount
+			&& GetSectionCount(DatabaseSection::PosePositions) == poseElementCount
+			&& GetSectionCount(DatabaseSection::PoseRotations) == poseElementCount
+			&& GetSectionCount(DatabaseSection::PoseScales) == poseElementCount;
+
+		if (valid && HasSection(DatabaseSection::Features))
+		{
+			valid = GetSectionCount(DatabaseSection::Features) == header.poseCount * header.featureStride
+				&& GetSectionCount(DatabaseSection::FeatureOffsets) == header.featureDimCount
+				&& GetSectionCount(DatabaseSection::FeatureScales) == header.featureDimCount;
+		}
+
+		valid = valid && ValidateContents();
+
+		if (!valid)
+		{
+			LOG_ERROR("Invalid or outdated database file " + filename);
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	// The sections are read in place: every index they hold is checked once,
+	// so that a corrupted file is rejected instead of being read out of bounds.
+	bool AnimationDatabaseFile::ValidateContents() const
+	{
+		const DatabaseFileHeader& header = GetHeader();
+		int poseCount = header.poseCount;
+		int jointCount = header.jointCount;
+
+		// Every string ends within the section
+		uint32_t stringCount = GetSectionCount(DatabaseSection::Strings);
+		const char* strings = GetSection<char>(DatabaseSection::Strings);
+		if (stringCount > 0 && strings[stringCount - 1] != '\0')
+			return false;
+
+		const int* parents = GetSection<int>(DatabaseSection::JointParents);
+		const uint32_t* names = GetSection<uint32_t>(DatabaseSection::JointNames);
+		for (int i = 0; i < jointCount; i++)
+		{
+			if (parents[i] < -1 || parents[i] >= jointCount || names[i] >= stringCount)
+				return false;
+		}
+
+		const DatabaseFileClip* clips = GetSection<DatabaseFileClip>(DatabaseSection::Clips);
+		for (uint32_t i = 0; i < header.clipCount; i++)
+		{
+			if (clips[i].name >= stringCount || (uint64_t)clips[i].firstPose + clips[i].poseCount > header.poseCount)
+				return false;
+		}
+
+		// The range of a pose holds it
+		const int* starts = GetSection<int>(DatabaseSection::RangeStarts);
+		const int* stops = GetSection<int>(DatabaseSection::RangeStops);
+		const int* clipIndex = GetSection<int>(DatabaseSection::PoseClipIndex);
+		for (int i = 0; i < poseCount; i++)
+		{
+			if (starts[i] < 0 || starts[i] > i || stops[i] <= i || stops[i] > poseCount
+				|| clipIndex[i] < 0 || clipIndex[i] >= (int)header.clipCount)
+				return false;
+		}
+
+		return true;
+	}
+
+	void AnimationDatabaseFile::Close()
+	{
+		if (mData)
+			UnmapViewOfFile(mData);
+
+		if (mMapping)
+			CloseHandle(mMapping);
+
+		if (mFile != INVALID_HANDLE_VALUE)
+			CloseHandle(mFile);
+
+		mFile = INVALID_HANDLE_VALUE;
+		mMapping = nullptr;
+		mData = nullptr;
+		mSize = 0;
+	}
+
+	bool AnimationDatabaseFile::IsOpen() const
+	{
+		return mData != nullptr;
+	}
+
+	const DatabaseFileHeader& AnimationDatabaseFile::GetHeader() const
+	{
+		return *reinterpret_cast<const DatabaseFileHeader*>(mData);
+	}
+
+	bool AnimationDatabaseFile::HasSection(DatabaseSection section) const
+	{
+		return GetSectionCount(section) > 0;
+	}
+
+	uint32_t AnimationDatabaseFile::GetSectionCount(DatabaseSection section) const
+	{
+		return GetHeader().sections[(int)section].count;
+	}
+
+	const char* AnimationDatabaseFile::GetString(uint32_t offset) const
+	{
+		// Offsets read from the file are checked by Open
+		if (offset >= GetSectionCount(DatabaseSection::Strings))
+			return "";
+
+		return GetSection<char>(DatabaseSection::Strings) + offset;
+	}
+
+	bool AnimationDatabaseFile::Write(
+		const std::string& filename,
+		const AnimationDatabase& db,
+		const DatabaseFeatureData* features)
+	{
+		uint32_t jointCount = db.JointCount();
+		uint32_t poseCount = db.totalPoseCount;
+
+		if (poseCount > 0 && db.mPoseJointCount != jointCount)
+		{
+			LOG_ERROR("Clips and skeleton don't match.");
+			return false;
+		}
+
+		if (features && features->rows != poseCount)
+		{
+			LOG_ERROR("Features don't match the database.");
+			return false;
+		}
+
+		std::vector<char> strings;
+		auto addString = [&strings](const std::string& s)
+		{
+			uint32_t offset = strings.size();
+			strings.insert(strings.end(), s.begin(), s.end());
+			strings.push_back('\0');
+			return offset;
+		};
+
+		std::vector<uint32_t> jointNames;
+		for (uint32_t i = 0; i < jointCount; i++)
+		{
+			jointNames.push_back(addString(db.mJointNames[i]));
+		}
+
+		std::vector<DatabaseFileClip> clips;
+		for (size_t i = 0; i < db.animation_names.size(); i++)
+		{
+			const std::string& name = db.animation_names[i];
+
+			DatabaseFileClip clip;
+			clip.name = addString(name);
+			clip.firstPose = db.offsets.at(name);
+			clip.poseCount = clip.firstPose < poseCount ? db.rangeStops[clip.firstPose] - clip.firstPose : 0;
+
+			clip.ticksPerSecond = db.mAnimations.at(name).mTicksPerSecond;
+
+			clips.push_back(clip);
+		}
+
+		DatabaseFileHeader header = {};
+		header.magic = DATABASE_FILE_MAGIC;
+		header.version = DATABASE_FILE_VERSION;
+		header.jointCount = jointCount;
+		header.poseCount = poseCount;
+		header.clipCount = clips.size();
+
+		std::vector<uint8_t> blob(sizeof(DatabaseFileHeader));
+		auto addSection = [&blob, &header](DatabaseSection section, const void* data, uint32_t count)
+		{
+			DatabaseFileSection& s = header.sections[(int)section];
+			s.offset = Align<uint64_t>(blob.size(), DATABASE_FILE_ALIGNMENT);
+			s.count = count;
+			s.stride = GetSectionStride(section);
+			s.size = (uint64_t)s.count * s.stride;
+
+			blob.resize(s.offset + s.size, 0);
+			if (s.size > 0)
+				memcpy(blob.data() + s.offset, data, s.size);
+		};
+
+		uint32_t poseElementCount = poseCount * jointCount;
+		addSection(DatabaseSection::JointParents, db.mJointHierarchy.data(), jointCount);
+		addSection(DatabaseSection::JointNames, jointNames.data(), jointNames.size());
+		addSection(DatabaseSection::JointOffsets, db.mJointOffsets.data(), db.mJointOffsets.size());
+		addSection(DatabaseSection::BindPose, db.mBindPose.data(), db.mBindPose.size());
+		addSection(DatabaseSection::Vertices, db.mVertices.data(), db.mVertices.size());
+		addSection(DatabaseSection::Clips, clips.data(), clips.size());
+		addSection(DatabaseSection::Strings, strings.data(), strings.size());
+		addSection(DatabaseSection::RangeStarts, db.rangeStarts.data(), poseCount);
+		addSection(DatabaseSection::RangeStops, db.rangeStops.data(), poseCount);
+		addSection(DatabaseSection::PoseClipIndex, db.mPoseClipIndex.data(), poseCount);
+		addSection(DatabaseSection::PosePositions, db.mPosePositionsView, poseElementCount);
+		addSection(DatabaseSection::PoseRotations, db.mPoseRotationsView, poseElementCount);
+		addSection(DatabaseSection::PoseScales, db.mPoseScalesView, poseElementCount);
+
+		if (features)
+		{
+			header.featureDimCount = features->cols;
+			header.featureStride = features->stride;
+			header.featureHash = features->hash;
+			addSection(DatabaseSection::Features, features->data, features->rows * features->stride);
+			addSection(DatabaseSection::FeatureOffsets, features->offset, features->cols);
+			addSection(DatabaseSection::FeatureScales, features->scale, features->cols);
+		}
+
+		header.fileSize = blob.size();
+		memcpy(blob.data(), &header, sizeof(DatabaseFileHeader));
+
+		FILE* f = fopen(filename.c_str(), "wb");
+		if (f == NULL)
+		{
+			LOG_ERROR("Failed to create database file " + filename);
+			return false;
+		}
+
+		size_t written = fwrite(blob.data(), 1, blob.size(), f);
+		fclose(f);
+
+		return written == blob.size();
+	}
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include "../pch.h"
+
+namespace Animation
+{
+	class AnimationDatabase;
+
+	///<summary>
+	/// Binary version of an AnimationDatabase. The file starts with a header
+	/// followed by sections aligned on DATABASE_FILE_ALIGNMENT bytes. Sections
+	/// are referenced by their offset from the start of the file and hold flat
+	/// arrays of plain structures, so the file is mapped in memory and read in
+	/// place, without any parsing.
+	///
+	/// The version must be bumped whenever the layout of a section changes.
+	///</summary>
+	enum
+	{
+		DATABASE_FILE_MAGIC = 0x4244414D, // "MADB"
+		DATABASE_FILE_VERSION = 2,
+		DATABASE_FILE_ALIGNMENT = 64
+	};
+
+	enum class DatabaseSection : uint32_t
+	{
+		JointParents,		// int per joint
+		JointNames,			// string offset per joint
+		JointOffsets,		// Matrix per joint
+		BindPose,			// Transform per joint
+		Vertices,			// SkinnedVertex
+		Clips,				// DatabaseFileClip per clip
+		Strings,			// null-terminated names
+		RangeStarts,		// int per pose
+		RangeStops,			// int per pose
+		PoseClipIndex,		// int per pose
+		PosePositions,		// Vector3 per pose per joint
+		PoseRotations,		// Quaternion per pose per joint
+		PoseScales,			// Vector3 per pose per joint
+		Features,			// normalized motion matching features, featureStride floats per pose
+		FeatureOffsets,		// float per feature dimension
+		FeatureScales,		// float per feature dimension
+		Count
+	};
+
+	struct DatabaseFileSection
+	{
+		uint64_t offset;
+
+		uint64_t size;
+
+		uint32_t count;
+
+		uint32_t stride;
+	};
+
+	struct DatabaseFileHeader
+	{
+		uint32_t magic;
+
+		uint32_t version;
+
+		uint32_t jointCount;
+
+		uint32_t poseCount;
+
+		uint32_t clipCount;
+
+		uint32_t featureDimCount;
+
+		uint32_t featureStride;
+
+		uint32_t reserved;
+
+		uint64_t fileSize;
+
+		// Configuration the features were computed with, see
+		// MotionMatchingJob::ComputeFeatureHash
+		uint64_t featureHash;
+
+		DatabaseFileSection sections[(int)DatabaseSection::Count];
+	};
+
+	struct DatabaseFileClip
+	{
+		uint32_t name;
+
+		uint32_t firstPose;
+
+		uint32_t poseCount;
+
+		float ticksPerSecond;
+	};
+
+	// Motion matching features to store along the database. All pointers are
+	// borrowed.
+	struct DatabaseFeatureData
+	{
+		int rows = 0;
+
+		int cols = 0;
+
+		int stride = 0;
+
+		const float* data = nullptr;
+
+		const float* offset = nullptr;
+
+		const float* scale = nullptr;
+
+		uint64_t hash = 0;
+	};
+
+	class AnimationDatabaseFile
+	{
+	public:
+		AnimationDatabaseFile();
+
+		~AnimationDatabaseFile();
+
+		AnimationDatabaseFile(const AnimationDatabaseFile&) = delete;
+
+		AnimationDatabaseFile& operator=(const AnimationDatabaseFile&) = delete;
+
+		// Maps the file and checks its header, sections and the indices they hold.
+		bool Open(const std::string& filename);
+
+		void Close();
+
+		bool IsOpen() const;
+
+		const DatabaseFileHeader& GetHeader() const;
+
+		bool HasSection(DatabaseSection section) const;
+
+		template<typename T>
+		const T* GetSection(DatabaseSection section) const
+		{
+			const DatabaseFileSection& s = GetHeader().sections[(int)section];
+			assert(s.count == 0 || s.stride == sizeof(T));
+			return reinterpret_cast<const T*>(mData + s.offset);
+		}
+
+		uint32_t GetSectionCount(DatabaseSection section) const;
+
+		const char* GetString(uint32_t offset) const;
+
+		static bool Write(
+			const std::string& filename,
+			const AnimationDatabase& db,
+			const DatabaseFeatureData* features = nullptr);
+
+	private:
+		bool ValidateContents() const;
+
+		HANDLE mFile;
+
+		HANDLE mMapping;
+
+		const uint8_t* mData;
+
+		uint64_t mSize;
+	};
+}
@@ -0,0 +1,392 @@
+#include "AnimationStreamer.h"
+
+namespace Animation
+{
+	AnimationStreamer::AnimationStreamer()
+		: mFile(INVALID_HANDLE_VALUE), mHeader() {}
+
+	AnimationStreamer::~AnimationStreamer()
+	{
+		Close();
+	}
+
+	bool AnimationStreamer::Open(const std::string& filename, const StreamingSettings& settings)
+	{
+		Close();
+
+		mSettings = settings;
+
+		mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (mFile == INVALID_HANDLE_VALUE)
+		{
+			LOG_ERROR("Failed to open database file " + filename);
+			return false;
+		}
+
+		bool valid = ReadAt(0, &mHeader, sizeof(mHeader))
+			&& mHeader.magic == DATABASE_FILE_MAGIC
+			&& mHeader.version == DATABASE_FILE_VERSION;
+
+		const DatabaseFileSection& clipSection = mHeader.sections[(int)DatabaseSection::Clips];
+		const DatabaseFileSection& stringSection = mHeader.sections[(int)DatabaseSection::Strings];
+
+		std::vector<DatabaseFileClip> clips(valid ? clipSection.count : 0);
+		std::vector<char> strings(valid ? stringSection.count : 0);
+
+		valid = valid
+			&& clipSection.stride == sizeof(DatabaseFileClip)
+			&& mHeader.sections[(int)DatabaseSection::PosePositions].count == mHeader.poseCount * mHeader.jointCount
+			&& ReadAt(clipSection.offset, clips.data(), clipSection.size)
+			&& ReadAt(stringSection.offset, strings.data(), stringSection.size);
+
+		if (!valid)
+		{
+			LOG_ERROR("Invalid or outdated database file " + filename);
+			Close();
+			return false;
+		}
+
+		mJointCount = mHeader.jointCount;
+
+		for (const DatabaseFileClip& c : clips)
+		{
+			ClipInfo clip;
+			clip.name = c.name < strings.size() ? &strings[c.name] : "";
+			clip.firstPose = c.firstPose;
+			clip.poseCount = c.poseCount;
+			clip.sampleRate = c.ticksPerSecond;
+			clip.posesPerChunk = std::max(1, (int)(settings.chunkDuration * clip.sampleRate));
+			clip.firstChunk = mChunks.size();
+			clip.chunkCount = (clip.poseCount + clip.posesPerChunk - 1) / clip.posesPerChunk;
+
+			for (int i = 0; i < clip.chunkCount; i++)
+			{
+				ChunkSlot chunk;
+				chunk.clip = mClips.size();
+				chunk.firstPose = i * clip.posesPerChunk;
+				chunk.poseCount = std::min(clip.posesPerChunk, clip.poseCount - chunk.firstPose);
+				mChunks.push_back(chunk);
+			}
+
+			mClips.push_back(clip);
+		}
+
+		mStop = false;
+		mIOThread = std::thread(&AnimationStreamer::IOLoop, this);
+
+		return true;
+	}
+
+	void AnimationStreamer::Close()
+	{
+		if (mIOThread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStop = true;
+			}
+			mCondition.notify_all();
+			mIOThread.join();
+		}
+
+		if (mFile != INVALID_HANDLE_VALUE)
+			CloseHandle(mFile);
+
+		mFile = INVALID_HANDLE_VALUE;
+		mJointCount = 0;
+		mClips.clear();
+		mChunks.clear();
+		mRequests.clear();
+		mLoaded.clear();
+		mStats = StreamingStats();
+	}
+
+	bool AnimationStreamer::IsOpen() const
+	{
+		return mFile != INVALID_HANDLE_VALUE;
+	}
+
+	int AnimationStreamer::FindClip(const std::string& name) const
+	{
+		for (int i = 0; i < mClips.size(); i++)
+		{
+			if (mClips[i].name == name)
+				return i;
+		}
+
+		return -1;
+	}
+
+	const std::string& AnimationStreamer::GetClipName(int clip) const
+	{
+		return mClips[clip].name;
+	}
+
+	float AnimationStreamer::GetClipDuration(int clip) const
+	{
+		const ClipInfo& info = mClips[clip];
+		return info.sampleRate > 0.0f ? (info.poseCount - 1) / info.sampleRate : 0.0f;
+	}
+
+	int AnimationStreamer::GetChunk(const ClipInfo& clip, int pose) const
+	{
+		return clip.firstChunk + pose / clip.posesPerChunk;
+	}
+
+	void AnimationStreamer::Request(int clip, float time)
+	{
+		const ClipInfo& info = mClips[clip];
+		if (info.poseCount == 0)
+			return;
+
+		int pose = clamp((int)(time * info.sampleRate), 0, info.poseCount - 1);
+		int chunk = GetChunk(info, pose);
+		int last = std::min(chunk + mSettings.prefetchChunks, info.firstChunk + info.chunkCount - 1);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (int i = chunk; i <= last; i++)
+		{
+			RequestChunk(i);
+		}
+	}
+
+	void AnimationStreamer::RequestChunk(int chunk)
+	{
+		ChunkSlot& slot = mChunks[chunk];
+		if (slot.data)
+			return;
+
+		slot.lastRequest = mFrame;
+		if (slot.requested)
+			return;
+
+		slot.requested = true;
+		mRequests.push_back(chunk);
+		mCondition.notify_one();
+	}
+
+	std::shared_ptr<const AnimationChunk> AnimationStreamer::Acquire(int chunk)
+	{
+		ChunkSlot& slot = mChunks[chunk];
+		if (slot.data)
+			slot.lastUse = mFrame;
+
+		return slot.data;
+	}
+
+	bool AnimationStreamer::Sample(int clip, float time, std::vector<Transform>& output)
+	{
+		if (clip < 0 || clip >= mClips.size())
+			return false;
+
+		const ClipInfo& info = mClips[clip];
+		if (info.poseCount == 0)
+			return false;
+
+		Request(clip, time);
+
+		float frame = clampf(time * info.sampleRate, 0.0f, (float)(info.poseCount - 1));
+		int pose0 = (int)frame;
+		int pose1 = std::min(pose0 + 1, info.poseCount - 1);
+		float alpha = frame - pose0;
+
+		int chunk0 = GetChunk(info, pose0);
+		int chunk1 = GetChunk(info, pose1);
+
+		std::shared_ptr<const AnimationChunk> data0;
+		std::shared_ptr<const AnimationChunk> data1;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			data0 = Acquire(chunk0);
+			data1 = chunk1 == chunk0 ? data0 : Acquire(chunk1);
+
+			if (!data0 || !data1)
+			{
+				mStats.misses++;
+
+				// Nearest resident pose, searching both directions
+				if (!data0 && !data1)
+				{
+					int first = info.firstChunk;
+					int last = info.firstChunk + info.chunkCount - 1;
+					for (int d = 1; d <= info.chunkCount && !data0; d++)
+					{
+						if (chunk0 - d >= first && (data0 = Acquire(chunk0 - d)))
+						{
+							chunk0 = chunk0 - d;
+							pose0 = mChunks[chunk0].firstPose + mChunks[chunk0].poseCount - 1;
+						}
+						else if (chunk1 + d <= last && (data0 = Acquire(chunk1 + d)))
+						{
+							chunk0 = chunk1 + d;
+							pose0 = mChunks[chunk0].firstPose;
+						}
+					}
+
+					if (!data0)
+						return false;
+				}
+				else if (!data0)
+				{
+					data0 = data1;
+					chunk0 = chunk1;
+					pose0 = pose1;
+				}
+
+				data1 = data0;
+				chunk1 = chunk0;
+				pose1 = pose0;
+			}
+		}
+
+		if (output.size() != mJointCount)
+			output.resize(mJointCount);
+
+		int base0 = (pose0 - mChunks[chunk0].firstPose) * mJointCount;
+		int base1 = (pose1 - mChunks[chunk1].firstPose) * mJointCount;
+
+		for (int i = 0; i < mJointCount; i++)
+		{
+			Transform& t = output[i];
+			t.mTrans.mValue = Vector3::Lerp(data0->positions[base0 + i], data1->positions[base1 + i], alpha);
+			t.mRot.mValue = Quaternion::Slerp(data0->rotations[base0 + i], data1->rotations[base1 + i], alpha);
+			t.mScale.mValue = Vector3::Lerp(data0->scales[base0 + i], data1->scales[base1 + i], alpha);
+		}
+
+		return true;
+	}
+
+	void AnimationStreamer::Update()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		for (auto& loaded : mLoaded)
+		{
+			ChunkSlot& slot = mChunks[loaded.first];
+			slot.requested = false;
+
+			// Failed reads can be requested again
+			if (!loaded.second)
+				continue;
+
+			slot.data = std::move(loaded.second);
+			slot.lastUse = mFrame;
+			mStats.residentBytes += GetChunkSize(loaded.first);
+			mStats.residentChunks++;
+			mStats.loads++;
+		}
+		mLoaded.clear();
+
+		// Playback jumped or changed clip since these were queued
+		auto stale = std::remove_if(mRequests.begin(), mRequests.end(), [this](int chunk)
+		{
+			ChunkSlot& slot = mChunks[chunk];
+			if (slot.lastRequest >= mFrame)
+				return false;
+
+			slot.requested = false;
+			mStats.droppedRequests++;
+			return true;
+		});
+		mRequests.erase(stale, mRequests.end());
+
+		// Evict the least recently used chunks, but never those used during
+		// the last frame
+		while (mStats.residentBytes > mSettings.residencyBudget)
+		{
+			int oldest = -1;
+			for (int i = 0; i < mChunks.size(); i++)
+			{
+				const ChunkSlot& slot = mChunks[i];
+				if (slot.data && slot.lastUse < mFrame && (oldest < 0 || slot.lastUse < mChunks[oldest].lastUse))
+					oldest = i;
+			}
+
+			if (oldest < 0)
+				break;
+
+			mChunks[oldest].data.reset();
+			mStats.residentBytes -= GetChunkSize(oldest);
+			mStats.residentChunks--;
+			mStats.evictions++;
+		}
+
+		mStats.pendingRequests = mRequests.size();
+		mFrame++;
+	}
+
+	StreamingStats AnimationStreamer::GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mStats;
+	}
+
+	void AnimationStreamer::IOLoop()
+	{
+		for (;;)
+		{
+			int chunk;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this]() { return mStop || !mRequests.empty(); });
+
+				if (mStop)
+					return;
+
+				chunk = mRequests.front();
+				mRequests.pop_front();
+			}
+
+			std::shared_ptr<AnimationChunk> data = ReadChunk(chunk);
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			mLoaded.emplace_back(chunk, std::move(data));
+		}
+	}
+
+	std::shared_ptr<AnimationChunk> AnimationStreamer::ReadChunk(int chunk)
+	{
+		const ChunkSlot& slot = mChunks[chunk];
+		const ClipInfo& clip = mClips[slot.clip];
+
+		size_t count = (size_t)slot.poseCount * mJointCount;
+		uint64_t first = (uint64_t)(clip.firstPose + slot.firstPose) * mJointCount;
+
+		std::shared_ptr<AnimationChunk> data = std::make_shared<AnimationChunk>();
+		data->positions.resize(count);
+		data->rotations.resize(count);
+		data->scales.resize(count);
+
+		const DatabaseFileSection* sections = mHeader.sections;
+		bool valid =
+			ReadAt(sections[(int)DatabaseSection::PosePositions].offset + first * sizeof(Vector3), data->positions.data(), count * sizeof(Vector3))
+			&& ReadAt(sections[(int)DatabaseSection::PoseRotations].offset + first * sizeof(Quaternion), data->rotations.data(), count * sizeof(Quaternion))
+			&& ReadAt(sections[(int)DatabaseSection::PoseScales].offset + first * sizeof(Vector3), data->scales.data(), count * sizeof(Vector3));
+
+		if (!valid)
+		{
+			LOG_ERROR("Failed to read animation chunk of " + clip.name);
+			return nullptr;
+		}
+
+		return data;
+	}
+
+	bool AnimationStreamer::ReadAt(uint64_t offset, void* buffer, size_t size)
+	{
+		// Only the thread opening the file and then the I/O thread read it
+		LARGE_INTEGER position;
+		position.QuadPart = offset;
+		if (!SetFilePointerEx(mFile, position, nullptr, FILE_BEGIN))
+			return false;
+
+		DWORD read = 0;
+		return size == 0 || (ReadFile(mFile, buffer, (DWORD)size, &read, nullptr) && read == size);
+	}
+
+	size_t AnimationStreamer::GetChunkSize(int chunk) const
+	{
+		return (size_t)mChunks[chunk].poseCount * mJointCount * (2 * sizeof(Vector3) + sizeof(Quaternion));
+	}
+}
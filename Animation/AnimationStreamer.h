@@ -0,0 +1,195 @@
+#pragma once
+#include "AnimationDatabaseFile.h"
+#include "AnimationKeyframe.h"
+#include "Common.h"
+
+#include <condition_variable>
+#include <thread>
+
+using namespace DirectX::SimpleMath;
+
+namespace Animation
+{
+	struct StreamingSettings
+	{
+		// Length of the chunks the clips are split in, in seconds
+		float chunkDuration = 1.0f;
+
+		// Maximum size of the resident chunks, in bytes
+		size_t residencyBudget = 64 << 20;
+
+		// Chunks requested ahead of the sampled one
+		int prefetchChunks = 1;
+	};
+
+	struct StreamingStats
+	{
+		int residentChunks = 0;
+
+		size_t residentBytes = 0;
+
+		int pendingRequests = 0;
+
+		int loads = 0;
+
+		int evictions = 0;
+
+		// Queued requests dropped before being read
+		int droppedRequests = 0;
+
+		// Samples whose chunk wasn't resident
+		int misses = 0;
+	};
+
+	// Poses of a chunk, in the layout of the database file:
+	// [pose * jointCount + joint]
+	struct AnimationChunk
+	{
+		std::vector<Vector3> positions;
+
+		std::vector<Quaternion> rotations;
+
+		std::vector<Vector3> scales;
+	};
+
+	///<summary>
+	/// Streams the clips of a database file from disk instead of keeping them
+	/// resident. Clips are split in chunks of fixed duration, which are read on
+	/// a background I/O thread as playback approaches them. Resident chunks are
+	/// kept within a budget and the least recently used are evicted first.
+	///
+	/// Poses are expected to be uniformly sampled at the ticks per second of
+	/// their clip, as they are once a database is converted to a fixed fps.
+	/// When the chunk of a sampled time isn't resident, the nearest resident
+	/// pose of the clip is returned meanwhile.
+	///</summary>
+	class AnimationStreamer
+	{
+	public:
+		AnimationStreamer();
+
+		~AnimationStreamer();
+
+		AnimationStreamer(const AnimationStreamer&) = delete;
+
+		AnimationStreamer& operator=(const AnimationStreamer&) = delete;
+
+		// Reads the header and the clip table, and starts the I/O thread.
+		bool Open(const std::string& filename, const StreamingSettings& settings = StreamingSettings());
+
+		void Close();
+
+		bool IsOpen() const;
+
+		int JointCount() const { return mJointCount; }
+
+		int GetClipCount() const { return (int)mClips.size(); }
+
+		// -1 if there's no such clip
+		int FindClip(const std::string& name) const;
+
+		const std::string& GetClipName(int clip) const;
+
+		float GetClipDuration(int clip) const;
+
+		// Queues the chunk covering the time and the prefetched ones after it.
+		// Chunks have to be requested every frame they are needed: queued
+		// requests that weren't renewed during the frame are dropped by Update().
+		void Request(int clip, float time);
+
+		// Writes the pose of the clip at the time (in seconds) in output, and
+		// requests the chunks around it. Returns false when no pose of the
+		// clip is resident yet, output is then left untouched.
+		bool Sample(int clip, float time, std::vector<Transform>& output);
+
+		// To call once per frame, when no sampling is running: takes the read
+		// chunks in, drops the requests that are no longer needed and evicts
+		// the least recently used chunks over the budget.
+		void Update();
+
+		StreamingStats GetStats() const;
+
+	private:
+		struct ClipInfo
+		{
+			std::string name;
+
+			int firstPose = 0;
+
+			int poseCount = 0;
+
+			float sampleRate = 0.0f;
+
+			int firstChunk = 0;
+
+			int chunkCount = 0;
+
+			int posesPerChunk = 0;
+		};
+
+		struct ChunkSlot
+		{
+			int clip = 0;
+
+			// First pose, relative to the clip
+			int firstPose = 0;
+
+			int poseCount = 0;
+
+			std::shared_ptr<const AnimationChunk> data;
+
+			bool requested = false;
+
+			// Frame of the last request, the chunk isn't read if playback moved
+			// on before the I/O thread got to it
+			uint64_t lastRequest = 0;
+
+			uint64_t lastUse = 0;
+		};
+
+		// Chunk index of a pose of a clip
+		int GetChunk(const ClipInfo& clip, int pose) const;
+
+		// Resident data of the chunk, null if not resident. Marks the use.
+		std::shared_ptr<const AnimationChunk> Acquire(int chunk);
+
+		void RequestChunk(int chunk);
+
+		void IOLoop();
+
+		std::shared_ptr<AnimationChunk> ReadChunk(int chunk);
+
+		bool ReadAt(uint64_t offset, void* buffer, size_t size);
+
+		size_t GetChunkSize(int chunk) const;
+
+		StreamingSettings mSettings;
+
+		HANDLE mFile;
+
+		DatabaseFileHeader mHeader;
+
+		int mJointCount = 0;
+
+		std::vector<ClipInfo> mClips;
+
+		std::vector<ChunkSlot> mChunks;
+
+		// Guards the chunk slots, the queues and the stats
+		mutable std::mutex mMutex;
+
+		std::condition_variable mCondition;
+
+		std::deque<int> mRequests;
+
+		std::vector<std::pair<int, std::shared_ptr<AnimationChunk>>> mLoaded;
+
+		std::thread mIOThread;
+
+		bool mStop = false;
+
+		uint64_t mFrame = 1;
+
+		StreamingStats mStats;
+	};
+}
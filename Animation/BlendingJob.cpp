@@ -2,8 +2,8 @@
 #include "BlendingJob.h"
 #include "SamplingJob.h"
 #include "GradientBandInterpolator.h"
-#include <Eigen/Dense>
-#include <Eigen/Eigenvalues>
+
+using namespace DirectX;
 
 namespace Animation
 {
@@ -14,6 +14,8 @@ namespace Animation
 
 	bool BlendingJob::Run()
 	{
+		PROFILE_SCOPE("BlendingJob::Run");
+
 		Validate();
 		UINT jointNum = layers[0].animation->mSamples.size();
 
@@ -55,147 +57,298 @@ namespace Animation
 			layer.T = layer.K[layer.m] + (((layer.Nk - 1) * t) - layer.m) * (layer.K[layer.m + 1] - layer.K[layer.m]);
 		}
 
-		output.clear();
-		output.resize(jointNum);
+		Scratch& buffers = scratch ? *scratch : ownScratch;
 
-		std::vector<std::vector<Quaternion>> qs;
-		qs.resize(jointNum);
+		int layerNum = layers.size();
+		int jointStride = (jointNum + 3) & ~3;
 
-		int numPass = 0;
-		for (const auto& layer : layers)
+		if (buffers.samplers.size() < layerNum)
+		{
+			buffers.samplers.resize(layerNum);
+			buffers.contexts.resize(layerNum);
+		}
+
+		size_t rotationCount = (size_t)layerNum * jointStride;
+		if (buffers.qx.size() < rotationCount)
+		{
+			buffers.qx.resize(rotationCount);
+			buffers.qy.resize(rotationCount);
+			buffers.qz.resize(rotationCount);
+			buffers.qw.resize(rotationCount);
+		}
+
+		if (buffers.rx.size() < jointStride)
+		{
+			buffers.rx.resize(jointStride);
+			buffers.ry.resize(jointStride);
+			buffers.rz.resize(jointStride);
+			buffers.rw.resize(jointStride);
+		}
+
+		buffers.weights.resize(layerNum);
+
+		if (output.size() != jointNum)
+			output.resize(jointNum);
+
+		std::fill(buffers.rx.begin(), buffers.rx.begin() + jointStride, 0.0f);
+		std::fill(buffers.ry.begin(), buffers.ry.begin() + jointStride, 0.0f);
+		std::fill(buffers.rz.begin(), buffers.rz.begin() + jointStride, 0.0f);
+		std::fill(buffers.rw.begin(), buffers.rw.begin() + jointStride, 0.0f);
+
+		// Samples every layer, blends translations and scales, and gathers
+		// the rotations in SoA along with their weighted sum, flipped to the
+		// hemisphere of the first layer: the nlerp reference rotation. A plain
+		// sum would cancel out when two layers store q and -q.
+		int activeCount = 0;
+		for (int l = 0; l < layerNum; l++)
 		{
+			const Layer& layer = layers[l];
 			if (layer.weight <= 0.0f){
 				continue;
 			}
 
 			float weight = layer.weight;
 
-			SamplingJob samplingJob;
+			SamplingJob& samplingJob = buffers.samplers[l];
 			samplingJob.animation = layer.animation;
+			samplingJob.context = &buffers.contexts[l];
+			samplingJob.cache = cache;
+			samplingJob.lod = lod;
 			samplingJob.ratio = layer.T / layer.animation->get_duration_in_second();
 			samplingJob.Run();
 
 			const std::vector<Transform>& transforms = samplingJob.output;
+
+			float* qx = &buffers.qx[activeCount * jointStride];
+			float* qy = &buffers.qy[activeCount * jointStride];
+			float* qz = &buffers.qz[activeCount * jointStride];
+			float* qw = &buffers.qw[activeCount * jointStride];
+
+			const uint8_t* mask = lod && lod->mask.size() == jointNum ? lod->mask.data() : nullptr;
+
 			for (UINT i = 0; i < jointNum; i++)
 			{
-				qs[i].push_back(transforms[i].mRot.mValue);		
-				
-				if (numPass == 0){
-					output[i].mRot.mValue = weight * transforms[i].mRot.mValue;
+				const Quaternion& q = !mask || mask[i] ? transforms[i].mRot.mValue : Quaternion::Identity;
+				qx[i] = q.x;
+				qy[i] = q.y;
+				qz[i] = q.z;
+				qw[i] = q.w;
+
+				float w = weight;
+				if (activeCount > 0)
+				{
+					float dot = q.x * buffers.qx[i] + q.y * buffers.qy[i] + q.z * buffers.qz[i] + q.w * buffers.qw[i];
+					w = dot < 0.0f ? -weight : weight;
+				}
+
+				buffers.rx[i] += w * q.x;
+				buffers.ry[i] += w * q.y;
+				buffers.rz[i] += w * q.z;
+				buffers.rw[i] += w * q.w;
+
+				if (activeCount == 0){
 					output[i].mScale.mValue = weight * transforms[i].mScale.mValue;
 					output[i].mTrans.mValue = weight * transforms[i].mTrans.mValue;
 				}
 				else{
-					output[i].mRot.mValue += weight * transforms[i].mRot.mValue;
 					output[i].mScale.mValue += weight * transforms[i].mScale.mValue;
 					output[i].mTrans.mValue += weight * transforms[i].mTrans.mValue;
 				}
 			}
-			numPass++;
-		}
 
-		// Log Quaternion Blending
-		for (int i = 0; i < jointNum; ++i)
-		{
-			numPass = 0;
-			Quaternion q_ref = CalculateReferenceQ(qs[i]);
-			Vector4 v_avg = Vector4::Zero;
-			for (int j = 0; j < layers.size(); ++j)
+			// Padding joints get the identity, so the blend stays finite
+			for (int i = jointNum; i < jointStride; i++)
 			{
-				if (layers[j].weight <= 0)
-					continue;
-
-				Quaternion q_ref_inv_x_qj = q_ref.Inversed() * qs[i][numPass];
+				qx[i] = qy[i] = qz[i] = 0.0f;
+				qw[i] = 1.0f;
+			}
 
-				v_avg += layers[j].weight * q_ref_inv_x_qj.Ln();				
+			buffers.weights[activeCount] = weight;
+			activeCount++;
+		}
 
-				numPass++;
-			}
-			output[i].mRot.mValue = q_ref * Quaternion::Exp(v_avg);
+		if (activeCount == 0)
+		{
+			return false;
 		}
 
-		// Normalize quaternion
-		for (UINT i = 0; i < jointNum; i++)
+		for (int i = jointNum; i < jointStride; i++)
 		{
-			output[i].mRot.mValue.Normalize();
+			buffers.rw[i] = 1.0f;
 		}
 
-		return true;
-	}
+		bool warmStart = buffers.references.size() == jointNum;
 
-	bool BlendingJob::Validate()
-	{
-		float weightSum = 0.0f;
-		for (const auto& layer : layers)
+		if (compareReferenceModes)
 		{
-			weightSum += layer.weight;
+			CompareQuaternionAverages(
+				buffers.qx.data(), buffers.qy.data(), buffers.qz.data(), buffers.qw.data(),
+				jointStride, buffers.weights.data(), activeCount, jointNum,
+				warmStart ? buffers.references.data() : nullptr,
+				referenceComparison);
 		}
 
-		if (weightSum != 1.0f)
+		if (referenceMode == QuaternionAverageMode::PowerIteration)
 		{
-			for (auto& layer : layers)
-			{
-				layer.weight /= weightSum;
-			}
+			RefineReferences(buffers, jointNum, jointStride, activeCount);
 		}
 
+		BlendRotations(buffers, jointNum, jointStride, activeCount);
+
 		return true;
 	}
 
-	Quaternion BlendingJob::CalculateReferenceQ(const std::vector<Quaternion>& qs)
+	void BlendingJob::RefineReferences(Scratch& buffers, int jointNum, int jointStride, int activeCount)
 	{
-		/*Eigen::Matrix4f sumOfqxqT = Eigen::Matrix4f::Zero();
-		for (const auto& q : qs)
-		{
-			Eigen::Vector4f qi(q.x, q.y, q.z, q.w);
-			sumOfqxqT += qi * qi.transpose();
-		}
+		bool warmStart = buffers.references.size() == jointNum;
+		if (!warmStart)
+			buffers.references.resize(jointNum);
 
-		Eigen::EigenSolver<Eigen::Matrix4f> solver(sumOfqxqT);
-		Eigen::Matrix4f V = solver.eigenvectors().real();
+		buffers.jointRotations.resize(activeCount);
 
-		float minE = std::numeric_limits<float>::max();
-		Quaternion q_ref;
-		for (size_t i = 0; i < 4; i++)
+		for (int i = 0; i < jointNum; i++)
 		{
-			float E = 0.0f;
-			Quaternion q_eigen(V.col(i)[0], V.col(i)[1], V.col(i)[2], V.col(i)[3]);
-			for (const auto& qi : qs) {
-				float dot = qi.Dot(q_eigen);
-				E += 1.0f - dot * dot;
+			for (int k = 0; k < activeCount; k++)
+			{
+				size_t offset = (size_t)k * jointStride + i;
+				buffers.jointRotations[k] = Quaternion(buffers.qx[offset], buffers.qy[offset], buffers.qz[offset], buffers.qw[offset]);
 			}
-			if (E < minE)
+
+			Quaternion guess = Quaternion(buffers.rx[i], buffers.ry[i], buffers.rz[i], buffers.rw[i]);
+			guess.Normalize();
+			if (warmStart)
 			{
-				minE = E;
-				q_ref = q_eigen;
+				// Stay in the hemisphere of this frame's layers
+				guess = buffers.references[i].Dot(guess) < 0.0f ? -buffers.references[i] : buffers.references[i];
 			}
-		}*/
-		Quaternion q_ref;
 
-		int num_pass = 0;
-		for (auto& qi : qs)
+			Quaternion reference = QuaternionAveragePowerIteration(
+				buffers.jointRotations.data(), buffers.weights.data(), activeCount, guess);
+
+			buffers.references[i] = reference;
+			buffers.rx[i] = reference.x;
+			buffers.ry[i] = reference.y;
+			buffers.rz[i] = reference.z;
+			buffers.rw[i] = reference.w;
+		}
+	}
+
+	// Log quaternion blending, 4 joints at a time:
+	// q = exp(sum(w_k * ln(q_k * q_ref^-1))) * q_ref
+	// with q_ref the reference computed in Run(). Products are written in
+	// Hamilton order, a * b is the rotation b followed by a.
+	void BlendingJob::BlendRotations(Scratch& buffers, int jointNum, int jointStride, int activeCount)
+	{
+		const XMVECTOR zero = XMVectorZero();
+		const XMVECTOR one = XMVectorSplatOne();
+		const XMVECTOR epsilon = XMVectorReplicate(1e-6f);
+
+		for (int i = 0; i < jointStride; i += 4)
 		{
-			if (num_pass == 0)
+			XMVECTOR rx = XMLoadFloat4((const XMFLOAT4*)&buffers.rx[i]);
+			XMVECTOR ry = XMLoadFloat4((const XMFLOAT4*)&buffers.ry[i]);
+			XMVECTOR rz = XMLoadFloat4((const XMFLOAT4*)&buffers.rz[i]);
+			XMVECTOR rw = XMLoadFloat4((const XMFLOAT4*)&buffers.rw[i]);
+
+			// Normalize the reference
+			XMVECTOR length = XMVectorSqrt(XMVectorMultiplyAdd(rx, rx, XMVectorMultiplyAdd(ry, ry,
+				XMVectorMultiplyAdd(rz, rz, XMVectorMultiply(rw, rw)))));
+			XMVECTOR invLength = XMVectorReciprocal(XMVectorMax(length, epsilon));
+			rx = XMVectorMultiply(rx, invLength);
+			ry = XMVectorMultiply(ry, invLength);
+			rz = XMVectorMultiply(rz, invLength);
+			rw = XMVectorMultiply(rw, invLength);
+
+			XMVECTOR vx = zero;
+			XMVECTOR vy = zero;
+			XMVECTOR vz = zero;
+
+			for (int k = 0; k < activeCount; k++)
 			{
-				q_ref = qi;
+				size_t offset = (size_t)k * jointStride + i;
+				XMVECTOR qx = XMLoadFloat4((const XMFLOAT4*)&buffers.qx[offset]);
+				XMVECTOR qy = XMLoadFloat4((const XMFLOAT4*)&buffers.qy[offset]);
+				XMVECTOR qz = XMLoadFloat4((const XMFLOAT4*)&buffers.qz[offset]);
+				XMVECTOR qw = XMLoadFloat4((const XMFLOAT4*)&buffers.qw[offset]);
+
+				// d = q * conjugate(q_ref)
+				XMVECTOR dw = XMVectorMultiplyAdd(qw, rw, XMVectorMultiplyAdd(qx, rx,
+					XMVectorMultiplyAdd(qy, ry, XMVectorMultiply(qz, rz))));
+				XMVECTOR dx = XMVectorSubtract(XMVectorSubtract(XMVectorMultiply(rw, qx), XMVectorMultiply(qw, rx)),
+					XMVectorSubtract(XMVectorMultiply(qy, rz), XMVectorMultiply(qz, ry)));
+				XMVECTOR dy = XMVectorSubtract(XMVectorSubtract(XMVectorMultiply(rw, qy), XMVectorMultiply(qw, ry)),
+					XMVectorSubtract(XMVectorMultiply(qz, rx), XMVectorMultiply(qx, rz)));
+				XMVECTOR dz = XMVectorSubtract(XMVectorSubtract(XMVectorMultiply(rw, qz), XMVectorMultiply(qw, rz)),
+					XMVectorSubtract(XMVectorMultiply(qx, ry), XMVectorMultiply(qy, rx)));
+
+				// q and -q are the same rotation, take the one in the
+				// hemisphere of the reference so that ln(d) takes the short way
+				XMVECTOR flip = XMVectorLess(dw, zero);
+				dw = XMVectorSelect(dw, XMVectorNegate(dw), flip);
+				dx = XMVectorSelect(dx, XMVectorNegate(dx), flip);
+				dy = XMVectorSelect(dy, XMVectorNegate(dy), flip);
+				dz = XMVectorSelect(dz, XMVectorNegate(dz), flip);
+
+				// ln(d) = axis * angle / 2
+				XMVECTOR theta = XMVectorACos(XMVectorClamp(dw, XMVectorNegate(one), one));
+				XMVECTOR sinTheta = XMVectorSin(theta);
+				XMVECTOR factor = XMVectorSelect(one, XMVectorDivide(theta, sinTheta),
+					XMVectorGreater(XMVectorAbs(sinTheta), epsilon));
+
+				XMVECTOR weight = XMVectorMultiply(XMVectorReplicate(buffers.weights[k]), factor);
+				vx = XMVectorMultiplyAdd(weight, dx, vx);
+				vy = XMVectorMultiplyAdd(weight, dy, vy);
+				vz = XMVectorMultiplyAdd(weight, dz, vz);
 			}
-			else
+
+			// e = exp(v)
+			XMVECTOR theta = XMVectorSqrt(XMVectorMultiplyAdd(vx, vx, XMVectorMultiplyAdd(vy, vy, XMVectorMultiply(vz, vz))));
+			XMVECTOR sinTheta, cosTheta;
+			XMVectorSinCos(&sinTheta, &cosTheta, theta);
+			XMVECTOR factor = XMVectorSelect(one, XMVectorDivide(sinTheta, theta),
+				XMVectorGreater(theta, epsilon));
+			XMVECTOR ex = XMVectorMultiply(vx, factor);
+			XMVECTOR ey = XMVectorMultiply(vy, factor);
+			XMVECTOR ez = XMVectorMultiply(vz, factor);
+			XMVECTOR ew = cosTheta;
+
+			// o = e * q_ref
+			XMVECTOR ow = XMVectorSubtract(XMVectorMultiply(ew, rw), XMVectorMultiplyAdd(ex, rx,
+				XMVectorMultiplyAdd(ey, ry, XMVectorMultiply(ez, rz))));
+			XMVECTOR ox = XMVectorAdd(XMVectorMultiplyAdd(ew, rx, XMVectorMultiply(rw, ex)),
+				XMVectorSubtract(XMVectorMultiply(ey, rz), XMVectorMultiply(ez, ry)));
+			XMVECTOR oy = XMVectorAdd(XMVectorMultiplyAdd(ew, ry, XMVectorMultiply(rw, ey)),
+				XMVectorSubtract(XMVectorMultiply(ez, rx), XMVectorMultiply(ex, rz)));
+			XMVECTOR oz = XMVectorAdd(XMVectorMultiplyAdd(ew, rz, XMVectorMultiply(rw, ez)),
+				XMVectorSubtract(XMVectorMultiply(ex, ry), XMVectorMultiply(ey, rx)));
+
+			// Back to one quaternion per joint
+			XMMATRIX rotations = XMMatrixTranspose(XMMATRIX(ox, oy, oz, ow));
+			int count = std::min(4, jointNum - i);
+			for (int j = 0; j < count; j++)
 			{
-				q_ref += qi;
+				XMStoreFloat4(&output[i + j].mRot.mValue, XMQuaternionNormalize(rotations.r[j]));
 			}
-			num_pass++;
 		}
-		q_ref.Normalize();
+	}
 
-		// Redirect the q_ref
-		//float sum = 0.0f;
-		//for (auto qi : qs)
-		//{
-		//	sum += qi.Dot(q_ref);
-		//}
-		//q_ref = sum >= 0 ? q_ref : -q_ref;
+	bool BlendingJob::Validate()
+	{
+		float weightSum = 0.0f;
+		for (const auto& layer : layers)
+		{
+			weightSum += layer.weight;
+		}
 
-		return q_ref;
+		if (weightSum != 1.0f)
+		{
+			for (auto& layer : layers)
+			{
+				layer.weight /= weightSum;
+			}
+		}
+
+		return true;
 	}
 
 	float BlendingJob::GetDuration()
@@ -225,6 +378,31 @@ namespace Animation
 			}
 		}
 
+		int mode = (int)referenceMode;
+		if (ImGui::Combo("Reference", &mode, [](void*, int i, const char** name)
+			{
+				*name = GetQuaternionAverageModeName((QuaternionAverageMode)i);
+				return true;
+			}, nullptr, (int)QuaternionAverageMode::Count))
+		{
+			referenceMode = (QuaternionAverageMode)mode;
+		}
+
+		ImGui::Checkbox("Compare references", &compareReferenceModes);
+		if (compareReferenceModes)
+		{
+			const QuaternionAverageComparison& c = referenceComparison;
+			ImGui::Text("%d joints, %d layers", c.jointCount, c.layerCount);
+			for (int i = 0; i < (int)QuaternionAverageMode::Count; i++)
+			{
+				ImGui::Text("%s: %.3f ms, error max %.4f deg, mean %.4f deg",
+					GetQuaternionAverageModeName((QuaternionAverageMode)i),
+					c.milliseconds[i],
+					XMConvertToDegrees(c.maxError[i]),
+					XMConvertToDegrees(c.meanError[i]));
+			}
+		}
+
 		//weight_transition = false;
 		float v[2] = { interpolator->v.x, interpolator->v.y };
 		if (ImGui::SliderFloat("velocity_x", &v[0], interpolator->minVx, interpolator->maxVx)|| 
@@ -1,6 +1,8 @@
 #pragma once
 #include"Animation.h"
 #include"AnimationDatabase.h"
+#include"SamplingJob.h"
+#include"QuaternionAverage.h"
 
 namespace Animation
 {
@@ -38,6 +40,49 @@ namespace Animation
 
 		std::vector<Layer> layers;
 
+		// Buffers kept from one Run() to the next, so that blending doesn't
+		// allocate once they have grown to the size of the blend. Can be owned
+		// by the caller and shared by jobs that don't run concurrently.
+		struct Scratch
+		{
+			// One sampler per layer, keeping its key cursors between frames.
+			std::vector<SamplingJob> samplers;
+
+			std::vector<SamplingJob::Context> contexts;
+
+			// Sampled rotations of the active layers, SoA, layer after layer:
+			// [layer * jointStride + joint]. jointStride is the joint count
+			// rounded up to 4.
+			std::vector<float> qx, qy, qz, qw;
+
+			// Reference rotation of every joint, SoA.
+			std::vector<float> rx, ry, rz, rw;
+
+			std::vector<float> weights;
+
+			// Last references, warm start of the power iteration.
+			std::vector<Quaternion> references;
+
+			std::vector<Quaternion> jointRotations;
+		};
+
+		// Optional, the job uses its own buffers otherwise.
+		Scratch* scratch = nullptr;
+
+		// Optional, given to the samplers of the layers.
+		SampledPoseCache* cache = nullptr;
+
+		// Optional, culled joints are not sampled and get the identity.
+		const SkeletonLodLevel* lod = nullptr;
+
+		// How the reference rotation of the log blending is computed.
+		QuaternionAverageMode referenceMode = QuaternionAverageMode::Nlerp;
+
+		// Times and compares the reference modes on every Run(), see OnGui().
+		bool compareReferenceModes = false;
+
+		QuaternionAverageComparison referenceComparison;
+
 		std::shared_ptr<PolarGradientBandInterpolator> interpolator;
 
 		//std::vector<Layer> mAdditiveLayers;
@@ -63,7 +108,13 @@ namespace Animation
 		float GetDuration();
 
 	private:
-		Quaternion CalculateReferenceQ(const std::vector<Quaternion>& qs);
+		// Blends the rotations gathered in the scratch arrays into output.
+		void BlendRotations(Scratch& buffers, int jointNum, int jointStride, int activeCount);
+
+		// Replaces the nlerp references by their power iteration refinement.
+		void RefineReferences(Scratch& buffers, int jointNum, int jointStride, int activeCount);
+
+		Scratch ownScratch;
 	};
 
 
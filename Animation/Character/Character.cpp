@@ -38,20 +38,43 @@ namespace Animation
 
 		LocalToModelJob ltm_job;
 		ltm_job.skeleton = &db;
-		ltm_job.input = locals;
+		ltm_job.input = &locals;
+		ltm_job.output = &models;
+		ltm_job.lod = isBindpose ? nullptr : GetLodLevel();
+		ltm_job.palette = &palette;
+		ltm_job.paletteFormat = palette_format;
 		ltm_job.Run(true, true);
-
-		models = ltm_job.output;
 		//transform.mTrans.mValue = Vector3::Transform(locals[0].mTrans.mValue, scale);
 	}
 
+	void Character::UpdateLod(const Matrix& view, const Matrix& proj)
+	{
+		if (!lod.IsBuilt())
+		{
+			if (db.JointCount() == 0)
+				return;
+
+			lod.Build(db);
+		}
+
+		float screenSize = SkeletonLod::ComputeScreenSize(transform.mTrans.mValue, GetBoundingRadius(), view, proj);
+
+		lod_level = lod.SelectLevel(screenSize);
+	}
+
+	float Character::GetBoundingRadius() const
+	{
+		const Vector3& s = transform.mScale.mValue;
+		return lod.GetRadius() * std::max(s.x, std::max(s.y, s.z));
+	}
+
 	void Character::UpdateFootIK(Vector3 target)
 	{
 		LocalToModelJob ltm_job;
 		ltm_job.skeleton = &db;
-		ltm_job.input = locals;
+		ltm_job.input = &locals;
+		ltm_job.output = &models;
 		ltm_job.Run(true, false);
-		models = ltm_job.output;
 
 		const LegInfo& leg = leg_controller.legs[0];
 		// Target position and pole vectors must be in model space.
@@ -85,10 +108,8 @@ namespace Animation
 	{
 		for (auto ri : ritems)
 		{
-			std::copy(
-				std::begin(models),
-				std::end(models),
-				&ri->skinnedConstant.BoneTransforms[0]);
+			ri->SkinnedPalette = palette.data();
+			ri->SkinnedPaletteSize = (UINT)palette.size();
 
 			XMMATRIX m = XMMatrixScaling(transform.mScale.mValue.x, transform.mScale.mValue.y, transform.mScale.mValue.z);
 			m *= XMMatrixRotationQuaternion(transform.mRot.mValue);
@@ -118,6 +139,7 @@ namespace Animation
 			_blending_job.layers[i].weight = weights[i];
 		}
 
+		_blending_job.cache = pose_cache;
 		_blending_job.Run();
 		locals = _blending_job.output;
 	}
@@ -126,9 +148,9 @@ namespace Animation
 	{
 		LocalToModelJob ltm_job;
 		ltm_job.skeleton = &db;
-		ltm_job.input = locals;
+		ltm_job.input = &locals;
+		ltm_job.output = &models;
 		ltm_job.Run(true, false);
-		models = ltm_job.output;
 
 		IKAimJob ik_job;
 
@@ -204,6 +226,6 @@ namespace Animation
 
 	void Character::UpdateController(float dt) {
 		character_controller.Update(dt);
-		locals = character_controller.curr_bone_transforms;
+		locals = character_controller.bone_transforms;
 	}
 }
\ No newline at end of file
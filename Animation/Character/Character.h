@@ -7,6 +7,7 @@
 #include "..//IKRigging/IKRig.h"
 #include "RootMotion.h"
 #include "CharacterController.h"
+#include "../Animation/SkeletonLod.h"
 
 namespace Animation
 {
@@ -30,6 +31,11 @@ namespace Animation
 
 		std::vector<Matrix> models;
 
+		// Skinning matrices packed for the shaders
+		SkinningPaletteFormat palette_format = SkinningPaletteFormat::Matrix4x4;
+
+		std::vector<float> palette;
+
 		CharacterController character_controller;
 
 		// Root Motion
@@ -46,6 +52,21 @@ namespace Animation
 		// Update Final models_ transform
 		void UpdateFinalModelTransform(bool isBindpose);
 
+		// Joint LOD, picked from the size of the character on screen
+		SkeletonLod lod;
+
+		int lod_level = 0;
+
+		void UpdateLod(const Matrix& view, const Matrix& proj);
+
+		const SkeletonLodLevel* GetLodLevel() const { return lod.GetLevel(lod_level); }
+
+		// Bind pose extent in world space, once the LOD is built
+		float GetBoundingRadius() const;
+
+		// Client of the update rate scheduler, -1 when updated every frame
+		int update_client = -1;
+
 		// Foot two bone ik
 		float foot_ik_weight = 1.0f;
 
@@ -72,6 +93,10 @@ namespace Animation
 
 		void UpdateRenderItem();
 
+		// Poses sampled this frame, shared with the other characters. Handed to
+		// the blending job so that layers playing the same clips decompress them once.
+		SampledPoseCache* pose_cache = nullptr;
+
 		void UpdateBlendingMotion(BlendingJob& _blending_job);
 
 		void UpdateHeadAimAtIK(Vector3 target);
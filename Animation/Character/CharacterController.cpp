@@ -17,7 +17,9 @@ namespace Animation
 		this->db = db;
 
 		frame_index = db->rangeStarts[0];
-		curr_bone_transforms = db->GetTransformsAtPoseId(frame_index);
+		db->GetTransformsAtPoseId(frame_index, curr_bone_transforms);
+		bone_transforms = curr_bone_transforms;
+		inertializer.Reset(db->JointCount());
 
 		trajectory_desired_velocities.resize(trajectory_points_size);
 		trajectory_desired_rotations.resize(trajectory_points_size);
@@ -31,8 +33,65 @@ namespace Animation
 
 		rt_data.parent_index = db->GetParentIndex();
 
-		// Build Motion Matching Job
-		mm.Build();
+		// Build Motion Matching Job, unless the database comes with its features
+		mm.cachePrefix = "MotionMatchingFeatures_";
+		if (!db->GetFile() || !mm.Load(*db->GetFile()))
+			mm.Build();
+	}
+
+	const AnimationClip* CharacterController::AddClip(const std::string& name, const AnimationClip& clip)
+	{
+		// A clip replaced under the same name is removed first, so that its
+		// old poses don't stay in the search
+		int firstPose, poseCount;
+		if (db->GetClipPoseRange(name, firstPose, poseCount) && !RemoveClip(name))
+			return nullptr;
+
+		firstPose = db->totalPoseCount;
+		const AnimationClip* added = db->AddAnimation(name, clip);
+		mm.AddPoses(firstPose, db->totalPoseCount - firstPose);
+		return added;
+	}
+
+	bool CharacterController::RemoveClip(const std::string& name)
+	{
+		int firstPose, poseCount;
+		if (!db->GetClipPoseRange(name, firstPose, poseCount) || poseCount >= db->totalPoseCount)
+		{
+			LOG_ERROR("Can't remove animation " + name);
+			return false;
+		}
+
+		if (!db->RemoveAnimation(name))
+			return false;
+
+		mm.RemovePoses(firstPose, poseCount);
+
+		// The current pose moves with its clip, or restarts from the first
+		// clip when it was the removed one
+		if (frame_index >= firstPose + poseCount)
+		{
+			frame_index -= poseCount;
+		}
+		else if (frame_index >= firstPose)
+		{
+			frame_index = db->rangeStarts[0];
+			force_search_timer = 0.0f;
+		}
+
+		return true;
+	}
+
+	void CharacterController::LookupPoseAndVelocities(
+		int pose,
+		std::vector<Transform>& transforms,
+		std::vector<Vector3>& velocities,
+		std::vector<Vector3>& angular_velocities)
+	{
+		db->GetTransformsAtPoseId(pose, transforms);
+		db->GetTransformsAtPoseId(db->ClampDatabaseTrajectoryIndex(pose, 1), next_bone_transforms);
+
+		Inertializer::ComputeVelocities(transforms, next_bone_transforms, dt, velocities, angular_velocities);
 	}
 
 	float halflife_to_damping(float halflife, float eps = 1e-5f)
@@ -3,6 +3,7 @@
 #include "../pch.h"
 #include "..//Spring.h"
 #include "..//MotionMatchingJob.h"
+#include "..//Inertializer.h"
 
 using namespace DirectX::SimpleMath;
 
@@ -23,6 +24,12 @@ namespace Animation
 
 		void Initialize(AnimationDatabase* db);
 
+		// Hot-adds or removes a clip: the database and the motion matching
+		// features are updated in place, without a full rebuild.
+		const AnimationClip* AddClip(const std::string& name, const AnimationClip& clip);
+
+		bool RemoveClip(const std::string& name);
+
 		Vector3 UpdateDesiredVelocity(
 			const Vector3& gamepadstick_left,
 			const float camera_azimuth,
@@ -235,6 +242,8 @@ namespace Animation
 
 		void Update(float dT)
 		{
+			PROFILE_SCOPE("CharacterController::Update");
+
 			float camera_azimuth = 0.0f;
 
 			bool desired_strafe = false;
@@ -360,7 +369,7 @@ namespace Animation
 				// Compute the features of the query vector
 				//std::vector<float> query_features = mm.matcherData;
 				int offset = 0;
-				rt_data.transforms = db->GetTransformsAtPoseId(frame_index);
+				db->GetTransformsAtPoseId(frame_index, rt_data.transforms);
 				rt_data.root_position = trajectory_positions[0];
 				rt_data.root_rotation = trajectory_rotations[0];
 				rt_data.trajectory_positions = trajectory_positions;
@@ -379,9 +388,19 @@ namespace Animation
 				// Transition if better frame found
 				if (mm.bestIndex != frame_index)
 				{
+					// Offsets take the pose we leave to the pose we go to
+					LookupPoseAndVelocities(frame_index, curr_bone_transforms, curr_bone_velocities, curr_bone_angular_velocities);
+					LookupPoseAndVelocities(mm.bestIndex, trns_bone_transforms, trns_bone_velocities, trns_bone_angular_velocities);
+
+					inertializer.Transition(
+						curr_bone_transforms,
+						curr_bone_velocities,
+						curr_bone_angular_velocities,
+						trns_bone_transforms,
+						trns_bone_velocities,
+						trns_bone_angular_velocities);
 
 					frame_index = mm.bestIndex;
-
 				}
 
 				// Reset search timer
@@ -407,7 +426,10 @@ namespace Animation
 			frame_index++;
 			frame_index = clamp(frame_index, 0, db->totalPoseCount - 1);
 			// Look-up Next Pose
-			curr_bone_transforms = db->GetTransformsAtPoseId(frame_index);
+			db->GetTransformsAtPoseId(frame_index, curr_bone_transforms);
+
+			// Smooth out the transitions
+			inertializer.Update(curr_bone_transforms, inertialize_blending_halflife, dt, bone_transforms);
 
 			// Update Simulation
 			Vector3 simulation_position_prev = simulation_position;
@@ -441,6 +463,28 @@ namespace Animation
 
 		std::vector<Transform> curr_bone_transforms;
 
+		// Final pose, curr_bone_transforms with the inertialization offsets
+		std::vector<Transform> bone_transforms;
+
+		// Inertialization
+		Inertializer inertializer;
+
+		float inertialize_blending_halflife = 0.1f;
+
+		// Reads a pose of the database and its velocities
+		void LookupPoseAndVelocities(
+			int pose,
+			std::vector<Transform>& transforms,
+			std::vector<Vector3>& velocities,
+			std::vector<Vector3>& angular_velocities);
+
+		std::vector<Transform> next_bone_transforms;
+		std::vector<Vector3> curr_bone_velocities;
+		std::vector<Vector3> curr_bone_angular_velocities;
+		std::vector<Transform> trns_bone_transforms;
+		std::vector<Vector3> trns_bone_velocities;
+		std::vector<Vector3> trns_bone_angular_velocities;
+
 		// Trajectory & Gameplay Data
 		float search_time = 0.1f;
 		float search_timer = search_time;
@@ -0,0 +1,114 @@
+#include "CrowdBenchmark.h"
+#include "../../Common/TaskGraph.h"
+#include "../../Common/ThreadPool.h"
+#include <chrono>
+
+namespace Animation
+{
+	struct CrowdCharacter
+	{
+		SamplingJob sampler;
+
+		SamplingJob::Context context;
+
+		std::vector<Matrix> models;
+
+		std::vector<float> palette;
+
+		float phase = 0.0f;
+	};
+
+	std::vector<CrowdScalingSample> BenchmarkCrowdScaling(
+		const AnimationDatabase& skeleton,
+		const AnimationClip& clip,
+		const std::vector<int>& characterCounts,
+		const std::vector<int>& threadCounts,
+		int frames)
+	{
+		std::vector<CrowdScalingSample> results;
+		if (frames <= 0 || skeleton.JointCount() == 0 || clip.mSamples.size() < skeleton.JointCount())
+			return results;
+
+		// 60 fps playback
+		const float step = clip.get_duration_in_second() > 0.0f ? 1.0f / (60.0f * clip.get_duration_in_second()) : 0.0f;
+
+		ThreadPool* sharedPool = ThreadPool::GetSinglePtr();
+		const int sharedActiveCount = sharedPool ? sharedPool->GetActiveThreadCount() : 0;
+
+		for (int threadCount : threadCounts)
+		{
+			if (threadCount <= 0)
+				continue;
+
+			// The calling thread takes part in the runs
+			std::unique_ptr<ThreadPool> pool;
+			if (sharedPool)
+			{
+				if (threadCount - 1 > sharedPool->GetThreadCount())
+					continue;
+
+				sharedPool->SetActiveThreadCount(threadCount - 1);
+			}
+			else if (threadCount > 1)
+			{
+				pool = std::make_unique<ThreadPool>(threadCount - 1);
+			}
+
+			for (int characterCount : characterCounts)
+			{
+				if (characterCount <= 0)
+					continue;
+
+				std::vector<CrowdCharacter> characters(characterCount);
+				int frame = 0;
+
+				TaskGraph graph;
+				for (int i = 0; i < characterCount; i++)
+				{
+					CrowdCharacter* character = &characters[i];
+					character->sampler.animation = &clip;
+					character->sampler.context = &character->context;
+					character->phase = (float)i / characterCount;
+
+					TaskGraph::TaskId sample = graph.AddTask("Sample" + std::to_string(i), [character, &frame, step]()
+					{
+						float ratio = character->phase + frame * step;
+						character->sampler.ratio = ratio - floorf(ratio);
+						character->sampler.Run();
+					});
+
+					TaskGraph::TaskId update = graph.AddTask("Update" + std::to_string(i), [character, &skeleton]()
+					{
+						LocalToModelJob ltm_job;
+						ltm_job.skeleton = &skeleton;
+						ltm_job.input = &character->sampler.output;
+						ltm_job.output = &character->models;
+						ltm_job.palette = &character->palette;
+						ltm_job.Run(true, true);
+					});
+					graph.AddDependency(sample, update);
+				}
+
+				// The first frame sizes the buffers and the cursors
+				graph.Run();
+
+				auto start = std::chrono::steady_clock::now();
+				for (frame = 1; frame <= frames; frame++)
+				{
+					graph.Run();
+				}
+
+				CrowdScalingSample sample;
+				sample.characterCount = characterCount;
+				sample.threadCount = threadCount;
+				sample.millisecondsPerFrame = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+				results.push_back(sample);
+			}
+		}
+
+		if (sharedPool)
+			sharedPool->SetActiveThreadCount(sharedActiveCount);
+
+		return results;
+	}
+}
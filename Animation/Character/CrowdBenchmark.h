@@ -0,0 +1,34 @@
+#pragma once
+#include "../SamplingJob.h"
+#include "../LocalToModelJob.h"
+
+namespace Animation
+{
+	struct CrowdScalingSample
+	{
+		int characterCount = 0;
+
+		int threadCount = 0;
+
+		double millisecondsPerFrame = 0.0;
+	};
+
+	///<summary>
+	/// Headless scaling test of the character update graph: every character
+	/// samples clip at its own phase then computes its model space matrices
+	/// and skinning palette, as the engine does for the source character,
+	/// with one task per step and character. Runs frames frames for every
+	/// pair of characterCounts x threadCounts.
+	///
+	/// Runs on the application's thread pool, with only threadCount - 1 of
+	/// its workers active, and skips the thread counts it has no workers
+	/// for. Creates a pool per thread count when there is none (1 runs
+	/// inline). Call while no task of the pool is running.
+	///</summary>
+	std::vector<CrowdScalingSample> BenchmarkCrowdScaling(
+		const AnimationDatabase& skeleton,
+		const AnimationClip& clip,
+		const std::vector<int>& characterCounts,
+		const std::vector<int>& threadCounts,
+		int frames);
+}
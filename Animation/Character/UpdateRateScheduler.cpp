@@ -0,0 +1,174 @@
+#include "UpdateRateScheduler.h"
+#include "../SkeletonLod.h"
+
+namespace Animation
+{
+	const char* GetSkippedPoseModeName(SkippedPoseMode mode)
+	{
+		switch (mode)
+		{
+		case SkippedPoseMode::Extrapolate: return "Extrapolate";
+		case SkippedPoseMode::Interpolate: return "Interpolate";
+		default: return "";
+		}
+	}
+
+	int UpdateRateScheduler::AddClient()
+	{
+		mClients.emplace_back();
+		return (int)mClients.size() - 1;
+	}
+
+	void UpdateRateScheduler::Clear()
+	{
+		mClients.clear();
+	}
+
+	void UpdateRateScheduler::SetClientBounds(int client, const Vector3& center, float radius)
+	{
+		mClients[client].center = center;
+		mClients[client].radius = radius;
+	}
+
+	int UpdateRateScheduler::SelectDivisor(float screenSize, bool visible) const
+	{
+		if (!visible && settings.cullOffscreen)
+			return MAX_RATE_DIVISOR;
+
+		int divisor = 1;
+		for (int i = 0; i < 3 && screenSize < settings.screenSizes[i]; i++)
+			divisor *= 2;
+
+		return divisor;
+	}
+
+	void UpdateRateScheduler::Schedule(const Matrix& view, const Matrix& proj, float dt)
+	{
+		mFrame++;
+		mTime += dt;
+
+		DirectX::BoundingFrustum viewFrustum, frustum;
+		DirectX::BoundingFrustum::CreateFromMatrix(viewFrustum, proj);
+		viewFrustum.Transform(frustum, view.Invert());
+
+		// Clients of the same rate take the frames of the interval in turn
+		int ranks[4] = {};
+		mUpdateCount = 0;
+
+		for (Client& client : mClients)
+		{
+			float screenSize = SkeletonLod::ComputeScreenSize(client.center, client.radius, view, proj);
+			bool visible = frustum.Contains(DirectX::BoundingSphere(client.center, client.radius)) != DirectX::DISJOINT;
+
+			int divisor = SelectDivisor(screenSize, visible);
+			int level = divisor == 1 ? 0 : divisor == 2 ? 1 : divisor == 4 ? 2 : 3;
+
+			client.divisor = divisor;
+			client.phase = ranks[level]++ % divisor;
+			client.framesSinceUpdate++;
+
+			// A client changing rate may miss its frame, it's then updated as
+			// soon as the interval has elapsed
+			client.update = client.poseCount < 2
+				|| (mFrame + client.phase) % divisor == 0
+				|| client.framesSinceUpdate >= divisor;
+
+			mUpdateCount += client.update;
+		}
+
+		for (int i = 0; i < 4; i++)
+			mDivisorCounts[i] = ranks[i];
+	}
+
+	float UpdateRateScheduler::GetElapsedTime(int client) const
+	{
+		const Client& c = mClients[client];
+		return c.poseCount > 0 ? mTime - c.times[1] : 0.0f;
+	}
+
+	void UpdateRateScheduler::StorePose(int client, const std::vector<Transform>& pose)
+	{
+		Client& c = mClients[client];
+
+		std::swap(c.poses[0], c.poses[1]);
+		c.poses[1] = pose;
+		c.times[0] = c.times[1];
+		c.times[1] = mTime;
+
+		// The first pose is its own history
+		if (c.poseCount == 0)
+		{
+			c.poses[0] = pose;
+			c.times[0] = mTime;
+		}
+
+		c.poseCount = std::min(c.poseCount + 1, 2);
+		c.framesSinceUpdate = 0;
+	}
+
+	void UpdateRateScheduler::ResolvePose(int client, std::vector<Transform>& pose) const
+	{
+		const Client& c = mClients[client];
+		if (c.poseCount == 0)
+			return;
+
+		bool extrapolate = settings.mode == SkippedPoseMode::Extrapolate;
+		if (extrapolate && c.update)
+			return;
+
+		const std::vector<Transform>& prev = c.poses[0];
+		const std::vector<Transform>& last = c.poses[1];
+		pose.resize(last.size());
+
+		float interval = c.times[1] - c.times[0];
+		float alpha = interval > 1e-6f ? (mTime - c.times[1]) / interval : 0.0f;
+
+		if (extrapolate)
+		{
+			// The motion from prev to last continues at the same velocity
+			alpha = clampf(alpha, 0.0f, settings.maxExtrapolation);
+			for (size_t i = 0; i < last.size(); i++)
+			{
+				Vector3 velocity = last[i].mTrans.mValue - prev[i].mTrans.mValue;
+				Vector3 angularVelocity = quat_to_scaled_angle_axis(
+					quat_abs(last[i].mRot.mValue * prev[i].mRot.mValue.Inversed()));
+
+				pose[i].mTrans.mValue = last[i].mTrans.mValue + alpha * velocity;
+				pose[i].mRot.mValue = quat_from_scaled_angle_axis(alpha * angularVelocity) * last[i].mRot.mValue;
+				pose[i].mScale.mValue = last[i].mScale.mValue;
+			}
+		}
+		else
+		{
+			alpha = clampf(alpha, 0.0f, 1.0f);
+			for (size_t i = 0; i < last.size(); i++)
+			{
+				pose[i].mTrans.mValue = Vector3::Lerp(prev[i].mTrans.mValue, last[i].mTrans.mValue, alpha);
+				pose[i].mRot.mValue = quat_slerp_shortest_approx(prev[i].mRot.mValue, last[i].mRot.mValue, alpha);
+				pose[i].mScale.mValue = Vector3::Lerp(prev[i].mScale.mValue, last[i].mScale.mValue, alpha);
+			}
+		}
+	}
+
+	void UpdateRateScheduler::OnGui()
+	{
+		const char* modes[(int)SkippedPoseMode::Count];
+		for (int i = 0; i < (int)SkippedPoseMode::Count; i++)
+		{
+			modes[i] = GetSkippedPoseModeName((SkippedPoseMode)i);
+		}
+
+		int mode = (int)settings.mode;
+		if (ImGui::Combo("Skipped frames", &mode, modes, IM_ARRAYSIZE(modes)))
+		{
+			settings.mode = (SkippedPoseMode)mode;
+		}
+
+		ImGui::SliderFloat3("Rate screen sizes", settings.screenSizes, 0.0f, 1.0f);
+		ImGui::Checkbox("Slow down off-screen", &settings.cullOffscreen);
+
+		ImGui::Text("Updates: %d / %d characters", mUpdateCount, (int)mClients.size());
+		ImGui::Text("Rates 1/1: %d, 1/2: %d, 1/4: %d, 1/8: %d",
+			mDivisorCounts[0], mDivisorCounts[1], mDivisorCounts[2], mDivisorCounts[3]);
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "../Spring.h"
+#include "../AnimationKeyframe.h"
+
+namespace Animation
+{
+	// How the pose of a character is produced on the frames it's not updated.
+	enum class SkippedPoseMode
+	{
+		// Continues the motion of the last two updates. No latency, but
+		// overshoots on sudden changes.
+		Extrapolate,
+
+		// Blends from the second to last update to the last one over the
+		// update interval. Always smooth, one interval late.
+		Interpolate,
+
+		Count
+	};
+
+	const char* GetSkippedPoseModeName(SkippedPoseMode mode);
+
+	struct UpdateRateSettings
+	{
+		// Fraction of the screen height under which the update rate is
+		// halved: 1/2, 1/4 then 1/8.
+		float screenSizes[3] = { 0.2f, 0.08f, 0.03f };
+
+		// Characters outside of the view are updated at the lowest rate.
+		bool cullOffscreen = true;
+
+		SkippedPoseMode mode = SkippedPoseMode::Extrapolate;
+
+		// Extrapolation is stopped after this many update intervals.
+		float maxExtrapolation = 1.0f;
+	};
+
+	///<summary>
+	/// Decides which characters are updated each frame. Small or off-screen
+	/// characters are updated every 2, 4 or 8 frames, and the characters
+	/// sharing a rate are spread over the frames of the interval, so the
+	/// number of updates per frame stays about the same. The poses of the
+	/// skipped frames are rebuilt from the last two computed ones.
+	///
+	/// Clients only touch their own state between Schedule() calls, so they
+	/// can be updated in parallel.
+	///</summary>
+	class UpdateRateScheduler
+	{
+	public:
+		enum { MAX_RATE_DIVISOR = 8 };
+
+		int AddClient();
+
+		void Clear();
+
+		void SetClientBounds(int client, const Vector3& center, float radius);
+
+		// Picks the rate of every client and the clients to update this frame.
+		void Schedule(const Matrix& view, const Matrix& proj, float dt);
+
+		bool ShouldUpdate(int client) const { return mClients[client].update; }
+
+		int GetRateDivisor(int client) const { return mClients[client].divisor; }
+
+		// Time since the last update of the client, this frame included.
+		float GetElapsedTime(int client) const;
+
+		// Records the pose computed by an update.
+		void StorePose(int client, const std::vector<Transform>& pose);
+
+		// Writes the pose to display this frame. Left untouched when the pose
+		// computed this frame is displayed as is.
+		void ResolvePose(int client, std::vector<Transform>& pose) const;
+
+		UpdateRateSettings settings;
+
+		void OnGui();
+
+	private:
+		struct Client
+		{
+			Vector3 center;
+
+			float radius = 0.0f;
+
+			int divisor = 1;
+
+			// Frame of the interval the client is updated on
+			int phase = 0;
+
+			int framesSinceUpdate = 0;
+
+			bool update = true;
+
+			// Last two computed poses, the most recent one last
+			std::vector<Transform> poses[2];
+
+			float times[2] = {};
+
+			int poseCount = 0;
+		};
+
+		int SelectDivisor(float screenSize, bool visible) const;
+
+		std::vector<Client> mClients;
+
+		uint64_t mFrame = 0;
+
+		float mTime = 0.0f;
+
+		int mUpdateCount = 0;
+
+		int mDivisorCounts[4] = {};
+	};
+}
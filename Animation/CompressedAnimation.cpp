@@ -0,0 +1,587 @@
+#include "CompressedAnimation.h"
+
+using namespace DirectX;
+
+namespace Animation
+{
+	// The three smallest components of a unit quaternion are within
+	// [-1/sqrt(2), 1/sqrt(2)], scale them to [-1, 1] before quantizing.
+	static const float kSmallestThreeScale = 1.41421356f;
+
+	QuantizedQuaternion QuantizeQuaternion(Quaternion q)
+	{
+		q.Normalize();
+		float c[4] = { q.x, q.y, q.z, q.w };
+
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+		{
+			if (fabsf(c[i]) > fabsf(c[largest]))
+				largest = i;
+		}
+
+		// q and -q are the same rotation, make the dropped component positive
+		float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+		uint64_t bits = (uint64_t)largest << 45;
+		int shift = 30;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+
+			float v = clampf(c[i] * sign * kSmallestThreeScale, -1.0f, 1.0f);
+			bits |= (uint64_t)lroundf((v * 0.5f + 0.5f) * 32767.0f) << shift;
+			shift -= 15;
+		}
+
+		QuantizedQuaternion result;
+		result.data[0] = (uint16_t)(bits >> 32);
+		result.data[1] = (uint16_t)(bits >> 16);
+		result.data[2] = (uint16_t)bits;
+		return result;
+	}
+
+	Quaternion DequantizeQuaternion(const QuantizedQuaternion& q)
+	{
+		uint64_t bits = ((uint64_t)q.data[0] << 32) | ((uint64_t)q.data[1] << 16) | (uint64_t)q.data[2];
+		int largest = (int)((bits >> 45) & 3);
+
+		float c[4];
+		float sum = 0.0f;
+		int shift = 30;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+
+			float v = ((float)((bits >> shift) & 0x7fff) / 32767.0f * 2.0f - 1.0f) / kSmallestThreeScale;
+			c[i] = v;
+			sum += v * v;
+			shift -= 15;
+		}
+		c[largest] = sqrtf(maxf(0.0f, 1.0f - sum));
+
+		return Quaternion(c[0], c[1], c[2], c[3]);
+	}
+
+	static inline uint16_t quantize_unorm16(float x, float min, float extent)
+	{
+		if (extent <= 0.0f)
+			return 0;
+
+		return (uint16_t)lroundf(clampf((x - min) / extent, 0.0f, 1.0f) * 65535.0f);
+	}
+
+	QuantizedVector3 QuantizeVector3(const Vector3& v, const QuantizationRange& range)
+	{
+		QuantizedVector3 result;
+		result.x = quantize_unorm16(v.x, range.min.x, range.extent.x);
+		result.y = quantize_unorm16(v.y, range.min.y, range.extent.y);
+		result.z = quantize_unorm16(v.z, range.min.z, range.extent.z);
+		return result;
+	}
+
+	Vector3 DequantizeVector3(const QuantizedVector3& v, const QuantizationRange& range)
+	{
+		return range.min + range.extent * Vector3(v.x / 65535.0f, v.y / 65535.0f, v.z / 65535.0f);
+	}
+
+	int CompressedAnimation::JointCount() const
+	{
+		return mRotationTracks.size();
+	}
+
+	float CompressedAnimation::get_duration_in_tick() const
+	{
+		return mDurationInTick;
+	}
+
+	float CompressedAnimation::get_duration_in_second() const
+	{
+		return mDurationInTick / mTicksPerSecond;
+	}
+
+	size_t CompressedAnimation::GetSizeInBytes() const
+	{
+		return sizeof(CompressedAnimation)
+			+ (mRotationTracks.size() + mTranslationTracks.size() + mScaleTracks.size()) * sizeof(CompressedTrack)
+			+ (mTranslationRanges.size() + mScaleRanges.size()) * sizeof(QuantizationRange)
+			+ (mRotationTimes.size() + mTranslationTimes.size() + mScaleTimes.size()) * sizeof(uint16_t)
+			+ mRotationKeys.size() * sizeof(QuantizedQuaternion)
+			+ (mTranslationKeys.size() + mScaleKeys.size()) * sizeof(QuantizedVector3);
+	}
+
+	// Finds the key i such that times[i] <= frame < times[i + 1], trying the
+	// keys following the cursor first as BoneAnimationSample does.
+	static inline int find_compressed_key(const uint16_t* times, int count, float frame, int* cursor)
+	{
+		const int last = count - 2;
+
+		if (cursor)
+		{
+			int i = clamp(*cursor, 0, last);
+			if (times[i] <= frame)
+			{
+				for (int step = 0; step < 4 && i < last && times[i + 1] <= frame; step++)
+				{
+					i++;
+				}
+
+				if (i == last || frame < times[i + 1])
+				{
+					*cursor = i;
+					return i;
+				}
+			}
+		}
+
+		int i = clamp((int)(std::upper_bound(times + 1, times + count, frame) - times) - 1, 0, last);
+
+		if (cursor)
+			*cursor = i;
+
+		return i;
+	}
+
+	static inline Quaternion sample_rotation_track(
+		const CompressedTrack& track,
+		const std::vector<uint16_t>& times,
+		const std::vector<QuantizedQuaternion>& keys,
+		float frame,
+		int* cursor)
+	{
+		if (track.count == 1)
+			return DequantizeQuaternion(keys[track.first]);
+
+		int i = find_compressed_key(&times[track.first], track.count, frame, cursor) + track.first;
+		float alpha = clampf((frame - times[i]) / (times[i + 1] - times[i]), 0.0f, 1.0f);
+
+		return Quaternion::Slerp(DequantizeQuaternion(keys[i]), DequantizeQuaternion(keys[i + 1]), alpha);
+	}
+
+	static inline Vector3 sample_vector_track(
+		const CompressedTrack& track,
+		const QuantizationRange& range,
+		const std::vector<uint16_t>& times,
+		const std::vector<QuantizedVector3>& keys,
+		float frame,
+		int* cursor)
+	{
+		if (track.count == 1)
+			return DequantizeVector3(keys[track.first], range);
+
+		int i = find_compressed_key(&times[track.first], track.count, frame, cursor) + track.first;
+		float alpha = clampf((frame - times[i]) / (times[i + 1] - times[i]), 0.0f, 1.0f);
+
+		return Vector3::Lerp(DequantizeVector3(keys[i], range), DequantizeVector3(keys[i + 1], range), alpha);
+	}
+
+	void CompressedAnimation::Sample(float frame, Transform* output, KeyCursor* cursors) const
+	{
+		frame = clampf(frame, 0.0f, (float)(mFrameCount - 1));
+		float tick = frame / mSampleRate * mTicksPerSecond;
+
+		for (int i = 0; i < JointCount(); i++)
+		{
+			Transform& t = output[i];
+			KeyCursor* cursor = cursors ? &cursors[i] : nullptr;
+
+			t.mRot.mValue = sample_rotation_track(mRotationTracks[i], mRotationTimes, mRotationKeys,
+				frame, cursor ? &cursor->rotation : nullptr);
+			t.mTrans.mValue = sample_vector_track(mTranslationTracks[i], mTranslationRanges[i], mTranslationTimes, mTranslationKeys,
+				frame, cursor ? &cursor->position : nullptr);
+			t.mScale.mValue = sample_vector_track(mScaleTracks[i], mScaleRanges[i], mScaleTimes, mScaleKeys,
+				frame, cursor ? &cursor->scale : nullptr);
+
+			t.mRot.mTimeTick = tick;
+			t.mTrans.mTimeTick = tick;
+			t.mScale.mTimeTick = tick;
+		}
+	}
+
+	//--------------------------------------
+	// Offline compression
+
+	// Samples the local pose of every joint at every frame, [frame][joint].
+	static void ResampleClip(const AnimationClip& clip, int jointCount, int frameCount, std::vector<Transform>& frames)
+	{
+		frames.resize(frameCount * jointCount);
+
+		for (int f = 0; f < frameCount; f++)
+		{
+			float ratio = (float)f / (frameCount - 1);
+
+			for (int j = 0; j < jointCount; j++)
+			{
+				Transform& t = frames[f * jointCount + j];
+				const BoneAnimationSample& sample = clip.mSamples[j];
+
+				if (sample.get_key_count() == 0)
+				{
+					t = Transform();
+					t.mScale.mValue = Vector3::One;
+				}
+				else
+				{
+					sample.interpolate(ratio, t);
+				}
+
+				// Keep consecutive rotations in the same hemisphere so that
+				// interpolating between kept keys takes the same path
+				if (f > 0 && t.mRot.mValue.Dot(frames[(f - 1) * jointCount + j].mRot.mValue) < 0.0f)
+					t.mRot.mValue = -t.mRot.mValue;
+			}
+		}
+	}
+
+	static void ComputeModelSpace(const Transform* locals, const std::vector<int>& parents, int jointCount, std::vector<Matrix>& models)
+	{
+		models.resize(jointCount);
+
+		for (int j = 0; j < jointCount; j++)
+		{
+			Matrix local = Transform::ToMatrix(locals[j]);
+			int parent = parents[j];
+			models[j] = parent >= 0 ? local * models[parent] : local;
+		}
+	}
+
+	// Drops the keys that can be rebuilt by interpolating the kept ones within
+	// the tolerance. The key whose removal costs the least error goes first,
+	// and only its two neighbours need their cost updated. Since the costs
+	// don't depend on the tolerance, a tighter one keeps a superset of keys.
+	template<typename T, typename Lerp, typename Error>
+	static std::vector<int> ReduceKeys(const std::vector<T>& values, float tolerance, Lerp lerp, Error error)
+	{
+		int count = values.size();
+		std::vector<int> keys;
+		keys.push_back(0);
+
+		bool constant = true;
+		for (int k = 1; k < count && constant; k++)
+		{
+			constant = error(values[0], values[k]) <= tolerance;
+		}
+
+		if (constant)
+			return keys;
+
+		// Largest error between two kept keys once the ones in between are dropped
+		auto segmentError = [&](int a, int b) {
+			float maxError = 0.0f;
+			for (int k = a + 1; k < b; k++)
+			{
+				maxError = maxf(maxError, error(lerp(values[a], values[b], (float)(k - a) / (b - a)), values[k]));
+			}
+			return maxError;
+		};
+
+		struct Candidate
+		{
+			float error;
+			int key;
+			int version;
+
+			bool operator<(const Candidate& other) const
+			{
+				// Lowest error first, ties broken by frame for a stable order
+				return error != other.error ? error > other.error : key > other.key;
+			}
+		};
+
+		std::vector<int> prev(count);
+		std::vector<int> next(count);
+		std::vector<int> versions(count, 0);
+		std::vector<bool> kept(count, true);
+		std::priority_queue<Candidate> candidates;
+
+		for (int k = 0; k < count; k++)
+		{
+			prev[k] = k - 1;
+			next[k] = k + 1;
+			if (k > 0 && k < count - 1)
+				candidates.push({ segmentError(k - 1, k + 1), k, 0 });
+		}
+
+		while (!candidates.empty())
+		{
+			Candidate c = candidates.top();
+			candidates.pop();
+
+			if (!kept[c.key] || c.version != versions[c.key])
+				continue;
+
+			if (c.error > tolerance)
+				break;
+
+			kept[c.key] = false;
+			int a = prev[c.key];
+			int b = next[c.key];
+			next[a] = b;
+			prev[b] = a;
+
+			if (a > 0)
+				candidates.push({ segmentError(prev[a], b), a, ++versions[a] });
+			if (b < count - 1)
+				candidates.push({ segmentError(a, next[b]), b, ++versions[b] });
+		}
+
+		for (int k = next[0]; k < count; k = next[k])
+		{
+			keys.push_back(k);
+		}
+
+		return keys;
+	}
+
+	static QuantizationRange ComputeRange(const std::vector<Vector3>& values, const std::vector<int>& keys)
+	{
+		Vector3 min(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vector3 max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+		for (int k : keys)
+		{
+			min = Vector3::Min(min, values[k]);
+			max = Vector3::Max(max, values[k]);
+		}
+
+		QuantizationRange range;
+		range.min = min;
+		range.extent = max - min;
+		return range;
+	}
+
+	// Builds the tracks of every joint. Each channel is reduced with its own
+	// tolerance, converted from the model space one with the lever arm of the
+	// joint, i.e. how far its descendants and their shell vertices reach.
+	static void BuildTracks(
+		const std::vector<Transform>& frames,
+		int jointCount,
+		int frameCount,
+		const std::vector<float>& leverArms,
+		float tolerance,
+		CompressedAnimation& output)
+	{
+		output.mRotationTracks.assign(jointCount, CompressedTrack());
+		output.mTranslationTracks.assign(jointCount, CompressedTrack());
+		output.mScaleTracks.assign(jointCount, CompressedTrack());
+		output.mTranslationRanges.assign(jointCount, QuantizationRange());
+		output.mScaleRanges.assign(jointCount, QuantizationRange());
+		output.mRotationTimes.clear();
+		output.mTranslationTimes.clear();
+		output.mScaleTimes.clear();
+		output.mRotationKeys.clear();
+		output.mTranslationKeys.clear();
+		output.mScaleKeys.clear();
+
+		std::vector<Quaternion> rotations(frameCount);
+		std::vector<Vector3> translations(frameCount);
+		std::vector<Vector3> scales(frameCount);
+
+		for (int j = 0; j < jointCount; j++)
+		{
+			for (int f = 0; f < frameCount; f++)
+			{
+				const Transform& t = frames[f * jointCount + j];
+				rotations[f] = t.mRot.mValue;
+				translations[f] = t.mTrans.mValue;
+				scales[f] = t.mScale.mValue;
+			}
+
+			float lever = leverArms[j];
+
+			// Displacement of a point at the lever distance rotated by the
+			// angle between a and b
+			std::vector<int> rotationKeys = ReduceKeys(rotations, tolerance,
+				[](const Quaternion& a, const Quaternion& b, float alpha) { return Quaternion::Slerp(a, b, alpha); },
+				[lever](const Quaternion& a, const Quaternion& b) {
+					float d = minf(fabsf(a.Dot(b)), 1.0f);
+					return 2.0f * sqrtf(1.0f - d * d) * lever;
+				});
+
+			std::vector<int> translationKeys = ReduceKeys(translations, tolerance,
+				[](const Vector3& a, const Vector3& b, float alpha) { return Vector3::Lerp(a, b, alpha); },
+				[](const Vector3& a, const Vector3& b) { return (a - b).Length(); });
+
+			std::vector<int> scaleKeys = ReduceKeys(scales, tolerance,
+				[](const Vector3& a, const Vector3& b, float alpha) { return Vector3::Lerp(a, b, alpha); },
+				[lever](const Vector3& a, const Vector3& b) { return (a - b).Length() * lever; });
+
+			CompressedTrack& rotationTrack = output.mRotationTracks[j];
+			rotationTrack.first = output.mRotationKeys.size();
+			rotationTrack.count = rotationKeys.size();
+			for (int k : rotationKeys)
+			{
+				output.mRotationTimes.push_back(k);
+				output.mRotationKeys.push_back(QuantizeQuaternion(rotations[k]));
+			}
+
+			QuantizationRange& translationRange = output.mTranslationRanges[j];
+			translationRange = ComputeRange(translations, translationKeys);
+			CompressedTrack& translationTrack = output.mTranslationTracks[j];
+			translationTrack.first = output.mTranslationKeys.size();
+			translationTrack.count = translationKeys.size();
+			for (int k : translationKeys)
+			{
+				output.mTranslationTimes.push_back(k);
+				output.mTranslationKeys.push_back(QuantizeVector3(translations[k], translationRange));
+			}
+
+			QuantizationRange& scaleRange = output.mScaleRanges[j];
+			scaleRange = ComputeRange(scales, scaleKeys);
+			CompressedTrack& scaleTrack = output.mScaleTracks[j];
+			scaleTrack.first = output.mScaleKeys.size();
+			scaleTrack.count = scaleKeys.size();
+			for (int k : scaleKeys)
+			{
+				output.mScaleTimes.push_back(k);
+				output.mScaleKeys.push_back(QuantizeVector3(scales[k], scaleRange));
+			}
+		}
+	}
+
+	// Largest distance between the raw and the decompressed joints, and the
+	// virtual vertices around them, in model space over all the frames.
+	static float MeasureError(
+		const std::vector<Transform>& frames,
+		const std::vector<int>& parents,
+		int jointCount,
+		int frameCount,
+		float shellDistance,
+		const CompressedAnimation& compressed)
+	{
+		const Vector3 points[4] = {
+			Vector3::Zero,
+			Vector3(shellDistance, 0.0f, 0.0f),
+			Vector3(0.0f, shellDistance, 0.0f),
+			Vector3(0.0f, 0.0f, shellDistance) };
+
+		std::vector<Transform> lossy(jointCount);
+		std::vector<Matrix> rawModels;
+		std::vector<Matrix> lossyModels;
+		std::vector<KeyCursor> cursors(jointCount);
+
+		float maxError = 0.0f;
+		for (int f = 0; f < frameCount; f++)
+		{
+			compressed.Sample((float)f, lossy.data(), cursors.data());
+
+			ComputeModelSpace(&frames[f * jointCount], parents, jointCount, rawModels);
+			ComputeModelSpace(lossy.data(), parents, jointCount, lossyModels);
+
+			for (int j = 0; j < jointCount; j++)
+			{
+				for (const Vector3& p : points)
+				{
+					float error = (Vector3::Transform(p, rawModels[j]) - Vector3::Transform(p, lossyModels[j])).Length();
+					maxError = maxf(maxError, error);
+				}
+			}
+		}
+
+		return maxError;
+	}
+
+	bool CompressAnimation(
+		const AnimationClip& clip,
+		const std::vector<int>& parents,
+		const CompressionSettings& settings,
+		CompressedAnimation& output,
+		CompressionStats* stats)
+	{
+		int jointCount = clip.mSamples.size();
+		if (jointCount == 0 || parents.size() < jointCount)
+		{
+			LOG_ERROR("Clip and skeleton don't match.");
+			return false;
+		}
+
+		for (int j = 0; j < jointCount; j++)
+		{
+			if (parents[j] >= j)
+			{
+				LOG_ERROR("Parents must be ordered before their children.");
+				return false;
+			}
+		}
+
+		float durationTick = clip.get_clip_end_time() - clip.get_clip_start_time();
+		float durationSecond = durationTick / clip.mTicksPerSecond;
+		int frameCount = std::max(2, (int)ceilf(durationSecond * settings.sampleRate) + 1);
+		// Key times are 16-bit frame indices and a track that keeps every key
+		// stores frameCount in CompressedTrack::count, which is 16-bit too.
+		if (frameCount > 65535)
+		{
+			LOG_ERROR("Clip is too long to be compressed.");
+			return false;
+		}
+
+		output.mName = clip.mName;
+		output.mFrameCount = frameCount;
+		output.mSampleRate = (frameCount - 1) / maxf(durationSecond, 1e-6f);
+		output.mDurationInTick = durationTick;
+		output.mTicksPerSecond = clip.mTicksPerSecond;
+
+		std::vector<Transform> frames;
+		ResampleClip(clip, jointCount, frameCount, frames);
+
+		// Lever arm of each joint, measured in the first frame
+		std::vector<Matrix> models;
+		ComputeModelSpace(&frames[0], parents, jointCount, models);
+
+		std::vector<float> leverArms(jointCount, 0.0f);
+		for (int d = 0; d < jointCount; d++)
+		{
+			Vector3 position = models[d].Translation();
+			for (int a = parents[d]; a >= 0; a = parents[a])
+			{
+				leverArms[a] = maxf(leverArms[a], (position - models[a].Translation()).Length());
+			}
+		}
+		for (float& lever : leverArms)
+		{
+			lever += settings.shellDistance;
+		}
+
+		// Errors add up along the chains, tighten the per track tolerance
+		// until the model space error fits
+		float trackTolerance = settings.tolerance;
+		float maxError = 0.0f;
+		size_t keyCount = 0;
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			BuildTracks(frames, jointCount, frameCount, leverArms, trackTolerance, output);
+
+			// A tighter tolerance only keeps more keys: the same count means
+			// the same tracks, and the error won't go down any further
+			size_t newKeyCount = output.mRotationKeys.size() + output.mTranslationKeys.size() + output.mScaleKeys.size();
+			if (iteration > 0 && newKeyCount == keyCount)
+				break;
+			keyCount = newKeyCount;
+
+			maxError = MeasureError(frames, parents, jointCount, frameCount, settings.shellDistance, output);
+			if (maxError <= settings.tolerance)
+				break;
+
+			trackTolerance *= 0.5f;
+		}
+
+		if (stats)
+		{
+			stats->rawBytes = 0;
+			stats->rawKeyCount = 0;
+			for (const BoneAnimationSample& sample : clip.mSamples)
+			{
+				stats->rawBytes += sample.get_key_count() * sizeof(Transform);
+				stats->rawKeyCount += sample.get_key_count() * 3;
+			}
+
+			stats->compressedBytes = output.GetSizeInBytes();
+			stats->compressedKeyCount = output.mRotationKeys.size() + output.mTranslationKeys.size() + output.mScaleKeys.size();
+			stats->maxError = maxError;
+		}
+
+		return true;
+	}
+}
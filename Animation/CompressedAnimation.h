@@ -0,0 +1,137 @@
+#pragma once
+#include "Animation.h"
+
+using namespace DirectX::SimpleMath;
+
+namespace Animation
+{
+	// Rotation stored with the smallest three components: 2 bits for the
+	// index of the dropped (largest) component and 15 bits for each of the
+	// three others, packed in 48 bits.
+	struct QuantizedQuaternion
+	{
+		uint16_t data[3];
+	};
+
+	// Vector stored as 16 bits per component, relative to the range of its
+	// track.
+	struct QuantizedVector3
+	{
+		uint16_t x, y, z;
+	};
+
+	struct QuantizationRange
+	{
+		Vector3 min;
+
+		Vector3 extent;
+	};
+
+	// A run of keys of one channel of one joint. Constant channels have a
+	// single key.
+	struct CompressedTrack
+	{
+		uint32_t first = 0;
+
+		// At most 65535, clips are limited to that many frames
+		uint16_t count = 0;
+	};
+
+	struct CompressionSettings
+	{
+		// Maximum displacement allowed in model space, measured on the joints
+		// and on virtual vertices at shellDistance around them. The default
+		// values assume the assets are authored in centimeters.
+		float tolerance = 0.01f;
+
+		float shellDistance = 3.0f;
+
+		// Rate the clip is resampled at before the keys are reduced.
+		float sampleRate = 30.0f;
+	};
+
+	struct CompressionStats
+	{
+		size_t rawBytes = 0;
+
+		size_t compressedBytes = 0;
+
+		int rawKeyCount = 0;
+
+		int compressedKeyCount = 0;
+
+		// Largest model space error measured over all frames and joints.
+		float maxError = 0.0f;
+	};
+
+	QuantizedQuaternion QuantizeQuaternion(Quaternion q);
+
+	Quaternion DequantizeQuaternion(const QuantizedQuaternion& q);
+
+	QuantizedVector3 QuantizeVector3(const Vector3& v, const QuantizationRange& range);
+
+	Vector3 DequantizeVector3(const QuantizedVector3& v, const QuantizationRange& range);
+
+	///<summary>
+	/// Compact version of an AnimationClip. The clip is resampled uniformly,
+	/// the keys that can be rebuilt by interpolating their neighbours within
+	/// the tolerance are removed, and the remaining ones are quantized. Key
+	/// times are stored as frame indices.
+	///</summary>
+	class CompressedAnimation
+	{
+	public:
+		int JointCount() const;
+
+		float get_duration_in_tick() const;
+
+		float get_duration_in_second() const;
+
+		size_t GetSizeInBytes() const;
+
+		// Decompresses every joint at the given frame (may be fractional).
+		// cursors is optional and holds one KeyCursor per joint.
+		void Sample(float frame, Transform* output, KeyCursor* cursors = nullptr) const;
+
+		std::string mName;
+
+		int mFrameCount = 0;
+
+		float mSampleRate = 30.0f;
+
+		float mDurationInTick = 0.0f;
+
+		double mTicksPerSecond = 0.0;
+
+		std::vector<CompressedTrack> mRotationTracks;
+
+		std::vector<CompressedTrack> mTranslationTracks;
+
+		std::vector<CompressedTrack> mScaleTracks;
+
+		std::vector<QuantizationRange> mTranslationRanges;
+
+		std::vector<QuantizationRange> mScaleRanges;
+
+		std::vector<uint16_t> mRotationTimes;
+
+		std::vector<uint16_t> mTranslationTimes;
+
+		std::vector<uint16_t> mScaleTimes;
+
+		std::vector<QuantizedQuaternion> mRotationKeys;
+
+		std::vector<QuantizedVector3> mTranslationKeys;
+
+		std::vector<QuantizedVector3> mScaleKeys;
+	};
+
+	// Offline compression of a clip. The error is measured through the joint
+	// hierarchy, so parents must have a lower index than their children.
+	bool CompressAnimation(
+		const AnimationClip& clip,
+		const std::vector<int>& parents,
+		const CompressionSettings& settings,
+		CompressedAnimation& output,
+		CompressionStats* stats = nullptr);
+}
@@ -0,0 +1,48 @@
+#include "CompressedSamplingJob.h"
+
+namespace Animation
+{
+	void CompressedSamplingJob::Context::Invalidate()
+	{
+		animation = nullptr;
+		cursors.clear();
+	}
+
+	CompressedSamplingJob::CompressedSamplingJob() : ratio(0.0f), animation(nullptr), context(nullptr) {}
+
+	bool CompressedSamplingJob::Validate() const
+	{
+		if (!animation || animation->mFrameCount < 2)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	bool CompressedSamplingJob::Run()
+	{
+		if (!Validate()){
+			return false;
+		}
+
+		int numJoint = animation->JointCount();
+		output.resize(numJoint);
+
+		KeyCursor* cursors = nullptr;
+		if (context)
+		{
+			if (context->animation != animation || context->cursors.size() != numJoint)
+			{
+				context->animation = animation;
+				context->cursors.assign(numJoint, KeyCursor());
+			}
+			cursors = context->cursors.data();
+		}
+
+		float frame = clampf(ratio, 0.0f, 1.0f) * (animation->mFrameCount - 1);
+		animation->Sample(frame, output.data(), cursors);
+
+		return true;
+	}
+}
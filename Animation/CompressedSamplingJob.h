@@ -0,0 +1,40 @@
+#pragma once
+#include "CompressedAnimation.h"
+
+namespace Animation
+{
+	// Samples a CompressedAnimation, decompressing only the keys surrounding
+	// the sampled time. Mirrors SamplingJob.
+	struct CompressedSamplingJob
+	{
+		// Key cursors of every joint between two Run() calls, see
+		// SamplingJob::Context.
+		class Context
+		{
+		public:
+			void Invalidate();
+
+		private:
+			friend struct CompressedSamplingJob;
+
+			const CompressedAnimation* animation = nullptr;
+
+			std::vector<KeyCursor> cursors;
+		};
+
+		CompressedSamplingJob();
+
+		bool Validate() const;
+
+		bool Run();
+
+		float ratio;
+
+		const CompressedAnimation* animation;
+
+		// Optional
+		Context* context;
+
+		std::vector<Transform> output;
+	};
+}
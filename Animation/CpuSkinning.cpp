@@ -0,0 +1,278 @@
+#include "CpuSkinning.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/CpuFeatures.h"
+#include <algorithm>
+#include <chrono>
+
+namespace Animation
+{
+	void CpuSkinningMesh::Reset(int count)
+	{
+		vertexCount = count;
+		paddedCount = (vertexCount + CPU_SKINNING_LANES - 1) / CPU_SKINNING_LANES * CPU_SKINNING_LANES;
+		maxBoneIndex = -1;
+
+		for (int c = 0; c < 3; c++)
+		{
+			positions[c].assign(paddedCount, 0.0f);
+			normals[c].assign(paddedCount, 0.0f);
+			tangents[c].assign(paddedCount, 0.0f);
+		}
+
+		for (int k = 0; k < NUM_BONES_PER_VEREX; k++)
+		{
+			weights[k].assign(paddedCount, 0.0f);
+			indices[k].assign(paddedCount, 0);
+		}
+	}
+
+	void CpuSkinningMesh::SetVertex(int i, const float* position, const float* normal, const float* tangent,
+		const float* boneWeights, const uint8_t* boneIndices)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			positions[c][i] = position[c];
+			normals[c][i] = normal[c];
+			tangents[c][i] = tangent[c];
+		}
+
+		weights[0][i] = boneWeights[0];
+		weights[1][i] = boneWeights[1];
+		weights[2][i] = boneWeights[2];
+		weights[3][i] = 1.0f - boneWeights[0] - boneWeights[1] - boneWeights[2];
+
+		for (int k = 0; k < NUM_BONES_PER_VEREX; k++)
+		{
+			indices[k][i] = boneIndices[k];
+			maxBoneIndex = std::max(maxBoneIndex, (int)boneIndices[k]);
+		}
+	}
+
+	void CpuSkinnedVertices::Resize(int paddedCount)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			positions[c].resize(paddedCount);
+			normals[c].resize(paddedCount);
+			tangents[c].resize(paddedCount);
+		}
+	}
+
+	CpuSkinningFloat3 CpuSkinnedVertices::GetPosition(int vertex) const
+	{
+		return { positions[0][vertex], positions[1][vertex], positions[2][vertex] };
+	}
+
+	CpuSkinningFloat3 CpuSkinnedVertices::GetNormal(int vertex) const
+	{
+		return { normals[0][vertex], normals[1][vertex], normals[2][vertex] };
+	}
+
+	CpuSkinningFloat3 CpuSkinnedVertices::GetTangent(int vertex) const
+	{
+		return { tangents[0][vertex], tangents[1][vertex], tangents[2][vertex] };
+	}
+
+	// Element e of the blended matrix is row e / 4, column e % 4 of the
+	// transposed skinning matrix: p' = (dot(row0, p), dot(row1, p), dot(row2, p))
+	// with p = (x, y, z, 1).
+#if defined(CPU_SKINNING_SSE)
+	static inline void skin_lanes_sse4(const CpuSkinningStreams& s, const float* palette, bool skinNormals, int i)
+	{
+		__m128 m[12];
+		for (int e = 0; e < 12; e++)
+			m[e] = _mm_setzero_ps();
+
+		for (int k = 0; k < NUM_BONES_PER_VEREX; k++)
+		{
+			const int* index = s.indices[k] + i;
+			const float* b0 = palette + index[0] * 16;
+			const float* b1 = palette + index[1] * 16;
+			const float* b2 = palette + index[2] * 16;
+			const float* b3 = palette + index[3] * 16;
+			__m128 w = _mm_load_ps(s.weights[k] + i);
+
+			// Rows of the four matrices, transposed to one element per register
+			for (int row = 0; row < 3; row++)
+			{
+				__m128 r0 = _mm_loadu_ps(b0 + row * 4);
+				__m128 r1 = _mm_loadu_ps(b1 + row * 4);
+				__m128 r2 = _mm_loadu_ps(b2 + row * 4);
+				__m128 r3 = _mm_loadu_ps(b3 + row * 4);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				m[row * 4] = _mm_add_ps(m[row * 4], _mm_mul_ps(w, r0));
+				m[row * 4 + 1] = _mm_add_ps(m[row * 4 + 1], _mm_mul_ps(w, r1));
+				m[row * 4 + 2] = _mm_add_ps(m[row * 4 + 2], _mm_mul_ps(w, r2));
+				m[row * 4 + 3] = _mm_add_ps(m[row * 4 + 3], _mm_mul_ps(w, r3));
+			}
+		}
+
+		__m128 x = _mm_load_ps(s.positions[0] + i);
+		__m128 y = _mm_load_ps(s.positions[1] + i);
+		__m128 z = _mm_load_ps(s.positions[2] + i);
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m[c * 4]), _mm_mul_ps(y, m[c * 4 + 1])),
+				_mm_add_ps(_mm_mul_ps(z, m[c * 4 + 2]), m[c * 4 + 3]));
+			_mm_store_ps(s.outPositions[c] + i, r);
+		}
+
+		if (!skinNormals)
+			return;
+
+		__m128 nx = _mm_load_ps(s.normals[0] + i);
+		__m128 ny = _mm_load_ps(s.normals[1] + i);
+		__m128 nz = _mm_load_ps(s.normals[2] + i);
+		__m128 tx = _mm_load_ps(s.tangents[0] + i);
+		__m128 ty = _mm_load_ps(s.tangents[1] + i);
+		__m128 tz = _mm_load_ps(s.tangents[2] + i);
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, m[c * 4]), _mm_mul_ps(ny, m[c * 4 + 1])), _mm_mul_ps(nz, m[c * 4 + 2]));
+			__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, m[c * 4]), _mm_mul_ps(ty, m[c * 4 + 1])), _mm_mul_ps(tz, m[c * 4 + 2]));
+			_mm_store_ps(s.outNormals[c] + i, n);
+			_mm_store_ps(s.outTangents[c] + i, t);
+		}
+	}
+
+	static void skin_lanes_sse(const CpuSkinningStreams& s, const float* palette, bool skinNormals, int i)
+	{
+		skin_lanes_sse4(s, palette, skinNormals, i);
+		skin_lanes_sse4(s, palette, skinNormals, i + 4);
+	}
+#else
+	static void skin_lanes_scalar(const CpuSkinningStreams& s, const float* palette, bool skinNormals, int i)
+	{
+		float m[12] = {};
+		for (int k = 0; k < NUM_BONES_PER_VEREX; k++)
+		{
+			const float* bone = palette + s.indices[k][i] * 16;
+			float w = s.weights[k][i];
+			for (int e = 0; e < 12; e++)
+				m[e] += w * bone[e];
+		}
+
+		float p[3] = { s.positions[0][i], s.positions[1][i], s.positions[2][i] };
+		float n[3] = { s.normals[0][i], s.normals[1][i], s.normals[2][i] };
+		float t[3] = { s.tangents[0][i], s.tangents[1][i], s.tangents[2][i] };
+		for (int c = 0; c < 3; c++)
+		{
+			const float* row = m + c * 4;
+			s.outPositions[c][i] = p[0] * row[0] + p[1] * row[1] + p[2] * row[2] + row[3];
+			if (skinNormals)
+			{
+				s.outNormals[c][i] = n[0] * row[0] + n[1] * row[1] + n[2] * row[2];
+				s.outTangents[c][i] = t[0] * row[0] + t[1] * row[1] + t[2] * row[2];
+			}
+		}
+	}
+#endif
+
+	CpuSkinningJob::CpuSkinningJob()
+		: mesh(nullptr), palette(nullptr), boneCount(0), output(nullptr), skinNormals(true), batchSize(CPU_SKINNING_BATCH), stats(nullptr) {}
+
+	bool CpuSkinningJob::Validate() const
+	{
+		if (!mesh || !palette || !output)
+		{
+			return false;
+		}
+
+		return boneCount > 0 && mesh->maxBoneIndex < boneCount && batchSize > 0;
+	}
+
+	bool CpuSkinningJob::Run()
+	{
+		if (!Validate())
+		{
+			return false;
+		}
+
+		typedef std::chrono::high_resolution_clock Clock;
+		Clock::time_point start = Clock::now();
+
+		output->Resize(mesh->paddedCount);
+		output->vertexCount = mesh->vertexCount;
+
+		CpuSkinningStreams streams;
+		for (int c = 0; c < 3; c++)
+		{
+			streams.positions[c] = mesh->positions[c].data();
+			streams.normals[c] = mesh->normals[c].data();
+			streams.tangents[c] = mesh->tangents[c].data();
+			streams.outPositions[c] = output->positions[c].data();
+			streams.outNormals[c] = output->normals[c].data();
+			streams.outTangents[c] = output->tangents[c].data();
+		}
+
+		for (int k = 0; k < NUM_BONES_PER_VEREX; k++)
+		{
+			streams.weights[k] = mesh->weights[k].data();
+			streams.indices[k] = mesh->indices[k].data();
+		}
+
+#if defined(CPU_SKINNING_SSE)
+		CpuSkinningLanesKernel skinLanes = skin_lanes_sse;
+#else
+		CpuSkinningLanesKernel skinLanes = skin_lanes_scalar;
+#endif
+#if defined(CPU_SKINNING_AVX2)
+		if (CpuSupportsAVX2())
+			skinLanes = skin_lanes_avx2;
+#endif
+
+		// Batches are made of whole lanes
+		int laneCount = mesh->paddedCount / CPU_SKINNING_LANES;
+		int batchLanes = std::max(1, batchSize / CPU_SKINNING_LANES);
+
+		ThreadPool::For(laneCount, batchLanes, [this, &streams, skinLanes](int begin, int end)
+		{
+			for (int lane = begin; lane < end; lane++)
+			{
+				skinLanes(streams, palette, skinNormals, lane * CPU_SKINNING_LANES);
+			}
+		});
+
+		if (stats)
+		{
+			ThreadPool* pool = ThreadPool::GetSinglePtr();
+
+			stats->vertexCount = mesh->vertexCount;
+			stats->batchCount = (laneCount + batchLanes - 1) / batchLanes;
+			stats->threadCount = pool ? pool->GetThreadCount() + 1 : 1;
+			stats->milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			stats->verticesPerSecond = stats->milliseconds > 0.0 ? mesh->vertexCount * 1000.0 / stats->milliseconds : 0.0;
+		}
+
+		return true;
+	}
+
+	CpuSkinningStats BenchmarkCpuSkinning(CpuSkinningJob& job, int iterations)
+	{
+		CpuSkinningStats total;
+		CpuSkinningStats* jobStats = job.stats;
+
+		CpuSkinningStats stats;
+		job.stats = &stats;
+
+		int runCount = 0;
+		for (int i = 0; i < iterations && job.Run(); i++)
+		{
+			total.vertexCount = stats.vertexCount;
+			total.batchCount = stats.batchCount;
+			total.threadCount = stats.threadCount;
+			total.milliseconds += stats.milliseconds;
+			runCount++;
+		}
+
+		job.stats = jobStats;
+
+		if (runCount > 0)
+		{
+			total.verticesPerSecond = total.milliseconds > 0.0 ? (double)total.vertexCount * runCount * 1000.0 / total.milliseconds : 0.0;
+			total.milliseconds /= runCount;
+		}
+
+		return total;
+	}
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "../Common/AlignedAllocator.h"
+
+// Vertices are skinned CPU_SKINNING_LANES at a time: in one AVX2 step when
+// the CPU supports it, otherwise in two SSE steps. The AVX2 kernel is built on
+// its own with /arch:AVX2 (CpuSkinningAVX2.cpp), the rest of the executable
+// for the baseline instruction set.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define CPU_SKINNING_SSE
+#define CPU_SKINNING_LANES 8
+#else
+#define CPU_SKINNING_LANES 1
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_SKINNING_AVX2
+#endif
+
+// Vertices skinned by a task of the thread pool. Input and output of a batch
+// take about 100 bytes per vertex, so a batch stays in L2.
+#define CPU_SKINNING_BATCH 1024
+
+#ifndef NUM_BONES_PER_VEREX
+#define NUM_BONES_PER_VEREX 4
+#endif
+
+// Only std and intrinsics are used here, no pch, so that the skinning can be
+// built and checked on its own, off Windows.
+
+namespace Animation
+{
+	typedef std::vector<float, AlignedAllocator<float, 32>> SkinningFloatArray;
+
+	typedef std::vector<int, AlignedAllocator<int, 32>> SkinningIndexArray;
+
+	// Bind pose vertices stored SoA, one array per component, padded to a
+	// multiple of CPU_SKINNING_LANES with vertices of null weights.
+	struct CpuSkinningMesh
+	{
+		// VertexType is any vertex with Pos, Normal, TangentU and BoneWeights
+		// stored as 3 floats and BoneIndices[NUM_BONES_PER_VEREX], such as
+		// SkinnedVertex.
+		template <typename VertexType>
+		void Build(const std::vector<VertexType>& vertices)
+		{
+			Reset((int)vertices.size());
+
+			for (int i = 0; i < vertexCount; i++)
+			{
+				const VertexType& v = vertices[i];
+				SetVertex(i, &v.Pos.x, &v.Normal.x, &v.TangentU.x, &v.BoneWeights.x, v.BoneIndices);
+			}
+		}
+
+		// Resizes the arrays for vertexCount vertices, all of null weights.
+		void Reset(int vertexCount);
+
+		// The last weight is implicit, as in the shaders.
+		void SetVertex(int vertex, const float* position, const float* normal, const float* tangent,
+			const float* boneWeights, const uint8_t* boneIndices);
+
+		int vertexCount = 0;
+
+		int paddedCount = 0;
+
+		// Highest bone index used, the palette must have more bones
+		int maxBoneIndex = -1;
+
+		SkinningFloatArray positions[3];
+
+		SkinningFloatArray normals[3];
+
+		SkinningFloatArray tangents[3];
+
+		SkinningFloatArray weights[NUM_BONES_PER_VEREX];
+
+		SkinningIndexArray indices[NUM_BONES_PER_VEREX];
+	};
+
+	struct CpuSkinningFloat3
+	{
+		float x, y, z;
+	};
+
+	// Skinned vertices, in the same layout as the mesh
+	struct CpuSkinnedVertices
+	{
+		void Resize(int paddedCount);
+
+		CpuSkinningFloat3 GetPosition(int vertex) const;
+
+		CpuSkinningFloat3 GetNormal(int vertex) const;
+
+		CpuSkinningFloat3 GetTangent(int vertex) const;
+
+		int vertexCount = 0;
+
+		SkinningFloatArray positions[3];
+
+		SkinningFloatArray normals[3];
+
+		SkinningFloatArray tangents[3];
+	};
+
+	// Arrays of a mesh and of its skinned vertices, as raw pointers for the
+	// kernels.
+	struct CpuSkinningStreams
+	{
+		const float* positions[3];
+
+		const float* normals[3];
+
+		const float* tangents[3];
+
+		const float* weights[NUM_BONES_PER_VEREX];
+
+		const int* indices[NUM_BONES_PER_VEREX];
+
+		float* outPositions[3];
+
+		float* outNormals[3];
+
+		float* outTangents[3];
+	};
+
+	// Skins the CPU_SKINNING_LANES vertices starting at vertex i
+	typedef void (*CpuSkinningLanesKernel)(const CpuSkinningStreams& streams, const float* palette, bool skinNormals, int i);
+
+#if defined(CPU_SKINNING_AVX2)
+	// Only call when CpuSupportsAVX2.
+	void skin_lanes_avx2(const CpuSkinningStreams& streams, const float* palette, bool skinNormals, int i);
+#endif
+
+	struct CpuSkinningStats
+	{
+		int vertexCount = 0;
+
+		int batchCount = 0;
+
+		int threadCount = 1;
+
+		double milliseconds = 0.0;
+
+		double verticesPerSecond = 0.0;
+	};
+
+	///<summary>
+	/// Linear blend skinning of a mesh on the CPU, the same as the skinned
+	/// shaders, for code running without a GPU (hit detection against the
+	/// skinned mesh, offline validation...). The vertices are processed
+	/// CPU_SKINNING_LANES at a time, with AVX2 gathers of the palette when
+	/// the CPU supports them, in batches of batchSize vertices spread over the thread
+	/// pool.
+	///</summary>
+	struct CpuSkinningJob
+	{
+		CpuSkinningJob();
+
+		bool Validate() const;
+
+		bool Run();
+
+		const CpuSkinningMesh* mesh;
+
+		// Skinning matrices as written by LocalToModelJob with the offsets
+		// applied (transposed), 16 floats each: &skinning[0]._11.
+		const float* palette;
+
+		int boneCount;
+
+		CpuSkinnedVertices* output;
+
+		// Positions only when false
+		bool skinNormals;
+
+		int batchSize;
+
+		// Optional, timing of the last Run().
+		CpuSkinningStats* stats;
+	};
+
+	// Runs the job iterations times and reports the average throughput.
+	CpuSkinningStats BenchmarkCpuSkinning(CpuSkinningJob& job, int iterations);
+}
@@ -0,0 +1,57 @@
+// Built with /arch:AVX2, unlike the rest of the executable: nothing here may
+// run before CpuSupportsAVX2 was checked. Only the raw pointers of
+// CpuSkinningStreams are used, so that no inline function of a shared header
+// gets compiled with AVX2 and picked by the linker for the other translation
+// units.
+#include "CpuSkinning.h"
+
+#if defined(CPU_SKINNING_AVX2)
+#include <immintrin.h>
+
+namespace Animation
+{
+	// Element e of the blended matrix is row e / 4, column e % 4 of the
+	// transposed skinning matrix, see CpuSkinning.cpp. The palette is
+	// gathered for the eight vertices at once.
+	void skin_lanes_avx2(const CpuSkinningStreams& s, const float* palette, bool skinNormals, int i)
+	{
+		__m256 m[12];
+		for (int e = 0; e < 12; e++)
+			m[e] = _mm256_setzero_ps();
+
+		for (int k = 0; k < NUM_BONES_PER_VEREX; k++)
+		{
+			__m256i offsets = _mm256_slli_epi32(_mm256_load_si256((const __m256i*)(s.indices[k] + i)), 4);
+			__m256 w = _mm256_load_ps(s.weights[k] + i);
+			for (int e = 0; e < 12; e++)
+				m[e] = _mm256_fmadd_ps(w, _mm256_i32gather_ps(palette + e, offsets, 4), m[e]);
+		}
+
+		__m256 x = _mm256_load_ps(s.positions[0] + i);
+		__m256 y = _mm256_load_ps(s.positions[1] + i);
+		__m256 z = _mm256_load_ps(s.positions[2] + i);
+		for (int c = 0; c < 3; c++)
+		{
+			__m256 r = _mm256_fmadd_ps(x, m[c * 4], _mm256_fmadd_ps(y, m[c * 4 + 1], _mm256_fmadd_ps(z, m[c * 4 + 2], m[c * 4 + 3])));
+			_mm256_store_ps(s.outPositions[c] + i, r);
+		}
+
+		if (!skinNormals)
+			return;
+
+		__m256 nx = _mm256_load_ps(s.normals[0] + i);
+		__m256 ny = _mm256_load_ps(s.normals[1] + i);
+		__m256 nz = _mm256_load_ps(s.normals[2] + i);
+		__m256 tx = _mm256_load_ps(s.tangents[0] + i);
+		__m256 ty = _mm256_load_ps(s.tangents[1] + i);
+		__m256 tz = _mm256_load_ps(s.tangents[2] + i);
+		for (int c = 0; c < 3; c++)
+		{
+			__m256 n = _mm256_fmadd_ps(nx, m[c * 4], _mm256_fmadd_ps(ny, m[c * 4 + 1], _mm256_mul_ps(nz, m[c * 4 + 2])));
+			__m256 t = _mm256_fmadd_ps(tx, m[c * 4], _mm256_fmadd_ps(ty, m[c * 4 + 1], _mm256_mul_ps(tz, m[c * 4 + 2])));
+			_mm256_store_ps(s.outNormals[c] + i, n);
+			_mm256_store_ps(s.outTangents[c] + i, t);
+		}
+	}
+}
+#endif
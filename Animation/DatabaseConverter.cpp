@@ -0,0 +1,41 @@
+#include "DatabaseConverter.h"
+#include "LoadFBX.h"
+#include "MotionMatchingJob.h"
+
+namespace Animation
+{
+	bool ConvertFBXToDatabase(
+		const std::string& bindPoseFilename,
+		const std::vector<std::string>& clipFilenames,
+		const std::string& outputFilename)
+	{
+		AnimationDatabase db;
+		FBXLoader fbxLoader;
+
+		std::vector<SkinnedVertex> vertices;
+		std::vector<USHORT> indices;
+		std::vector<FBXLoader::Subset> subsets;
+		std::vector<FBXLoader::FbxMaterial> mats;
+		if (!fbxLoader.LoadBindPose(bindPoseFilename, vertices, indices, subsets, mats, db))
+		{
+			LOG_ERROR("Failed to load bind pose " + bindPoseFilename);
+			return false;
+		}
+
+		for (const std::string& filename : clipFilenames)
+		{
+			if (!fbxLoader.LoadFBXClip(filename, db))
+			{
+				LOG_ERROR("Failed to load clip " + filename);
+				return false;
+			}
+		}
+
+		MotionMatchingJob mm;
+		mm.animDatabase = &db;
+		mm.Build();
+
+		DatabaseFeatureData features = mm.GetFeatureData();
+		return db.Save(outputFilename, &features);
+	}
+}
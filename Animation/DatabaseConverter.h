@@ -0,0 +1,13 @@
+#pragma once
+#include "AnimationDatabase.h"
+
+namespace Animation
+{
+	// Offline conversion to the binary database format. Imports the bind pose
+	// and the clips with Assimp the same way the engine does, evaluates the
+	// motion matching features and writes everything with AnimationDatabaseFile.
+	bool ConvertFBXToDatabase(
+		const std::string& bindPoseFilename,
+		const std::vector<std::string>& clipFilenames,
+		const std::string& outputFilename);
+}
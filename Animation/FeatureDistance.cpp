@@ -0,0 +1,143 @@
+#include "FeatureDistance.h"
+#include "../Common/CpuFeatures.h"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace Animation
+{
+#if !defined(FEATURE_DISTANCE_SSE)
+	static void feature_distance_batch_fallback(const float* query, const float* rows, const int stride, const float bestCost, float* costs)
+	{
+		feature_distance_batch_scalar(query, rows, stride, bestCost, costs, FEATURE_DISTANCE_BATCH);
+	}
+#endif
+
+	FeatureDistanceBatchKernel GetFeatureDistanceBatchKernel()
+	{
+#if defined(FEATURE_DISTANCE_AVX2)
+		if (CpuSupportsAVX2())
+			return feature_distance_batch_avx2;
+#endif
+#if defined(FEATURE_DISTANCE_SSE)
+		return feature_distance_batch_sse;
+#else
+		return feature_distance_batch_fallback;
+#endif
+	}
+
+	// Linear search of the best pose, BatchSize poses at a time with the given
+	// batch kernel, and one at a time with the scalar kernel for the remainder.
+	template <int BatchSize, typename BatchKernel>
+	static int FeatureDistanceSearch(const float* query, const float* rows, int poseCount, int stride, BatchKernel kernel)
+	{
+		float bestCost = FLT_MAX;
+		int bestIndex = -1;
+
+		int i = 0;
+		for (; i + BatchSize <= poseCount; i += BatchSize)
+		{
+			float costs[BatchSize];
+			kernel(query, rows + i * stride, stride, bestCost, costs);
+
+			for (int k = 0; k < BatchSize; k++)
+			{
+				if (costs[k] < bestCost)
+				{
+					bestCost = costs[k];
+					bestIndex = i + k;
+				}
+			}
+		}
+
+		for (; i < poseCount; i++)
+		{
+			float cost = feature_distance_scalar(query, rows + i * stride, stride, bestCost);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestIndex = i;
+			}
+		}
+
+		return bestIndex;
+	}
+
+	template <int BatchSize, typename BatchKernel>
+	static double RunFeatureDistance(const std::vector<const float*>& queries, const float* rows, int poseCount, int stride,
+		BatchKernel kernel, std::vector<int>& bestIndices)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		for (size_t q = 0; q < queries.size(); q++)
+			bestIndices[q] = FeatureDistanceSearch<BatchSize>(queries[q], rows, poseCount, stride, kernel);
+
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	FeatureDistanceBenchmark BenchmarkFeatureDistance(int poseCount, int featureCount, int queryCount, int iterations)
+	{
+		FeatureDistanceBenchmark result;
+		if (poseCount <= 0 || featureCount <= 0 || queryCount <= 0 || iterations <= 0)
+			return result;
+
+		const int stride = (featureCount + FEATURE_DISTANCE_PADDING - 1) / FEATURE_DISTANCE_PADDING * FEATURE_DISTANCE_PADDING;
+
+		// Poses and queries share one buffer, aligned on 32 bytes by hand
+		std::vector<float> storage(size_t(poseCount + queryCount) * stride + 8, 0.0f);
+		float* rows = storage.data();
+		while (reinterpret_cast<uintptr_t>(rows) % 32 != 0)
+			rows++;
+
+		unsigned int seed = 1;
+		for (int i = 0; i < poseCount + queryCount; i++)
+		{
+			for (int d = 0; d < featureCount; d++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				rows[i * stride + d] = float(seed >> 8) / float(1 << 24) * 2.0f - 1.0f;
+			}
+		}
+
+		std::vector<const float*> queries(queryCount);
+		for (int q = 0; q < queryCount; q++)
+			queries[q] = rows + (poseCount + q) * stride;
+
+		// Kernels are wrapped in lambdas rather than passed as function pointers so
+		// that the inline ones get inlined into the search loop
+		auto scalarKernel = [](const float* query, const float* batchRows, int batchStride, float bestCost, float* costs)
+		{
+			feature_distance_batch_scalar(query, batchRows, batchStride, bestCost, costs, 1);
+		};
+
+		std::vector<int> scalarIndices(queryCount);
+		std::vector<int> indices(queryCount);
+
+		for (int it = 0; it < iterations; it++)
+		{
+			result.ScalarMilliseconds += RunFeatureDistance<1>(queries, rows, poseCount, stride, scalarKernel, scalarIndices);
+
+#if defined(FEATURE_DISTANCE_SSE)
+			result.SSEMilliseconds += RunFeatureDistance<FEATURE_DISTANCE_BATCH_SSE>(queries, rows, poseCount, stride,
+				[](const float* q, const float* r, int n, float best, float* costs) { feature_distance_batch_sse(q, r, n, best, costs); }, indices);
+			result.Consistent = result.Consistent && indices == scalarIndices;
+#endif
+
+#if defined(FEATURE_DISTANCE_AVX2)
+			if (CpuSupportsAVX2())
+			{
+				result.AVX2Milliseconds += RunFeatureDistance<FEATURE_DISTANCE_BATCH_AVX2>(queries, rows, poseCount, stride,
+					[](const float* q, const float* r, int n, float best, float* costs) { feature_distance_batch_avx2(q, r, n, best, costs); }, indices);
+				result.Consistent = result.Consistent && indices == scalarIndices;
+			}
+#endif
+		}
+
+		result.ScalarMilliseconds /= iterations;
+		result.SSEMilliseconds /= iterations;
+		result.AVX2Milliseconds /= iterations;
+
+		return result;
+	}
+}
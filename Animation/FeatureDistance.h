@@ -0,0 +1,199 @@
+#pragma once
+
+#include <float.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define FEATURE_DISTANCE_SSE
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+#define FEATURE_DISTANCE_AVX2
+#endif
+
+// Squared euclidean distance kernels used by the motion matching search.
+// Feature rows are expected to be stored row-major, aligned on 32 bytes and
+// padded with zeros to a multiple of FEATURE_DISTANCE_PADDING floats, and so
+// is the query.
+//
+// The batched kernels evaluate FEATURE_DISTANCE_BATCH consecutive poses at
+// once. Partial sums are compared against the current best cost every
+// FEATURE_DISTANCE_EARLY_OUT dimensions, and the evaluation stops as soon as
+// no pose of the batch can win anymore. Costs of poses that were cut short are
+// only guaranteed to be >= bestCost.
+//
+// The executable is built for the baseline instruction set. The AVX2 kernel
+// is compiled on its own with /arch:AVX2 (FeatureDistanceAVX2.cpp), and
+// GetFeatureDistanceBatchKernel only returns it when the CPU supports it. The
+// per instruction set kernels stay available so that they can be compared
+// against each other, see BenchmarkFeatureDistance.
+
+#define FEATURE_DISTANCE_PADDING 8
+#define FEATURE_DISTANCE_EARLY_OUT 16
+
+// Kernels are picked at run time, so they all evaluate as many rows
+#define FEATURE_DISTANCE_BATCH 4
+#define FEATURE_DISTANCE_BATCH_SSE FEATURE_DISTANCE_BATCH
+#define FEATURE_DISTANCE_BATCH_AVX2 FEATURE_DISTANCE_BATCH
+
+namespace Animation
+{
+	static inline float feature_distance_scalar(
+		const float* query,
+		const float* row,
+		const int stride,
+		const float bestCost)
+	{
+		float cost = 0.0f;
+		for (int d = 0; d < stride; d++)
+		{
+			float diff = query[d] - row[d];
+			cost += diff * diff;
+			if (cost >= bestCost)
+				break;
+		}
+		return cost;
+	}
+
+	// Evaluates count consecutive rows starting at rows, one at a time.
+	static inline void feature_distance_batch_scalar(
+		const float* query,
+		const float* rows,
+		const int stride,
+		const float bestCost,
+		float* costs,
+		const int count)
+	{
+		for (int k = 0; k < count; k++)
+			costs[k] = feature_distance_scalar(query, rows + k * stride, stride, bestCost);
+	}
+
+#if defined(FEATURE_DISTANCE_SSE)
+	// Sums each of the four vectors horizontally: returns
+	// (sum(a), sum(b), sum(c), sum(d)).
+	static inline __m128 feature_hsum4(__m128 a, __m128 b, __m128 c, __m128 d)
+	{
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+		return _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+	}
+
+	static inline float feature_distance_sse(
+		const float* query,
+		const float* row,
+		const int stride,
+		const float bestCost)
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+
+		for (int d = 0; d < stride; d += 8)
+		{
+			__m128 diff0 = _mm_sub_ps(_mm_load_ps(query + d), _mm_load_ps(row + d));
+			__m128 diff1 = _mm_sub_ps(_mm_load_ps(query + d + 4), _mm_load_ps(row + d + 4));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(diff0, diff0));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(diff1, diff1));
+
+			if (((d + 8) % FEATURE_DISTANCE_EARLY_OUT) == 0 && d + 8 < stride)
+			{
+				__m128 zero = _mm_setzero_ps();
+				float partial = _mm_cvtss_f32(feature_hsum4(_mm_add_ps(acc0, acc1), zero, zero, zero));
+				if (partial >= bestCost)
+					return partial;
+			}
+		}
+
+		__m128 zero = _mm_setzero_ps();
+		return _mm_cvtss_f32(feature_hsum4(_mm_add_ps(acc0, acc1), zero, zero, zero));
+	}
+
+	// Evaluates FEATURE_DISTANCE_BATCH_SSE consecutive rows starting at rows.
+	static inline void feature_distance_batch_sse(
+		const float* query,
+		const float* rows,
+		const int stride,
+		const float bestCost,
+		float* costs)
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		__m128 acc2 = _mm_setzero_ps();
+		__m128 acc3 = _mm_setzero_ps();
+
+		__m128 best = _mm_set1_ps(bestCost);
+		__m128 sums = _mm_setzero_ps();
+
+		for (int d = 0; d < stride; d += 4)
+		{
+			__m128 q = _mm_load_ps(query + d);
+			__m128 diff0 = _mm_sub_ps(q, _mm_load_ps(rows + d));
+			__m128 diff1 = _mm_sub_ps(q, _mm_load_ps(rows + stride + d));
+			__m128 diff2 = _mm_sub_ps(q, _mm_load_ps(rows + 2 * stride + d));
+			__m128 diff3 = _mm_sub_ps(q, _mm_load_ps(rows + 3 * stride + d));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(diff0, diff0));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(diff1, diff1));
+			acc2 = _mm_add_ps(acc2, _mm_mul_ps(diff2, diff2));
+			acc3 = _mm_add_ps(acc3, _mm_mul_ps(diff3, diff3));
+
+			bool last = d + 4 >= stride;
+			if (last || ((d + 4) % FEATURE_DISTANCE_EARLY_OUT) == 0)
+			{
+				sums = feature_hsum4(acc0, acc1, acc2, acc3);
+
+				if (!last && _mm_movemask_ps(_mm_cmplt_ps(sums, best)) == 0)
+					break;
+			}
+		}
+
+		_mm_storeu_ps(costs, sums);
+	}
+#endif
+
+#if defined(FEATURE_DISTANCE_AVX2)
+	// Evaluates FEATURE_DISTANCE_BATCH_AVX2 consecutive rows starting at rows.
+	// Only call when CpuSupportsAVX2.
+	void feature_distance_batch_avx2(
+		const float* query,
+		const float* rows,
+		const int stride,
+		const float bestCost,
+		float* costs);
+#endif
+
+	static inline float feature_distance(
+		const float* query,
+		const float* row,
+		const int stride,
+		const float bestCost)
+	{
+#if defined(FEATURE_DISTANCE_SSE)
+		return feature_distance_sse(query, row, stride, bestCost);
+#else
+		return feature_distance_scalar(query, row, stride, bestCost);
+#endif
+	}
+
+	// Evaluates FEATURE_DISTANCE_BATCH consecutive rows starting at rows.
+	typedef void (*FeatureDistanceBatchKernel)(
+		const float* query,
+		const float* rows,
+		const int stride,
+		const float bestCost,
+		float* costs);
+
+	// Widest batch kernel the CPU supports. Fetch it once per search rather
+	// than once per batch.
+	FeatureDistanceBatchKernel GetFeatureDistanceBatchKernel();
+
+	struct FeatureDistanceBenchmark
+	{
+		double ScalarMilliseconds = 0.0;
+		double SSEMilliseconds = 0.0;
+		// Stays at 0 when the CPU doesn't support AVX2.
+		double AVX2Milliseconds = 0.0;
+		// Whether every kernel found the same best pose for every query.
+		bool Consistent = true;
+	};
+
+	// Searches poseCount random poses of featureCount features for the best
+	// match of queryCount random queries with each available kernel.
+	FeatureDistanceBenchmark BenchmarkFeatureDistance(int poseCount, int featureCount, int queryCount, int iterations);
+}
@@ -0,0 +1,61 @@
+// Built with /arch:AVX2, unlike the rest of the executable: nothing here may
+// run before CpuSupportsAVX2 was checked. Only raw pointers and intrinsics are
+// used, so that no inline function of a shared header gets compiled with AVX2
+// and picked by the linker for the other translation units.
+#include "FeatureDistance.h"
+
+#if defined(FEATURE_DISTANCE_AVX2)
+#include <immintrin.h>
+
+namespace Animation
+{
+	// Evaluates FEATURE_DISTANCE_BATCH_AVX2 consecutive rows starting at rows.
+	// Same layout as the SSE kernel, but eight dimensions of each row are
+	// accumulated per fused multiply-add. Eight rows at a time was measured
+	// slower: the eight way horizontal sum costs more than it saves and the
+	// batch early-out triggers less often.
+	void feature_distance_batch_avx2(
+		const float* query,
+		const float* rows,
+		const int stride,
+		const float bestCost,
+		float* costs)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+
+		__m128 best = _mm_set1_ps(bestCost);
+		__m128 sums = _mm_setzero_ps();
+
+		for (int d = 0; d < stride; d += 8)
+		{
+			__m256 q = _mm256_load_ps(query + d);
+			__m256 diff0 = _mm256_sub_ps(q, _mm256_load_ps(rows + d));
+			__m256 diff1 = _mm256_sub_ps(q, _mm256_load_ps(rows + stride + d));
+			__m256 diff2 = _mm256_sub_ps(q, _mm256_load_ps(rows + 2 * stride + d));
+			__m256 diff3 = _mm256_sub_ps(q, _mm256_load_ps(rows + 3 * stride + d));
+			acc0 = _mm256_fmadd_ps(diff0, diff0, acc0);
+			acc1 = _mm256_fmadd_ps(diff1, diff1, acc1);
+			acc2 = _mm256_fmadd_ps(diff2, diff2, acc2);
+			acc3 = _mm256_fmadd_ps(diff3, diff3, acc3);
+
+			bool last = d + 8 >= stride;
+			if (last || ((d + 8) % FEATURE_DISTANCE_EARLY_OUT) == 0)
+			{
+				sums = feature_hsum4(
+					_mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1)),
+					_mm_add_ps(_mm256_castps256_ps128(acc1), _mm256_extractf128_ps(acc1, 1)),
+					_mm_add_ps(_mm256_castps256_ps128(acc2), _mm256_extractf128_ps(acc2, 1)),
+					_mm_add_ps(_mm256_castps256_ps128(acc3), _mm256_extractf128_ps(acc3, 1)));
+
+				if (!last && _mm_movemask_ps(_mm_cmplt_ps(sums, best)) == 0)
+					break;
+			}
+		}
+
+		_mm_storeu_ps(costs, sums);
+	}
+}
+#endif
@@ -52,6 +52,8 @@ namespace Animation
 	}
 
 	bool IKAimJob::Run() {
+		PROFILE_SCOPE("IKAimJob::Run");
+
 		if (!Validate()){
 			return false;
 		}
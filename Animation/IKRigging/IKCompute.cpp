@@ -4,6 +4,8 @@ namespace Animation
 {
 	void IKCompute::Run(IKRig& ik_rig, IKPose& ik_pose)
 	{
+		PROFILE_SCOPE("IKCompute::Run");
+
 		ik_rig.UpdateWorld();
 
 		Hip(ik_rig, ik_pose);
@@ -4,6 +4,8 @@ namespace Animation
 {
 	void IKPose::ApplyRig(IKRig& rig, float dt)
 	{
+		PROFILE_SCOPE("IKPose::ApplyRig");
+
 		rig.pose = *rig.tpose;
 		rig.UpdateWorld();
 
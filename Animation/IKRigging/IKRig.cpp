@@ -9,13 +9,15 @@ namespace Animation
 		this->skeleton = db;
 
 		if (this->tpose != nullptr) {
+			std::vector<Matrix> models;
 			LocalToModelJob ltmJob;
 			ltmJob.skeleton = this->skeleton;
-			ltmJob.input = *this->tpose;
+			ltmJob.input = this->tpose;
+			ltmJob.output = &models;
 			ltmJob.Run(true, false);
 
 			tpose_world.clear();
-			for (auto m : ltmJob.output) {
+			for (auto m : models) {
 				Transform t;
 				m.Decompose(t.mScale.mValue, t.mRot.mValue, t.mTrans.mValue);
 				tpose_world.push_back(t);
@@ -104,13 +106,15 @@ namespace Animation
 
 	void IKRig::UpdateWorld()
 	{
+		std::vector<Matrix> models;
 		LocalToModelJob ltmJob;
 		ltmJob.skeleton = this->skeleton;
-		ltmJob.input = this->pose;
+		ltmJob.input = &this->pose;
+		ltmJob.output = &models;
 		ltmJob.Run(true, false);
 
 		pose_world.clear();
-		for (auto m : ltmJob.output) {
+		for (auto m : models) {
 			pose_world.push_back(Transform::FromMatrix(m));
 		}
 
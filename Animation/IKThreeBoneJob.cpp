@@ -188,6 +188,8 @@ namespace Animation
 
 	bool IKThreeBoneJob::Run()
 	{
+		PROFILE_SCOPE("IKThreeBoneJob::Run");
+
 		const IKThreeBoneConstantSetup setup(*this);
 
 		Vector3 joint0_joint3_j0s;
@@ -257,6 +257,8 @@ namespace Animation
 
 	bool IKTwoBoneJob::Run()
 	{
+		PROFILE_SCOPE("IKTwoBoneJob::Run");
+
 		if (!Validate()) {
 			return false;
 		}
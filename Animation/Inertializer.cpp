@@ -0,0 +1,113 @@
+#include "Inertializer.h"
+
+namespace Animation
+{
+	void Inertializer::Reset(int jointCount)
+	{
+		mJointCount = jointCount;
+		mStride = (jointCount + 3) & ~3;
+
+		mPositionOffsets.assign(3 * mStride, 0.0f);
+		mVelocityOffsets.assign(3 * mStride, 0.0f);
+		mRotationOffsets.assign(3 * mStride, 0.0f);
+		mAngularVelocityOffsets.assign(3 * mStride, 0.0f);
+	}
+
+	void Inertializer::Transition(
+		const std::vector<Transform>& src,
+		const std::vector<Vector3>& srcVelocities,
+		const std::vector<Vector3>& srcAngularVelocities,
+		const std::vector<Transform>& dst,
+		const std::vector<Vector3>& dstVelocities,
+		const std::vector<Vector3>& dstAngularVelocities)
+	{
+		if (src.size() != mJointCount)
+			Reset(src.size());
+
+		assert(dst.size() == mJointCount);
+
+		for (int i = 0; i < mJointCount; i++)
+		{
+			Vector3 offPosition = GetOffset(mPositionOffsets, i);
+			Vector3 offVelocity = GetOffset(mVelocityOffsets, i);
+			inertialize_transition(
+				offPosition,
+				offVelocity,
+				src[i].mTrans.mValue,
+				srcVelocities[i],
+				dst[i].mTrans.mValue,
+				dstVelocities[i]);
+			SetOffset(mPositionOffsets, i, offPosition);
+			SetOffset(mVelocityOffsets, i, offVelocity);
+
+			Quaternion offRotation = quat_from_scaled_angle_axis(GetOffset(mRotationOffsets, i));
+			Vector3 offAngularVelocity = GetOffset(mAngularVelocityOffsets, i);
+			inertialize_transition(
+				offRotation,
+				offAngularVelocity,
+				src[i].mRot.mValue,
+				srcAngularVelocities[i],
+				dst[i].mRot.mValue,
+				dstAngularVelocities[i]);
+			SetOffset(mRotationOffsets, i, quat_to_scaled_angle_axis(offRotation));
+			SetOffset(mAngularVelocityOffsets, i, offAngularVelocity);
+		}
+	}
+
+	void Inertializer::Update(
+		const std::vector<Transform>& input,
+		float halflife,
+		float dt,
+		std::vector<Transform>& output)
+	{
+		if (input.size() != mJointCount)
+			Reset(input.size());
+
+		decay_spring_damper_implicit(mPositionOffsets.data(), mVelocityOffsets.data(), 3 * mStride, halflife, dt);
+		decay_spring_damper_implicit(mRotationOffsets.data(), mAngularVelocityOffsets.data(), 3 * mStride, halflife, dt);
+
+		if (output.size() != mJointCount)
+			output.resize(mJointCount);
+
+		const float* px = &mPositionOffsets[0];
+		const float* py = &mPositionOffsets[mStride];
+		const float* pz = &mPositionOffsets[2 * mStride];
+
+		for (int i = 0; i < mJointCount; i++)
+		{
+			output[i].mTrans.mValue = input[i].mTrans.mValue + Vector3(px[i], py[i], pz[i]);
+			output[i].mRot.mValue = quat_from_scaled_angle_axis(GetOffset(mRotationOffsets, i)) * input[i].mRot.mValue;
+			output[i].mScale.mValue = input[i].mScale.mValue;
+		}
+	}
+
+	void Inertializer::ComputeVelocities(
+		const std::vector<Transform>& pose,
+		const std::vector<Transform>& next,
+		float dt,
+		std::vector<Vector3>& velocities,
+		std::vector<Vector3>& angularVelocities)
+	{
+		velocities.resize(pose.size());
+		angularVelocities.resize(pose.size());
+
+		for (size_t i = 0; i < pose.size(); i++)
+		{
+			velocities[i] = (next[i].mTrans.mValue - pose[i].mTrans.mValue) / dt;
+			angularVelocities[i] = quat_to_scaled_angle_axis(
+				quat_abs(next[i].mRot.mValue * pose[i].mRot.mValue.Inversed())) / dt;
+		}
+	}
+
+	Vector3 Inertializer::GetOffset(const FloatArray& offsets, int joint) const
+	{
+		return Vector3(offsets[joint], offsets[mStride + joint], offsets[2 * mStride + joint]);
+	}
+
+	void Inertializer::SetOffset(FloatArray& offsets, int joint, const Vector3& v)
+	{
+		offsets[joint] = v.x;
+		offsets[mStride + joint] = v.y;
+		offsets[2 * mStride + joint] = v.z;
+	}
+}
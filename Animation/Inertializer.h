@@ -0,0 +1,71 @@
+#pragma once
+#include "Spring.h"
+#include "AnimationKeyframe.h"
+
+namespace Animation
+{
+	///<summary>
+	/// Inertialization of a whole pose. On a transition, the difference between
+	/// the pose we come from and the pose we go to (and between their
+	/// velocities) is stored as an offset, which is then added to the new
+	/// animation and decayed to zero with a critically damped spring.
+	///
+	/// Offsets are stored SoA, rotations as scaled angle axis, so the decay is
+	/// the same few SIMD operations for every joint, whatever the number of
+	/// transitions.
+	///</summary>
+	class Inertializer
+	{
+	public:
+		// Clears the offsets: the next outputs are the inputs.
+		void Reset(int jointCount);
+
+		// Switches from the src pose to the dst pose. Velocities are in the
+		// local space of each joint.
+		void Transition(
+			const std::vector<Transform>& src,
+			const std::vector<Vector3>& srcVelocities,
+			const std::vector<Vector3>& srcAngularVelocities,
+			const std::vector<Transform>& dst,
+			const std::vector<Vector3>& dstVelocities,
+			const std::vector<Vector3>& dstAngularVelocities);
+
+		// Decays the offsets and applies them to the input pose.
+		void Update(
+			const std::vector<Transform>& input,
+			float halflife,
+			float dt,
+			std::vector<Transform>& output);
+
+		int JointCount() const { return mJointCount; }
+
+		// Finite differences between two successive poses.
+		static void ComputeVelocities(
+			const std::vector<Transform>& pose,
+			const std::vector<Transform>& next,
+			float dt,
+			std::vector<Vector3>& velocities,
+			std::vector<Vector3>& angularVelocities);
+
+	private:
+		typedef std::vector<float, AlignedAllocator<float, 16>> FloatArray;
+
+		Vector3 GetOffset(const FloatArray& offsets, int joint) const;
+
+		void SetOffset(FloatArray& offsets, int joint, const Vector3& v);
+
+		int mJointCount = 0;
+
+		// Joint count rounded up to 4
+		int mStride = 0;
+
+		// All components of one axis, then the next: [x..., y..., z...]
+		FloatArray mPositionOffsets;
+
+		FloatArray mVelocityOffsets;
+
+		FloatArray mRotationOffsets;
+
+		FloatArray mAngularVelocityOffsets;
+	};
+}
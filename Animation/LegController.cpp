@@ -36,17 +36,21 @@ namespace Animation
 			return false;
 		}
 
+		std::vector<Matrix> models;
 		LocalToModelJob ltmJob;
 		ltmJob.skeleton = skeleton;
-		ltmJob.input = skeleton->GetBindPose();
+		ltmJob.input = &skeleton->GetBindPose();
+		ltmJob.output = &models;
 		if (!ltmJob.Run(true, true))
 		{
 			// return false;
 		}
 
+		std::vector<Matrix> modelsWithoutOffset;
 		LocalToModelJob ltmJobWithoutOffset;
 		ltmJobWithoutOffset.skeleton = skeleton;
-		ltmJobWithoutOffset.input = skeleton->GetBindPose();
+		ltmJobWithoutOffset.input = &skeleton->GetBindPose();
+		ltmJobWithoutOffset.output = &modelsWithoutOffset;
 		if (!ltmJobWithoutOffset.Run(true, false))
 		{
 			// return false;
@@ -66,9 +70,9 @@ namespace Animation
 			float zAvg = 0.0f;
 
 			Vector3 modelPos;
-			Matrix M = ltmJobWithoutOffset.output[legs[leg].toe];
+			Matrix M = modelsWithoutOffset[legs[leg].toe];
 			legs[leg].toeToetipVector = Vector3(0.0f, 0.0f, -7.0f);//TODO
-			M = ltmJobWithoutOffset.output[legs[leg].ankle];
+			M = modelsWithoutOffset[legs[leg].ankle];
 			legs[leg].ankleHeelVector = Vector3(0.0f, -8.5f, 2.0f);
 
 			//for (auto v : skeleton->GetVertices())
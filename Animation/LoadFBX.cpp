@@ -194,6 +194,10 @@ bool FBXLoader::LoadFBXClip(const std::string& filename, AnimationDatabase& db)
 	animations.clear();
 	ReadAnimationClips(filename,pScene);
 	db.AddAnimation(animations);
+	// The database holds the keys now
+	animations.clear();
+
+	return true;
 }
 
 bool FBXLoader::InitFromScene(const aiScene* pScene,
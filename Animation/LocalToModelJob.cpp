@@ -1,70 +1,287 @@
 #include "LocalToModelJob.h"
+#include <chrono>
+
+using namespace DirectX;
 
 namespace Animation
 {
+	// Builds the affine matrices (scale, rotation then translation) of 4
+	// joints at once: their quaternions and scales are transposed to SoA,
+	// converted together, and the rows are transposed back to one matrix per
+	// joint.
+	static inline void ComputeLocalMatrices4(const Transform* const src[4], Matrix* const dst[4])
+	{
+		XMMATRIX q = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat4(&src[0]->mRot.mValue),
+			XMLoadFloat4(&src[1]->mRot.mValue),
+			XMLoadFloat4(&src[2]->mRot.mValue),
+			XMLoadFloat4(&src[3]->mRot.mValue)));
+
+		XMMATRIX s = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat3(&src[0]->mScale.mValue),
+			XMLoadFloat3(&src[1]->mScale.mValue),
+			XMLoadFloat3(&src[2]->mScale.mValue),
+			XMLoadFloat3(&src[3]->mScale.mValue)));
+
+		const XMVECTOR x = q.r[0];
+		const XMVECTOR y = q.r[1];
+		const XMVECTOR z = q.r[2];
+		const XMVECTOR w = q.r[3];
+		const XMVECTOR one = XMVectorSplatOne();
+		const XMVECTOR two = XMVectorReplicate(2.0f);
+		const XMVECTOR zero = XMVectorZero();
+
+		const XMVECTOR xx = XMVectorMultiply(x, x);
+		const XMVECTOR yy = XMVectorMultiply(y, y);
+		const XMVECTOR zz = XMVectorMultiply(z, z);
+		const XMVECTOR xy = XMVectorMultiply(x, y);
+		const XMVECTOR xz = XMVectorMultiply(x, z);
+		const XMVECTOR yz = XMVectorMultiply(y, z);
+		const XMVECTOR xw = XMVectorMultiply(x, w);
+		const XMVECTOR yw = XMVectorMultiply(y, w);
+		const XMVECTOR zw = XMVectorMultiply(z, w);
+
+		// Same layout as XMMatrixRotationQuaternion, each row scaled
+		const XMVECTOR m00 = XMVectorMultiply(XMVectorNegativeMultiplySubtract(two, XMVectorAdd(yy, zz), one), s.r[0]);
+		const XMVECTOR m01 = XMVectorMultiply(XMVectorMultiply(two, XMVectorAdd(xy, zw)), s.r[0]);
+		const XMVECTOR m02 = XMVectorMultiply(XMVectorMultiply(two, XMVectorSubtract(xz, yw)), s.r[0]);
+
+		const XMVECTOR m10 = XMVectorMultiply(XMVectorMultiply(two, XMVectorSubtract(xy, zw)), s.r[1]);
+		const XMVECTOR m11 = XMVectorMultiply(XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, zz), one), s.r[1]);
+		const XMVECTOR m12 = XMVectorMultiply(XMVectorMultiply(two, XMVectorAdd(yz, xw)), s.r[1]);
+
+		const XMVECTOR m20 = XMVectorMultiply(XMVectorMultiply(two, XMVectorAdd(xz, yw)), s.r[2]);
+		const XMVECTOR m21 = XMVectorMultiply(XMVectorMultiply(two, XMVectorSubtract(yz, xw)), s.r[2]);
+		const XMVECTOR m22 = XMVectorMultiply(XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, yy), one), s.r[2]);
+
+		XMMATRIX rows0 = XMMatrixTranspose(XMMATRIX(m00, m01, m02, zero));
+		XMMATRIX rows1 = XMMatrixTranspose(XMMATRIX(m10, m11, m12, zero));
+		XMMATRIX rows2 = XMMatrixTranspose(XMMATRIX(m20, m21, m22, zero));
+
+		for (int k = 0; k < 4; k++)
+		{
+			XMVECTOR translation = XMVectorSetW(XMLoadFloat3(&src[k]->mTrans.mValue), 1.0f);
+			XMStoreFloat4x4(dst[k], XMMATRIX(rows0.r[k], rows1.r[k], rows2.r[k], translation));
+		}
+	}
+
 	LocalToModelJob::LocalToModelJob()
-		:skeleton(nullptr) {}
+		:skeleton(nullptr), input(nullptr), output(nullptr), from(-1), to(INT_MAX), lod(nullptr), palette(nullptr), paletteFormat(SkinningPaletteFormat::Matrix4x4) {}
 
 	bool LocalToModelJob::Validate() const
 	{
 		bool valid = true;
 
-		if (!skeleton)
+		if (!skeleton || !input || !output)
 		{
 			return false;
 		}
 
+		valid &= input->size() >= skeleton->JointCount();
+		valid &= !lod || lod->mask.size() == skeleton->JointCount();
+
+		// A partial update reads the parents of the joint from in output
+		if (from >= 0)
+		{
+			valid &= from < skeleton->JointCount();
+			valid &= output->size() == skeleton->JointCount();
+		}
+
 		return valid;
 	}
 
 
 	bool LocalToModelJob::Run(bool local, bool offset)
 	{
-		if (!Validate())
+		PROFILE_SCOPE("LocalToModelJob::Run");
+
+		if (!Validate() || (from >= 0 && offset))
 		{
 			return false;
 		}
 
 		int jointNum = skeleton->JointCount();
-		output.clear();
-		output.resize(jointNum);
+		const std::vector<int>& parents = skeleton->GetParentIndex();
+		const std::vector<Transform>& locals = *input;
+		std::vector<Matrix>& models = *output;
 
-		// The root bone has index 0.  The root bone has no parent, so its toRootTransform
-		// is just its local bone transform.
-		Vector3 scale = input[0].mScale.mValue;
-		Vector3 translation;
-		if (local)
-			translation = Vector3(0.0f, input[0].mTrans.mValue.y, 0.0f);
-		else
-			translation = input[0].mTrans.mValue;
-		Quaternion rotation = input[0].mRot.mValue;
-		output[0] = Matrix::CreateAffineTransformation(scale, translation, rotation);
-
-		// Now find the toRootTransform of the children.
-		for (UINT i = 1; i < jointNum; ++i)
+		if (models.size() != jointNum)
+			models.resize(jointNum);
+
+		// Joints of the partial update, parents come first so a joint belongs
+		// to the subtree when its parent does
+		bool partial = from >= 0;
+		int first = partial ? from : 0;
+		int last = partial ? std::min(to, jointNum - 1) : jointNum - 1;
+
+		static thread_local std::vector<char> subtree;
+		if (partial)
 		{
-			Vector3 scale = input[i].mScale.mValue;
-			Vector3 translation = input[i].mTrans.mValue;
-			Quaternion rotation = input[i].mRot.mValue;
-			Matrix toParent = Matrix::CreateAffineTransformation(scale, translation, rotation);
+			subtree.assign(jointNum, 0);
+			subtree[from] = 1;
+		}
+
+		const Transform* src[4];
+		Matrix* dst[4];
+		int joints[4];
+		int count = 0;
+		Matrix padding;
 
-			int parentIndex = skeleton->GetJointParentIndex(i);
+		// The local matrices of a batch are built together, then concatenated
+		// with their parents in index order.
+		auto flush = [&]()
+		{
+			for (int k = count; k < 4; k++)
+			{
+				src[k] = src[0];
+				dst[k] = &padding;
+			}
 
-			output[i] = toParent * output[parentIndex];
+			ComputeLocalMatrices4(src, dst);
+
+			for (int k = 0; k < count; k++)
+			{
+				int i = joints[k];
+				int parentIndex = parents[i];
+
+				if (parentIndex < 0)
+				{
+					// The root bone has no parent, so its toRootTransform
+					// is just its local bone transform.
+					if (local)
+					{
+						models[i]._41 = 0.0f;
+						models[i]._43 = 0.0f;
+					}
+				}
+				else
+				{
+					models[i] = models[i] * models[parentIndex];
+				}
+			}
+
+			count = 0;
+		};
+
+		const uint8_t* mask = lod ? lod->mask.data() : nullptr;
+
+		for (int i = first; i <= last; i++)
+		{
+			if (partial && i != from)
+			{
+				if (parents[i] < 0 || !subtree[parents[i]])
+					continue;
+
+				subtree[i] = 1;
+			}
+
+			if (mask && !mask[i])
+				continue;
+
+			src[count] = &locals[i];
+			dst[count] = &models[i];
+			joints[count] = i;
+
+			if (++count == 4)
+				flush();
+		}
+
+		if (count > 0)
+			flush();
+
+		// Descendants of culled joints are culled too, so none of the joints
+		// above depends on them
+		if (lod)
+		{
+			for (size_t k = 0; k < lod->culled.size(); k++)
+			{
+				int i = lod->culled[k];
+				if (i < first || i > last || (partial && !subtree[i]))
+					continue;
+
+				models[i] = parents[i] < 0 ? lod->culledLocals[k] : lod->culledLocals[k] * models[parents[i]];
+			}
 		}
 
 		if (offset)
 		{
 			// Premultiply by the bone offset transform to get the final transform.
-			for (UINT i = 0; i < jointNum; ++i)
+			for (int i = 0; i < jointNum; ++i)
 			{
-				Matrix offset = skeleton->GetJointOffset(i);
-				Matrix toRoot = output[i];
-				output[i] = (offset * toRoot).Transpose();
+				models[i] = (skeleton->GetJointOffset(i) * models[i]).Transpose();
+			}
+
+			if (palette)
+			{
+				palette->resize((size_t)jointNum * GetSkinningPaletteStride(paletteFormat));
+				WriteSkinningPalette(models.data(), jointNum, paletteFormat, palette->data());
 			}
 		}
-		
 
 		return true;
 	}
-}
\ No newline at end of file
+
+	// The conversion LocalToModelJob::Run replaced: one affine matrix per
+	// joint through SimpleMath, for comparison.
+	static void ScalarLocalToModel(const AnimationDatabase& skeleton, const std::vector<Transform>& input, std::vector<Matrix>& output)
+	{
+		int jointNum = skeleton.JointCount();
+		output.resize(jointNum);
+
+		for (int i = 0; i < jointNum; ++i)
+		{
+			Vector3 translation = input[i].mTrans.mValue;
+			int parentIndex = skeleton.GetJointParentIndex(i);
+			if (parentIndex < 0)
+				translation = Vector3(0.0f, translation.y, 0.0f);
+
+			Matrix toParent = Matrix::CreateAffineTransformation(input[i].mScale.mValue, translation, input[i].mRot.mValue);
+			output[i] = parentIndex < 0 ? toParent : toParent * output[parentIndex];
+		}
+
+		for (int i = 0; i < jointNum; ++i)
+		{
+			output[i] = (skeleton.GetJointOffset(i) * output[i]).Transpose();
+		}
+	}
+
+	LocalToModelBenchmark BenchmarkLocalToModel(const AnimationDatabase& skeleton, const std::vector<Transform>& pose, int iterations)
+	{
+		LocalToModelBenchmark result;
+
+		std::vector<Matrix> batched;
+		std::vector<Matrix> scalar;
+
+		LocalToModelJob job;
+		job.skeleton = &skeleton;
+		job.input = &pose;
+		job.output = &batched;
+
+		if (iterations <= 0 || !job.Validate())
+			return result;
+
+		typedef std::chrono::steady_clock Clock;
+
+		// A pose takes microseconds, each path is timed over all the
+		// iterations at once
+		Clock::time_point start = Clock::now();
+		for (int it = 0; it < iterations; it++)
+			job.Run(true, true);
+		result.BatchedMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+
+		start = Clock::now();
+		for (int it = 0; it < iterations; it++)
+			ScalarLocalToModel(skeleton, pose, scalar);
+		result.ScalarMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+
+		for (size_t i = 0; i < batched.size(); i++)
+		{
+			const float* a = &batched[i]._11;
+			const float* b = &scalar[i]._11;
+			for (int e = 0; e < 16; e++)
+				result.MaxError = std::max(result.MaxError, fabsf(a[e] - b[e]));
+		}
+
+		return result;
+	}
+}
@@ -1,22 +1,66 @@
 #pragma once
 #include"AnimationDatabase.h"
+#include"SkeletonLod.h"
+#include"SkinningPalette.h"
 
 namespace Animation
 {
 	//class Skeleton;
 
+	// Computes the model space matrices of a skeleton from its local
+	// transforms. Local matrices are built 4 joints at a time with SIMD, the
+	// hierarchy is then walked in index order, parents always come before
+	// their children.
 	struct LocalToModelJob
 	{
 		LocalToModelJob();
 
 		bool Validate() const;
 
+		// local: keeps only the height of the root translation.
+		// offset: premultiplies by the joint offsets and transposes, to get
+		// skinning matrices. Can't be combined with a partial update, as the
+		// parents must be in model space.
 		bool Run(bool local = true, bool offset = true);
 
 		const AnimationDatabase* skeleton;
 
-		std::vector<Transform> input;
+		// Caller owned buffers. output is only resized when its size doesn't
+		// match the skeleton.
+		const std::vector<Transform>* input;
 
-		std::vector<Matrix> output;
+		std::vector<Matrix>* output;
+
+		// Partial update: only the joint from and its descendants up to the
+		// joint to are computed, the others must already be in output (e.g.
+		// recomputing a leg after IK). from = -1 updates every joint.
+		int from;
+
+		int to;
+
+		// Optional, the culled joints are not read from input and follow
+		// their parent with their bind pose local transform.
+		const SkeletonLodLevel* lod;
+
+		// Optional, also packs the skinning matrices in paletteFormat when
+		// offset is applied. Resized to the skeleton.
+		std::vector<float>* palette;
+
+		SkinningPaletteFormat paletteFormat;
 	};
-}
\ No newline at end of file
+
+	struct LocalToModelBenchmark
+	{
+		double BatchedMilliseconds = 0.0;
+
+		double ScalarMilliseconds = 0.0;
+
+		// Largest difference between the matrices of the two paths
+		float MaxError = 0.0f;
+	};
+
+	// Runs the job on pose, an AoS pose of the skeleton, against the former
+	// one joint at a time conversion, with the root kept local and the
+	// offsets applied as for skinning.
+	LocalToModelBenchmark BenchmarkLocalToModel(const AnimationDatabase& skeleton, const std::vector<Transform>& pose, int iterations);
+}
@@ -12,6 +12,10 @@ namespace Animation
 
 		sampleNum = 50;
 
+		// Both legs are analyzed on the same poses. Every slot is probed, so the
+		// poses of the first leg all stay in the cache for the second one.
+		SampledPoseCache cache(sampleNum + 1, 1e-4f, sampleNum + 1);
+
 		for (size_t leg = 0; leg < 2; leg++)
 		{
 			int hip = legC->legs[leg].hip;
@@ -26,16 +30,19 @@ namespace Animation
 			cycles[leg].toeMax = std::numeric_limits<float>::lowest();
 			// Foot stance time
 			// Find the time when the foot stands most firmly on the ground.
+			std::vector<Matrix> models;
 			for (int i = 0; i < sampleNum + 1; ++i)
 			{
 				SamplingJob samplingJob;
 				samplingJob.animation = animation;
 				samplingJob.ratio = (float)i / (float)sampleNum;
+				samplingJob.cache = &cache;
 				samplingJob.Run();
 				
 				LocalToModelJob ltmJob;
 				ltmJob.skeleton = legC->skeleton;
-				ltmJob.input = samplingJob.output;
+				ltmJob.input = &samplingJob.output;
+				ltmJob.output = &models;
 				ltmJob.Run(true, false);
 
 				//char out[100];
@@ -43,9 +50,9 @@ namespace Animation
 				//Debug::Log(LOG_LEVEL::LOG_LEVEL_INFO, "Analyze", "MotionAnalyzer", 196, out);
 
 				LegCycleSample sample;
-				sample.knee = Vector3::Transform(Vector3::Zero, ltmJob.output[knee]);
-				sample.heel = Vector3::Transform(legC->legs[leg].ankleHeelVector, ltmJob.output[ankle]);
-				sample.toetip = Vector3::Transform(legC->legs[leg].toeToetipVector, ltmJob.output[toe]);
+				sample.knee = Vector3::Transform(Vector3::Zero, models[knee]);
+				sample.heel = Vector3::Transform(legC->legs[leg].ankleHeelVector, models[ankle]);
+				sample.toetip = Vector3::Transform(legC->legs[leg].toeToetipVector, models[toe]);
 				sample.middle = (sample.heel + sample.toetip) / 2;
 				if (i == 0)	legC->legs[leg].footLength = (sample.toetip - sample.heel).Length();
 				// For each sample in time we want to know if the heel or toetip is closer to the ground.
@@ -1,4 +1,5 @@
 #include "MotionMatchingJob.h"
+#include <chrono>
 
 namespace Animation
 {
@@ -29,4 +30,75 @@ namespace Animation
 			bone_rotation = bone_transforms[bone].mRot.mValue;
 		}
 	}
-}
\ No newline at end of file
+
+	MotionMatchingSearchBenchmark BenchmarkMotionMatchingSearch(MotionMatchingJob& job, int queryCount, int iterations)
+	{
+		MotionMatchingSearchBenchmark result;
+		if (job.matcherData.rows == 0 || queryCount <= 0 || iterations <= 0)
+			return result;
+
+		// Database poses moved by up to half a std on every dimension
+		std::vector<std::vector<float>> queries(queryCount);
+		unsigned int seed = 1;
+		for (int q = 0; q < queryCount; q++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			std::vector<float> normalized = job.matcherData.get_row((seed >> 8) % job.matcherData.rows);
+			for (float& value : normalized)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				value += (float(seed >> 8) / float(1 << 24) - 0.5f);
+			}
+			queries[q] = job.DenormalizeFeature(normalized);
+		}
+
+		const float savedCost = job.bestCost;
+		const int savedIndex = job.bestIndex;
+		const bool savedUseBounds = job.useBounds;
+
+		std::vector<int> bestIndices[2];
+		std::vector<float> bestCosts[2];
+		double milliseconds[2] = {};
+
+		for (int it = 0; it < iterations; it++)
+		{
+			for (int pass = 0; pass < 2; pass++)
+			{
+				job.useBounds = pass == 0;
+				bestIndices[pass].resize(queryCount);
+				bestCosts[pass].resize(queryCount);
+
+				auto start = std::chrono::steady_clock::now();
+				for (int q = 0; q < queryCount; q++)
+				{
+					job.bestCost = FLT_MAX;
+					job.bestIndex = -1;
+					job.Run(queries[q]);
+					bestIndices[pass][q] = job.bestIndex;
+					bestCosts[pass][q] = job.bestCost;
+				}
+				milliseconds[pass] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+		}
+
+		// The box costs are summed in another order than the pose costs, so
+		// a pose can lose to another one within rounding of its cost
+		for (int q = 0; q < queryCount; q++)
+		{
+			if (bestIndices[0][q] != bestIndices[1][q] &&
+				fabsf(bestCosts[0][q] - bestCosts[1][q]) > 1e-5f * maxf(1.0f, bestCosts[1][q]))
+			{
+				result.Mismatches++;
+			}
+		}
+
+		result.PrunedMilliseconds = milliseconds[0] / iterations;
+		result.BruteForceMilliseconds = milliseconds[1] / iterations;
+
+		job.bestCost = savedCost;
+		job.bestIndex = savedIndex;
+		job.useBounds = savedUseBounds;
+
+		return result;
+	}
+}
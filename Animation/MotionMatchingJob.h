@@ -1,34 +1,47 @@
 #pragma once
 #include "Spring.h"
 #include "AnimationDatabase.h"
+#include "FeatureDistance.h"
+#include "../Common/ThreadPool.h"
 using namespace DirectX::SimpleMath;
 
 // Reference: https://www.youtube.com/watch?v=jcpIrw38E-s
 
 namespace Animation
 {
+	// Row-major 2D array. Rows are padded with zeros to a multiple of
+	// FEATURE_DISTANCE_PADDING elements and the storage is 32 bytes aligned,
+	// so that rows can be fed to the SIMD distance kernels directly.
 	template<typename T>
 	struct Array2D
 	{
-		int rows, cols;
+		int rows, cols, stride;
 
-		std::vector<T> data;
+		std::vector<T, AlignedAllocator<T, 32>> data;
 
-		Array2D() : rows(0), cols(0) { data.resize(rows * cols); }
+		Array2D() : rows(0), cols(0), stride(0) {}
 
-		Array2D(int r, int c) : rows(r), cols(c) { data.resize(rows * cols); }
+		Array2D(int r, int c) : rows(r), cols(c), stride(Align(c, FEATURE_DISTANCE_PADDING)) { data.resize(rows * stride); }
 
-		T& get(int r, int c) { return data[cols * r + c]; }
+		T& get(int r, int c) { return data[stride * r + c]; }
 
-		const T& get(int r, int c) const { return data[cols * r + c]; }
+		const T& get(int r, int c) const { return data[stride * r + c]; }
+
+		T* row(int r) { return data.data() + stride * r; }
+
+		const T* row(int r) const { return data.data() + stride * r; }
 
 		std::vector<T> get_row(int r) const {
-			std::vector<T> row;
-			for (int i = 0; i < cols; i++)
-			{
-				row.push_back(data[cols * r + i]);
-			}
-			return row;
+			return std::vector<T>(row(r), row(r) + cols);
+		}
+
+		// New rows are zeroed.
+		void resize_rows(int r) { rows = r; data.resize((size_t)rows * stride); }
+
+		void erase_rows(int first, int count)
+		{
+			data.erase(data.begin() + (size_t)first * stride, data.begin() + (size_t)(first + count) * stride);
+			rows -= count;
 		}
 	};
 
@@ -48,6 +61,69 @@ namespace Animation
 		std::vector<Quaternion> trajectory_rotations;
 	};
 
+	// Model space transforms of the joints of one database pose. They are
+	// computed on demand and shared by all the features evaluated for that
+	// pose, so that joints common to several chains are only solved once.
+	struct PoseModelCache
+	{
+		void Reset(const AnimationDatabase& db, int poseIndex)
+		{
+			localPositions = db.GetPosePositions(poseIndex);
+			localRotations = db.GetPoseRotations(poseIndex);
+			parents = &db.GetParentIndex();
+
+			if (positions.size() != parents->size())
+			{
+				positions.resize(parents->size());
+				rotations.resize(parents->size());
+				stamps.assign(parents->size(), 0);
+			}
+
+			stamp++;
+		}
+
+		void GetModelTransform(int bone, Vector3& bone_position, Quaternion& bone_rotation)
+		{
+			if (stamps[bone] != stamp)
+			{
+				int parent = (*parents)[bone];
+				if (parent != -1)
+				{
+					Vector3 parent_position;
+					Quaternion parent_rotation;
+					GetModelTransform(parent, parent_position, parent_rotation);
+
+					positions[bone] = quat_mul_vec3(parent_rotation, localPositions[bone]) + parent_position;
+					rotations[bone] = parent_rotation * localRotations[bone];
+				}
+				else
+				{
+					positions[bone] = localPositions[bone];
+					rotations[bone] = localRotations[bone];
+				}
+
+				stamps[bone] = stamp;
+			}
+
+			bone_position = positions[bone];
+			bone_rotation = rotations[bone];
+		}
+
+		const Vector3* localPositions = nullptr;
+
+		const Quaternion* localRotations = nullptr;
+
+		const std::vector<int>* parents = nullptr;
+
+		std::vector<Vector3> positions;
+
+		std::vector<Quaternion> rotations;
+
+		std::vector<int> stamps;
+
+		int stamp = 0;
+	};
+
 	struct Feature
 	{
 		virtual int Size() const = 0;
@@ -55,7 +131,8 @@ namespace Animation
 		virtual void EvaluateForAnimationPose(
 			float* ResultLocation,
 			const AnimationDatabase& animDatabase,
-			int poseIndex
+			int poseIndex,
+			PoseModelCache& cache
 		) const = 0;
 
 		virtual void EvaluateForRuntimeGuy(
@@ -63,6 +140,13 @@ namespace Animation
 			const RuntimeCharacterData& runtimeData
 		) const = 0;
 
+		// Hashes every setting the evaluated values depend on, so that
+		// features computed with another configuration are not reused.
+		virtual void HashConfig(size_t& seed) const
+		{
+			HashCombine(seed, Size(), weight);
+		}
+
 		float weight = 1.0f;
 	};
 
@@ -75,12 +159,10 @@ namespace Animation
 		virtual void EvaluateForAnimationPose(
 			float* ResultLocation,
 			const AnimationDatabase& db,
-			int poseIndex
+			int poseIndex,
+			PoseModelCache& cache
 		) const override
 		{
-			std::vector<Transform> transforms = db.GetTransformsAtPoseId(poseIndex);
-
-			int interval = 20;
 			int t0 = db.ClampDatabaseTrajectoryIndex(poseIndex, interval);
 			int t1 = db.ClampDatabaseTrajectoryIndex(poseIndex, 2 * interval);
 			int t2 = db.ClampDatabaseTrajectoryIndex(poseIndex, 3 * interval);
@@ -119,6 +201,15 @@ namespace Animation
 			ResultLocation[i++] = traj2.x;
 			ResultLocation[i++] = traj2.z;
 		}
+
+		virtual void HashConfig(size_t& seed) const override
+		{
+			Feature::HashConfig(seed);
+			HashCombine(seed, interval);
+		}
+
+		// Poses between the samples of the trajectory
+		int interval = 20;
 	};
 
 	struct TrajectoryDirectionFeature : Feature {
@@ -130,10 +221,10 @@ namespace Animation
 		virtual void EvaluateForAnimationPose(
 			float* ResultLocation,
 			const AnimationDatabase& db,
-			int poseIndex
+			int poseIndex,
+			PoseModelCache& cache
 		) const override
 		{
-			int interval = 20;
 			int t0 = db.ClampDatabaseTrajectoryIndex(poseIndex, interval);
 			int t1 = db.ClampDatabaseTrajectoryIndex(poseIndex, 2 * interval);
 			int t2 = db.ClampDatabaseTrajectoryIndex(poseIndex, 3 * interval);
@@ -170,6 +261,15 @@ namespace Animation
 			ResultLocation[i++] = traj2.z;
 
 		}
+
+		virtual void HashConfig(size_t& seed) const override
+		{
+			Feature::HashConfig(seed);
+			HashCombine(seed, interval);
+		}
+
+		// Poses between the samples of the trajectory
+		int interval = 20;
 	};
 
 	void ForwardKinematics(
@@ -188,24 +288,18 @@ namespace Animation
 		virtual void EvaluateForAnimationPose(
 			float* ResultLocation,
 			const AnimationDatabase& db,
-			int poseIndex
+			int poseIndex,
+			PoseModelCache& cache
 		) const override
 		{
-
-			int leftFootId = 46; // Hard coding for now
-			// 46 50
 			Vector3 bone_position;
 			Quaternion bone_rotation;
 
-			std::vector<Transform> transform = db.GetTransformsAtPoseId(poseIndex);
-			ForwardKinematics(
-				bone_position,
-				bone_rotation,
-				transform,
-				db.GetParentIndex(),
-				leftFootId);
+			cache.GetModelTransform(boneIndex, bone_position, bone_rotation);
 
-			bone_position = quat_inv_mul_vec3(transform[0].mRot.mValue, bone_position - transform[0].mTrans.mValue);
+			const Vector3* positions = db.GetPosePositions(poseIndex);
+			const Quaternion* rotations = db.GetPoseRotations(poseIndex);
+			bone_position = quat_inv_mul_vec3(rotations[0], bone_position - positions[0]);
 
 			// Need trasform the coordinate relative to simulation rotation
 			ResultLocation[0] = bone_position.x;
@@ -219,8 +313,6 @@ namespace Animation
 			const RuntimeCharacterData& runtimeData
 		) const override
 		{
-			int leftFootId = 46; // Hard coding for now
-			// 46 50
 			Vector3 bone_position;
 			Quaternion bone_rotation;
 
@@ -229,7 +321,7 @@ namespace Animation
 				bone_rotation,
 				runtimeData.transforms,
 				runtimeData.parent_index,
-				leftFootId);
+				boneIndex);
 
 			bone_position = quat_inv_mul_vec3(runtimeData.transforms[0].mRot.mValue, bone_position - runtimeData.transforms[0].mTrans.mValue);
 
@@ -239,6 +331,14 @@ namespace Animation
 			ResultLocation[2] = bone_position.z;
 
 		}
+
+		virtual void HashConfig(size_t& seed) const override
+		{
+			Feature::HashConfig(seed);
+			HashCombine(seed, boneIndex);
+		}
+
+		int boneIndex = 46; // Hard coding for now
 	};
 
 	struct RightFootPositionFeature :Feature {
@@ -250,24 +350,18 @@ namespace Animation
 		virtual void EvaluateForAnimationPose(
 			float* ResultLocation,
 			const AnimationDatabase& db,
-			int poseIndex
+			int poseIndex,
+			PoseModelCache& cache
 		) const override
 		{
-
-			int RightFootId = 50; // Hard coding for now
-			// 46 50
 			Vector3 bone_position;
 			Quaternion bone_rotation;
 
-			std::vector<Transform> transform = db.GetTransformsAtPoseId(poseIndex);
-			ForwardKinematics(
-				bone_position,
-				bone_rotation,
-				transform,
-				db.GetParentIndex(),
-				RightFootId);
+			cache.GetModelTransform(boneIndex, bone_position, bone_rotation);
 
-			bone_position = quat_inv_mul_vec3(transform[0].mRot.mValue, bone_position - transform[0].mTrans.mValue);
+			const Vector3* positions = db.GetPosePositions(poseIndex);
+			const Quaternion* rotations = db.GetPoseRotations(poseIndex);
+			bone_position = quat_inv_mul_vec3(rotations[0], bone_position - positions[0]);
 
 			// Need trasform the coordinate relative to simulation rotation
 			ResultLocation[0] = bone_position.x;
@@ -281,8 +375,6 @@ namespace Animation
 			const RuntimeCharacterData& runtimeData
 		) const override
 		{
-			int leftFootId = 50; // Hard coding for now
-			// 46 50
 			Vector3 bone_position;
 			Quaternion bone_rotation;
 
@@ -291,7 +383,7 @@ namespace Animation
 				bone_rotation,
 				runtimeData.transforms,
 				runtimeData.parent_index,
-				leftFootId);
+				boneIndex);
 
 			bone_position = quat_inv_mul_vec3(runtimeData.transforms[0].mRot.mValue, bone_position - runtimeData.transforms[0].mTrans.mValue);
 
@@ -301,6 +393,14 @@ namespace Animation
 			ResultLocation[2] = bone_position.z;
 
 		}
+
+		virtual void HashConfig(size_t& seed) const override
+		{
+			Feature::HashConfig(seed);
+			HashCombine(seed, boneIndex);
+		}
+
+		int boneIndex = 50; // Hard coding for now
 	};
 
 	struct FeatureArray
@@ -334,133 +434,610 @@ namespace Animation
 	public:
 		MotionMatchingJob() {}
 
-		void Build()
+		void SetupFeatures()
 		{
+			featureArray.features.clear();
 			featureArray.features.push_back(&trajectoryPositionFeature);
 			featureArray.features.push_back(&trajectoryDirectionFeature);
 			featureArray.features.push_back(&leftFootPositionFeature);
 			featureArray.features.push_back(&rightFootPositionFeature);
 
 			featureArray.ComputeOffset();
+		}
+
+		// Evaluates and normalizes the features of every pose of the database.
+		// When cachePrefix is set, the result is read from the cache file of
+		// the poses and features if there is one, and written to it
+		// otherwise.
+		void Build()
+		{
+			PROFILE_SCOPE("MotionMatchingJob::Build");
+
+			SetupFeatures();
+
+			size_t cacheKey = 0;
+			std::string cacheFilename;
+			if (!cachePrefix.empty())
+			{
+				cacheKey = ComputeCacheKey();
+				cacheFilename = GetCacheFilename(cacheKey);
+				if (LoadCache(cacheFilename, cacheKey))
+				{
+					featureStatsValid = false;
+					BuildBounds();
+					return;
+				}
+			}
 
 			int pointCount = animDatabase->totalPoseCount;
 			int dimCount = featureArray.totalDimCount;
 
 			matcherData = Array2D<float>(pointCount, dimCount);
-			featuresOffset.resize(dimCount);
-			featuresScale.resize(dimCount);
+			EvaluatePoses(0, pointCount);
 
-			for (int featureIndex = 0; featureIndex < featureArray.features.size(); featureIndex++)
+			ResetFeatureStats();
+			for (int poseIndex = 0; poseIndex < pointCount; poseIndex++)
 			{
-				Feature* feature = featureArray.features[featureIndex];
-				int featureDimOffset = featureArray.offsets[featureIndex];
+				AddFeatureStats(matcherData.row(poseIndex));
+			}
 
-				for (int poseIndex = 0; poseIndex < pointCount; poseIndex++)
+			ComputeNormalization(featuresOffset, featuresScale);
+			NormalizeRows(0, pointCount);
+
+			BuildBounds();
+
+			if (!cacheFilename.empty())
+			{
+				SaveCache(cacheFilename, cacheKey);
+			}
+		}
+
+		// Appends the features of the poses of a clip just added to the
+		// database, instead of rebuilding everything. The rows are normalized
+		// with the current offsets and scales, which are only updated when
+		// the statistics of the database drifted too far from them.
+		void AddPoses(int firstPose, int poseCount)
+		{
+			PROFILE_SCOPE("MotionMatchingJob::AddPoses");
+
+			if (matcherData.stride == 0 || firstPose != matcherData.rows ||
+				firstPose + poseCount != animDatabase->totalPoseCount)
+			{
+				Build();
+				return;
+			}
+
+			EnsureFeatureStats();
+
+			int end = firstPose + poseCount;
+			matcherData.resize_rows(end);
+			EvaluatePoses(firstPose, end);
+
+			for (int poseIndex = firstPose; poseIndex < end; poseIndex++)
+			{
+				AddFeatureStats(matcherData.row(poseIndex));
+			}
+
+			NormalizeRows(firstPose, end);
+			UpdateBounds(firstPose);
+			Renormalize(false);
+		}
+
+		// Removes the features of the poses of a clip just removed from the
+		// database. The following poses move down.
+		void RemovePoses(int firstPose, int poseCount)
+		{
+			if (matcherData.stride == 0 || firstPose + poseCount > matcherData.rows ||
+				matcherData.rows - poseCount != animDatabase->totalPoseCount)
+			{
+				Build();
+				return;
+			}
+
+			EnsureFeatureStats();
+
+			std::vector<float> raw(matcherData.cols);
+			for (int poseIndex = firstPose; poseIndex < firstPose + poseCount; poseIndex++)
+			{
+				for (int dimIndex = 0; dimIndex < matcherData.cols; dimIndex++)
 				{
+					raw[dimIndex] = matcherData.get(poseIndex, dimIndex) * featuresScale[dimIndex] + featuresOffset[dimIndex];
+				}
+				RemoveFeatureStats(raw.data());
+			}
+
+			matcherData.erase_rows(firstPose, poseCount);
+			UpdateBounds(firstPose);
+			Renormalize(false);
+
+			if (bestIndex >= firstPose + poseCount)
+				bestIndex -= poseCount;
+			else if (bestIndex >= firstPose)
+				bestIndex = -1;
+		}
 
-					feature->EvaluateForAnimationPose(
-						&matcherData.get(poseIndex, featureDimOffset),
-						*animDatabase,
-						poseIndex
-					);
+		// Evaluates the raw features of the poses [begin, end). All the
+		// features of a pose are evaluated together so that they share its
+		// model space transforms, and the poses are spread over the thread
+		// pool.
+		void EvaluatePoses(int begin, int end)
+		{
+			ThreadPool::For(end - begin, 256, [this, begin](int first, int last)
+			{
+				PoseModelCache cache;
+				for (int poseIndex = begin + first; poseIndex < begin + last; poseIndex++)
+				{
+					cache.Reset(*animDatabase, poseIndex);
+
+					for (int featureIndex = 0; featureIndex < featureArray.features.size(); featureIndex++)
+					{
+						featureArray.features[featureIndex]->EvaluateForAnimationPose(
+							&matcherData.get(poseIndex, featureArray.offsets[featureIndex]),
+							*animDatabase,
+							poseIndex,
+							cache
+						);
+					}
 				}
+			});
+		}
 
-				NormalizeFeature(feature, featureDimOffset, 1.0f);
+		// One file per key, so that characters with other databases or
+		// features don't keep overwriting each other's cache.
+		std::string GetCacheFilename(size_t key) const
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "%016llx.cache", (unsigned long long)key);
+			return cachePrefix + name;
+		}
+
+		// Identifies the feature configuration: the features, their settings
+		// and the way they are evaluated.
+		size_t ComputeFeatureHash() const
+		{
+			size_t seed = 0;
+			HashCombine(seed, (int)FEATURE_CACHE_VERSION, featureArray.totalDimCount);
+			for (const Feature* feature : featureArray.features)
+			{
+				feature->HashConfig(seed);
 			}
+			return seed;
 		}
 
+		// Identifies the poses of the database and the feature configuration.
+		size_t ComputeCacheKey() const
+		{
+			size_t seed = animDatabase->ComputePoseHash();
+			HashCombine(seed, ComputeFeatureHash());
+			return seed;
+		}
 
-		bool Run(std::vector<float> queryPoint)
+		bool LoadCache(const std::string& filename, size_t key)
 		{
-			// Normalize Query
-			std::vector<float> normalizedQuery;
-			for (int i = 0; i < queryPoint.size(); i++)
+			FILE* f = fopen(filename.c_str(), "rb");
+			if (f == NULL)
+			{
+				return false;
+			}
+
+			FeatureCacheHeader header = {};
+			bool valid = fread(&header, sizeof(FeatureCacheHeader), 1, f) == 1
+				&& header.magic == FEATURE_CACHE_MAGIC
+				&& header.version == FEATURE_CACHE_VERSION
+				&& header.key == key
+				&& header.rows == animDatabase->totalPoseCount
+				&& header.cols == featureArray.totalDimCount;
+
+			if (valid)
+			{
+				matcherData = Array2D<float>(header.rows, header.cols);
+				featuresOffset.resize(header.cols);
+				featuresScale.resize(header.cols);
+
+				valid = header.stride == matcherData.stride
+					&& fread(featuresOffset.data(), sizeof(float), header.cols, f) == header.cols
+					&& fread(featuresScale.data(), sizeof(float), header.cols, f) == header.cols
+					&& fread(matcherData.data.data(), sizeof(float), matcherData.data.size(), f) == matcherData.data.size();
+			}
+
+			fclose(f);
+			return valid;
+		}
+
+		bool SaveCache(const std::string& filename, size_t key) const
+		{
+			FILE* f = fopen(filename.c_str(), "wb");
+			if (f == NULL)
 			{
-				normalizedQuery.push_back((queryPoint[i] - featuresOffset[i]) / featuresScale[i]);
+				LOG_WARNING("Failed to write motion matching cache " + filename);
+				return false;
 			}
 
-			// Search
+			FeatureCacheHeader header = {};
+			header.magic = FEATURE_CACHE_MAGIC;
+			header.version = FEATURE_CACHE_VERSION;
+			header.key = key;
+			header.rows = matcherData.rows;
+			header.cols = matcherData.cols;
+			header.stride = matcherData.stride;
+
+			bool written = fwrite(&header, sizeof(FeatureCacheHeader), 1, f) == 1
+				&& fwrite(featuresOffset.data(), sizeof(float), header.cols, f) == header.cols
+				&& fwrite(featuresScale.data(), sizeof(float), header.cols, f) == header.cols
+				&& fwrite(matcherData.data.data(), sizeof(float), matcherData.data.size(), f) == matcherData.data.size();
+
+			fclose(f);
+			return written;
+		}
+
+		// Reads the normalized features precomputed in a database file instead
+		// of evaluating them. Fails when the file has none, or when they were
+		// computed with another feature configuration.
+		bool Load(const AnimationDatabaseFile& file)
+		{
+			SetupFeatures();
+
+			const DatabaseFileHeader& header = file.GetHeader();
+			if (!file.HasSection(DatabaseSection::Features) ||
+				header.featureHash != ComputeFeatureHash() ||
+				header.featureDimCount != featureArray.totalDimCount ||
+				header.poseCount != animDatabase->totalPoseCount)
+			{
+				return false;
+			}
 
-			for (int poseIndex = 0; poseIndex < matcherData.rows; poseIndex++)
+			matcherData = Array2D<float>(header.poseCount, header.featureDimCount);
+			if (header.featureStride != matcherData.stride)
 			{
+				return false;
+			}
 
-				if (poseIndex + 10 > animDatabase->rangeStops[poseIndex])
-					continue;
+			const float* features = file.GetSection<float>(DatabaseSection::Features);
+			std::copy(features, features + matcherData.data.size(), matcherData.data.begin());
 
-				float currCost = 0.0f;
+			const float* offset = file.GetSection<float>(DatabaseSection::FeatureOffsets);
+			const float* scale = file.GetSection<float>(DatabaseSection::FeatureScales);
+			featuresOffset.assign(offset, offset + header.featureDimCount);
+			featuresScale.assign(scale, scale + header.featureDimCount);
+
+			featureStatsValid = false;
+			BuildBounds();
+			return true;
+		}
+
+		DatabaseFeatureData GetFeatureData() const
+		{
+			DatabaseFeatureData features;
+			features.rows = matcherData.rows;
+			features.cols = matcherData.cols;
+			features.stride = matcherData.stride;
+			features.data = matcherData.data.data();
+			features.offset = featuresOffset.data();
+			features.scale = featuresScale.data();
+			features.hash = ComputeFeatureHash();
+			return features;
+		}
+
+		// Computes the AABBs of the normalized features over small and large
+		// consecutive segments of poses. A query whose distance to a box is
+		// already above the best cost can't match any pose inside it, so Run
+		// skips the whole segment. The result stays exact.
+		void BuildBounds()
+		{
+			boundSmMin = Array2D<float>(0, matcherData.cols);
+			boundSmMax = Array2D<float>(0, matcherData.cols);
+			boundLrMin = Array2D<float>(0, matcherData.cols);
+			boundLrMax = Array2D<float>(0, matcherData.cols);
+
+			UpdateBounds(0);
+		}
+
+		// Recomputes the boxes holding the poses from firstRow on, after
+		// poses were appended or removed.
+		void UpdateBounds(int firstRow)
+		{
+			int smCount = (matcherData.rows + BOUND_SM_SIZE - 1) / BOUND_SM_SIZE;
+			int lrCount = (matcherData.rows + BOUND_LR_SIZE - 1) / BOUND_LR_SIZE;
+
+			boundSmMin.resize_rows(smCount);
+			boundSmMax.resize_rows(smCount);
+			boundLrMin.resize_rows(lrCount);
+			boundLrMax.resize_rows(lrCount);
+
+			// Large boxes are made of whole small ones
+			int smFirst = firstRow / BOUND_SM_SIZE;
+			int lrFirst = firstRow / BOUND_LR_SIZE;
+
+			std::fill(boundSmMin.data.begin() + (size_t)smFirst * boundSmMin.stride, boundSmMin.data.end(), FLT_MAX);
+			std::fill(boundSmMax.data.begin() + (size_t)smFirst * boundSmMax.stride, boundSmMax.data.end(), -FLT_MAX);
+			std::fill(boundLrMin.data.begin() + (size_t)lrFirst * boundLrMin.stride, boundLrMin.data.end(), FLT_MAX);
+			std::fill(boundLrMax.data.begin() + (size_t)lrFirst * boundLrMax.stride, boundLrMax.data.end(), -FLT_MAX);
+
+			for (int poseIndex = lrFirst * BOUND_LR_SIZE; poseIndex < matcherData.rows; poseIndex++)
+			{
+				int iSm = poseIndex / BOUND_SM_SIZE;
+				int iLr = poseIndex / BOUND_LR_SIZE;
 
 				for (int dimIndex = 0; dimIndex < matcherData.cols; dimIndex++)
 				{
-					float distanceForThisDim = normalizedQuery[dimIndex] - matcherData.get(poseIndex, dimIndex);
-					currCost += distanceForThisDim * distanceForThisDim;
+					float value = matcherData.get(poseIndex, dimIndex);
+					if (iSm >= smFirst)
+					{
+						boundSmMin.get(iSm, dimIndex) = minf(boundSmMin.get(iSm, dimIndex), value);
+						boundSmMax.get(iSm, dimIndex) = maxf(boundSmMax.get(iSm, dimIndex), value);
+					}
+					boundLrMin.get(iLr, dimIndex) = minf(boundLrMin.get(iLr, dimIndex), value);
+					boundLrMax.get(iLr, dimIndex) = maxf(boundLrMax.get(iLr, dimIndex), value);
 				}
+			}
+		}
+
+
+		bool Run(const std::vector<float>& queryPoint)
+		{
+			PROFILE_SCOPE("MotionMatchingJob::Run");
 
-				if (currCost < bestCost)
+			// Normalize Query, keeping the padding of the rows zeroed
+			normalizedQuery.assign(matcherData.stride, 0.0f);
+			for (int i = 0; i < queryPoint.size(); i++)
+			{
+				normalizedQuery[i] = (queryPoint[i] - featuresOffset[i]) / featuresScale[i];
+			}
+
+			const float* query = normalizedQuery.data();
+			FeatureDistanceBatchKernel batchKernel = GetFeatureDistanceBatchKernel();
+
+			// Search one animation range at a time, so that the poses too close
+			// to the end of their clip can be ignored.
+			for (int rangeStart = 0; rangeStart < matcherData.rows; rangeStart = animDatabase->rangeStops[rangeStart])
+			{
+				int rangeEnd = animDatabase->rangeStops[rangeStart] - ignoreRangeEnd + 1;
+
+				int i = rangeStart;
+				while (i < rangeEnd)
 				{
-					bestCost = currCost;
-					bestIndex = poseIndex;
+					// Test the large bounding box first
+					int iLr = i / BOUND_LR_SIZE;
+					int iLrNext = (iLr + 1) * BOUND_LR_SIZE;
+
+					if (useBounds && BoundCost(boundLrMin, boundLrMax, iLr, query) >= bestCost)
+					{
+						i = iLrNext;
+						continue;
+					}
+
+					while (i < iLrNext && i < rangeEnd)
+					{
+						// Then the small one
+						int iSm = i / BOUND_SM_SIZE;
+						int iSmNext = (iSm + 1) * BOUND_SM_SIZE;
+
+						if (useBounds && BoundCost(boundSmMin, boundSmMax, iSm, query) >= bestCost)
+						{
+							i = iSmNext;
+							continue;
+						}
+
+						// Finally every pose inside of it, a batch at a time
+						while (i < iSmNext && i < rangeEnd)
+						{
+							if (i + FEATURE_DISTANCE_BATCH <= iSmNext && i + FEATURE_DISTANCE_BATCH <= rangeEnd)
+							{
+								float costs[FEATURE_DISTANCE_BATCH];
+								batchKernel(query, matcherData.row(i), matcherData.stride, bestCost, costs);
+
+								for (int k = 0; k < FEATURE_DISTANCE_BATCH; k++)
+								{
+									if (costs[k] < bestCost)
+									{
+										bestCost = costs[k];
+										bestIndex = i + k;
+									}
+								}
+
+								i += FEATURE_DISTANCE_BATCH;
+							}
+							else
+							{
+								float currCost = feature_distance(query, matcherData.row(i), matcherData.stride, bestCost);
+
+								if (currCost < bestCost)
+								{
+									bestCost = currCost;
+									bestIndex = i;
+								}
+
+								i++;
+							}
+						}
+					}
 				}
 			}
 
 			return true;
 		}
 
-		void NormalizeFeature(
-			Feature* feature,
-			const int offset,
-			const float weight)
+		// Squared distance from the query to the AABB, a lower bound of the
+		// cost of every pose inside the box.
+		float BoundCost(
+			const Array2D<float>& boundMin,
+			const Array2D<float>& boundMax,
+			const int boundIndex,
+			const float* query) const
+		{
+			float cost = 0.0f;
+
+			for (int dimIndex = 0; dimIndex < matcherData.cols; dimIndex++)
+			{
+				float q = query[dimIndex];
+				float distanceForThisDim = q - clampf(q, boundMin.get(boundIndex, dimIndex), boundMax.get(boundIndex, dimIndex));
+				cost += distanceForThisDim * distanceForThisDim;
+				if (cost >= bestCost)
+					break;
+			}
+
+			return cost;
+		}
+
+		void ResetFeatureStats()
 		{
-			// First compute what is essentially the mean value for each feature dimension
-			std::vector<float> vars;
-			for (int j = 0; j < feature->Size(); j++)
+			featureStats.count = 0;
+			featureStats.mean.assign(featureArray.totalDimCount, 0.0);
+			featureStats.m2.assign(featureArray.totalDimCount, 0.0);
+			featureStatsValid = true;
+		}
+
+		// Welford's online update with the raw features of a pose
+		void AddFeatureStats(const float* raw)
+		{
+			featureStats.count++;
+			for (int j = 0; j < featureArray.totalDimCount; j++)
+			{
+				double delta = raw[j] - featureStats.mean[j];
+				featureStats.mean[j] += delta / featureStats.count;
+				featureStats.m2[j] += delta * (raw[j] - featureStats.mean[j]);
+			}
+		}
+
+		void RemoveFeatureStats(const float* raw)
+		{
+			if (featureStats.count <= 1)
+			{
+				ResetFeatureStats();
+				return;
+			}
+
+			featureStats.count--;
+			for (int j = 0; j < featureArray.totalDimCount; j++)
 			{
-				featuresOffset[offset + j] = 0.0f;
-				vars.push_back(0.0f);
+				double delta = raw[j] - featureStats.mean[j];
+				featureStats.mean[j] -= delta / featureStats.count;
+				featureStats.m2[j] = std::max(0.0, featureStats.m2[j] - delta * (raw[j] - featureStats.mean[j]));
 			}
+		}
+
+		// The statistics aren't stored with the features, they are rebuilt
+		// from the denormalized rows the first time they are needed.
+		void EnsureFeatureStats()
+		{
+			if (featureStatsValid)
+				return;
+
+			ResetFeatureStats();
 
+			std::vector<float> raw(matcherData.cols);
 			for (int i = 0; i < matcherData.rows; i++)
 			{
-				for (int j = 0; j < feature->Size(); j++)
+				for (int j = 0; j < matcherData.cols; j++)
 				{
-					featuresOffset[offset + j] += matcherData.get(i, offset + j) / matcherData.rows;
+					raw[j] = matcherData.get(i, j) * featuresScale[j] + featuresOffset[j];
 				}
+				AddFeatureStats(raw.data());
 			}
+		}
 
-			// Now compute the variance of each feature dimension
-			for (int i = 0; i < matcherData.rows; i++)
+		// The offset of each dimension is its mean, and all the dimensions of
+		// a feature share its scale: the average std across its dimensions.
+		void ComputeNormalization(std::vector<float>& offset, std::vector<float>& scale) const
+		{
+			const float weight = 1.0f;
+
+			offset.resize(featureArray.totalDimCount);
+			scale.resize(featureArray.totalDimCount);
+
+			for (int featureIndex = 0; featureIndex < featureArray.features.size(); featureIndex++)
 			{
-				for (int j = 0; j < feature->Size(); j++)
+				int first = featureArray.offsets[featureIndex];
+				int size = featureArray.features[featureIndex]->Size();
+
+				float std = 0.0f;
+				for (int j = first; j < first + size; j++)
+				{
+					offset[j] = (float)featureStats.mean[j];
+					std += featureStats.count > 0 ? (float)sqrt(featureStats.m2[j] / featureStats.count) / size : 0.0f;
+				}
+
+				// Features with no variation can have zero std which is
+				// almost always a bug.
+				assert(std > 0.0 || featureStats.count <= 1);
+				if (std <= 0.0f)
+					std = 1.0f;
+
+				// The scale of a feature is just the std divided by the weight
+				for (int j = first; j < first + size; j++)
 				{
-					vars[j] += squaref(matcherData.get(i, offset + j) - featuresOffset[offset + j]) / matcherData.rows;
+					scale[j] = std / weight;
 				}
 			}
+		}
 
-			// We compute the overall std of the feature as the average std across all dimensions
-			float std = 0.0f;
-			for (int j = 0; j < feature->Size(); j++)
+		// Normalizes the raw features of the rows [begin, end) with the
+		// current offsets and scales.
+		void NormalizeRows(int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
 			{
-				std += sqrtf(vars[j]) / feature->Size();
+				for (int j = 0; j < matcherData.cols; j++)
+				{
+					matcherData.get(i, j) = (matcherData.get(i, j) - featuresOffset[j]) / featuresScale[j];
+				}
 			}
+		}
 
-			// Features with no variation can have zero std which is
-			// almost always a bug.
-			assert(std > 0.0);
+		// Moves every row to the normalization given by the current
+		// statistics, when it drifted by more than renormalizeTolerance (in
+		// stds) from the one the rows use, or when forced. The change is
+		// affine per dimension, so the bounds are remapped rather than
+		// rebuilt.
+		bool Renormalize(bool force)
+		{
+			std::vector<float> offset, scale;
+			ComputeNormalization(offset, scale);
 
-			// The scale of a feature is just the std divided by the weight
-			for (int j = 0; j < feature->Size(); j++)
+			bool drifted = force;
+			for (int j = 0; j < matcherData.cols && !drifted; j++)
 			{
-				featuresScale[offset + j] = std / weight;
+				drifted = fabsf(offset[j] - featuresOffset[j]) > renormalizeTolerance * featuresScale[j]
+					|| fabsf(scale[j] - featuresScale[j]) > renormalizeTolerance * featuresScale[j];
 			}
 
-			// Using the offset and scale we can then normalize the features
-			for (int i = 0; i < matcherData.rows; i++)
+			if (!drifted)
+				return false;
+
+			// v' = ((v * s + o) - o') / s'
+			std::vector<float> a(matcherData.cols), b(matcherData.cols);
+			for (int j = 0; j < matcherData.cols; j++)
 			{
-				for (int j = 0; j < feature->Size(); j++)
+				a[j] = featuresScale[j] / scale[j];
+				b[j] = (featuresOffset[j] - offset[j]) / scale[j];
+			}
+
+			auto remap = [&a, &b](Array2D<float>& array, int begin, int end)
+			{
+				for (int i = begin; i < end; i++)
 				{
-					matcherData.get(i, offset + j) = (matcherData.get(i, offset + j) - featuresOffset[offset + j]) / featuresScale[offset + j];
+					float* row = array.row(i);
+					for (int j = 0; j < array.cols; j++)
+					{
+						row[j] = row[j] * a[j] + b[j];
+					}
 				}
-			}
+			};
 
+			ThreadPool::For(matcherData.rows, 1024, [this, &remap](int begin, int end)
+			{
+				remap(matcherData, begin, end);
+			});
+
+			remap(boundSmMin, 0, boundSmMin.rows);
+			remap(boundSmMax, 0, boundSmMax.rows);
+			remap(boundLrMin, 0, boundLrMin.rows);
+			remap(boundLrMax, 0, boundLrMax.rows);
+
+			featuresOffset = offset;
+			featuresScale = scale;
+			renormalizationCount++;
+			return true;
 		}
 
 		std::vector<float> DenormalizeFeature(
@@ -496,8 +1073,88 @@ namespace Animation
 
 		int bestIndex = -1;
 
+		// Poses closer than this to the end of their clip are never matched
+		int ignoreRangeEnd = 10;
+
+		// Path and name prefix of the files the normalized features are
+		// cached in, followed by the cache key. No cache when empty.
+		std::string cachePrefix;
+
+		// Bump when a feature changes the way it is evaluated, so that the
+		// cached features are rebuilt.
+		enum { FEATURE_CACHE_MAGIC = 0x4346464D, FEATURE_CACHE_VERSION = 1 };
+
+		// Written as is, so every byte is a field: no padding to leave
+		// uninitialized in the file
+		struct FeatureCacheHeader
+		{
+			uint32_t magic;
+
+			uint32_t version;
+
+			uint64_t key;
+
+			int32_t rows, cols, stride;
+
+			uint32_t reserved;
+		};
+		static_assert(sizeof(FeatureCacheHeader) == 32, "FeatureCacheHeader must not have padding");
+
+		enum { BOUND_SM_SIZE = 16, BOUND_LR_SIZE = 64 };
+
+		// Run tests every pose when false, for comparison with the pruned
+		// search
+		bool useBounds = true;
+
+		Array2D<float> boundSmMin;
+
+		Array2D<float> boundSmMax;
+
+		Array2D<float> boundLrMin;
+
+		Array2D<float> boundLrMax;
+
+		// Running mean and squared deviations of the raw features, per
+		// dimension, over every pose of the database
+		struct FeatureStats
+		{
+			int count = 0;
+
+			std::vector<double> mean;
+
+			std::vector<double> m2;
+		};
+
+		FeatureStats featureStats;
+
+		bool featureStatsValid = false;
+
+		// Drift of the normalization, in stds, above which the rows are
+		// renormalized after poses were added or removed
+		float renormalizeTolerance = 0.05f;
+
+		int renormalizationCount = 0;
+
+		// Scratch buffer of the normalized, padded query
+		std::vector<float, AlignedAllocator<float, 32>> normalizedQuery;
+
 		
 	};
+
+	struct MotionMatchingSearchBenchmark
+	{
+		double PrunedMilliseconds = 0.0;
+
+		double BruteForceMilliseconds = 0.0;
+
+		// Queries for which both searches didn't find a match of the same cost
+		int Mismatches = 0;
+	};
+
+	// Runs queryCount queries, poses of the database with some noise, through
+	// the search of a built job with and without the AABB pruning, and checks
+	// that both find the same best match. The state of the job is restored.
+	MotionMatchingSearchBenchmark BenchmarkMotionMatchingSearch(MotionMatchingJob& job, int queryCount, int iterations);
 }
 
 
@@ -0,0 +1,158 @@
+#include "QuaternionAverage.h"
+#include <chrono>
+
+namespace Animation
+{
+	const char* GetQuaternionAverageModeName(QuaternionAverageMode mode)
+	{
+		switch (mode)
+		{
+		case QuaternionAverageMode::Nlerp: return "Nlerp";
+		case QuaternionAverageMode::PowerIteration: return "Power Iteration";
+		default: return "Unknown";
+		}
+	}
+
+	Quaternion QuaternionAverageNlerp(const Quaternion* qs, const float* weights, int count)
+	{
+		if (count <= 0)
+			return Quaternion::Identity;
+
+		Quaternion sum = weights[0] * qs[0];
+		for (int i = 1; i < count; i++)
+		{
+			float w = qs[i].Dot(qs[0]) < 0.0f ? -weights[i] : weights[i];
+			sum += w * qs[i];
+		}
+
+		float length = sum.Length();
+		return length > 1e-8f ? sum * (1.0f / length) : qs[0];
+	}
+
+	Quaternion QuaternionAveragePowerIteration(
+		const Quaternion* qs,
+		const float* weights,
+		int count,
+		const Quaternion& guess,
+		int iterations)
+	{
+		if (count <= 0)
+			return guess;
+
+		// Upper triangle of M, the sign of each quaternion doesn't matter
+		float m00 = 0, m01 = 0, m02 = 0, m03 = 0;
+		float m11 = 0, m12 = 0, m13 = 0;
+		float m22 = 0, m23 = 0;
+		float m33 = 0;
+
+		for (int i = 0; i < count; i++)
+		{
+			const Quaternion& q = qs[i];
+			float w = weights[i];
+			m00 += w * q.x * q.x; m01 += w * q.x * q.y; m02 += w * q.x * q.z; m03 += w * q.x * q.w;
+			m11 += w * q.y * q.y; m12 += w * q.y * q.z; m13 += w * q.y * q.w;
+			m22 += w * q.z * q.z; m23 += w * q.z * q.w;
+			m33 += w * q.w * q.w;
+		}
+
+		// A guess orthogonal to the average would never converge
+		Quaternion x = guess;
+		if (fabsf(x.Dot(qs[0])) < 0.1f)
+			x = QuaternionAverageNlerp(qs, weights, count);
+
+		for (int k = 0; k < iterations; k++)
+		{
+			Quaternion y(
+				m00 * x.x + m01 * x.y + m02 * x.z + m03 * x.w,
+				m01 * x.x + m11 * x.y + m12 * x.z + m13 * x.w,
+				m02 * x.x + m12 * x.y + m22 * x.z + m23 * x.w,
+				m03 * x.x + m13 * x.y + m23 * x.z + m33 * x.w);
+
+			float length = y.Length();
+			if (length < 1e-12f)
+				break;
+
+			x = y * (1.0f / length);
+		}
+
+		return x.Dot(guess) < 0.0f ? -x : x;
+	}
+
+	// Angle between the rotations of two unit quaternions
+	static inline float quat_angle_between(const Quaternion& a, const Quaternion& b)
+	{
+		float d = fabsf(a.Dot(b));
+		return 2.0f * acosf(std::min(d, 1.0f));
+	}
+
+	void CompareQuaternionAverages(
+		const float* qx,
+		const float* qy,
+		const float* qz,
+		const float* qw,
+		int stride,
+		const float* weights,
+		int layerCount,
+		int jointCount,
+		const Quaternion* guesses,
+		QuaternionAverageComparison& result)
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+
+		const int modeCount = (int)QuaternionAverageMode::Count;
+
+		result = QuaternionAverageComparison();
+		result.jointCount = jointCount;
+		result.layerCount = layerCount;
+
+		if (jointCount <= 0 || layerCount <= 0)
+			return;
+
+		std::vector<Quaternion> rotations(layerCount);
+		std::vector<Quaternion> averages[modeCount];
+		std::vector<Quaternion> exact(jointCount);
+
+		auto gather = [&](int joint)
+		{
+			for (int k = 0; k < layerCount; k++)
+			{
+				size_t offset = (size_t)k * stride + joint;
+				rotations[k] = Quaternion(qx[offset], qy[offset], qz[offset], qw[offset]);
+			}
+		};
+
+		for (int mode = 0; mode < modeCount; mode++)
+		{
+			averages[mode].resize(jointCount);
+
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < jointCount; i++)
+			{
+				gather(i);
+				if ((QuaternionAverageMode)mode == QuaternionAverageMode::Nlerp)
+					averages[mode][i] = QuaternionAverageNlerp(rotations.data(), weights, layerCount);
+				else
+					averages[mode][i] = QuaternionAveragePowerIteration(rotations.data(), weights, layerCount, guesses ? guesses[i] : averages[0][i]);
+			}
+			result.milliseconds[mode] = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		}
+
+		for (int i = 0; i < jointCount; i++)
+		{
+			gather(i);
+			exact[i] = QuaternionAveragePowerIteration(rotations.data(), weights, layerCount, averages[0][i], 64);
+		}
+
+		for (int mode = 0; mode < modeCount; mode++)
+		{
+			float sum = 0.0f;
+			for (int i = 0; i < jointCount; i++)
+			{
+				float error = quat_angle_between(averages[mode][i], exact[i]);
+				result.maxError[mode] = std::max(result.maxError[mode], error);
+				sum += error;
+			}
+			result.meanError[mode] = sum / jointCount;
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "../pch.h"
+
+using namespace DirectX::SimpleMath;
+
+namespace Animation
+{
+	enum class QuaternionAverageMode
+	{
+		// Normalized weighted sum, cheap and close to the exact average when
+		// the rotations are near each other.
+		Nlerp,
+
+		// Eigenvector of the accumulated 4x4 matrix, the exact average.
+		PowerIteration,
+
+		Count
+	};
+
+	const char* GetQuaternionAverageModeName(QuaternionAverageMode mode);
+
+	// Weighted sum of the quaternions, each one flipped to the hemisphere of
+	// the first, normalized.
+	Quaternion QuaternionAverageNlerp(const Quaternion* qs, const float* weights, int count);
+
+	// Dominant eigenvector of M = sum(w_i * q_i * q_i^T), which minimizes the
+	// weighted sum of squared chordal distances to the quaternions. M is
+	// symmetric, so its 10 distinct terms are accumulated and the eigenvector
+	// is found by power iteration starting from guess. Warm started from the
+	// last frame's average, one or two iterations are enough. The result is
+	// in the hemisphere of guess.
+	Quaternion QuaternionAveragePowerIteration(
+		const Quaternion* qs,
+		const float* weights,
+		int count,
+		const Quaternion& guess,
+		int iterations = 2);
+
+	struct QuaternionAverageComparison
+	{
+		// Time spent averaging every joint, per mode
+		double milliseconds[(int)QuaternionAverageMode::Count] = {};
+
+		// Angle between each mode and the converged average, in radians
+		float maxError[(int)QuaternionAverageMode::Count] = {};
+
+		float meanError[(int)QuaternionAverageMode::Count] = {};
+
+		int jointCount = 0;
+
+		int layerCount = 0;
+	};
+
+	// Averages the rotations of every joint with each mode and compares them
+	// against a power iteration run until convergence. Rotations are SoA,
+	// layer after layer: [layer * stride + joint]. guesses holds one
+	// quaternion per joint for the warm start, nlerp is used if null.
+	void CompareQuaternionAverages(
+		const float* qx,
+		const float* qy,
+		const float* qz,
+		const float* qw,
+		int stride,
+		const float* weights,
+		int layerCount,
+		int jointCount,
+		const Quaternion* guesses,
+		QuaternionAverageComparison& result);
+}
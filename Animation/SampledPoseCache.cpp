@@ -0,0 +1,127 @@
+#include "SampledPoseCache.h"
+
+namespace Animation
+{
+	SampledPoseCache::SampledPoseCache(int capacity, float timeQuantum, int probeCount)
+		: mTimeQuantum(timeQuantum)
+	{
+		size_t size = 1;
+		while (size < (size_t)std::max(capacity, (int)PROBE_COUNT))
+			size <<= 1;
+
+		mEntries.resize(size);
+		mMask = size - 1;
+		mProbeCount = (int)std::min((size_t)std::max(probeCount, 1), size);
+	}
+
+	void SampledPoseCache::BeginFrame()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		mLastFrameStats = mFrameStats;
+		mFrameStats = SampledPoseCacheStats();
+		mFrame++;
+	}
+
+	int64_t SampledPoseCache::Quantize(const AnimationClip* clip, float ratio) const
+	{
+		// In seconds, so that the precision doesn't depend on the clip length
+		return (int64_t)llroundf(ratio * clip->get_duration_in_second() / mTimeQuantum);
+	}
+
+	size_t SampledPoseCache::GetSlot(const AnimationClip* clip, int64_t time) const
+	{
+		return ComputeHash(clip, time) & mMask;
+	}
+
+	bool SampledPoseCache::Find(const AnimationClip* clip, float ratio, std::vector<Transform>& output)
+	{
+		int64_t time = Quantize(clip, ratio);
+		size_t slot = GetSlot(clip, time);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		for (int i = 0; i < mProbeCount; i++)
+		{
+			const Entry& entry = mEntries[(slot + i) & mMask];
+			// Poses are stored in the first free slot, and slots are only freed by
+			// BeginFrame: the pose can't be further
+			if (entry.frame != mFrame)
+				break;
+
+			if (entry.clip == clip && entry.time == time)
+			{
+				output = entry.pose;
+				mFrameStats.hits++;
+				mTotalStats.hits++;
+				return true;
+			}
+		}
+
+		mFrameStats.misses++;
+		mTotalStats.misses++;
+		return false;
+	}
+
+	void SampledPoseCache::Store(const AnimationClip* clip, float ratio, const std::vector<Transform>& pose)
+	{
+		int64_t time = Quantize(clip, ratio);
+		size_t slot = GetSlot(clip, time);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		Entry* target = nullptr;
+		for (int i = 0; i < mProbeCount && !target; i++)
+		{
+			Entry& entry = mEntries[(slot + i) & mMask];
+			if (entry.frame != mFrame || (entry.clip == clip && entry.time == time))
+				target = &entry;
+		}
+
+		// Every probed slot holds a pose of this frame, replace them in turn
+		if (!target)
+		{
+			target = &mEntries[(slot + mNextVictim++ % mProbeCount) & mMask];
+			mFrameStats.evictions++;
+			mTotalStats.evictions++;
+		}
+
+		target->clip = clip;
+		target->time = time;
+		target->frame = mFrame;
+		target->pose = pose;
+	}
+
+	void SampledPoseCache::Clear()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		for (Entry& entry : mEntries)
+		{
+			entry.clip = nullptr;
+			entry.frame = 0;
+		}
+	}
+
+	SampledPoseCacheStats SampledPoseCache::GetLastFrameStats() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mLastFrameStats;
+	}
+
+	SampledPoseCacheStats SampledPoseCache::GetTotalStats() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mTotalStats;
+	}
+
+	void SampledPoseCache::OnGui() const
+	{
+		SampledPoseCacheStats frame = GetLastFrameStats();
+		SampledPoseCacheStats total = GetTotalStats();
+
+		ImGui::Text("Pose cache (%d entries)", (int)mEntries.size());
+		ImGui::Text("Frame: %d hits, %d misses, %d evictions", frame.hits, frame.misses, frame.evictions);
+		ImGui::Text("Total: %d hits, %d misses, %d evictions", total.hits, total.misses, total.evictions);
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "Animation.h"
+
+namespace Animation
+{
+	struct SampledPoseCacheStats
+	{
+		int hits = 0;
+
+		int misses = 0;
+
+		// Entries of the current frame replaced by newer ones
+		int evictions = 0;
+	};
+
+	///<summary>
+	/// Poses sampled during the current frame, keyed by clip and quantized
+	/// time, so that jobs sampling the same clip at the same time (blend
+	/// layers, IK resets, debug views...) decompress it once. The cache holds
+	/// a fixed number of poses and is emptied by BeginFrame(). It can be
+	/// shared by jobs running on several threads.
+	///</summary>
+	class SampledPoseCache
+	{
+	public:
+		// capacity is rounded up to a power of two. Poses are only replaced when
+		// the probeCount slots following their hash are taken: probing every
+		// slot never evicts as long as the capacity isn't reached.
+		explicit SampledPoseCache(int capacity = 64, float timeQuantum = 1e-4f, int probeCount = PROBE_COUNT);
+
+		// Invalidates every pose and starts counting the new frame.
+		void BeginFrame();
+
+		// Copies the pose of the clip at ratio to output if it's cached.
+		bool Find(const AnimationClip* clip, float ratio, std::vector<Transform>& output);
+
+		void Store(const AnimationClip* clip, float ratio, const std::vector<Transform>& pose);
+
+		void Clear();
+
+		// Counters of the last complete frame and since the creation.
+		SampledPoseCacheStats GetLastFrameStats() const;
+
+		SampledPoseCacheStats GetTotalStats() const;
+
+		void OnGui() const;
+
+	private:
+		struct Entry
+		{
+			const AnimationClip* clip = nullptr;
+
+			int64_t time = 0;
+
+			// Entries of older frames are free
+			uint64_t frame = 0;
+
+			std::vector<Transform> pose;
+		};
+
+		// Slots probed for a key by default
+		enum { PROBE_COUNT = 4 };
+
+		int64_t Quantize(const AnimationClip* clip, float ratio) const;
+
+		size_t GetSlot(const AnimationClip* clip, int64_t time) const;
+
+		std::vector<Entry> mEntries;
+
+		size_t mMask;
+
+		int mProbeCount;
+
+		float mTimeQuantum;
+
+		uint64_t mFrame = 1;
+
+		// Next slot replaced when all the probed ones are taken
+		size_t mNextVictim = 0;
+
+		SampledPoseCacheStats mFrameStats;
+
+		SampledPoseCacheStats mLastFrameStats;
+
+		SampledPoseCacheStats mTotalStats;
+
+		mutable std::mutex mMutex;
+	};
+}
@@ -2,7 +2,13 @@
 
 namespace Animation
 {
-	SamplingJob::SamplingJob() : ratio(0.0f), animation(nullptr) {}
+	void SamplingJob::Context::Invalidate()
+	{
+		animation = nullptr;
+		cursors.clear();
+	}
+
+	SamplingJob::SamplingJob() : ratio(0.0f), animation(nullptr), context(nullptr), cache(nullptr), lod(nullptr) {}
 
 	bool SamplingJob::Validate() const
 	{
@@ -17,16 +23,49 @@ namespace Animation
 
 	bool SamplingJob::Run()
 	{
+		PROFILE_SCOPE("SamplingJob::Run");
+
 		if (!Validate()){
 			return false;
 		}
 
+		if (cache && cache->Find(animation, ratio, output))
+		{
+			return true;
+		}
+
 		int numJoint = animation->mSamples.size();
 		output.resize(numJoint);
+
+		KeyCursor* cursors = nullptr;
+		if (context)
+		{
+			if (context->animation != animation || context->cursors.size() != numJoint)
+			{
+				context->animation = animation;
+				context->cursors.assign(numJoint, KeyCursor());
+			}
+			cursors = context->cursors.data();
+		}
+
+		if (lod && lod->mask.size() == numJoint)
+		{
+			for (int i : lod->joints){
+				animation->mSamples[i].interpolate(ratio, output[i], cursors ? &cursors[i] : nullptr);
+			}
+
+			return true;
+		}
+
 		for (UINT i = 0; i < animation->mSamples.size(); ++i){
-			animation->mSamples[i].interpolate(ratio, output[i]);
+			animation->mSamples[i].interpolate(ratio, output[i], cursors ? &cursors[i] : nullptr);
+		}
+
+		if (cache)
+		{
+			cache->Store(animation, ratio, output);
 		}
 
 		return true;
 	}
-}
\ No newline at end of file
+}
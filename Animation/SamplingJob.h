@@ -1,23 +1,51 @@
 #pragma once
 #include"Animation.h"
+#include"SampledPoseCache.h"
+#include"SkeletonLod.h"
 
 namespace Animation
 {
 	struct SamplingJob
 	{
+		// Keeps the key cursors of every track between two Run() calls, so
+		// that sampling a clip at increasing times finds its keys in O(1)
+		// instead of searching them. A context is bound to one animation and
+		// is reset when used with another one.
+		class Context
+		{
+		public:
+			void Invalidate();
+
+		private:
+			friend struct SamplingJob;
+
+			const AnimationClip* animation = nullptr;
+
+			std::vector<KeyCursor> cursors;
+		};
+
 		SamplingJob();
 
 		bool Validate() const;
 
-		// In a real project, you'd want to cache the result if there was a chance
-		// that you were calling this several times with the same clipName at 
-		// the same timePos.
+		// Poses are looked up in the cache first when one is set, for jobs
+		// sampling the same clip at the same time during a frame.
 		bool Run();
 
 		float ratio;
 
 		const AnimationClip* animation;
 
+		// Optional, can be shared by successive jobs sampling the same playback.
+		Context* context;
+
+		// Optional, can be shared by every job of the frame.
+		SampledPoseCache* cache;
+
+		// Optional, only the joints of the level are sampled. The others keep
+		// whatever output held, partial poses are not stored in the cache.
+		const SkeletonLodLevel* lod;
+
 		std::vector<Transform> output;
 	};
-}
\ No newline at end of file
+}
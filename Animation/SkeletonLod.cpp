@@ -0,0 +1,105 @@
+#include "SkeletonLod.h"
+#include "AnimationDatabase.h"
+
+namespace Animation
+{
+	static inline bool name_contains_any(const std::string& name, const std::vector<std::string>& patterns)
+	{
+		for (const std::string& pattern : patterns)
+		{
+			if (name.find(pattern) != name.npos)
+				return true;
+		}
+
+		return false;
+	}
+
+	void SkeletonLod::Build(const AnimationDatabase& skeleton, const SkeletonLodSettings& settings)
+	{
+		int jointNum = skeleton.JointCount();
+		const std::vector<int>& parents = skeleton.GetParentIndex();
+		const std::vector<Transform>& bindPose = skeleton.GetBindPose();
+
+		// The root is never culled, parents come before their children so
+		// the masks are propagated down in a single pass
+		std::vector<uint8_t> detail(jointNum, 0);
+		std::vector<uint8_t> belowExtremity(jointNum, 0);
+		for (int i = 1; i < jointNum; i++)
+		{
+			int parent = parents[i];
+			std::string name = skeleton.GetJointName(i);
+
+			detail[i] = name_contains_any(name, settings.detailJoints) || (parent > 0 && detail[parent]);
+			belowExtremity[i] = parent > 0 && (belowExtremity[parent] || name_contains_any(skeleton.GetJointName(parent), settings.extremityJoints));
+		}
+
+		for (int level = 0; level < LEVEL_COUNT; level++)
+		{
+			SkeletonLodLevel& lod = mLevels[level];
+			lod.mask.assign(jointNum, 1);
+			lod.joints.clear();
+			lod.culled.clear();
+			lod.culledLocals.clear();
+
+			for (int i = 0; i < jointNum; i++)
+			{
+				bool culled = (level >= 1 && detail[i]) || (level >= 2 && belowExtremity[i]);
+				lod.mask[i] = !culled;
+
+				if (culled)
+				{
+					lod.culled.push_back(i);
+					lod.culledLocals.push_back(i < (int)bindPose.size() ? Transform::ToMatrix(bindPose[i]) : Matrix::Identity);
+				}
+				else
+				{
+					lod.joints.push_back(i);
+				}
+			}
+		}
+
+		for (int i = 0; i < LEVEL_COUNT - 1; i++)
+		{
+			mScreenSizes[i] = settings.screenSizes[i];
+		}
+
+		// Bind pose extent, for the screen size of the character
+		std::vector<Matrix> models(jointNum);
+		mRadius = 0.0f;
+		for (int i = 0; i < jointNum && i < (int)bindPose.size(); i++)
+		{
+			models[i] = Transform::ToMatrix(bindPose[i]);
+			if (parents[i] >= 0)
+				models[i] *= models[parents[i]];
+
+			mRadius = std::max(mRadius, (models[i].Translation() - models[0].Translation()).Length());
+		}
+	}
+
+	const SkeletonLodLevel* SkeletonLod::GetLevel(int level) const
+	{
+		if (!IsBuilt() || level <= 0)
+			return nullptr;
+
+		return &mLevels[std::min(level, (int)LEVEL_COUNT - 1)];
+	}
+
+	int SkeletonLod::SelectLevel(float screenSize) const
+	{
+		int level = 0;
+		while (level < LEVEL_COUNT - 1 && screenSize < mScreenSizes[level])
+			level++;
+
+		return level;
+	}
+
+	float SkeletonLod::ComputeScreenSize(const Vector3& center, float radius, const Matrix& view, const Matrix& proj)
+	{
+		// Projected diameter over the height of the view volume, [-1, 1]
+		float depth = Vector3::Transform(center, view).z;
+		if (depth <= radius)
+			return 1.0f;
+
+		return radius * proj._22 / depth;
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "Animation.h"
+
+namespace Animation
+{
+	class AnimationDatabase;
+
+	// Joints evaluated at one level of detail. A joint is culled with all its
+	// descendants, so the evaluated joints always form a connected hierarchy
+	// rooted at joint 0.
+	struct SkeletonLodLevel
+	{
+		// 1 for the evaluated joints
+		std::vector<uint8_t> mask;
+
+		// Evaluated joints, in increasing order
+		std::vector<int> joints;
+
+		// Culled joints, in increasing order. They follow their parent
+		// rigidly, keeping their bind pose local transform.
+		std::vector<int> culled;
+
+		std::vector<Matrix> culledLocals;
+	};
+
+	struct SkeletonLodSettings
+	{
+		// Joints whose name contains one of these are culled from LOD 1 on:
+		// fingers, face and twist bones.
+		std::vector<std::string> detailJoints = {
+			"Thumb", "Index", "Middle", "Ring", "Pinky",
+			"Eye", "Jaw", "Tongue", "Brow", "Lip", "Cheek", "Nose",
+			"Twist", "_End", "End_" };
+
+		// Joints whose descendants are culled from LOD 2 on: hands and feet.
+		std::vector<std::string> extremityJoints = { "Hand", "Foot", "Neck" };
+
+		// Fraction of the screen height covered by the character under which
+		// each LOD after the first is used.
+		float screenSizes[2] = { 0.25f, 0.08f };
+	};
+
+	///<summary>
+	/// Joint masks per level of detail, derived from the hierarchy and the
+	/// joint names of a skeleton. LOD 0 evaluates every joint, LOD 1 skips
+	/// the detail joints and LOD 2 also skips everything below the
+	/// extremities. The level is picked from the size of the character on
+	/// screen.
+	///</summary>
+	class SkeletonLod
+	{
+	public:
+		enum { LEVEL_COUNT = 3 };
+
+		void Build(const AnimationDatabase& skeleton, const SkeletonLodSettings& settings = SkeletonLodSettings());
+
+		bool IsBuilt() const { return !mLevels[0].mask.empty(); }
+
+		// null for LOD 0, where nothing is culled
+		const SkeletonLodLevel* GetLevel(int level) const;
+
+		int SelectLevel(float screenSize) const;
+
+		// Distance from the root to the farthest joint in the bind pose
+		float GetRadius() const { return mRadius; }
+
+		// Fraction of the screen height covered by a sphere
+		static float ComputeScreenSize(const Vector3& center, float radius, const Matrix& view, const Matrix& proj);
+
+	private:
+		SkeletonLodLevel mLevels[LEVEL_COUNT];
+
+		float mScreenSizes[LEVEL_COUNT - 1] = {};
+
+		float mRadius = 0.0f;
+	};
+}
@@ -0,0 +1,94 @@
+#include "SkinningPalette.h"
+
+namespace Animation
+{
+	const char* GetSkinningPaletteFormatName(SkinningPaletteFormat format)
+	{
+		switch (format)
+		{
+		case SkinningPaletteFormat::Matrix4x4: return "Matrix 4x4";
+		case SkinningPaletteFormat::Matrix3x4: return "Matrix 3x4";
+		case SkinningPaletteFormat::DualQuaternion: return "Dual quaternion";
+		default: return "";
+		}
+	}
+
+	const char* GetSkinningPaletteDefine(SkinningPaletteFormat format)
+	{
+		switch (format)
+		{
+		case SkinningPaletteFormat::Matrix3x4: return "SKINNING_MATRIX3X4";
+		case SkinningPaletteFormat::DualQuaternion: return "SKINNING_DUAL_QUATERNION";
+		default: return nullptr;
+		}
+	}
+
+	int GetSkinningPaletteStride(SkinningPaletteFormat format)
+	{
+		switch (format)
+		{
+		case SkinningPaletteFormat::Matrix3x4: return 12;
+		case SkinningPaletteFormat::DualQuaternion: return 8;
+		default: return 16;
+		}
+	}
+
+	DualQuaternion DualQuaternion::FromMatrix(const Matrix& m)
+	{
+		Vector3 scale, translation;
+		Quaternion rotation;
+		Matrix(m).Decompose(scale, rotation, translation);
+		rotation.Normalize();
+
+		// dual = 0.5 * t * real, with t as a pure quaternion
+		Vector3 r(rotation.x, rotation.y, rotation.z);
+		Vector3 d = 0.5f * (rotation.w * translation + translation.Cross(r));
+
+		DualQuaternion dq;
+		dq.real = rotation;
+		dq.dual = Quaternion(d.x, d.y, d.z, -0.5f * translation.Dot(r));
+		return dq;
+	}
+
+	Vector3 DualQuaternion::TransformVector(const Vector3& v) const
+	{
+		Vector3 r(real.x, real.y, real.z);
+		return v + 2.0f * r.Cross(r.Cross(v) + real.w * v);
+	}
+
+	Vector3 DualQuaternion::TransformPoint(const Vector3& p) const
+	{
+		Vector3 r(real.x, real.y, real.z);
+		Vector3 d(dual.x, dual.y, dual.z);
+		Vector3 translation = 2.0f * (real.w * d - dual.w * r + r.Cross(d));
+		return TransformVector(p) + translation;
+	}
+
+	void WriteSkinningPalette(const Matrix* skinning, int count, SkinningPaletteFormat format, float* dst)
+	{
+		switch (format)
+		{
+		case SkinningPaletteFormat::Matrix3x4:
+			// The matrices are transposed, their first three rows are the
+			// columns of the affine transform
+			for (int i = 0; i < count; i++)
+			{
+				memcpy(dst + i * 12, &skinning[i]._11, 12 * sizeof(float));
+			}
+			break;
+
+		case SkinningPaletteFormat::DualQuaternion:
+			for (int i = 0; i < count; i++)
+			{
+				DualQuaternion dq = DualQuaternion::FromMatrix(skinning[i].Transpose());
+				memcpy(dst + i * 8, &dq.real, 4 * sizeof(float));
+				memcpy(dst + i * 8 + 4, &dq.dual, 4 * sizeof(float));
+			}
+			break;
+
+		default:
+			memcpy(dst, skinning, count * sizeof(Matrix));
+			break;
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Animation.h"
+
+namespace Animation
+{
+	// Layout of the bone palette uploaded for skinning. The shaders select the
+	// matching one with the define given by GetSkinningPaletteDefine().
+	enum class SkinningPaletteFormat
+	{
+		// float4x4 per bone
+		Matrix4x4,
+
+		// Affine rows, float3x4 per bone
+		Matrix3x4,
+
+		// Rotation and translation as a unit dual quaternion, 2 float4 per
+		// bone. Bone scale is dropped.
+		DualQuaternion,
+
+		Count
+	};
+
+	const char* GetSkinningPaletteFormatName(SkinningPaletteFormat format);
+
+	// Shader define of the format, null for the default float4x4 palette.
+	const char* GetSkinningPaletteDefine(SkinningPaletteFormat format);
+
+	// Floats per bone
+	int GetSkinningPaletteStride(SkinningPaletteFormat format);
+
+	struct DualQuaternion
+	{
+		Quaternion real;
+
+		Quaternion dual;
+
+		// Rigid part of an affine matrix (row vector convention).
+		static DualQuaternion FromMatrix(const Matrix& m);
+
+		Vector3 TransformPoint(const Vector3& p) const;
+
+		Vector3 TransformVector(const Vector3& v) const;
+	};
+
+	// Packs the skinning matrices written by LocalToModelJob (transposed,
+	// offsets applied) to the format. dst holds count *
+	// GetSkinningPaletteStride(format) floats.
+	void WriteSkinningPalette(const Matrix* skinning, int count, SkinningPaletteFormat format, float* dst);
+}
@@ -256,29 +256,64 @@ static inline void inertialize_update(
 	out_v = in_v + off_v;
 }
 
-//static inline void inertialize_transition(
-//	Quaternion& off_x,
-//	Vector3& off_v,
-//	const Quaternion src_x,
-//	const Vector3 src_v,
-//	const Quaternion dst_x,
-//	const Vector3 dst_v)
-//{
-//	off_x = quat_abs(Quaternion_mul(Quaternion_mul(off_x, src_x), Quaternion_inv(dst_x)));
-//	off_v = (off_v + src_v) - dst_v;
-//}
-//
-//static inline void inertialize_update(
-//	Quaternion& out_x,
-//	Vector3& out_v,
-//	Quaternion& off_x,
-//	Vector3& off_v,
-//	const Quaternion in_x,
-//	const Vector3 in_v,
-//	const float halflife,
-//	const float dt)
-//{
-//	decay_spring_damper_implicit(off_x, off_v, halflife, dt);
-//	out_x = Quaternion_mul(off_x, in_x);
-//	out_v = off_v + in_v;
-//}
+static inline void inertialize_transition(
+	Quaternion& off_x,
+	Vector3& off_v,
+	const Quaternion src_x,
+	const Vector3 src_v,
+	const Quaternion dst_x,
+	const Vector3 dst_v)
+{
+	off_x = quat_abs(off_x * src_x * dst_x.Inversed());
+	off_v = (off_v + src_v) - dst_v;
+}
+
+static inline void inertialize_update(
+	Quaternion& out_x,
+	Vector3& out_v,
+	Quaternion& off_x,
+	Vector3& off_v,
+	const Quaternion in_x,
+	const Vector3 in_v,
+	const float halflife,
+	const float dt)
+{
+	decay_spring_damper_implicit(off_x, off_v, halflife, dt);
+	out_x = off_x * in_x;
+	out_v = off_v + in_v;
+}
+
+//--------------------------------------
+
+// Decays count offsets and their velocities stored as flat arrays, 4 at a
+// time. Rotation offsets must be stored as scaled angle axis, which decays
+// the same way as the quaternion version above. count must be a multiple of
+// 4 and the arrays aligned on 16 bytes.
+static inline void decay_spring_damper_implicit(
+	float* x,
+	float* v,
+	const int count,
+	const float halflife,
+	const float dt)
+{
+	float y = halflife_to_damping(halflife) / 2.0f;
+	float eydt = fast_negexpf(y * dt);
+
+	const DirectX::XMVECTOR vy = DirectX::XMVectorReplicate(y);
+	const DirectX::XMVECTOR vdt = DirectX::XMVectorReplicate(dt);
+	const DirectX::XMVECTOR vydt = DirectX::XMVectorReplicate(y * dt);
+	const DirectX::XMVECTOR veydt = DirectX::XMVectorReplicate(eydt);
+
+	for (int i = 0; i < count; i += 4)
+	{
+		DirectX::XMVECTOR xi = DirectX::XMLoadFloat4A((const DirectX::XMFLOAT4A*)(x + i));
+		DirectX::XMVECTOR vi = DirectX::XMLoadFloat4A((const DirectX::XMFLOAT4A*)(v + i));
+
+		DirectX::XMVECTOR j1 = DirectX::XMVectorMultiplyAdd(xi, vy, vi);
+		xi = DirectX::XMVectorMultiply(veydt, DirectX::XMVectorMultiplyAdd(j1, vdt, xi));
+		vi = DirectX::XMVectorMultiply(veydt, DirectX::XMVectorNegativeMultiplySubtract(j1, vydt, vi));
+
+		DirectX::XMStoreFloat4A((DirectX::XMFLOAT4A*)(x + i), xi);
+		DirectX::XMStoreFloat4A((DirectX::XMFLOAT4A*)(v + i), vi);
+	}
+}
@@ -0,0 +1,26 @@
+#include "StreamingSamplingJob.h"
+
+namespace Animation
+{
+	StreamingSamplingJob::StreamingSamplingJob() : ratio(0.0f), streamer(nullptr), clip(-1) {}
+
+	bool StreamingSamplingJob::Validate() const
+	{
+		if (!streamer || !streamer->IsOpen())
+		{
+			return false;
+		}
+
+		return clip >= 0 && clip < streamer->GetClipCount();
+	}
+
+	bool StreamingSamplingJob::Run()
+	{
+		if (!Validate()){
+			return false;
+		}
+
+		float time = clampf(ratio, 0.0f, 1.0f) * streamer->GetClipDuration(clip);
+		return streamer->Sample(clip, time, output);
+	}
+}
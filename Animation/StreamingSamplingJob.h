@@ -0,0 +1,26 @@
+#pragma once
+#include "AnimationStreamer.h"
+
+namespace Animation
+{
+	// Samples a clip of an AnimationStreamer. Mirrors SamplingJob, the chunks
+	// around the sampled time are requested as a side effect.
+	struct StreamingSamplingJob
+	{
+		StreamingSamplingJob();
+
+		bool Validate() const;
+
+		// Fails when nothing of the clip is resident yet, output is then kept
+		// as it was.
+		bool Run();
+
+		float ratio;
+
+		AnimationStreamer* streamer;
+
+		int clip;
+
+		std::vector<Transform> output;
+	};
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "AlignedAllocator.h"
+
 template <typename T>
 bool IsPowerOfTwoD(T val)
 {
@@ -22,4 +24,4 @@ inline T AlignDown(T val, T alignment)
 		LOG_ERROR("Alignment must be power of two.");
 
 	return val & ~(alignment - 1);
-}
\ No newline at end of file
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Allocator returning memory aligned to the given boundary, so that
+// containers can be read with aligned SIMD loads.
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator
+{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+	AlignedAllocator() noexcept {}
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+	T* allocate(std::size_t n)
+	{
+#if defined(_WIN32)
+		void* p = _aligned_malloc(n * sizeof(T), Alignment);
+#else
+		// aligned_alloc wants a size multiple of the alignment
+		void* p = std::aligned_alloc(Alignment, (n * sizeof(T) + Alignment - 1) / Alignment * Alignment);
+#endif
+		if (p == nullptr)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, std::size_t) noexcept
+	{
+#if defined(_WIN32)
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
@@ -0,0 +1,65 @@
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+static void Cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuidex(info, leaf, subleaf);
+	for (int i = 0; i < 4; i++)
+		regs[i] = (unsigned int)info[i];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long ReadXCR0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static bool DetectAVX2()
+{
+	unsigned int regs[4];
+	Cpuid(0, 0, regs);
+	if (regs[0] < 7)
+		return false;
+
+	// Leaf 1 ECX: FMA (12), OSXSAVE (27), AVX (28)
+	Cpuid(1, 0, regs);
+	const unsigned int fma = 1u << 12, osxsave = 1u << 27, avx = 1u << 28;
+	if ((regs[2] & (fma | osxsave | avx)) != (fma | osxsave | avx))
+		return false;
+
+	// XMM and YMM states enabled by the OS
+	if ((ReadXCR0() & 6) != 6)
+		return false;
+
+	// Leaf 7 EBX: AVX2 (5)
+	Cpuid(7, 0, regs);
+	return (regs[1] & (1u << 5)) != 0;
+}
+#else
+static bool DetectAVX2()
+{
+	return false;
+}
+#endif
+
+bool CpuSupportsAVX2()
+{
+	static const bool supported = DetectAVX2();
+	return supported;
+}
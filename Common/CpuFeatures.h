@@ -0,0 +1,10 @@
+#pragma once
+
+// Instruction sets the running CPU supports, for the code paths compiled with
+// a wider instruction set than the rest of the executable. Detected once, on
+// first use. Only std and intrinsics are used, as the skinning built off
+// Windows depends on it.
+
+// Whether AVX2 and FMA can be used: supported by the CPU, and the YMM
+// registers saved by the OS.
+bool CpuSupportsAVX2();
@@ -1,29 +1,133 @@
 #include "GraphicDebug.h"
 #include "SimpleMath.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
 using namespace DirectX::SimpleMath;
 
-void GraphicDebug::DrawLine(const DirectX::SimpleMath::Vector3& p1, const DirectX::SimpleMath::Vector3& dir, float length, const DirectX::SimpleMath::Vector4& color){
-	Line l;
+// Corner pairs of the 12 edges of a box, in the order of BoundingBox::GetCorners
+static const int s_BoxEdges[12][2] =
+{
+	{ 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+	{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+	{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+};
 
-	l.p1 = p1;
-	l.p2 = p1 + dir * length;
-	l.color = color;
+GraphicDebug::GraphicDebug(uint32_t capacity)
+	: m_Lines(std::make_unique<Line[]>(capacity)), m_Capacity(capacity), m_Count(0) {}
 
-	lines.push_back(std::move(l));
+void GraphicDebug::DrawLine(const DirectX::SimpleMath::Vector3& p1, const DirectX::SimpleMath::Vector3& dir, float length, const DirectX::SimpleMath::Vector4& color){
+	DrawLine(p1, p1 + dir * length, color);
 }
 
 void GraphicDebug::DrawLine(const DirectX::SimpleMath::Vector3& p1, const DirectX::SimpleMath::Vector3& p2, const DirectX::SimpleMath::Vector4& color)
 {
-	Line l;
+	Line* l = Reserve(1);
+	if (!l)
+		return;
+
+	l->p1 = p1;
+	l->p2 = p2;
+	l->color = PackColor(color);
+}
+
+void GraphicDebug::DrawSphere(const DirectX::SimpleMath::Vector3& center, float radius, const DirectX::SimpleMath::Vector4& color, int segments)
+{
+	if (segments < 3)
+		return;
+
+	Line* l = Reserve(3 * segments);
+	if (!l)
+		return;
+
+	uint32_t packed = PackColor(color);
+	float step = DirectX::XM_2PI / segments;
+	for (int i = 0; i < segments; i++)
+	{
+		float s0 = sinf(i * step) * radius, c0 = cosf(i * step) * radius;
+		float s1 = sinf((i + 1) * step) * radius, c1 = cosf((i + 1) * step) * radius;
+
+		*l++ = Line{ center + Vector3(c0, s0, 0.0f), center + Vector3(c1, s1, 0.0f), packed };
+		*l++ = Line{ center + Vector3(0.0f, c0, s0), center + Vector3(0.0f, c1, s1), packed };
+		*l++ = Line{ center + Vector3(s0, 0.0f, c0), center + Vector3(s1, 0.0f, c1), packed };
+	}
+}
+
+void GraphicDebug::DrawBox(const DirectX::BoundingBox& box, const DirectX::SimpleMath::Vector4& color)
+{
+	DrawBox(DirectX::BoundingOrientedBox(box.Center, box.Extents, Quaternion::Identity), color);
+}
+
+void GraphicDebug::DrawBox(const DirectX::BoundingOrientedBox& box, const DirectX::SimpleMath::Vector4& color)
+{
+	Line* l = Reserve(12);
+	if (!l)
+		return;
+
+	DirectX::XMFLOAT3 corners[DirectX::BoundingOrientedBox::CORNER_COUNT];
+	box.GetCorners(corners);
+
+	uint32_t packed = PackColor(color);
+	for (int i = 0; i < 12; i++)
+	{
+		l[i] = Line{ corners[s_BoxEdges[i][0]], corners[s_BoxEdges[i][1]], packed };
+	}
+}
+
+uint32_t GraphicDebug::GetLineCount() const
+{
+	return std::min(m_Count.load(std::memory_order_acquire), m_Capacity);
+}
+
+uint32_t GraphicDebug::GetDroppedLineCount() const
+{
+	uint32_t count = m_Count.load(std::memory_order_acquire);
+	return count > m_Capacity ? count - m_Capacity : 0;
+}
 
-	l.p1 = p1;
-	l.p2 = p2;
-	l.color = color;
+void GraphicDebug::Clear()
+{
+	m_Count.store(0, std::memory_order_release);
+}
 
-	lines.push_back(std::move(l));
+uint32_t GraphicDebug::PackColor(const DirectX::SimpleMath::Vector4& color)
+{
+	auto channel = [](float c) { return (uint32_t)(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f); };
+	return channel(color.x) | (channel(color.y) << 8) | (channel(color.z) << 16) | (channel(color.w) << 24);
 }
 
-void GraphicDebug::Update()
+GraphicDebug::Line* GraphicDebug::Reserve(uint32_t count)
 {
-	lines.clear();
-}
\ No newline at end of file
+	uint32_t first = m_Count.fetch_add(count, std::memory_order_relaxed);
+	if (first >= m_Capacity || count > m_Capacity - first)
+		return nullptr;
+
+	return m_Lines.get() + first;
+}
+
+double BenchmarkGraphicDebug(int lineCount, int iterations)
+{
+	GraphicDebug graphicDebug(std::max(lineCount, 1));
+	std::vector<GraphicDebug::Line> upload(graphicDebug.GetCapacity());
+	Vector4 color(1.0f, 0.5f, 0.0f, 1.0f);
+
+	double milliseconds = 0.0;
+	for (int it = 0; it < iterations; it++)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < lineCount; i++)
+		{
+			Vector3 p((float)(i & 255), (float)(i >> 8), (float)it);
+			graphicDebug.DrawLine(p, p + Vector3::UnitY, color);
+		}
+
+		uint32_t count = graphicDebug.GetLineCount();
+		memcpy(upload.data(), graphicDebug.GetLines(), count * sizeof(GraphicDebug::Line));
+		graphicDebug.Clear();
+
+		milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	return iterations > 0 ? milliseconds / iterations : 0.0;
+}
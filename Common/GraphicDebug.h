@@ -1,23 +1,76 @@
 #pragma once
+#include <atomic>
+#include <memory>
 #include "SimpleMath.h"
 
+///<summary>
+/// Debug primitives drawn for a single frame. Everything is reduced to lines,
+/// written into a stream allocated once, so drawing a primitive never
+/// allocates. The renderer uploads the stream once per frame and draws all the
+/// lines with one instanced draw, each line being an instance of two vertices.
+///
+/// Lines can be added from several threads at once: a primitive reserves its
+/// lines with an atomic add. Lines that don't fit anymore are dropped.
+///</summary>
 class GraphicDebug
 {
 public:
+	// Instance layout read by Shaders/DebugLines.hlsl
 	struct Line
 	{
 		DirectX::SimpleMath::Vector3 p1;
 
 		DirectX::SimpleMath::Vector3 p2;
 
-		DirectX::SimpleMath::Vector4 color;
+		// R8G8B8A8_UNORM
+		uint32_t color;
 	};
 
-	std::vector<Line> lines;
+	enum { DEFAULT_CAPACITY = 1 << 17 };
+
+	explicit GraphicDebug(uint32_t capacity = DEFAULT_CAPACITY);
+
+	GraphicDebug(const GraphicDebug&) = delete;
+
+	GraphicDebug& operator=(const GraphicDebug&) = delete;
 
 	void DrawLine(const DirectX::SimpleMath::Vector3& p1, const DirectX::SimpleMath::Vector3& dir, float length, const DirectX::SimpleMath::Vector4& color);
 
 	void DrawLine(const DirectX::SimpleMath::Vector3& p1, const DirectX::SimpleMath::Vector3& p2, const DirectX::SimpleMath::Vector4& color);
 
-	void Update();
-};
\ No newline at end of file
+	// Three great circles of segments lines each.
+	void DrawSphere(const DirectX::SimpleMath::Vector3& center, float radius, const DirectX::SimpleMath::Vector4& color, int segments = 16);
+
+	void DrawBox(const DirectX::BoundingBox& box, const DirectX::SimpleMath::Vector4& color);
+
+	void DrawBox(const DirectX::BoundingOrientedBox& box, const DirectX::SimpleMath::Vector4& color);
+
+	// Lines drawn since the last Clear, in the order they were reserved.
+	const Line* GetLines() const { return m_Lines.get(); }
+
+	uint32_t GetLineCount() const;
+
+	uint32_t GetDroppedLineCount() const;
+
+	uint32_t GetCapacity() const { return m_Capacity; }
+
+	// Called once the frame's lines have been uploaded.
+	void Clear();
+
+	static uint32_t PackColor(const DirectX::SimpleMath::Vector4& color);
+
+private:
+	// Returns room for count lines, or nullptr if the stream is full.
+	Line* Reserve(uint32_t count);
+
+	std::unique_ptr<Line[]> m_Lines;
+
+	uint32_t m_Capacity;
+
+	// May go past the capacity, the excess is what was dropped
+	std::atomic<uint32_t> m_Count;
+};
+
+// Average time in milliseconds to batch lineCount lines and copy them to an
+// upload buffer, over the given number of frames.
+double BenchmarkGraphicDebug(int lineCount, int iterations);
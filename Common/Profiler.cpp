@@ -0,0 +1,185 @@
+#include "../pch.h"
+#include "Profiler.h"
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static const Clock::time_point s_Epoch = Clock::now();
+
+// Ring of the calling thread, and the profiler it belongs to
+static thread_local const Profiler* t_RingOwner = nullptr;
+static thread_local void* t_Ring = nullptr;
+
+Profiler::Profiler() : m_FrameStart(Now()), m_FrameMilliseconds(0.0) {}
+
+int64_t Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - s_Epoch).count();
+}
+
+Profiler::ScopedZone::ScopedZone(const char* name) : m_Name(name), m_Start(0), m_Ring(nullptr)
+{
+	Profiler* profiler = GetSinglePtr();
+	if (!profiler)
+		return;
+
+	m_Ring = profiler->GetThreadRing();
+	m_Ring->depth++;
+	m_Start = Now();
+}
+
+Profiler::ScopedZone::~ScopedZone()
+{
+	if (!m_Ring)
+		return;
+
+	int64_t end = Now();
+	Record(m_Ring, m_Name, m_Start, end, --m_Ring->depth);
+}
+
+Profiler::ThreadRing* Profiler::GetThreadRing()
+{
+	if (t_RingOwner == this)
+		return static_cast<ThreadRing*>(t_Ring);
+
+	std::lock_guard<std::mutex> lock(m_RingsMutex);
+
+	std::unique_ptr<ThreadRing> ring = std::make_unique<ThreadRing>();
+	ring->events = std::make_unique<ProfileEvent[]>(RING_CAPACITY);
+	ring->writeIndex = 0;
+	ring->threadIndex = (int)m_Rings.size();
+	ring->depth = 0;
+	m_Rings.push_back(std::move(ring));
+
+	t_RingOwner = this;
+	t_Ring = m_Rings.back().get();
+	return m_Rings.back().get();
+}
+
+void Profiler::Record(ThreadRing* ring, const char* name, int64_t start, int64_t end, int depth)
+{
+	// Only the owning thread writes, the release publishes the event
+	uint64_t index = ring->writeIndex.load(std::memory_order_relaxed);
+	ring->events[index & (RING_CAPACITY - 1)] = ProfileEvent{ name, start, end, depth };
+	ring->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::CollectEvents(const ThreadRing& ring, int64_t from, int64_t to, std::vector<ProfileEvent>& events)
+{
+	uint64_t end = ring.writeIndex.load(std::memory_order_acquire);
+
+	// Keep clear of the slots the writer is about to reuse
+	uint64_t begin = end > RING_CAPACITY / 2 ? end - RING_CAPACITY / 2 : 0;
+
+	for (uint64_t i = begin; i < end; i++)
+	{
+		const ProfileEvent& e = ring.events[i & (RING_CAPACITY - 1)];
+		if (e.start >= from && e.start < to)
+			events.push_back(e);
+	}
+}
+
+void Profiler::BeginFrame()
+{
+	int64_t now = Now();
+
+	m_Scratch.clear();
+	{
+		std::lock_guard<std::mutex> lock(m_RingsMutex);
+		for (const std::unique_ptr<ThreadRing>& ring : m_Rings)
+		{
+			CollectEvents(*ring, m_FrameStart, now, m_Scratch);
+		}
+	}
+
+	// Zones are identified by their name pointer, the same literal is
+	// shared by every call site
+	std::unordered_map<const char*, size_t> indices;
+	m_FrameSummary.clear();
+	for (const ProfileEvent& e : m_Scratch)
+	{
+		auto it = indices.find(e.name);
+		if (it == indices.end())
+		{
+			it = indices.emplace(e.name, m_FrameSummary.size()).first;
+			m_FrameSummary.push_back(ProfileZoneSummary{ e.name, 0, 0.0, 0.0 });
+		}
+
+		ProfileZoneSummary& zone = m_FrameSummary[it->second];
+		double ms = (e.end - e.start) * 1e-6;
+		zone.calls++;
+		zone.totalMilliseconds += ms;
+		zone.maxMilliseconds = std::max(zone.maxMilliseconds, ms);
+	}
+
+	std::sort(m_FrameSummary.begin(), m_FrameSummary.end(), [](const ProfileZoneSummary& a, const ProfileZoneSummary& b)
+	{
+		return a.totalMilliseconds > b.totalMilliseconds;
+	});
+
+	m_FrameMilliseconds = (now - m_FrameStart) * 1e-6;
+	m_FrameStart = now;
+}
+
+bool Profiler::WriteChromeTrace(const std::string& filename) const
+{
+	std::vector<ProfileEvent> events;
+	std::vector<int> threads;
+	{
+		std::lock_guard<std::mutex> lock(m_RingsMutex);
+		for (const std::unique_ptr<ThreadRing>& ring : m_Rings)
+		{
+			CollectEvents(*ring, 0, INT64_MAX, events);
+			threads.resize(events.size(), ring->threadIndex);
+		}
+	}
+
+	FILE* f = fopen(filename.c_str(), "w");
+	if (f == NULL)
+	{
+		LOG_ERROR("Failed to write profile " + filename);
+		return false;
+	}
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const ProfileEvent& e = events[i];
+		fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+			e.name, threads[i], e.start * 1e-3, (e.end - e.start) * 1e-3, i + 1 < events.size() ? "," : "");
+	}
+	fprintf(f, "],\"displayTimeUnit\":\"ns\"}\n");
+
+	fclose(f);
+	return true;
+}
+
+void Profiler::OnGui()
+{
+	if (!ImGui::CollapsingHeader("Profiler"))
+		return;
+
+	ImGui::Text("Frame: %.3f ms", m_FrameMilliseconds);
+
+	if (ImGui::Button("Save Chrome trace"))
+	{
+		WriteChromeTrace("profile.json");
+	}
+
+	ImGui::Columns(4, "ProfilerZones");
+	ImGui::Text("Zone"); ImGui::NextColumn();
+	ImGui::Text("Calls"); ImGui::NextColumn();
+	ImGui::Text("Total (ms)"); ImGui::NextColumn();
+	ImGui::Text("Max (ms)"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	for (const ProfileZoneSummary& zone : m_FrameSummary)
+	{
+		ImGui::Text("%s", zone.name); ImGui::NextColumn();
+		ImGui::Text("%d", zone.calls); ImGui::NextColumn();
+		ImGui::Text("%.3f", zone.totalMilliseconds); ImGui::NextColumn();
+		ImGui::Text("%.3f", zone.maxMilliseconds); ImGui::NextColumn();
+	}
+
+	ImGui::Columns(1);
+}
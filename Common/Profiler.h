@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+
+// Scoped zones are recorded in debug builds, or when MENG_ENABLE_PROFILER is
+// defined. Otherwise the markers expand to nothing.
+#if defined(_DEBUG) || defined(MENG_ENABLE_PROFILER)
+#define MENG_PROFILER_ENABLED
+#endif
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef MENG_PROFILER_ENABLED
+// name must be a string literal, or outlive the profiler.
+#define PROFILE_SCOPE(name) Profiler::ScopedZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#endif
+
+struct ProfileEvent
+{
+	const char* name;
+
+	// Nanoseconds since the creation of the profiler
+	int64_t start;
+
+	int64_t end;
+
+	int depth;
+};
+
+struct ProfileZoneSummary
+{
+	const char* name;
+
+	int calls;
+
+	double totalMilliseconds;
+
+	double maxMilliseconds;
+};
+
+///<summary>
+/// Records the scoped zones of every thread while an instance exists. Each
+/// thread writes to its own ring buffer, so recording a zone takes no lock:
+/// the reader only looks at the events the write index of a ring has passed.
+/// The oldest events are overwritten once a ring is full.
+///</summary>
+class Profiler : public Singleton<Profiler>
+{
+public:
+	// Events kept per thread, a power of two
+	enum { RING_CAPACITY = 1 << 16 };
+
+	Profiler();
+
+	// Closes the frame, the zones it contains are summarized.
+	void BeginFrame();
+
+	const std::vector<ProfileZoneSummary>& GetFrameSummary() const { return m_FrameSummary; }
+
+	double GetFrameMilliseconds() const { return m_FrameMilliseconds; }
+
+	// Writes every event still in the rings, in the Chrome trace event format
+	// (chrome://tracing, Perfetto).
+	bool WriteChromeTrace(const std::string& filename) const;
+
+	void OnGui();
+
+	static int64_t Now();
+
+private:
+	struct ThreadRing
+	{
+		std::unique_ptr<ProfileEvent[]> events;
+
+		std::atomic<uint64_t> writeIndex;
+
+		int threadIndex;
+
+		int depth;
+	};
+
+public:
+	class ScopedZone
+	{
+	public:
+		explicit ScopedZone(const char* name);
+
+		~ScopedZone();
+
+	private:
+		const char* m_Name;
+
+		int64_t m_Start;
+
+		ThreadRing* m_Ring;
+	};
+
+private:
+	ThreadRing* GetThreadRing();
+
+	static void Record(ThreadRing* ring, const char* name, int64_t start, int64_t end, int depth);
+
+	// Copies the events of a ring that started in [from, to).
+	static void CollectEvents(const ThreadRing& ring, int64_t from, int64_t to, std::vector<ProfileEvent>& events);
+
+	std::vector<std::unique_ptr<ThreadRing>> m_Rings;
+
+	// Only taken when a thread records its first zone, and by the readers
+	mutable std::mutex m_RingsMutex;
+
+	int64_t m_FrameStart;
+
+	double m_FrameMilliseconds;
+
+	std::vector<ProfileZoneSummary> m_FrameSummary;
+
+	std::vector<ProfileEvent> m_Scratch;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cassert>
+
 template <typename T>
 class Singleton
 {
@@ -0,0 +1,100 @@
+#include "../pch.h"
+#include "ThreadPool.h"
+#include "TaskGraph.h"
+
+TaskGraph::TaskId TaskGraph::AddTask(const std::string& name, std::function<void()> func)
+{
+	Task task;
+	task.name = name;
+	task.func = std::move(func);
+	m_Tasks.push_back(std::move(task));
+	m_Pending.reset();
+
+	return (TaskId)m_Tasks.size() - 1;
+}
+
+void TaskGraph::AddDependency(TaskId before, TaskId after)
+{
+	assert(before >= 0 && before < (int)m_Tasks.size());
+	assert(after >= 0 && after < (int)m_Tasks.size());
+	assert(before != after);
+
+	m_Tasks[before].successors.push_back(after);
+	m_Tasks[after].dependencyCount++;
+}
+
+void TaskGraph::Run()
+{
+	int taskCount = (int)m_Tasks.size();
+	if (taskCount == 0)
+		return;
+
+	ThreadPool* pool = ThreadPool::GetSinglePtr();
+	if (!pool)
+	{
+		for (Task& task : m_Tasks)
+		{
+			task.func();
+		}
+		return;
+	}
+
+	if (!m_Pending)
+		m_Pending.reset(new std::atomic<int>[taskCount]);
+
+	for (int i = 0; i < taskCount; i++)
+	{
+		m_Pending[i] = m_Tasks[i].dependencyCount;
+	}
+	m_Remaining = taskCount;
+
+	// Roots are collected first, so that none of their successors can be
+	// started (and reset) while we're still reading the counters
+	std::vector<TaskId> roots;
+	for (int i = 0; i < taskCount; i++)
+	{
+		if (m_Tasks[i].dependencyCount == 0)
+			roots.push_back(i);
+	}
+	assert(!roots.empty());
+
+	for (size_t i = 1; i < roots.size(); i++)
+	{
+		TaskId id = roots[i];
+		pool->Submit([this, id]() { Execute(id); });
+	}
+	Execute(roots[0]);
+
+	pool->HelpUntil([this]() { return m_Remaining == 0; });
+}
+
+void TaskGraph::Clear()
+{
+	m_Tasks.clear();
+	m_Pending.reset();
+}
+
+void TaskGraph::Execute(TaskId id)
+{
+	Task& task = m_Tasks[id];
+	task.func();
+
+	// The last ready successor runs on this thread, the others go to the pool
+	TaskId next = -1;
+	for (TaskId successor : task.successors)
+	{
+		if (--m_Pending[successor] == 0)
+		{
+			if (next >= 0)
+			{
+				ThreadPool::GetSingleton().Submit([this, next]() { Execute(next); });
+			}
+			next = successor;
+		}
+	}
+
+	m_Remaining--;
+
+	if (next >= 0)
+		Execute(next);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Set of tasks with explicit dependencies, run on the ThreadPool. A task starts
+// once all the tasks it depends on are done. The graph is built once and can
+// be run every frame; tasks must only write data no concurrent task touches,
+// so the results don't depend on the thread count or the scheduling order.
+class TaskGraph
+{
+public:
+	typedef int TaskId;
+
+	TaskId AddTask(const std::string& name, std::function<void()> func);
+
+	// after won't start before before is done.
+	void AddDependency(TaskId before, TaskId after);
+
+	// Runs every task and returns once they are all done. Without a pool, the
+	// tasks run on the calling thread in the order they were added, which must
+	// then be a valid order.
+	void Run();
+
+	void Clear();
+
+	int GetTaskCount() const { return (int)m_Tasks.size(); }
+
+	const std::string& GetTaskName(TaskId id) const { return m_Tasks[id].name; }
+
+private:
+	struct Task
+	{
+		std::string name;
+
+		std::function<void()> func;
+
+		std::vector<TaskId> successors;
+
+		int dependencyCount = 0;
+	};
+
+	void Execute(TaskId id);
+
+	std::vector<Task> m_Tasks;
+
+	// Dependencies left per task during a run
+	std::unique_ptr<std::atomic<int>[]> m_Pending;
+
+	std::atomic<int> m_Remaining;
+};
@@ -0,0 +1,211 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+// Index of the worker running on this thread, -1 for threads outside of the pool
+static thread_local int t_WorkerIndex = -1;
+
+static thread_local ThreadPool* t_WorkerPool = nullptr;
+
+ThreadPool::ThreadPool(int threadCount)
+	: m_PendingCount(0), m_ActiveCount(0), m_Stop(false)
+{
+	if (threadCount <= 0)
+		threadCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+	m_ActiveCount = threadCount;
+
+	for (int i = 0; i < threadCount; i++)
+	{
+		m_Queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	for (int i = 0; i < threadCount; i++)
+	{
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Stop = true;
+		m_ActiveCount = GetThreadCount();
+	}
+	m_Condition.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	WorkQueue& queue = t_WorkerPool == this ? *m_Queues[t_WorkerIndex] : m_SharedQueue;
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	// Taking the lock orders the increment with the check of a worker about to sleep
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_PendingCount++;
+	}
+
+	// The woken worker could be one that is not active
+	if (m_ActiveCount < GetThreadCount())
+		m_Condition.notify_all();
+	else
+		m_Condition.notify_one();
+}
+
+void ThreadPool::SetActiveThreadCount(int count)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_ActiveCount = std::min(std::max(count, 0), GetThreadCount());
+	}
+	m_Condition.notify_all();
+}
+
+void ThreadPool::ParallelFor(int count, int grainSize, const std::function<void(int, int)>& func)
+{
+	if (count <= 0)
+		return;
+
+	grainSize = std::max(grainSize, 1);
+	int chunkCount = (count + grainSize - 1) / grainSize;
+	int helperCount = std::min(GetActiveThreadCount(), chunkCount - 1);
+
+	std::atomic<int> nextChunk(0);
+	std::atomic<int> pendingHelpers(helperCount);
+
+	auto run = [&]()
+	{
+		for (int chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+		{
+			int begin = chunk * grainSize;
+			func(begin, std::min(begin + grainSize, count));
+		}
+	};
+
+	for (int i = 0; i < helperCount; i++)
+	{
+		Submit([&]()
+		{
+			run();
+			pendingHelpers--;
+		});
+	}
+
+	run();
+
+	// The helpers may still be queued behind other tasks
+	HelpUntil([&]() { return pendingHelpers == 0; });
+}
+
+void ThreadPool::For(int count, int grainSize, const std::function<void(int, int)>& func)
+{
+	if (ThreadPool* pool = GetSinglePtr())
+		pool->ParallelFor(count, grainSize, func);
+	else if (count > 0)
+		func(0, count);
+}
+
+void ThreadPool::HelpUntil(const std::function<bool()>& done)
+{
+	while (!done())
+	{
+		if (!TryRunPendingTask())
+			std::this_thread::yield();
+	}
+}
+
+void ThreadPool::WorkerLoop(int index)
+{
+	t_WorkerIndex = index;
+	t_WorkerPool = this;
+
+	for (;;)
+	{
+		std::function<void()> task;
+		if (index < m_ActiveCount && PopTask(task))
+		{
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_Condition.wait(lock, [this, index]() { return m_Stop || (index < m_ActiveCount && m_PendingCount > 0); });
+
+		if (m_Stop && m_PendingCount == 0)
+			return;
+	}
+}
+
+bool ThreadPool::TryRunPendingTask()
+{
+	std::function<void()> task;
+	if (!PopTask(task))
+		return false;
+
+	task();
+	return true;
+}
+
+bool ThreadPool::PopTask(std::function<void()>& task)
+{
+	if (m_PendingCount == 0)
+		return false;
+
+	int self = t_WorkerPool == this ? t_WorkerIndex : -1;
+
+	// Newest task of our own queue, it's the most likely to be in cache
+	if (self >= 0)
+	{
+		WorkQueue& queue = *m_Queues[self];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			m_PendingCount--;
+			return true;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_SharedQueue.mutex);
+		if (!m_SharedQueue.tasks.empty())
+		{
+			task = std::move(m_SharedQueue.tasks.front());
+			m_SharedQueue.tasks.pop_front();
+			m_PendingCount--;
+			return true;
+		}
+	}
+
+	// Steal the oldest task of another worker, starting from our neighbour
+	// so that thieves spread over the victims
+	int queueCount = (int)m_Queues.size();
+	for (int i = 1; i <= queueCount; i++)
+	{
+		int victim = (std::max(self, 0) + i) % queueCount;
+		if (victim == self)
+			continue;
+
+		WorkQueue& queue = *m_Queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			m_PendingCount--;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Singleton.hpp"
+
+// Work-stealing pool. Each worker owns a queue: tasks submitted from a worker
+// go to its own queue and are run last in first out, tasks submitted from
+// other threads go to a shared queue. Idle workers take from the shared queue
+// first, then steal the oldest task of the other workers.
+class ThreadPool : public Singleton<ThreadPool>
+{
+public:
+	// 0 uses one worker per hardware thread, minus the calling thread.
+	explicit ThreadPool(int threadCount = 0);
+
+	~ThreadPool();
+
+	int GetThreadCount() const { return (int)m_Workers.size(); }
+
+	// Only the first count workers take tasks, the others sleep, so that a
+	// measurement can run at a lower thread count on the same pool. Call
+	// while no task is running.
+	void SetActiveThreadCount(int count);
+
+	int GetActiveThreadCount() const { return m_ActiveCount; }
+
+	void Submit(std::function<void()> task);
+
+	// Splits [0, count) in chunks of grainSize items and calls func(begin, end)
+	// for each of them on the workers and on the calling thread. Returns once
+	// every chunk is done. Can be called from a task of the pool.
+	void ParallelFor(int count, int grainSize, const std::function<void(int, int)>& func);
+
+	// Same as above, on the pool if there is one, inline otherwise.
+	static void For(int count, int grainSize, const std::function<void(int, int)>& func);
+
+	// Runs queued tasks on the calling thread until done returns true, rather
+	// than blocking, so that waiting from a task can't deadlock.
+	void HelpUntil(const std::function<bool()>& done);
+
+private:
+	struct WorkQueue
+	{
+		std::deque<std::function<void()>> tasks;
+
+		std::mutex mutex;
+	};
+
+	void WorkerLoop(int index);
+
+	// Runs a queued task on the calling thread, if any.
+	bool TryRunPendingTask();
+
+	bool PopTask(std::function<void()>& task);
+
+	std::vector<std::thread> m_Workers;
+
+	std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+
+	WorkQueue m_SharedQueue;
+
+	// Number of queued tasks over all the queues, workers sleep when it's 0
+	std::atomic<int> m_PendingCount;
+
+	std::atomic<int> m_ActiveCount;
+
+	std::mutex m_SleepMutex;
+
+	std::condition_variable m_Condition;
+
+	std::atomic<bool> m_Stop;
+};
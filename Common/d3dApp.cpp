@@ -331,6 +331,7 @@ bool D3DApp::InitDirect3D()
 	//m_SceneManager = make_unique<SceneManager>();
 	m_ResourceManager = make_unique<ResourceManager>();
 	m_VertexFactory = make_unique<VertexFactory>();
+	m_ThreadPool = make_unique<ThreadPool>();
 
 	m_Initialized = true;
 
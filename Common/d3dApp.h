@@ -24,6 +24,7 @@
 #include "../Renderer/ResourceManager.h"
 #include "../Renderer/VertexFactory.h"
 #include "Debug.h"
+#include "ThreadPool.h"
 
 // Link necessary d3d12 libraries.
 #pragma comment(lib,"d3dcompiler.lib")
@@ -105,6 +106,7 @@ protected:
 	//std::unique_ptr<SceneManager> m_SceneManager;
 	std::unique_ptr<ResourceManager> m_ResourceManager;
 	std::unique_ptr<VertexFactory> m_VertexFactory;
+	std::unique_ptr<ThreadPool> m_ThreadPool;
 
     D3D12_VIEWPORT mScreenViewport; 
     D3D12_RECT mScissorRect;
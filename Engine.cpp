@@ -8,20 +8,32 @@
 #include "Common/GeometryGenerator.h"
 #include "Common/Camera.h"
 #include "Common/GraphicDebug.h"
+#include "Common/TaskGraph.h"
+#include "Common/CpuFeatures.h"
+#include "Graphics/TLSFAllocationsManager.h"
+#include "Graphics/DynamicPagePool.h"
 #include "Renderer/VertexFactory.h"
 #include "Renderer/FrameResource.h"
 #include "Renderer/Material.h"
 #include "Renderer/ResourceManager.h"
 #include "Renderer/RenderItem.h"
+#include "Renderer/RenderQueue.h"
+#include "Renderer/SkinnedInstancing.h"
 #include "Animation/LoadFBX.h"
+#include "Animation/DatabaseConverter.h"
+#include "Animation/StreamingSamplingJob.h"
+#include "Animation/CpuSkinning.h"
 #include "Animation/Utils.h"
 #include "Animation/GradientBandInterpolator.h"
 #include "Animation/MotionAnalyzer.h"
 #include "Animation/Character/Character.h"
+#include "Animation/Character/UpdateRateScheduler.h"
+#include "Animation/Character/CrowdBenchmark.h"
 #include "Animation/IKRigging/IKCompute.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "Common/stb_image.h"
 #include "DirectXTex/DirectXTex/DirectXTex.h"
+#include <filesystem>
 
 using namespace Animation;
 
@@ -35,6 +47,27 @@ enum class RenderLayer : int
 	Count
 };
 
+// Pipeline a render queue entry is drawn with, and the buffers of its pass.
+// The entries of an instanced pipeline are drawn from the skinned batches,
+// perDrawCB then holds SkinnedBatchConstants.
+struct PassPipeline
+{
+	Graphics::PipelineState* pso = nullptr;
+	Graphics::GpuDynamicBuffer* perDrawCB = nullptr;
+	bool useMaterial = true;
+	bool instanced = false;
+};
+
+// Capacity of the skinned instancing buffers
+constexpr UINT MAX_SKINNED_INSTANCES = 4096;
+constexpr UINT MAX_BONE_PALETTE_VECTORS = 1024 * 96 * 4;
+
+enum class RenderPass : uint32_t
+{
+	Shadow = 0,
+	Main
+};
+
 class Engine : public D3DApp
 {
 public:
@@ -58,7 +91,7 @@ private:
     void UpdateSkinnedCBs(void* perPassCB, const GameTimer& gt);
 	void UpdateMainPassCB(void* perPassCB, const GameTimer& gt);
 	void UpdateGUI();
-	void UpdateGraphicDebug();
+	void UpdateBenchmarkGUI();
 	void UpdateShadowTransform(const GameTimer& gt);
 	void UpdateShadowPerPassCB(const GameTimer& gt);
 
@@ -66,10 +99,19 @@ private:
 	void LoadTargetAModel();
 	void LoadTargetBModel();
 	void LoadSourceModel();
+	bool LoadSourceDatabase();
     void BuildMaterials();
     void BuildRenderItems();
 	void BuildGUI();
-    void DrawRenderItems(Graphics::GraphicsContext& graphicsContext, Graphics::PipelineState* pipelineState,Graphics::GpuDynamicBuffer* perDrawCB, Graphics::GpuDynamicBuffer* perSkinnedCB, const std::vector<RenderItem*>& ritems, bool useMaterial = true);
+	void BuildCharacterUpdateGraph();
+	void UpdateObjectConstants();
+	void BuildRenderQueues();
+	void SubmitRenderItems(RenderQueue& queue, RenderPass pass, const PassPipeline& pipeline, const std::vector<RenderItem*>& ritems, const Matrix& view, float farZ);
+	void AddSkinnedDraws(const RenderQueue& queue);
+	void UploadSkinnedInstances(Graphics::GraphicsContext& graphicsContext);
+	void DrawRenderQueue(Graphics::GraphicsContext& graphicsContext, const RenderQueue& queue);
+	void DrawSkinnedBatches(Graphics::GraphicsContext& graphicsContext, const PassPipeline& pipeline);
+	void DrawGraphicDebug(Graphics::GraphicsContext& graphicsContext);
 
 private:
 	// Main Pass
@@ -86,7 +128,6 @@ private:
 	std::shared_ptr<Graphics::GpuDynamicBuffer> m_SkinnedPerDrawCB = nullptr;
 	std::shared_ptr<Graphics::GpuDynamicBuffer> m_SkinnedPerPassCB = nullptr;
 	std::shared_ptr<Graphics::GpuDynamicBuffer> m_SkinnedLightCB = nullptr;
-	std::shared_ptr<Graphics::GpuDynamicBuffer> m_SkinnedCB = nullptr;
 	std::shared_ptr<Graphics::GpuDynamicBuffer> m_SkinnedMaterialCB = nullptr;
 
 	std::shared_ptr<Graphics::Shader> m_SkinnedVS = nullptr;
@@ -115,16 +156,44 @@ private:
 	// Skinned ShadowMap Pass
 	std::shared_ptr<Graphics::GpuDynamicBuffer> m_SkinnedShadowMapPerDrawCB = nullptr;
 	std::shared_ptr<Graphics::GpuDynamicBuffer> m_SkinnedShadowMapPerPassCB = nullptr;
-	std::shared_ptr<Graphics::GpuDynamicBuffer> m_SkinnedShadowSkinnedCB = nullptr;
 
 	std::shared_ptr<Graphics::Shader> m_SkinnedShadowMapVS = nullptr;
 	std::shared_ptr<Graphics::Shader> m_SkinnedShadowMapPS = nullptr;
 	std::unique_ptr<Graphics::PipelineState> m_SkinnedShadowMapPSO = nullptr;
 
+	// Debug Line Pass
+	std::shared_ptr<Graphics::GpuDynamicBuffer> m_DebugLinePerPassCB = nullptr;
+
+	std::shared_ptr<Graphics::Shader> m_DebugLineVS = nullptr;
+	std::shared_ptr<Graphics::Shader> m_DebugLinePS = nullptr;
+	std::unique_ptr<Graphics::PipelineState> m_DebugLinePSO = nullptr;
+
 	std::shared_ptr<Graphics::GpuRenderTextureDepth> m_ShadowMap = nullptr;
 	std::shared_ptr<Graphics::GpuResourceDescriptor> m_ShadowMapDSV = nullptr;
 	std::shared_ptr<Graphics::GpuResourceDescriptor> m_ShadowMapSRV = nullptr;
 
+	PassPipeline m_SkinnedShadowMapPipeline;
+	PassPipeline m_ShadowMapPipeline;
+	PassPipeline m_CkBPipeline;
+	PassPipeline m_MainPassPipeline;
+	PassPipeline m_SkinnedPassPipeline;
+
+	// Draws of the frame, sorted to minimize state changes
+	RenderQueue m_ShadowQueue;
+	RenderQueue m_MainQueue;
+
+	// Constants of every render item, indexed by ObjCBIndex
+	std::vector<ObjectConstants> m_ObjectConstants;
+
+	// Skinned draws of both queues grouped into instanced draws. Instances
+	// and palettes are uploaded once per frame to the buffers below.
+	SkinnedInstanceBatcher m_SkinnedBatcher{ MAX_SKINNED_INSTANCES, MAX_BONE_PALETTE_VECTORS, sizeof(ObjectConstants) };
+
+	std::shared_ptr<Graphics::GpuDefaultBuffer> m_SkinnedInstanceBuffer = nullptr;
+	std::shared_ptr<Graphics::GpuDefaultBuffer> m_BonePaletteBuffer = nullptr;
+	std::shared_ptr<Graphics::GpuResourceDescriptor> m_SkinnedInstanceSRV = nullptr;
+	std::shared_ptr<Graphics::GpuResourceDescriptor> m_BonePaletteSRV = nullptr;
+
 	const float m_ShadowMapSize = 4096.0f;
 	CD3DX12_VIEWPORT m_ShadowMapViewport;
 	CD3DX12_RECT m_ShadowMapScissorRect;
@@ -143,13 +212,14 @@ private:
     PassConstants mMainPassCB;  // index 0 of pass cbuffer.
     PassConstants mShadowPassCB;// index 1 of pass cbuffer.
 	LightConstants mLightConstants;
-	//SkinnedConstants mSkinnedConstants;
 	PBRMaterialConstants mMaterialConstants[2];
 
 	// Animation
 	enum { Animation_Num = 9 };
 	
 	const std::string bind_pose_filename = "Contents/Models/Models/xbot.fbx";
+	// Clips of the source character converted from the FBX files below
+	const std::string database_filename = "Contents/Models/Locomotion.madb";
 	const std::string targetA_bind_pose_filename = "Contents/Models/Models/NPBRGirl.fbx";
 	const std::string targetB_bind_pose_filename = "Contents/Models/Models/Tyrannosaurus.fbx";
 	// Ch36_nonPBR
@@ -178,8 +248,16 @@ private:
 	Character targetA_character;
 	Character targetB_character;
 
+	// Every character, the source first, and the ones retargeted from it.
+	// The per character loops and the update graph are built from these.
+	std::vector<Character*> mCharacters;
+	std::vector<Character*> mRetargetedCharacters;
+
 	IKPose ik_pose;
 
+	// Per-character animation pipelines, run in parallel every frame
+	TaskGraph mCharacterUpdateGraph;
+
 	std::shared_ptr<PolarGradientBandInterpolator> interpolator;
 
 	const AnimationClip* mSamplers[Animation_Num] = { nullptr };
@@ -189,6 +267,25 @@ private:
 
 	//BlendingJob blender;
 	SamplingJob sampler;
+	SamplingJob::Context samplerContext;
+	// The source clip is streamed from the database file when it could be
+	// loaded, the sampler above only fills in until its chunks are read
+	AnimationStreamer mStreamer;
+	StreamingSamplingJob mStreamingSampler;
+
+	// Poses sampled during the frame, shared by the sampling jobs
+	SampledPoseCache mPoseCache;
+
+	UpdateRateScheduler mUpdateScheduler;
+
+	// Result of the last benchmark run from the panel
+	std::string mBenchmarkReport;
+
+#ifdef MENG_PROFILER_ENABLED
+	Profiler mProfiler;
+#endif
+
+	SkinningPaletteFormat mSkinningPaletteFormat = SkinningPaletteFormat::Matrix3x4;
 
 	Camera mCamera;
 
@@ -429,9 +526,14 @@ bool Engine::Initialize()
 	//
 	shaderCI.FilePath = L"Shaders\\Default.hlsl";
 	shaderCI.EntryPoint = "VS";
+	// The palette layout is chosen once, the skinned shaders are compiled
+	// for it. Skinned items are always drawn instanced, a character alone
+	// being a batch of one instance.
 	const D3D_SHADER_MACRO skinnedDefines[] =
 	{
 		"SKINNED", "1",
+		"SKINNED_INSTANCED", "1",
+		GetSkinningPaletteDefine(mSkinningPaletteFormat), "1",
 		NULL, NULL
 	};
 	shaderCI.d3dMacros = skinnedDefines;
@@ -471,17 +573,26 @@ bool Engine::Initialize()
 
 	m_SkinnedPassPSO = std::make_unique<Graphics::PipelineState>(&Graphics::RenderDevice::GetSingleton(), PSODesc);
 
-	m_SkinnedPerDrawCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(ObjectConstants));
+	m_SkinnedPerDrawCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(SkinnedBatchConstants));
 	m_SkinnedPerPassCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(PassConstants));
 	m_SkinnedLightCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(LightConstants));
-	m_SkinnedCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(SkinnedConstants));
 
-	Graphics::ShaderVariable* skinnedPerDrawVariable = m_SkinnedPassPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbPerObject");
+	// Shared by the skinned passes, filled by UploadSkinnedInstances
+	m_SkinnedInstanceBuffer = std::make_shared<Graphics::GpuDefaultBuffer>(MAX_SKINNED_INSTANCES, sizeof(SkinnedInstanceConstants), nullptr);
+	m_SkinnedInstanceBuffer->SetName(L"SkinnedInstances");
+	m_SkinnedInstanceSRV = m_SkinnedInstanceBuffer->CreateSRV();
+	m_BonePaletteBuffer = std::make_shared<Graphics::GpuDefaultBuffer>(MAX_BONE_PALETTE_VECTORS, sizeof(DirectX::XMFLOAT4), nullptr);
+	m_BonePaletteBuffer->SetName(L"BonePalettes");
+	m_BonePaletteSRV = m_BonePaletteBuffer->CreateSRV();
+
+	Graphics::ShaderVariable* skinnedPerDrawVariable = m_SkinnedPassPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbSkinnedBatch");
 	skinnedPerDrawVariable->Set(m_SkinnedPerDrawCB);
 	Graphics::ShaderVariable* skinnedPerPassVariable = m_SkinnedPassPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbPass");
 	skinnedPerPassVariable->Set(m_SkinnedPerPassCB);
-	Graphics::ShaderVariable* skinnedVariable = m_SkinnedPassPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbSkinned");
-	skinnedVariable->Set(m_SkinnedCB);
+	Graphics::ShaderVariable* skinnedInstanceVariable = m_SkinnedPassPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "gSkinnedInstances");
+	skinnedInstanceVariable->Set(m_SkinnedInstanceSRV);
+	Graphics::ShaderVariable* bonePaletteVariable = m_SkinnedPassPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "gBonePalettes");
+	bonePaletteVariable->Set(m_BonePaletteSRV);
 	Graphics::ShaderVariable* skinnedlightVariable = m_SkinnedPassPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_PIXEL, "cbLight");
 	if (skinnedlightVariable != nullptr)
 		skinnedlightVariable->Set(m_SkinnedLightCB);
@@ -512,16 +623,66 @@ bool Engine::Initialize()
 
 	m_SkinnedShadowMapPSO = std::make_unique<Graphics::PipelineState>(&Graphics::RenderDevice::GetSingleton(), PSODesc);
 
-	m_SkinnedShadowMapPerDrawCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(ObjectConstants));
+	m_SkinnedShadowMapPerDrawCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(SkinnedBatchConstants));
 	m_SkinnedShadowMapPerPassCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(PassConstants));
-	m_SkinnedShadowSkinnedCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(SkinnedConstants));
 
-	Graphics::ShaderVariable* skinnedShadowMapPerDrawVariable = m_SkinnedShadowMapPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbPerObject");
+	Graphics::ShaderVariable* skinnedShadowMapPerDrawVariable = m_SkinnedShadowMapPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbSkinnedBatch");
 	skinnedShadowMapPerDrawVariable->Set(m_SkinnedShadowMapPerDrawCB);
 	Graphics::ShaderVariable* skinnedShadowMapPerPassVariable = m_SkinnedShadowMapPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbPass");
 	skinnedShadowMapPerPassVariable->Set(m_SkinnedShadowMapPerPassCB);
-	Graphics::ShaderVariable* skinnedShadowSkinnedVariable = m_SkinnedShadowMapPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbSkinned");
-	skinnedShadowSkinnedVariable->Set(m_SkinnedShadowSkinnedCB);
+	Graphics::ShaderVariable* skinnedShadowInstanceVariable = m_SkinnedShadowMapPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "gSkinnedInstances");
+	skinnedShadowInstanceVariable->Set(m_SkinnedInstanceSRV);
+	Graphics::ShaderVariable* skinnedShadowPaletteVariable = m_SkinnedShadowMapPSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "gBonePalettes");
+	skinnedShadowPaletteVariable->Set(m_BonePaletteSRV);
+
+	//
+	// PSO for debug lines, one instance per line.
+	//
+	{
+		Graphics::ShaderCreateInfo shaderCI;
+
+		shaderCI.FilePath = L"Shaders\\DebugLines.hlsl";
+		shaderCI.EntryPoint = "VS";
+		shaderCI.d3dMacros = nullptr;
+		shaderCI.Desc.ShaderType = Graphics::SHADER_TYPE_VERTEX;
+		m_DebugLineVS = std::make_shared<Graphics::Shader>(shaderCI);
+
+		shaderCI.EntryPoint = "PS";
+		shaderCI.Desc.ShaderType = Graphics::SHADER_TYPE_PIXEL;
+		m_DebugLinePS = std::make_shared<Graphics::Shader>(shaderCI);
+
+		// Matches GraphicDebug::Line
+		static const D3D12_INPUT_ELEMENT_DESC debugLineLayout[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+			{ "POSITION", 1, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+			{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 }
+		};
+
+		Graphics::PipelineStateDesc PSODesc;
+		PSODesc.PipelineType = Graphics::PIPELINE_TYPE_GRAPHIC;
+		PSODesc.GraphicsPipeline.VertexShader = m_DebugLineVS;
+		PSODesc.GraphicsPipeline.PixelShader = m_DebugLinePS;
+		PSODesc.GraphicsPipeline.GraphicPipelineState.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+		PSODesc.GraphicsPipeline.GraphicPipelineState.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+		PSODesc.GraphicsPipeline.GraphicPipelineState.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+		PSODesc.GraphicsPipeline.GraphicPipelineState.SampleMask = UINT_MAX;
+		PSODesc.GraphicsPipeline.GraphicPipelineState.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
+		PSODesc.GraphicsPipeline.GraphicPipelineState.NumRenderTargets = 1;
+		PSODesc.GraphicsPipeline.GraphicPipelineState.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+		PSODesc.GraphicsPipeline.GraphicPipelineState.SampleDesc.Count = 1;
+		PSODesc.GraphicsPipeline.GraphicPipelineState.SampleDesc.Quality = 0;
+		PSODesc.GraphicsPipeline.GraphicPipelineState.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		PSODesc.GraphicsPipeline.GraphicPipelineState.InputLayout.NumElements = _countof(debugLineLayout);
+		PSODesc.GraphicsPipeline.GraphicPipelineState.InputLayout.pInputElementDescs = debugLineLayout;
+
+		m_DebugLinePSO = std::make_unique<Graphics::PipelineState>(&Graphics::RenderDevice::GetSingleton(), PSODesc);
+
+		m_DebugLinePerPassCB = std::make_shared<Graphics::GpuDynamicBuffer>(1, sizeof(PassConstants));
+
+		Graphics::ShaderVariable* debugLinePerPassVariable = m_DebugLinePSO->GetStaticVariableByName(Graphics::SHADER_TYPE_VERTEX, "cbPass");
+		debugLinePerPassVariable->Set(m_DebugLinePerPassCB);
+	}
 
 	// ShadowMap
 	m_ShadowMap = std::make_shared<Graphics::GpuRenderTextureDepth>(m_ShadowMapSize, m_ShadowMapSize, DXGI_FORMAT_R24G8_TYPELESS);
@@ -548,6 +709,12 @@ bool Engine::Initialize()
 
 
 
+	m_SkinnedShadowMapPipeline = PassPipeline{ m_SkinnedShadowMapPSO.get(), m_SkinnedShadowMapPerDrawCB.get(), false, true };
+	m_ShadowMapPipeline = PassPipeline{ m_ShadowMapPSO.get(), m_ShadowMapPerDrawCB.get(), false, false };
+	m_CkBPipeline = PassPipeline{ m_CkBPSO.get(), m_CkBPerDrawCB.get(), true, false };
+	m_MainPassPipeline = PassPipeline{ m_MainPassPSO.get(), m_PerDrawCB.get(), true, false };
+	m_SkinnedPassPipeline = PassPipeline{ m_SkinnedPassPSO.get(), m_SkinnedPerDrawCB.get(), true, true };
+
 	// Set Camera
 	mCamera.SetLens(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
 	mCamera.LookAt(Vector3(0.0f, 25.0f, -50.0f), Vector3(0.0f, 0.0f, 1.0f), Vector3(0.0f, 1.0f, 0.0f));
@@ -555,10 +722,18 @@ bool Engine::Initialize()
 	LoadSourceModel();
 	LoadTargetAModel();
 	LoadTargetBModel();
+	mCharacters = { &source_character, &targetA_character, &targetB_character };
+	mRetargetedCharacters = { &targetA_character, &targetB_character };
+	for (Character* character : mCharacters)
+	{
+		character->palette_format = mSkinningPaletteFormat;
+		character->pose_cache = &mPoseCache;
+	}
 	BuildShapeGeometry();
 	BuildMaterials();
 	BuildRenderItems();
 	BuildGUI();
+	BuildCharacterUpdateGraph();
 
     return true;
 }
@@ -572,8 +747,16 @@ void Engine::OnResize()
 
 void Engine::Update(const GameTimer& gt)
 {
+#ifdef MENG_PROFILER_ENABLED
+	mProfiler.BeginFrame();
+#endif
+	PROFILE_SCOPE("Engine::Update");
+
     OnKeyboardInput(gt);
 
+	mPoseCache.BeginFrame();
+	mStreamer.Update();
+
 	//mLightRotationAngle += 0.1f * gt.DeltaTime();
 
 	XMMATRIX R = XMMatrixRotationY(mLightRotationAngle);
@@ -588,7 +771,8 @@ void Engine::Update(const GameTimer& gt)
 	UpdateShadowPerPassCB(gt);
 	UpdateMainPassCB(nullptr, gt);
 	UpdateSkinnedCBs(nullptr, gt);
-	UpdateGraphicDebug();
+	UpdateObjectConstants();
+	BuildRenderQueues();
 }
 
 
@@ -600,6 +784,9 @@ void Engine::Render(const GameTimer& gt)
 	ID3D12DescriptorHeap* samplerHeap = Graphics::RenderDevice::GetSingleton().GetGPUDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER).GetD3D12DescriptorHeap();
 	graphicsContext.SetDescriptorHeap(cbvsrvuavHeap, samplerHeap);
 
+	// Instances and palettes of both skinned passes
+	UploadSkinnedInstances(graphicsContext);
+
 	Graphics::SwapChain& swapChain = *m_SwapChain;
 	// <------------------------------------ShadowMap Pass---------------------------------------------->
 	graphicsContext.SetViewport(m_ShadowMapViewport);
@@ -609,25 +796,14 @@ void Engine::Render(const GameTimer& gt)
 	graphicsContext.ClearDepthAndStencil(*m_ShadowMapDSV);
 	graphicsContext.SetRenderTargets(0, nullptr, m_ShadowMapDSV.get());
 
-	// Draw skinned to shadowmap
-	graphicsContext.SetPipelineState(m_SkinnedShadowMapPSO.get());
-
 	void* pSkinnedShadowPerPassCB = m_SkinnedShadowMapPerPassCB->Map(graphicsContext, 256);
 	memcpy(pSkinnedShadowPerPassCB, &mShadowPassCB, sizeof(mShadowPassCB));
 
-	//void* pShadowSkinnedCB = m_SkinnedShadowSkinnedCB->Map(graphicsContext, 256);
-	//memcpy(pShadowSkinnedCB, &source_character.ri->skinnedConstant, sizeof(source_character.ri->skinnedConstant));
-
-	DrawRenderItems(graphicsContext, m_SkinnedShadowMapPSO.get(), m_SkinnedShadowMapPerDrawCB.get(), m_SkinnedShadowSkinnedCB.get(), mRitemLayer[(int)RenderLayer::SkinnedOpaque], false);
-
-	// Draw opaque to shadowmap
-	graphicsContext.SetPipelineState(m_ShadowMapPSO.get());
-
 	void* pShadowPerPassCB = m_ShadowMapPerPassCB->Map(graphicsContext, 256);
 	memcpy(pShadowPerPassCB, &mShadowPassCB, sizeof(mShadowPassCB));
 
-	DrawRenderItems(graphicsContext, m_ShadowMapPSO.get(), m_ShadowMapPerDrawCB.get(), nullptr, mRitemLayer[(int)RenderLayer::Checkboard], false);
-	DrawRenderItems(graphicsContext, m_ShadowMapPSO.get(), m_ShadowMapPerDrawCB.get(), nullptr, mRitemLayer[(int)RenderLayer::Opaque], false);
+	// Skinned and opaque items, sorted by pipeline and geometry
+	DrawRenderQueue(graphicsContext, m_ShadowQueue);
 
 	// Shadow MapȵRead״̬
 	graphicsContext.TransitionResource(*m_ShadowMap, D3D12_RESOURCE_STATE_GENERIC_READ);
@@ -646,43 +822,31 @@ void Engine::Render(const GameTimer& gt)
 	graphicsContext.ClearDepthAndStencil(*depthStencilBufferDSV);
 	graphicsContext.SetRenderTargets(1, &backBufferRTV, depthStencilBufferDSV);
 
-	// <------------------------------------Floor Pass---------------------------------------------->
-	graphicsContext.SetPipelineState(m_CkBPSO.get());
-
+	// <------------------------------------Main Pass---------------------------------------------->
+	// The per-pass buffers of the floor, opaque and skinned pipelines are
+	// filled first, the queue then switches between them as it goes.
 	void* ckBPerPassCB = m_CkBPerPassCB->Map(graphicsContext, 256);
 	memcpy(ckBPerPassCB, &mMainPassCB, sizeof(mMainPassCB));
 
 	void* ckBLightCB = m_CkBLightCB->Map(graphicsContext, 256);
 	memcpy(ckBLightCB, &mLightConstants, sizeof(mLightConstants));
 
-	DrawRenderItems(graphicsContext, m_CkBPSO.get(), m_CkBPerDrawCB.get(), nullptr, mRitemLayer[(int)RenderLayer::Checkboard]);
-
-	// <------------------------------------Main Pass---------------------------------------------->
-
-	graphicsContext.SetPipelineState(m_MainPassPSO.get());
-
 	void* perPassCB = m_PerPassCB->Map(graphicsContext, 256);
 	memcpy(perPassCB, &mMainPassCB, sizeof(mMainPassCB));
 
 	void* lightCB = m_LightCB->Map(graphicsContext, 256);
 	memcpy(lightCB, &mLightConstants, sizeof(mLightConstants));
 
-	DrawRenderItems(graphicsContext, m_MainPassPSO.get(), m_PerDrawCB.get(), nullptr, mRitemLayer[(int)RenderLayer::Opaque]);
-	DrawRenderItems(graphicsContext, m_MainPassPSO.get(), m_PerDrawCB.get(), nullptr, mRitemLayer[(int)RenderLayer::Debug]);
-
-	// <------------------------------------Skinned Pass---------------------------------------------->
-	graphicsContext.SetPipelineState(m_SkinnedPassPSO.get());
-	
 	void* skinnedPerPassCB = m_SkinnedPerPassCB->Map(graphicsContext, 256);
 	memcpy(skinnedPerPassCB, &mMainPassCB, sizeof(mMainPassCB));
 
-	//void* skinnedCB = m_SkinnedCB->Map(graphicsContext, 256);
-	//memcpy(skinnedCB, &source_character.ri->skinnedConstant, sizeof(source_character.ri->skinnedConstant));
-
 	void* skinnedlightCB = m_SkinnedLightCB->Map(graphicsContext, 256);
 	memcpy(skinnedlightCB, &mLightConstants, sizeof(mLightConstants));
 
-	DrawRenderItems(graphicsContext, m_SkinnedPassPSO.get(), m_SkinnedPerDrawCB.get(), m_SkinnedCB.get(),mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+	DrawRenderQueue(graphicsContext, m_MainQueue);
+
+	// <------------------------------------Debug Line Pass---------------------------------------------->
+	DrawGraphicDebug(graphicsContext);
 
 	// <------------------------------------GUI Pass---------------------------------------------->
 	UpdateGUI();
@@ -769,29 +933,106 @@ void Engine::UpdateSkinnedCBs(void* perPassCB, const GameTimer& gt)
 	
 	mController.Update(sampler.animation->get_duration_in_second(), gt.DeltaTime());
 
-	sampler.ratio = mController.GetTimeRatio();;
-	sampler.Run();
-	source_character.locals = sampler.output;
+	Matrix view = mCamera.GetView();
+	Matrix proj = mCamera.GetProj();
+	for (Character* character : mCharacters)
+	{
+		character->UpdateLod(view, proj);
+		mUpdateScheduler.SetClientBounds(character->update_client, character->transform.mTrans.mValue, character->GetBoundingRadius());
+	}
+
+	mUpdateScheduler.Schedule(view, proj, gt.DeltaTime());
 
-	// Retargeting
-	source_character.ik_rig.pose = source_character.locals;
-	IKCompute::Run(source_character.ik_rig, ik_pose);
+	// The sampled pose drives the retargeted characters too, so it is only
+	// reduced as much as the most detailed of them allows
+	int sourceLod = source_character.lod_level;
+	for (Character* target : mRetargetedCharacters)
+	{
+		sourceLod = std::min(sourceLod, target->lod_level);
+	}
+	sampler.lod = source_character.lod.GetLevel(sourceLod);
 
-	ik_pose.ApplyRig(targetA_character.ik_rig, mController.GetDeltaTime() * mController.GetPlaybackSpeed());
-	targetA_character.locals = targetA_character.ik_rig.pose;
+	mCharacterUpdateGraph.Run();
+}
+
+void Engine::BuildCharacterUpdateGraph()
+{
+	// Each task only writes the state of its own character. The retargeted
+	// characters read ik_pose, so they wait for the source to be computed.
+	TaskGraph& graph = mCharacterUpdateGraph;
+	graph.Clear();
+
+	// Characters skipped by the scheduler this frame display a pose rebuilt
+	// from their last updates instead.
+	mUpdateScheduler.Clear();
+	for (Character* character : mCharacters)
+	{
+		character->update_client = mUpdateScheduler.AddClient();
+	}
 
-	ik_pose.ApplyRig(targetB_character.ik_rig, mController.GetDeltaTime() * mController.GetPlaybackSpeed());
-	targetB_character.locals = targetB_character.ik_rig.pose;
+	TaskGraph::TaskId sampleSource = graph.AddTask("SampleSource", [this]()
+	{
+		int client = source_character.update_client;
+		if (mUpdateScheduler.ShouldUpdate(client))
+		{
+			sampler.ratio = mController.GetTimeRatio();
+			mStreamingSampler.ratio = sampler.ratio;
+			if (mStreamingSampler.Run())
+			{
+				source_character.locals = mStreamingSampler.output;
+			}
+			else
+			{
+				sampler.Run();
+				source_character.locals = sampler.output;
+			}
+			mUpdateScheduler.StorePose(client, source_character.locals);
+		}
 
+		mUpdateScheduler.ResolvePose(client, source_character.locals);
+		source_character.ik_rig.pose = source_character.locals;
+	});
 
-	source_character.UpdateFinalModelTransform(false);
-	targetA_character.UpdateFinalModelTransform(false);
-	targetB_character.UpdateFinalModelTransform(false);
+	TaskGraph::TaskId computeIKPose = graph.AddTask("ComputeIKPose", [this]()
+	{
+		for (Character* target : mRetargetedCharacters)
+		{
+			if (mUpdateScheduler.ShouldUpdate(target->update_client))
+			{
+				IKCompute::Run(source_character.ik_rig, ik_pose);
+				break;
+			}
+		}
+	});
+	graph.AddDependency(sampleSource, computeIKPose);
 
-	source_character.UpdateRenderItem();
-	targetA_character.UpdateRenderItem();
-	targetB_character.UpdateRenderItem();
+	TaskGraph::TaskId updateSource = graph.AddTask("UpdateSource", [this]()
+	{
+		source_character.UpdateFinalModelTransform(false);
+		source_character.UpdateRenderItem();
+	});
+	graph.AddDependency(sampleSource, updateSource);
 
+	for (Character* target : mRetargetedCharacters)
+	{
+		TaskGraph::TaskId retarget = graph.AddTask("Retarget" + target->name, [this, target]()
+		{
+			int client = target->update_client;
+			if (mUpdateScheduler.ShouldUpdate(client))
+			{
+				// The springs of the rig catch up with the skipped frames
+				float dt = std::max(mUpdateScheduler.GetElapsedTime(client), mController.GetDeltaTime());
+				ik_pose.ApplyRig(target->ik_rig, dt * mController.GetPlaybackSpeed());
+				target->locals = target->ik_rig.pose;
+				mUpdateScheduler.StorePose(client, target->locals);
+			}
+
+			mUpdateScheduler.ResolvePose(client, target->locals);
+			target->UpdateFinalModelTransform(false);
+			target->UpdateRenderItem();
+		});
+		graph.AddDependency(computeIKPose, retarget);
+	}
 }
 
 void Engine::UpdateShadowTransform(const GameTimer& gt)
@@ -937,14 +1178,50 @@ void Engine::UpdateGUI()
 		ImGui::Combo("combo", &item_current, items, IM_ARRAYSIZE(items));
 		std::string animation_name = source_character.db.GetAnimationClipName(item_current);
 		sampler.animation = source_character.db.GetAnimationClipByName(animation_name);
+		mStreamingSampler.clip = mStreamer.FindClip(animation_name);
 		if (temp != item_current)
 		{
-			targetA_character.ik_rig.Reset();
-			targetB_character.ik_rig.Reset();
+			for (Character* target : mRetargetedCharacters)
+			{
+				target->ik_rig.Reset();
+			}
 			temp = item_current;
 		}
 
 		mController.OnGui();
+
+		mPoseCache.OnGui();
+
+		if (mStreamer.IsOpen() && ImGui::CollapsingHeader("Animation streaming"))
+		{
+			StreamingStats stats = mStreamer.GetStats();
+			ImGui::Text("Resident: %d chunks, %.1f KB", stats.residentChunks, stats.residentBytes / 1024.0f);
+			ImGui::Text("Loads: %d, evictions: %d, misses: %d", stats.loads, stats.evictions, stats.misses);
+			ImGui::Text("Pending requests: %d, dropped: %d", stats.pendingRequests, stats.droppedRequests);
+		}
+
+		mUpdateScheduler.OnGui();
+
+		if (ImGui::CollapsingHeader("Render queue"))
+		{
+			const RenderQueueStats& stats = m_MainQueue.GetStats();
+			ImGui::Text("Draws: %d", stats.drawCount);
+			ImGui::Text("Pipeline changes: %d", stats.pipelineChanges);
+			ImGui::Text("Material changes: %d", stats.materialChanges);
+			ImGui::Text("Geometry changes: %d", stats.geometryChanges);
+
+			const SkinnedInstancingStats& skinnedStats = m_SkinnedBatcher.GetStats();
+			ImGui::Text("Skinned draws: %d in %d instanced draws", skinnedStats.drawCount, skinnedStats.batchCount);
+			ImGui::Text("Skinned palettes: %d, %.1f KB uploaded", skinnedStats.paletteCount, skinnedStats.uploadSize / 1024.0f);
+			if (skinnedStats.droppedDrawCount > 0)
+				ImGui::Text("Dropped skinned draws: %d", skinnedStats.droppedDrawCount);
+		}
+
+		UpdateBenchmarkGUI();
+
+#ifdef MENG_PROFILER_ENABLED
+		mProfiler.OnGui();
+#endif
 		
 		ImGui::End();
 	}
@@ -952,34 +1229,176 @@ void Engine::UpdateGUI()
 	//ImGui::End();
 }
 
-void Engine::UpdateGraphicDebug()
+// Benchmarks and self-tests of the engine systems, run on demand. A run blocks
+// the frame it is started from.
+void Engine::UpdateBenchmarkGUI()
 {
-	mRitemLayer[(int)RenderLayer::Debug].clear();
+	if (!ImGui::CollapsingHeader("Benchmarks"))
+		return;
+
+	char report[1024] = {};
 
-	//graphic_debug.DrawLine(Vector3(0.0f, 0.0f, 0.0f), Vector3(1.0f, 1.0f, 1.0f).Normalized(), 10.0f, Vector4(Colors::Red));
-	//graphic_debug.DrawLine(Vector3(1.0f, 1.0f, 1.0f), Vector3(3.0f, 3.0f, 1.0f), Vector4(Colors::Yellow));
+	if (ImGui::Button("Motion matching search"))
+	{
+		// The characters don't run motion matching, so the features are
+		// built for the run
+		MotionMatchingJob mm;
+		mm.animDatabase = &source_character.db;
+		if (!source_character.db.GetFile() || !mm.Load(*source_character.db.GetFile()))
+			mm.Build();
+
+		MotionMatchingSearchBenchmark result = BenchmarkMotionMatchingSearch(mm, 256, 4);
+		snprintf(report, sizeof(report), "Motion matching search, %d poses, 256 queries: %.3f ms pruned, %.3f ms brute force, %d mismatches",
+			mm.matcherData.rows, result.PrunedMilliseconds, result.BruteForceMilliseconds, result.Mismatches);
+	}
+
+	if (ImGui::Button("Feature distance kernels"))
+	{
+		FeatureDistanceBenchmark result = BenchmarkFeatureDistance(4096, 18, 256, 4);
+		snprintf(report, sizeof(report), "Feature distance, 4096 poses, 256 queries: %.3f ms scalar, %.3f ms SSE, %.3f ms AVX2%s%s",
+			result.ScalarMilliseconds, result.SSEMilliseconds, result.AVX2Milliseconds,
+			CpuSupportsAVX2() ? "" : " (not supported)", result.Consistent ? "" : ", kernels disagree");
+	}
 
-	for (auto line : graphic_debug.lines)
+	if (sampler.animation && ImGui::Button("Keyframe search"))
 	{
-		auto lineRitem = std::make_unique<RenderItem>();
-		lineRitem->World = MathHelper::Identity4x4();
-		Vector3 dir = line.p2 - line.p1;
-		float len = dir.Length();
-		Quaternion q = Quaternion::CreateFromVectors(Vector3::UnitY, dir);
-		XMStoreFloat4x4(&lineRitem->World, XMMatrixRotationQuaternion(q) * XMMatrixScaling(len, len, len) * XMMatrixTranslationFromVector(line.p1));
-		XMStoreFloat4x4(&lineRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
-		lineRitem->ObjCBIndex = 0;//TODO
-		lineRitem->Mat = mMaterials["tile0"].get();
-		lineRitem->Geo = mGeometries["shapeGeo"].get();
-		lineRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
-		lineRitem->IndexCount = lineRitem->Geo->DrawArgs["line"].IndexCount;
-		lineRitem->StartIndexLocation = lineRitem->Geo->DrawArgs["line"].StartIndexLocation;
-		lineRitem->BaseVertexLocation = lineRitem->Geo->DrawArgs["line"].BaseVertexLocation;
-		lineRitem->Color = line.color;
-		mRitemLayer[(int)RenderLayer::Debug].push_back(lineRitem.get());
-		mAllRitems.push_back(std::move(lineRitem));
+		KeyframeSearchBenchmark result = BenchmarkKeyframeSearch(*sampler.animation, 1024, 4);
+		snprintf(report, sizeof(report), "Keyframe search, 1024 samples of the selected clip: %.3f ms linear, %.3f ms binary, %.3f ms cursors, %d mismatches",
+			result.LinearMilliseconds, result.BinaryMilliseconds, result.CursorMilliseconds, result.Mismatches);
 	}
-	graphic_debug.Update();
+
+	if (ImGui::Button("Local to model"))
+	{
+		const AnimationDatabase& skeleton = source_character.db;
+		const std::vector<Transform>& pose = source_character.locals.size() == skeleton.JointCount() ? source_character.locals : skeleton.GetBindPose();
+		LocalToModelBenchmark result = BenchmarkLocalToModel(skeleton, pose, 1000);
+		snprintf(report, sizeof(report), "Local to model, %u joints: %.4f ms batched, %.4f ms scalar, max error %g",
+			skeleton.JointCount(), result.BatchedMilliseconds, result.ScalarMilliseconds, result.MaxError);
+	}
+
+	if (sampler.animation && ImGui::Button("Crowd scaling"))
+	{
+		std::vector<int> threadCounts = { 1, 2, 4 };
+		if (ThreadPool* pool = ThreadPool::GetSinglePtr())
+			threadCounts.push_back(pool->GetThreadCount() + 1);
+
+		std::vector<CrowdScalingSample> samples = BenchmarkCrowdScaling(source_character.db, *sampler.animation, { 16, 64, 256 }, threadCounts, 30);
+
+		int length = snprintf(report, sizeof(report), "Crowd scaling, ms per frame:");
+		for (const CrowdScalingSample& sample : samples)
+		{
+			if (length < 0 || length >= (int)sizeof(report))
+				break;
+
+			length += snprintf(report + length, sizeof(report) - length, "\n%d characters, %d threads: %.3f",
+				sample.characterCount, sample.threadCount, sample.millisecondsPerFrame);
+		}
+	}
+
+	auto sourceGeo = mGeometries.find(source_character.name);
+	if (sourceGeo != mGeometries.end() && ImGui::Button("CPU skinning"))
+	{
+		// Vertices of the source model skinned with its current pose
+		const MeshGeometry* geo = sourceGeo->second.get();
+		const SkinnedVertex* first = (const SkinnedVertex*)geo->VertexBufferCPU->GetBufferPointer();
+		std::vector<SkinnedVertex> vertices(first, first + geo->VertexBufferByteSize / sizeof(SkinnedVertex));
+
+		CpuSkinningMesh mesh;
+		mesh.Build(vertices);
+
+		const AnimationDatabase& skeleton = source_character.db;
+		std::vector<Matrix> skinning;
+		LocalToModelJob ltm_job;
+		ltm_job.skeleton = &skeleton;
+		ltm_job.input = source_character.locals.size() == skeleton.JointCount() ? &source_character.locals : &skeleton.GetBindPose();
+		ltm_job.output = &skinning;
+
+		CpuSkinnedVertices output;
+		CpuSkinningJob job;
+		job.mesh = &mesh;
+		job.output = &output;
+
+		if (ltm_job.Run(true, true) && !skinning.empty())
+		{
+			job.palette = &skinning[0]._11;
+			job.boneCount = (int)skinning.size();
+		}
+
+		CpuSkinningStats stats = BenchmarkCpuSkinning(job, 10);
+		snprintf(report, sizeof(report), "CPU skinning, %d vertices in %d batches on %d threads: %.3f ms, %.1f M vertices/s%s",
+			stats.vertexCount, stats.batchCount, stats.threadCount, stats.milliseconds, stats.verticesPerSecond / 1e6,
+			CpuSupportsAVX2() ? " (AVX2)" : " (SSE)");
+	}
+
+	if (ImGui::Button("Debug lines"))
+	{
+		double milliseconds = BenchmarkGraphicDebug(100000, 10);
+		snprintf(report, sizeof(report), "Debug lines, 100000 lines batched and copied: %.3f ms per frame", milliseconds);
+	}
+
+	if (ImGui::Button("Render queue"))
+	{
+		double milliseconds = BenchmarkRenderQueue(10000, 10);
+		snprintf(report, sizeof(report), "Render queue, 10000 draws submitted and sorted: %.3f ms", milliseconds);
+	}
+
+	if (ImGui::Button("Skinned instancing"))
+	{
+		double milliseconds = BenchmarkSkinnedInstancing(1000, (int)mSkinnedSubsets.size(), 10);
+		snprintf(report, sizeof(report), "Skinned instancing, 1000 characters of %d submeshes batched and packed: %.3f ms",
+			(int)mSkinnedSubsets.size(), milliseconds);
+	}
+
+	if (ImGui::Button("Allocations managers"))
+	{
+		const size_t maxSize = 64 << 20;
+		Graphics::AllocationsManagerBenchmark result = Graphics::BenchmarkAllocationsManagers(maxSize, 10000, 10);
+		UINT32 seed = (UINT32)GetTickCount();
+		bool fuzzPassed = Graphics::FuzzTestTLSFAllocationsManager(maxSize, 100000, seed);
+		snprintf(report, sizeof(report), "Allocations managers, 10000 operations: %.3f ms variable size (%.1f%% fragmented), %.3f ms TLSF (%.1f%% fragmented). Fuzz test with seed %u %s",
+			result.VariableSizeMilliseconds, result.VariableSizeFragmentation * 100.0f, result.TLSFMilliseconds, result.TLSFFragmentation * 100.0f,
+			seed, fuzzPassed ? "passed" : "failed, see the log");
+	}
+
+	if (ImGui::Button("Dynamic page pool"))
+	{
+		bool passed = Graphics::StressTestDynamicPagePool(4, 1000);
+		snprintf(report, sizeof(report), "Dynamic page pool, 4 threads over 1000 frames: stress test %s", passed ? "passed" : "failed, see the log");
+	}
+
+	if (report[0])
+		mBenchmarkReport = report;
+
+	if (!mBenchmarkReport.empty())
+		ImGui::TextWrapped("%s", mBenchmarkReport.c_str());
+}
+
+void Engine::DrawGraphicDebug(Graphics::GraphicsContext& graphicsContext)
+{
+	UINT lineCount = graphic_debug.GetLineCount();
+	if (lineCount == 0)
+		return;
+
+	// The lines are copied to the frame's dynamic upload pages, which are
+	// recycled once the GPU is done with the frame
+	UINT size = lineCount * sizeof(GraphicDebug::Line);
+	Graphics::D3D12DynamicAllocation lines = graphicsContext.AllocateDynamicSpace(size, 16);
+	memcpy(lines.CPUAddress, graphic_debug.GetLines(), size);
+	graphic_debug.Clear();
+
+	D3D12_VERTEX_BUFFER_VIEW vbv;
+	vbv.BufferLocation = lines.GPUAddress;
+	vbv.SizeInBytes = size;
+	vbv.StrideInBytes = sizeof(GraphicDebug::Line);
+
+	graphicsContext.SetPipelineState(m_DebugLinePSO.get());
+
+	void* debugLinePerPassCB = m_DebugLinePerPassCB->Map(graphicsContext, 256);
+	memcpy(debugLinePerPassCB, &mMainPassCB, sizeof(mMainPassCB));
+
+	graphicsContext.SetVertexBuffer(0, vbv);
+	graphicsContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
+	graphicsContext.DrawInstanced(2, lineCount);
 }
 
 
@@ -1310,6 +1729,54 @@ void Engine::LoadTargetBModel()
 	mGeometries[geo->Name] = std::move(geo);
 }
 
+// Maps the clips from the database file, which is converted again when one
+// of the FBX files is more recent.
+bool Engine::LoadSourceDatabase()
+{
+	std::vector<std::string> clipFilenames(mAnimationFilename, mAnimationFilename + Animation_Num);
+
+	std::error_code error;
+	auto databaseTime = std::filesystem::last_write_time(database_filename, error);
+	bool outdated = (bool)error;
+	auto isNewer = [&databaseTime](const std::string& source)
+	{
+		std::error_code sourceError;
+		auto sourceTime = std::filesystem::last_write_time(source, sourceError);
+		return !sourceError && sourceTime > databaseTime;
+	};
+
+	outdated = outdated || isNewer(bind_pose_filename);
+	for (const std::string& filename : clipFilenames)
+	{
+		outdated = outdated || isNewer(filename);
+	}
+
+	if (outdated && !ConvertFBXToDatabase(bind_pose_filename, clipFilenames, database_filename))
+	{
+		LOG_WARNING("Failed to convert the clips to " + database_filename + ", they are imported from the FBX files.");
+		return false;
+	}
+
+	auto file = std::make_shared<AnimationDatabaseFile>();
+	bool opened = file->Open(database_filename);
+	if (!opened && !outdated)
+	{
+		// Written with another version of the file format
+		opened = ConvertFBXToDatabase(bind_pose_filename, clipFilenames, database_filename)
+			&& file->Open(database_filename);
+	}
+
+	if (!opened || !source_character.db.Load(file))
+	{
+		LOG_WARNING("Failed to load " + database_filename + ", the clips are imported from the FBX files.");
+		return false;
+	}
+
+	mStreamer.Open(database_filename);
+	mStreamingSampler.streamer = &mStreamer;
+	return true;
+}
+
 void Engine::LoadSourceModel()
 {
 	//// Prepares playback controller
@@ -1326,15 +1793,21 @@ void Engine::LoadSourceModel()
 	source_character.transform.mTrans.mValue = Vector3(0.0f, 0.0f, 0.0f);
 	source_character.db.graphic_debug = &graphic_debug;
 
-	for (int i = 0; i < Animation_Num; i++)
+	if (!LoadSourceDatabase())
 	{
-		fbxLoader.LoadFBXClip(mAnimationFilename[i], source_character.db);
+		for (int i = 0; i < Animation_Num; i++)
+		{
+			fbxLoader.LoadFBXClip(mAnimationFilename[i], source_character.db);
+		}
 	}
 
 	source_character.ik_rig.Init(&source_character.db, &source_character.db.GetBindPose(), true);
 
 	std::string animation_name = source_character.db.GetAnimationClipName(5);
 	sampler.animation = source_character.db.GetAnimationClipByName(animation_name);
+	sampler.context = &samplerContext;
+	sampler.cache = &mPoseCache;
+	mStreamingSampler.clip = mStreamer.FindClip(animation_name);
 
 	const UINT vbByteSize = static_cast<UINT>(vertices.size()) * sizeof(Animation::SkinnedVertex);
 	const UINT ibByteSize = static_cast<UINT>(indices.size()) * sizeof(std::uint16_t);
@@ -1565,37 +2038,182 @@ void Engine::BuildGUI()
 
 }
 
-void Engine::DrawRenderItems(Graphics::GraphicsContext& graphicsContext, Graphics::PipelineState* pipelineState, Graphics::GpuDynamicBuffer* perDrawCB, Graphics::GpuDynamicBuffer* perSkinnedCB,const std::vector<RenderItem*>& ritems, bool useMaterial)
+void Engine::UpdateObjectConstants()
+{
+	PROFILE_SCOPE("Engine::UpdateObjectConstants");
+
+	m_ObjectConstants.resize(mAllRitems.size());
+
+	ThreadPool::For((int)mAllRitems.size(), 16, [this](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const RenderItem* ri = mAllRitems[i].get();
+			assert(ri->ObjCBIndex == (UINT)i);
+
+			ObjectConstants& objConstants = m_ObjectConstants[i];
+			XMMATRIX world = XMLoadFloat4x4(&ri->World);
+			XMMATRIX object = XMMatrixInverse(nullptr, world);
+			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&objConstants.Obejct, XMMatrixTranspose(object));
+			XMStoreFloat4(&objConstants.Color, XMLoadFloat4(&ri->Color));
+		}
+	});
+}
+
+void Engine::BuildRenderQueues()
+{
+	PROFILE_SCOPE("Engine::BuildRenderQueues");
+
+	Matrix lightView = mLightView;
+	m_ShadowQueue.Clear();
+	SubmitRenderItems(m_ShadowQueue, RenderPass::Shadow, m_SkinnedShadowMapPipeline, mRitemLayer[(int)RenderLayer::SkinnedOpaque], lightView, mLightFarZ);
+	SubmitRenderItems(m_ShadowQueue, RenderPass::Shadow, m_ShadowMapPipeline, mRitemLayer[(int)RenderLayer::Checkboard], lightView, mLightFarZ);
+	SubmitRenderItems(m_ShadowQueue, RenderPass::Shadow, m_ShadowMapPipeline, mRitemLayer[(int)RenderLayer::Opaque], lightView, mLightFarZ);
+	m_ShadowQueue.Sort();
+
+	Matrix view = mCamera.GetView();
+	m_MainQueue.Clear();
+	SubmitRenderItems(m_MainQueue, RenderPass::Main, m_CkBPipeline, mRitemLayer[(int)RenderLayer::Checkboard], view, mCamera.GetFarZ());
+	SubmitRenderItems(m_MainQueue, RenderPass::Main, m_MainPassPipeline, mRitemLayer[(int)RenderLayer::Opaque], view, mCamera.GetFarZ());
+	SubmitRenderItems(m_MainQueue, RenderPass::Main, m_SkinnedPassPipeline, mRitemLayer[(int)RenderLayer::SkinnedOpaque], view, mCamera.GetFarZ());
+	m_MainQueue.Sort();
+
+	m_SkinnedBatcher.Clear();
+	AddSkinnedDraws(m_ShadowQueue);
+	AddSkinnedDraws(m_MainQueue);
+	m_SkinnedBatcher.Build();
+}
+
+void Engine::AddSkinnedDraws(const RenderQueue& queue)
+{
+	for (const RenderQueueEntry& entry : queue.GetEntries())
+	{
+		if (!static_cast<const PassPipeline*>(entry.pipeline)->instanced)
+			continue;
+
+		const RenderItem* ri = mAllRitems[entry.item].get();
+
+		SkinnedDraw draw;
+		draw.pipeline = entry.pipeline;
+		draw.material = entry.material;
+		draw.geometry = entry.geometry;
+		draw.indexCount = ri->IndexCount;
+		draw.startIndexLocation = ri->StartIndexLocation;
+		draw.baseVertexLocation = ri->BaseVertexLocation;
+		draw.object = &m_ObjectConstants[entry.item];
+		draw.palette = ri->SkinnedPalette;
+		draw.paletteSize = ri->SkinnedPaletteSize;
+		draw.item = entry.item;
+		m_SkinnedBatcher.Add(draw);
+	}
+}
+
+void Engine::UploadSkinnedInstances(Graphics::GraphicsContext& graphicsContext)
 {
-	// For each render item...
-	for (size_t i = 0; i < ritems.size(); ++i)
+	auto upload = [&graphicsContext](Graphics::GpuDefaultBuffer& buffer, const void* data, size_t size)
 	{
-		auto ri = ritems[i];
+		if (size == 0)
+			return;
+
+		Graphics::D3D12DynamicAllocation allocation = graphicsContext.AllocateDynamicSpace(size, 16);
+		memcpy(allocation.CPUAddress, data, size);
+
+		graphicsContext.TransitionResource(buffer, D3D12_RESOURCE_STATE_COPY_DEST);
+		graphicsContext.CopyBufferRegion(buffer, 0, allocation, size);
+		graphicsContext.TransitionResource(buffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	};
 
-		if (useMaterial)
-			ri->Mat->CreateSRB(pipelineState);
+	const std::vector<uint8_t>& instances = m_SkinnedBatcher.GetInstances();
+	upload(*m_SkinnedInstanceBuffer, instances.data(), instances.size());
 
-		graphicsContext.SetVertexBuffer(0, ri->Geo->VertexBufferView());
-		graphicsContext.SetIndexBuffer(ri->Geo->IndexBufferView());
-		graphicsContext.SetPrimitiveTopology(ri->PrimitiveType);
-		if(useMaterial)
-			graphicsContext.SetShaderResourceBinding(ri->Mat->GetSRB());
+	const std::vector<float>& palettes = m_SkinnedBatcher.GetPalettes();
+	upload(*m_BonePaletteBuffer, palettes.data(), palettes.size() * sizeof(float));
+}
 
-		if (ri->IsSkinned){
-			void* pSkinnedCB = perSkinnedCB->Map(graphicsContext, 256);
-			memcpy(pSkinnedCB, &ri->skinnedConstant, sizeof(ri->skinnedConstant));
+void Engine::SubmitRenderItems(RenderQueue& queue, RenderPass pass, const PassPipeline& pipeline, const std::vector<RenderItem*>& ritems, const Matrix& view, float farZ)
+{
+	for (const RenderItem* ri : ritems)
+	{
+		// Sorted front to back on the depth of the item's origin
+		float depth = Vector3::Transform(ri->World.Translation(), view).z / farZ;
+
+		queue.Submit((uint32_t)pass, &pipeline, pipeline.useMaterial ? ri->Mat : nullptr, ri->Geo,
+			ri->PrimitiveType, depth, ri->ObjCBIndex);
+	}
+}
+
+void Engine::DrawRenderQueue(Graphics::GraphicsContext& graphicsContext, const RenderQueue& queue)
+{
+	const PassPipeline* pipeline = nullptr;
+
+	for (const RenderQueueEntry& entry : queue.GetEntries())
+	{
+		RenderItem* ri = mAllRitems[entry.item].get();
+
+		if (entry.changes & RENDER_CHANGE_PIPELINE)
+		{
+			pipeline = static_cast<const PassPipeline*>(entry.pipeline);
+			graphicsContext.SetPipelineState(pipeline->pso);
+
+			// The entries of the pipeline all follow, they are drawn by
+			// their batches
+			if (pipeline->instanced)
+				DrawSkinnedBatches(graphicsContext, *pipeline);
 		}
 
-		ObjectConstants objConstants;
-		XMMATRIX world = XMLoadFloat4x4(&ri->World);
-		XMMATRIX object = XMMatrixInverse(nullptr, world);
-		XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-		XMStoreFloat4x4(&objConstants.Obejct, XMMatrixTranspose(object));
-		XMStoreFloat4(&objConstants.Color, XMLoadFloat4(&ri->Color));
-		void* pPerDrawCB = perDrawCB->Map(graphicsContext, 256);
-		memcpy(pPerDrawCB, &objConstants, sizeof(ObjectConstants));
+		if (pipeline->instanced)
+			continue;
+
+		if ((entry.changes & RENDER_CHANGE_MATERIAL) && pipeline->useMaterial)
+			graphicsContext.SetShaderResourceBinding(ri->Mat->GetSRB(pipeline->pso));
+
+		if (entry.changes & RENDER_CHANGE_GEOMETRY)
+		{
+			graphicsContext.SetVertexBuffer(0, ri->Geo->VertexBufferView());
+			graphicsContext.SetIndexBuffer(ri->Geo->IndexBufferView());
+		}
+
+		if (entry.changes & RENDER_CHANGE_TOPOLOGY)
+			graphicsContext.SetPrimitiveTopology(ri->PrimitiveType);
+
+		void* pPerDrawCB = pipeline->perDrawCB->Map(graphicsContext, 256);
+		memcpy(pPerDrawCB, &m_ObjectConstants[entry.item], sizeof(ObjectConstants));
 
 		graphicsContext.DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+	}
+}
+
+void Engine::DrawSkinnedBatches(Graphics::GraphicsContext& graphicsContext, const PassPipeline& pipeline)
+{
+	const SkinnedInstanceBatch* prev = nullptr;
+
+	for (const SkinnedInstanceBatch& batch : m_SkinnedBatcher.GetBatches())
+	{
+		if (batch.pipeline != &pipeline)
+			continue;
+
+		RenderItem* ri = mAllRitems[batch.item].get();
+
+		if (pipeline.useMaterial && (!prev || batch.material != prev->material))
+			graphicsContext.SetShaderResourceBinding(ri->Mat->GetSRB(pipeline.pso));
+
+		if (!prev || batch.geometry != prev->geometry)
+		{
+			graphicsContext.SetVertexBuffer(0, ri->Geo->VertexBufferView());
+			graphicsContext.SetIndexBuffer(ri->Geo->IndexBufferView());
+		}
+
+		if (!prev || ri->PrimitiveType != mAllRitems[prev->item]->PrimitiveType)
+			graphicsContext.SetPrimitiveTopology(ri->PrimitiveType);
+
+		SkinnedBatchConstants batchConstants;
+		batchConstants.BaseInstance = batch.firstInstance;
+		void* pBatchCB = pipeline.perDrawCB->Map(graphicsContext, 256);
+		memcpy(pBatchCB, &batchConstants, sizeof(SkinnedBatchConstants));
+
+		graphicsContext.DrawIndexedInstanced(batch.indexCount, batch.instanceCount, batch.startIndexLocation, batch.baseVertexLocation, 0);
 
+		prev = &batch;
 	}
 }
\ No newline at end of file
@@ -16,6 +16,8 @@ namespace Graphics
 	// ´һCommandAllocator
 	ID3D12CommandAllocator* CommandAllocatorPool::RequestAllocator(UINT64 CompletedFenceValue)
 	{
+		std::lock_guard<std::mutex> LockGuard(m_AllocatorMutex);
+
 		ID3D12CommandAllocator* pAllocator = nullptr;
 
 		if (!m_ReadyAllocators.empty())
@@ -45,6 +47,8 @@ namespace Graphics
 
 	void CommandAllocatorPool::DiscardAllocator(uint64_t FenceValue, ID3D12CommandAllocator* Allocator)
 	{
+		std::lock_guard<std::mutex> LockGuard(m_AllocatorMutex);
+
 		m_ReadyAllocators.push(std::make_pair(FenceValue, Allocator));
 	}
 
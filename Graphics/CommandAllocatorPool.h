@@ -23,5 +23,6 @@ namespace Graphics
 		ID3D12Device* m_Device;
 		std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> m_Allocators;
 		std::queue<std::pair<uint64_t, ID3D12CommandAllocator*>> m_ReadyAllocators;
+		std::mutex m_AllocatorMutex;
     };
 }
\ No newline at end of file
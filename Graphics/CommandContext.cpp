@@ -1,4 +1,5 @@
 #include "../pch.h"
+#include <stdexcept>
 #include "CommandContext.h"
 #include "CommandListManager.h"
 #include "CommandQueue.h"
@@ -10,12 +11,20 @@ namespace Graphics
 
 	CommandContext* ContextManager::AllocateContext(D3D12_COMMAND_LIST_TYPE Type)
 	{
+		std::lock_guard<std::mutex> LockGuard(m_ContextAllocationMutex);
+
 		auto& AvailableContexts = m_AvailableContexts[Type];
 
 		CommandContext* context = nullptr;
 		if (AvailableContexts.empty())
 		{
-			context = new CommandContext(Type);
+			// GpuDynamicBufferűÿCommandContextķ䣬MAX_COMMAND_CONTEXTSԽ磬ܼ
+			if (m_NumContexts >= MAX_COMMAND_CONTEXTS)
+			{
+				LOG_ERROR("Too many command contexts, increase MAX_COMMAND_CONTEXTS");
+				throw std::runtime_error("Too many command contexts");
+			}
+			context = new CommandContext(Type, m_NumContexts++);
 			m_ContextPool[Type].emplace_back(context);
 			context->Initialize();
 		}
@@ -35,11 +44,13 @@ namespace Graphics
 	void ContextManager::FreeContext(CommandContext* UsedContext)
 	{
 		assert(UsedContext != nullptr);
+		std::lock_guard<std::mutex> LockGuard(m_ContextAllocationMutex);
 		m_AvailableContexts[UsedContext->m_Type].push(UsedContext);
 	}
 
-	CommandContext::CommandContext(D3D12_COMMAND_LIST_TYPE Type) :
+	CommandContext::CommandContext(D3D12_COMMAND_LIST_TYPE Type, UINT32 ContextIndex) :
 		m_Type(Type),
+		m_ContextIndex(ContextIndex),
 		m_CommandList(nullptr),
 		m_CurrentAllocator(nullptr),
 		m_NumBarriersToFlush(0),
@@ -54,7 +65,7 @@ namespace Graphics
 		// ͷŷDynamic Descriptor
 		m_DynamicGPUDescriptorAllocator.ReleaseAllocations();
 		// ͷŷDynamic Resource
-		m_DynamicResourceHeap.ReleaseAllocatedPages();
+		m_DynamicResourceHeap.ReleaseAllocatedPages(CommandListManager::GetSingleton().GetQueue(m_Type).GetNextFenceValue(), m_Type);
 	}
 
 	void CommandContext::Initialize()
@@ -118,15 +129,16 @@ namespace Graphics
 		{
 			// ͷŷDynamic Descriptor
 			m_DynamicGPUDescriptorAllocator.ReleaseAllocations();
-
-			// ͷŷDynamic Resource
-			m_DynamicResourceHeap.ReleaseAllocatedPages();
 		}
 		
 		uint64_t FenceValue = Queue.ExecuteCommandList(m_CommandList.Get());
 		Queue.DiscardAllocator(FenceValue, m_CurrentAllocator);
 		m_CurrentAllocator = nullptr;
 
+		// ͷŷDynamic ResourceGPUCommandList֮ŻḴЩPage
+		if (releaseDynamic)
+			m_DynamicResourceHeap.ReleaseAllocatedPages(FenceValue, m_Type);
+
 
 		if (WaitForCompletion)
 			CommandListManager::GetSingleton().WaitForFence(FenceValue, m_Type);
@@ -192,6 +204,14 @@ namespace Graphics
 		return m_DynamicResourceHeap.Allocate(NumBytes, Alignment);
 	}
 
+	void CommandContext::CopyBufferRegion(GpuBuffer& Dest, size_t DestOffset, const D3D12DynamicAllocation& Src, size_t NumBytes)
+	{
+		assert(NumBytes <= Src.Size && DestOffset + NumBytes <= Dest.GetBufferSize());
+
+		FlushResourceBarriers();
+		m_CommandList->CopyBufferRegion(Dest.GetResource(), DestOffset, Src.pBuffer, Src.Offset, NumBytes);
+	}
+
 	void CommandContext::TransitionResource(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate /*= false*/)
 	{
 		D3D12_RESOURCE_STATES OldState = Resource.m_UsageState;
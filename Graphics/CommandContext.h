@@ -24,6 +24,7 @@ namespace Graphics
 
 
 	// TODO:ùƶRenderDevice
+	// ߳̿ͬʱͻCommandContext
 	class ContextManager : public Singleton<ContextManager>
 	{
 	public:
@@ -33,6 +34,9 @@ namespace Graphics
 	private:
 		std::vector<std::unique_ptr<CommandContext> > m_ContextPool[4];
 		std::queue<CommandContext*> m_AvailableContexts[4];
+		// ͵CommandContextCommandContextı
+		UINT32 m_NumContexts = 0;
+		std::mutex m_ContextAllocationMutex;
 	};
 
 	struct NonCopyable
@@ -54,7 +58,7 @@ namespace Graphics
 
 		// CommandContextContextManager,԰ѹ캯ķȨΪprivate
 	private:
-		CommandContext(D3D12_COMMAND_LIST_TYPE Type);
+		CommandContext(D3D12_COMMAND_LIST_TYPE Type, UINT32 ContextIndex);
 
 		// CommandContextʱãúᴴһCommandListһAllocator
 		void Initialize();
@@ -66,6 +70,9 @@ namespace Graphics
 
 		// ʼ¼
 		 static CommandContext& Begin(const std::wstring ID = L"");
+
+		// CommandContextıţ[0, MAX_COMMAND_CONTEXTS)֮
+		UINT32 GetContextIndex() const { return m_ContextIndex; }
 		// Flush existing commands to the GPU but keep the context alive
 		uint64_t Flush(bool WaitForCompletion = false);
 		// ɼ¼
@@ -102,6 +109,9 @@ namespace Graphics
 		// ΪDynamic Resourceڴ
 		D3D12DynamicAllocation AllocateDynamicSpace(size_t NumBytes, size_t Alignment);
 
+		// AllocateDynamicSpaceCopyBufferDestҪȹȵCOPY_DEST״̬
+		void CopyBufferRegion(GpuBuffer& Dest, size_t DestOffset, const D3D12DynamicAllocation& Src, size_t NumBytes);
+
 		/* Resource Barrier TODO: UAVBarrier
 		* GpuResourceԱm_UsageStatem_TransitioningState
 		* m_UsageState:ʾԴǰ״̬TransitionResourceʹm_UsageStateԴĵǰ״̬͹֮״̬ȲύResource Barrier
@@ -131,6 +141,7 @@ namespace Graphics
 		void SetID(const std::wstring& ID) { m_ID = ID; }
 
 		D3D12_COMMAND_LIST_TYPE m_Type;
+		const UINT32 m_ContextIndex;
 		// CommandListCommandContextУCommandAllocatorɶع
 		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList;
 		ID3D12CommandAllocator* m_CurrentAllocator;
@@ -36,6 +36,8 @@ namespace Graphics
 
 	UINT64 CommandQueue::IncrementFence(void)
 	{
+		std::lock_guard<std::mutex> LockGuard(m_FenceMutex);
+
 		m_CommandQueue->Signal(m_pFence.Get(), m_NextFenceValue);
 		return m_NextFenceValue++;
 	}
@@ -45,10 +47,20 @@ namespace Graphics
 		// Avoid querying the fence value by testing against the last one seen.
 		// The max() is to protect against an unlikely race condition that could cause the last
 		// completed fence value to regress.
-		if (FenceValue > m_LastCompletedFenceValue)
-			m_LastCompletedFenceValue = std::max(m_LastCompletedFenceValue, m_pFence->GetCompletedValue());
+		if (FenceValue > m_LastCompletedFenceValue.load())
+			UpdateLastCompletedFenceValue(m_pFence->GetCompletedValue());
 
-		return FenceValue <= m_LastCompletedFenceValue;
+		return FenceValue <= m_LastCompletedFenceValue.load();
+	}
+
+	void CommandQueue::UpdateLastCompletedFenceValue(UINT64 CompletedFenceValue)
+	{
+		// ߳ͬʱʱֵֻ
+		UINT64 LastCompletedFenceValue = m_LastCompletedFenceValue.load();
+		while (LastCompletedFenceValue < CompletedFenceValue &&
+			!m_LastCompletedFenceValue.compare_exchange_weak(LastCompletedFenceValue, CompletedFenceValue))
+		{
+		}
 	}
 
 
@@ -61,8 +73,9 @@ namespace Graphics
 
 	void CommandQueue::StallForProducer(CommandQueue& Producer)
 	{
-		assert(Producer.m_NextFenceValue > 0);
-		m_CommandQueue->Wait(Producer.m_pFence.Get(), Producer.m_NextFenceValue - 1);
+		UINT64 ProducerFenceValue = Producer.m_NextFenceValue.load();
+		assert(ProducerFenceValue > 0);
+		m_CommandQueue->Wait(Producer.m_pFence.Get(), ProducerFenceValue - 1);
 	}
 
 	void CommandQueue::WaitForFence(UINT64 FenceValue)
@@ -72,11 +85,13 @@ namespace Graphics
 
 		m_pFence->SetEventOnCompletion(FenceValue, m_FenceEventHandle);
 		WaitForSingleObject(m_FenceEventHandle, INFINITE);
-		m_LastCompletedFenceValue = FenceValue;
+		UpdateLastCompletedFenceValue(FenceValue);
 	}
 
 	UINT64 CommandQueue::ExecuteCommandList(ID3D12CommandList* List)
 	{
+		std::lock_guard<std::mutex> LockGuard(m_FenceMutex);
+
 		ThrowIfFailed(((ID3D12GraphicsCommandList*)List)->Close());
 
 		// Kickoff the command list
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include "CommandAllocatorPool.h"
 
 namespace Graphics 
@@ -23,7 +24,7 @@ namespace Graphics
 		void WaitForFence(UINT64 FenceValue);
 		void WaitForIdle(void) { WaitForFence(IncrementFence()); }
 
-		UINT64 GetNextFenceValue() const { return m_NextFenceValue; }
+		UINT64 GetNextFenceValue() const { return m_NextFenceValue.load(); }
 		UINT64 GetCompletedFenceValue() const { return m_pFence->GetCompletedValue(); }
 
 		ID3D12CommandQueue* GetD3D12CommandQueue() { return m_CommandQueue.Get(); }
@@ -33,6 +34,7 @@ namespace Graphics
 
 		ID3D12CommandAllocator* RequestAllocator(void);
 		void DiscardAllocator(uint64_t FenceValue, ID3D12CommandAllocator* Allocator);
+		void UpdateLastCompletedFenceValue(UINT64 CompletedFenceValue);
 
 
 		Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CommandQueue;
@@ -41,8 +43,11 @@ namespace Graphics
 		CommandAllocatorPool m_AllocatorPool;
 
 		Microsoft::WRL::ComPtr<ID3D12Fence> m_pFence;
-		UINT64 m_NextFenceValue;
-		UINT64 m_LastCompletedFenceValue;
+		// ̻߳ͬʱȡFenceValueʹatomic޸m_NextFenceValueSignalm_FenceMutexһɣ
+		// ֤FenceValueύ˳
+		std::atomic<UINT64> m_NextFenceValue;
+		std::atomic<UINT64> m_LastCompletedFenceValue;
+		std::mutex m_FenceMutex;
 		HANDLE m_FenceEventHandle;
     };
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "VariableSizeAllocationsManager.h"
+#include "TLSFAllocationsManager.h"
 
 namespace Graphics 
 {
@@ -162,7 +163,7 @@ namespace Graphics
     * һD3D12 Descriptor HeapһDescriptor Heapһ
     * CPU-onlyDescriptor HeapжǹһDescriptor Heap
     * GPU-visibleDescriptor HeapУΪֻһDX12 Descriptor HeapManagerֻǹеһ
-    * ʹVariableSizeAllocationsManagerеĿڴ
+    * ʹVariableSizeAllocationsManagerTLSFAllocationsManagerеĿڴ棬DESCRIPTOR_HEAP_USE_TLSFѡ
     *
     * |  X  X  X  X  O  O  O  X  X  O  O  X  O  O  O  O  |  D3D12 descriptor heap
     *
@@ -172,6 +173,12 @@ namespace Graphics
     class DescriptorHeapAllocationManager
     {
     public:
+#if DESCRIPTOR_HEAP_USE_TLSF
+        using FreeBlockManager = TLSFAllocationsManager;
+#else
+        using FreeBlockManager = VariableSizeAllocationsManager;
+#endif
+
         // һµD3D12 Descriptor Heap, CPU Descriptor Heapʹ
         DescriptorHeapAllocationManager(RenderDevice&                     renderDevice,
                                         IDescriptorAllocator&             parentAllocator,
@@ -234,7 +241,7 @@ namespace Graphics
         // ԷDescriptor
         UINT32 m_NumDescriptorsInAllocation = 0;
 
-        VariableSizeAllocationsManager m_FreeBlockManager;
+        FreeBlockManager m_FreeBlockManager;
 
         Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_DescriptorHeap;
 
@@ -0,0 +1,123 @@
+#include "DynamicPagePool.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Graphics
+{
+    bool StressTestDynamicPagePool(int ThreadCount, int FrameCount)
+    {
+        // ģQueueFenceValue1ʼƽٶȲͬ
+        const uint32_t FenceDomains[2] = { 0, 2 };
+        const uint32_t MaxPages = static_cast<uint32_t>(ThreadCount) * 64;
+
+        // Pageʹ̱߳
+        DynamicPagePool<uint64_t> Pool(MaxPages);
+
+        // ÿPageǷڱʹãԼʱFenceDomainFenceValue
+        std::unique_ptr<std::atomic<int>[]> PageUsers = std::make_unique<std::atomic<int>[]>(MaxPages);
+        std::unique_ptr<std::atomic<uint32_t>[]> PageDomains = std::make_unique<std::atomic<uint32_t>[]>(MaxPages);
+        std::unique_ptr<std::atomic<uint64_t>[]> PageFences = std::make_unique<std::atomic<uint64_t>[]>(MaxPages);
+        for (uint32_t i = 0; i < MaxPages; ++i)
+        {
+            PageUsers[i].store(0);
+            PageDomains[i].store(0);
+            PageFences[i].store(0);
+        }
+
+        std::atomic<uint64_t> NextFenceValue[2] = { { 1 }, { 1 } };
+        std::atomic<uint64_t> CompletedFenceValue[2] = { { 0 }, { 0 } };
+        std::atomic<int> RunningThreads{ ThreadCount };
+        std::atomic<int> Errors{ 0 };
+
+        // ģGPUÿһFenceValueڶQueueÿ4βƽһ
+        std::thread Gpu([&]()
+        {
+            for (uint64_t Step = 0; RunningThreads.load() > 0; ++Step)
+            {
+                for (int q = 0; q < 2; ++q)
+                {
+                    if (q == 1 && Step % 4 != 0)
+                        continue;
+
+                    uint64_t Completed = CompletedFenceValue[q].load();
+                    if (Completed + 1 < NextFenceValue[q].load())
+                        CompletedFenceValue[q].store(Completed + 1);
+                }
+                std::this_thread::yield();
+            }
+        });
+
+        std::vector<std::thread> Threads;
+        for (int t = 0; t < ThreadCount; ++t)
+        {
+            Threads.emplace_back([&, t]()
+            {
+                // ߳ģAsync Compute
+                const int Queue = t % 2;
+                const uint32_t FenceDomain = FenceDomains[Queue];
+
+                uint32_t Seed = t * 7919u + 1u;
+                std::vector<uint32_t> Pages;
+
+                for (int Frame = 0; Frame < FrameCount; ++Frame)
+                {
+                    Seed = Seed * 1664525u + 1013904223u;
+                    int NumPages = 1 + (Seed >> 24) % 4;
+
+                    for (int i = 0; i < NumPages; ++i)
+                    {
+                        Seed = Seed * 1664525u + 1013904223u;
+                        uint64_t Size = 1ull << (16 + (Seed >> 28) % 5);
+
+                        uint32_t Page = Pool.Acquire(Size);
+                        if (Page == Pool.InvalidPage)
+                        {
+                            for (int q = 0; q < 2; ++q)
+                                Pool.Reclaim(CompletedFenceValue[q].load(), FenceDomains[q]);
+                            Page = Pool.Acquire(Size);
+                        }
+                        if (Page == Pool.InvalidPage)
+                            Page = Pool.Add(uint64_t(t), Size);
+                        if (Page == Pool.InvalidPage)
+                            continue;
+
+                        if (PageUsers[Page].exchange(1) != 0)
+                            Errors++;
+                        if (Pool.GetPageSize(Page) < Size)
+                            Errors++;
+                        // ʱڵQueueɵFenceValueȽ
+                        if (PageFences[Page].load() > CompletedFenceValue[PageDomains[Page].load() == FenceDomains[0] ? 0 : 1].load())
+                            Errors++;
+
+                        Pool.GetPage(Page) = uint64_t(t);
+                        Pages.push_back(Page);
+                    }
+
+                    uint64_t FenceValue = NextFenceValue[Queue].fetch_add(1);
+                    for (uint32_t Page : Pages)
+                    {
+                        if (Pool.GetPage(Page) != uint64_t(t))
+                            Errors++;
+
+                        PageDomains[Page].store(FenceDomain);
+                        PageFences[Page].store(FenceValue);
+                        PageUsers[Page].store(0);
+                        Pool.Retire(Page, FenceValue, FenceDomain);
+                    }
+                    Pages.clear();
+                }
+
+                RunningThreads--;
+            });
+        }
+
+        for (std::thread& Thread : Threads)
+            Thread.join();
+        Gpu.join();
+
+        Pool.Destroy();
+
+        return Errors.load() == 0;
+    }
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace Graphics
+{
+    /**
+    * PageأPageģӱD3D12ƽ̵̨߳ѹ
+    * ÿPageڳһ̶ıţPageֻDestroyʱͷţջֻţ
+    *   еPageС飬С[2^n, 2^(n+1))֮PageڵnջУʱССջʼ
+    *   PageFenceValueһջReclaimʱGPUѾɵPageŻؿջ
+    *   ÿQueueFenceValueǸԵģÿFenceDomainһջֻͬһQueueɵFenceValueȽ
+    * ջĸ32λǰ汾ţÿ޸ջ1ջʱABA
+    */
+    template <typename PageType>
+    class DynamicPagePool
+    {
+    public:
+        static constexpr uint32_t InvalidPage = static_cast<uint32_t>(-1);
+        // D3D12_COMMAND_LIST_TYPEһ
+        static constexpr uint32_t NumFenceDomains = 4;
+
+        explicit DynamicPagePool(uint32_t MaxPages) :
+            m_Nodes{ std::make_unique<Node[]>(MaxPages) },
+            m_MaxPages{ MaxPages }
+        {
+            for (auto& Head : m_FreePages)
+                Head.store(InvalidPage, std::memory_order_relaxed);
+            for (auto& Head : m_RetiredPages)
+                Head.store(InvalidPage, std::memory_order_relaxed);
+        }
+
+        DynamicPagePool(const DynamicPagePool&) = delete;
+        DynamicPagePool& operator= (const DynamicPagePool&) = delete;
+
+        // һССSizeInBytesĿPageûʱInvalidPage
+        uint32_t Acquire(uint64_t SizeInBytes)
+        {
+            for (uint32_t SizeClass = CeilLog2(SizeInBytes); SizeClass < NumSizeClasses; ++SizeClass)
+            {
+                uint32_t Page = Pop(m_FreePages[SizeClass]);
+                if (Page != InvalidPage)
+                    return Page;
+            }
+            return InvalidPage;
+        }
+
+        // ´PageУصPageʹ״̬˷InvalidPage
+        uint32_t Add(PageType&& Page, uint64_t Size)
+        {
+            uint32_t Index = m_NumPages.fetch_add(1, std::memory_order_relaxed);
+            if (Index >= m_MaxPages)
+                return InvalidPage;
+
+            m_Nodes[Index].Page.emplace(std::move(Page));
+            m_Nodes[Index].Size = Size;
+            return Index;
+        }
+
+        // ҪȴGPUPageֱӷŻؿջ
+        void Release(uint32_t Page)
+        {
+            Push(m_FreePages[FloorLog2(m_Nodes[Page].Size)], Page);
+        }
+
+        // PageFenceDomainӦQueueFenceValueܸ֮
+        void Retire(uint32_t Page, uint64_t FenceValue, uint32_t FenceDomain = 0)
+        {
+            assert(FenceDomain < NumFenceDomains);
+            m_Nodes[Page].FenceValue = FenceValue;
+            Push(m_RetiredPages[FenceDomain], Page);
+        }
+
+        // FenceDomainFenceValue <= CompletedFenceValuePageŻؿջPageŻջ
+        // ջֻȡᵥջԿԶ߳ͬʱ
+        void Reclaim(uint64_t CompletedFenceValue, uint32_t FenceDomain = 0)
+        {
+            assert(FenceDomain < NumFenceDomains);
+            std::atomic<uint64_t>& RetiredPages = m_RetiredPages[FenceDomain];
+            uint64_t Head = RetiredPages.exchange(InvalidPage, std::memory_order_acquire);
+
+            uint32_t Page = static_cast<uint32_t>(Head);
+            while (Page != InvalidPage)
+            {
+                uint32_t Next = m_Nodes[Page].Next.load(std::memory_order_relaxed);
+
+                if (m_Nodes[Page].FenceValue <= CompletedFenceValue)
+                    Release(Page);
+                else
+                    Push(RetiredPages, Page);
+
+                Page = Next;
+            }
+        }
+
+        PageType& GetPage(uint32_t Page)
+        {
+            assert(Page < GetPageCount());
+            return *m_Nodes[Page].Page;
+        }
+
+        uint64_t GetPageSize(uint32_t Page) const
+        {
+            assert(Page < GetPageCount());
+            return m_Nodes[Page].Size;
+        }
+
+        uint32_t GetPageCount() const
+        {
+            return std::min(m_NumPages.load(std::memory_order_relaxed), m_MaxPages);
+        }
+
+        uint32_t GetMaxPages() const { return m_MaxPages; }
+
+        // ͷеPageʱ߳ʹó
+        void Destroy()
+        {
+            uint32_t NumPages = GetPageCount();
+            for (uint32_t i = 0; i < NumPages; ++i)
+            {
+                m_Nodes[i].Page.reset();
+                m_Nodes[i].Next.store(InvalidPage, std::memory_order_relaxed);
+            }
+
+            for (auto& Head : m_FreePages)
+                Head.store(InvalidPage, std::memory_order_relaxed);
+            for (auto& Head : m_RetiredPages)
+                Head.store(InvalidPage, std::memory_order_relaxed);
+            m_NumPages.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        struct Node
+        {
+            std::optional<PageType> Page;
+            uint64_t Size = 0;
+            // ֻջǰд룬ջȡջrelease/acquireͬ
+            uint64_t FenceValue = 0;
+            // ջʱܶ߳޸ĵֵʱջİ汾Ѿ仯CASʧ
+            std::atomic<uint32_t> Next{ InvalidPage };
+        };
+
+        static constexpr uint32_t NumSizeClasses = 64;
+
+        static uint32_t FloorLog2(uint64_t Value)
+        {
+            uint32_t Log = 0;
+            while (Value >>= 1)
+                ++Log;
+            return Log;
+        }
+
+        static uint32_t CeilLog2(uint64_t Value)
+        {
+            return Value <= 1 ? 0 : FloorLog2(Value - 1) + 1;
+        }
+
+        static uint64_t MakeHead(uint64_t OldHead, uint32_t Page)
+        {
+            return (((OldHead >> 32) + 1) << 32) | Page;
+        }
+
+        void Push(std::atomic<uint64_t>& Head, uint32_t Page)
+        {
+            uint64_t OldHead = Head.load(std::memory_order_relaxed);
+            do
+            {
+                m_Nodes[Page].Next.store(static_cast<uint32_t>(OldHead), std::memory_order_relaxed);
+            } while (!Head.compare_exchange_weak(OldHead, MakeHead(OldHead, Page), std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        uint32_t Pop(std::atomic<uint64_t>& Head)
+        {
+            uint64_t OldHead = Head.load(std::memory_order_acquire);
+            while (static_cast<uint32_t>(OldHead) != InvalidPage)
+            {
+                uint32_t Page = static_cast<uint32_t>(OldHead);
+                uint32_t Next = m_Nodes[Page].Next.load(std::memory_order_relaxed);
+                if (Head.compare_exchange_weak(OldHead, MakeHead(OldHead, Next), std::memory_order_acquire, std::memory_order_acquire))
+                    return Page;
+            }
+            return InvalidPage;
+        }
+
+        std::unique_ptr<Node[]> m_Nodes;
+        const uint32_t m_MaxPages;
+        // ܳm_MaxPagesĲʧܵPage
+        std::atomic<uint32_t> m_NumPages{ 0 };
+
+        std::atomic<uint64_t> m_FreePages[NumSizeClasses];
+        std::atomic<uint64_t> m_RetiredPages[NumFenceDomains];
+    };
+
+    // ߳ͬʱģ¼Pageд롢FenceValueݣһ߳ģGPUƽQueueFenceValue
+    // ͬһPageͬʱ߳ʹãҲڵQueue֮ǰãִʱfalse
+    // ֻ׼⣬ƽ̨ϵ
+    bool StressTestDynamicPagePool(int ThreadCount, int FrameCount);
+}
@@ -1,6 +1,8 @@
 #include "../pch.h"
 #include "DynamicResource.h"
 #include "RenderDevice.h"
+#include "CommandListManager.h"
+#include "CommandQueue.h"
 
 namespace Graphics
 {
@@ -39,81 +41,76 @@ namespace Graphics
         m_pd3d12Buffer->Map(0, nullptr, &m_CPUVirtualAddress);
     }
 
-    DynamicResourceAllocator::DynamicResourceAllocator(UINT32 NumPagesToReserve, UINT64 PageSize)
+    DynamicResourceAllocator::DynamicResourceAllocator(UINT32 NumPagesToReserve, UINT64 PageSize, UINT32 MaxPages) :
+        m_Pages{ MaxPages }
     {
         for (UINT32 i = 0; i < NumPagesToReserve; ++i)
         {
             D3D12DynamicPage Page(PageSize);
             auto             Size = Page.GetSize();
-            m_AvailablePages.emplace(Size, std::move(Page));
+            UINT32 Index = m_Pages.Add(std::move(Page), Size);
+            if (Index != InvalidPage)
+                m_Pages.Release(Index);
         }
     }
 
     // صPageĴСܱSizeInBytes
-    D3D12DynamicPage DynamicResourceAllocator::AllocatePage(UINT64 SizeInBytes)
+    UINT32 DynamicResourceAllocator::AllocatePage(UINT64 SizeInBytes)
     {
-        // رSizeInBytesĵһPageĵ
-        auto PageIt = m_AvailablePages.lower_bound(SizeInBytes);
-        if (PageIt != m_AvailablePages.end())
+        UINT32 Page = m_Pages.Acquire(SizeInBytes);
+
+        // ûпеPageʱȻGPUѾPage
+        if (Page == InvalidPage)
         {
-            assert(PageIt->first >= SizeInBytes);
-            D3D12DynamicPage Page(std::move(PageIt->second));
-            m_AvailablePages.erase(PageIt);
-            return Page;
+            ReclaimCompletedPages();
+            Page = m_Pages.Acquire(SizeInBytes);
         }
-        else
+
+        if (Page == InvalidPage)
         {
-            return D3D12DynamicPage{ SizeInBytes };
+            D3D12DynamicPage NewPage(SizeInBytes);
+            auto             Size = NewPage.GetSize();
+            Page = m_Pages.Add(std::move(NewPage), Size);
         }
-    }
 
-    void DynamicResourceAllocator::ReleasePages(std::vector<D3D12DynamicPage>& Pages)
-    {
-        struct StalePage
+        // PageѴʱĻտ߳ȡ˴ջ֮GPUһЩPage
+        // ʧ֮ǰٻһ
+        if (Page == InvalidPage)
         {
-            D3D12DynamicPage           Page;
-            DynamicResourceAllocator* Mgr;
+            ReclaimCompletedPages();
+            Page = m_Pages.Acquire(SizeInBytes);
 
-            StalePage(D3D12DynamicPage&& _Page, DynamicResourceAllocator& _Mgr) noexcept :
-                Page{ std::move(_Page) },
-                Mgr{ &_Mgr }
-            {
-            }
+            if (Page == InvalidPage)
+                LOG_ERROR("Dynamic resource allocator is out of pages");
+        }
 
-            StalePage(const StalePage&) = delete;
-            StalePage& operator= (const StalePage&) = delete;
-            StalePage& operator= (StalePage&&) = delete;
+        return Page;
+    }
 
-            StalePage(StalePage&& rhs)noexcept :
-                Page{ std::move(rhs.Page) },
-                Mgr{ rhs.Mgr }
-            {
-                rhs.Mgr = nullptr;
-            }
+    // ÿQueuePageֻQueueɵFenceValueȽ
+    void DynamicResourceAllocator::ReclaimCompletedPages()
+    {
+        CommandListManager& Manager = CommandListManager::GetSingleton();
+        for (D3D12_COMMAND_LIST_TYPE Type : { D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_TYPE_COMPUTE, D3D12_COMMAND_LIST_TYPE_COPY })
+            m_Pages.Reclaim(Manager.GetQueue(Type).GetCompletedFenceValue(), Type);
+    }
 
-            ~StalePage()
-            {
-                if (Mgr != nullptr)
-                {
-                    auto PageSize = Page.GetSize();
-                    Mgr->m_AvailablePages.emplace(PageSize, std::move(Page));
-                }
-            }
-        };
-        for (auto& Page : Pages)
+    void DynamicResourceAllocator::ReleasePages(std::vector<UINT32>& Pages, UINT64 FenceValue, D3D12_COMMAND_LIST_TYPE Type)
+    {
+        for (UINT32 Page : Pages)
         {
-            RenderDevice::GetSingleton().SafeReleaseDeviceObject(StalePage{ std::move(Page), *this });
+            m_Pages.Retire(Page, FenceValue, Type);
         }
     }
 
     void DynamicResourceAllocator::Destroy()
     {
-        m_AvailablePages.clear();
+        m_Pages.Destroy();
     }
 
     DynamicResourceAllocator::~DynamicResourceAllocator()
     {
-        assert(m_AvailablePages.empty() && "Not all pages are destroyed. Dynamic memory manager must be explicitly destroyed with Destroy() method");
+        assert(m_Pages.GetPageCount() == 0 && "Not all pages are destroyed. Dynamic memory manager must be explicitly destroyed with Destroy() method");
     }
 
 
@@ -136,15 +133,16 @@ namespace Graphics
                 NewPageSize *= 2;
 
             auto NewPage = m_GlobalDynamicAllocator.AllocatePage(NewPageSize);
-            if (NewPage.IsValid())
+            if (NewPage != DynamicResourceAllocator::InvalidPage)
             {
+                m_CurrPage = &m_GlobalDynamicAllocator.GetPage(NewPage);
                 m_CurrOffset = 0;
-                m_AvailableSize = NewPage.GetSize();
+                m_AvailableSize = m_CurrPage->GetSize();
 
                 m_CurrAllocatedSize += m_AvailableSize;
                 m_PeakAllocatedSize = std::max(m_PeakAllocatedSize, m_CurrAllocatedSize);
 
-                m_AllocatedPages.emplace_back(std::move(NewPage));
+                m_AllocatedPages.push_back(NewPage);
             }
         }
 
@@ -163,25 +161,25 @@ namespace Graphics
             m_PeakAlignedSize = std::max(m_PeakAlignedSize, m_CurrUsedAlignedSize);
 
             // ǴһPageнз
-            auto& CurrPage = m_AllocatedPages.back();
             return D3D12DynamicAllocation
             {
-                CurrPage.GetD3D12Buffer(),
+                m_CurrPage->GetD3D12Buffer(),
                 AlignedOffset,
                 SizeInBytes,
-                CurrPage.GetCPUAddress(AlignedOffset),
-                CurrPage.GetGPUAddress(AlignedOffset)
+                m_CurrPage->GetCPUAddress(AlignedOffset),
+                m_CurrPage->GetGPUAddress(AlignedOffset)
             };
         }
         else
             return D3D12DynamicAllocation{};
     }
 
-    void DynamicResourceHeap::ReleaseAllocatedPages()
+    void DynamicResourceHeap::ReleaseAllocatedPages(UINT64 FenceValue, D3D12_COMMAND_LIST_TYPE Type)
     {
-        m_GlobalDynamicAllocator.ReleasePages(m_AllocatedPages);
+        m_GlobalDynamicAllocator.ReleasePages(m_AllocatedPages, FenceValue, Type);
         m_AllocatedPages.clear();
 
+        m_CurrPage = nullptr;
         m_CurrOffset = InvalidOffset;
         m_AvailableSize = 0;
         m_CurrAllocatedSize = 0;
@@ -1,4 +1,5 @@
 #pragma once
+#include "DynamicPagePool.h"
 
 namespace Graphics
 {
@@ -75,6 +76,7 @@ namespace Graphics
 
 
     // еĶ̬Դʹõڴ棬ȫֻһ
+    // ߳̿ͬʱͷPagePageĸDynamicPagePoolҪ
     class DynamicResourceAllocator
     {
     public:
@@ -83,8 +85,10 @@ namespace Graphics
         /// </summary>
         /// <param name="NumPagesToReserve">ԤȴPage</param>
         /// <param name="PageSize"></param>
+        /// <param name="MaxPages">ഴPage</param>
         DynamicResourceAllocator(UINT32 NumPagesToReserve,
-                                  UINT64 PageSize);
+                                  UINT64 PageSize,
+                                  UINT32 MaxPages);
         ~DynamicResourceAllocator();
 
         DynamicResourceAllocator(const DynamicResourceAllocator&) = delete;
@@ -92,17 +96,28 @@ namespace Graphics
         DynamicResourceAllocator& operator= (const DynamicResourceAllocator&) = delete;
         DynamicResourceAllocator& operator= (DynamicResourceAllocator&&) = delete;
 
-        void ReleasePages(std::vector<D3D12DynamicPage>& Pages);
+        // TypeӦQueueFenceValue֮ЩPageŻᱻãÿQueueFenceValueԵܻ
+        void ReleasePages(std::vector<UINT32>& Pages, UINT64 FenceValue, D3D12_COMMAND_LIST_TYPE Type);
 
         void Destroy();
 
-        D3D12DynamicPage AllocatePage(UINT64 SizeInBytes);
+        // PageıţʧʱInvalidPage
+        UINT32 AllocatePage(UINT64 SizeInBytes);
+
+        D3D12DynamicPage& GetPage(UINT32 Page) { return m_Pages.GetPage(Page); }
+
+        static constexpr UINT32 InvalidPage = DynamicPagePool<D3D12DynamicPage>::InvalidPage;
 
     private:
-        std::multimap<UINT64/*PageĴС*/, D3D12DynamicPage, std::less<UINT64>> m_AvailablePages;
+        // GPUѾPageŻؿջ
+        void ReclaimCompletedPages();
+
+        DynamicPagePool<D3D12DynamicPage> m_Pages;
     };
 
 
+    // ÿCommandContextһDynamicResourceHeapPageԷ䣬
+    // ֻ¼߳ʹãԲҪֻµPageʱŻȫֵDynamicResourceAllocator
     class DynamicResourceHeap
     {
     public:
@@ -119,15 +134,16 @@ namespace Graphics
         ~DynamicResourceHeap();
 
         D3D12DynamicAllocation Allocate(UINT64 SizeInBytes, UINT64 Alignment);
-        // ÿ֡ĩβѷPageӵͷŶ
-        void ReleaseAllocatedPages();
+        // ύCommandList֮󣬰ѷPageCommandListڵQueueFenceValueһ𽻻DynamicResourceAllocator
+        void ReleaseAllocatedPages(UINT64 FenceValue, D3D12_COMMAND_LIST_TYPE Type);
 
         static constexpr UINT64 InvalidOffset = static_cast<UINT64>(-1);
 
     private:
         DynamicResourceAllocator& m_GlobalDynamicAllocator;
 
-        std::vector<D3D12DynamicPage> m_AllocatedPages;
+        std::vector<UINT32> m_AllocatedPages;
+        D3D12DynamicPage* m_CurrPage = nullptr;
 
         // СPageСС2
         const UINT64 m_BasePageSize;
@@ -143,9 +143,9 @@ namespace Graphics
 		return Desc;
 	}
 
-	D3D12_GPU_VIRTUAL_ADDRESS GpuDynamicBuffer::GetGpuVirtualAddress() const
+	D3D12_GPU_VIRTUAL_ADDRESS GpuDynamicBuffer::GetGpuVirtualAddress(const CommandContext& cmdContext) const
 	{
-		return m_DynamicData.GPUAddress;
+		return m_DynamicData[cmdContext.GetContextIndex()].GPUAddress;
 	}
 
 	/// <summary>
@@ -156,8 +156,9 @@ namespace Graphics
 	/// <returns></returns>
 	void* GpuDynamicBuffer::Map(CommandContext& cmdContext, size_t alignment)
 	{
-		m_DynamicData = cmdContext.AllocateDynamicSpace(m_BufferSize, alignment);
-		return m_DynamicData.CPUAddress;
+		D3D12DynamicAllocation& DynamicData = m_DynamicData[cmdContext.GetContextIndex()];
+		DynamicData = cmdContext.AllocateDynamicSpace(m_BufferSize, alignment);
+		return DynamicData.CPUAddress;
 	}
 
 }
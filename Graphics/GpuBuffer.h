@@ -103,13 +103,15 @@ namespace Graphics
 
         }
 
-        virtual D3D12_GPU_VIRTUAL_ADDRESS GetGpuVirtualAddress() const override;
+        // cmdContextһMapĵַ
+        D3D12_GPU_VIRTUAL_ADDRESS GetGpuVirtualAddress(const CommandContext& cmdContext) const;
 
         void* Map(CommandContext& cmdContext, size_t alignment);
         
     protected:
         // Ҫͷţÿ֡DynamicResourceHeapͷ
-        D3D12DynamicAllocation m_DynamicData;
+        // ÿCommandContextһݣ߳̿ڸԵCommandContextͬʱMap
+        D3D12DynamicAllocation m_DynamicData[MAX_COMMAND_CONTEXTS];
     };
 
 }
\ No newline at end of file
@@ -19,7 +19,7 @@ namespace Graphics
 			{*this, 16384, 32768, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE},
 			{*this, 128, 1920, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE}
 		},
-		m_DynamicResAllocator(1, DYNAMIC_RESOURCE_PAGE_SIZE)
+		m_DynamicResAllocator(1, DYNAMIC_RESOURCE_PAGE_SIZE, DYNAMIC_RESOURCE_MAX_PAGES)
 	{
 	}
 
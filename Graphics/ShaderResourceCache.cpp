@@ -81,7 +81,7 @@ namespace Graphics
 				GpuDynamicBuffer* dynamicBuffer = dynamic_cast<GpuDynamicBuffer*>(rootDescriptor.ConstantBuffer.get());
 
 				if(dynamicBuffer != nullptr)
-					cmdContext.GetGraphicsContext().SetConstantBuffer(rootIndex, rootDescriptor.ConstantBuffer->GetGpuVirtualAddress());
+					cmdContext.GetGraphicsContext().SetConstantBuffer(rootIndex, dynamicBuffer->GetGpuVirtualAddress(cmdContext));
 			}
 		}
 
@@ -110,7 +110,7 @@ namespace Graphics
 			GpuDynamicBuffer* dynamicBuffer = dynamic_cast<GpuDynamicBuffer*>(rootDescriptor.ConstantBuffer.get());
 
 			if (dynamicBuffer != nullptr)
-				cmdContext.GetGraphicsContext().SetConstantBuffer(rootIndex, dynamicBuffer->GetGpuVirtualAddress());
+				cmdContext.GetGraphicsContext().SetConstantBuffer(rootIndex, dynamicBuffer->GetGpuVirtualAddress(cmdContext));
 		}
 
 		if (m_NumDynamicDescriptor > 0)
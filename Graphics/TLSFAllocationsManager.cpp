@@ -0,0 +1,201 @@
+#include "../pch.h"
+#include "TLSFAllocationsManager.h"
+#include <chrono>
+
+namespace Graphics
+{
+    // ͷţС164֮䣬ʹõĿռ䳬һֻͷ
+    template <typename AllocationsManagerType>
+    static double RunAllocationsManager(AllocationsManagerType& manager, std::vector<VariableSizeAllocationsManager::Allocation>& allocations,
+                                        int operationCount, UINT32 seed)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < operationCount; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+
+            if (allocations.empty() || ((seed >> 31) != 0 && manager.GetUsedSize() * 2 < manager.GetMaxSize()))
+            {
+                auto allocation = manager.Allocate(1 + (seed >> 8) % 64, 1);
+                if (allocation.IsValid())
+                    allocations.push_back(allocation);
+            }
+            else
+            {
+                size_t index = (seed >> 8) % allocations.size();
+                manager.Free(std::move(allocations[index]));
+                allocations[index] = allocations.back();
+                allocations.pop_back();
+            }
+        }
+
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for (auto& allocation : allocations)
+            manager.Free(std::move(allocation));
+        allocations.clear();
+
+        return milliseconds;
+    }
+
+    AllocationsManagerBenchmark BenchmarkAllocationsManagers(size_t maxSize, int operationCount, int iterations)
+    {
+        AllocationsManagerBenchmark result;
+        if (iterations <= 0)
+            return result;
+
+        std::vector<VariableSizeAllocationsManager::Allocation> allocations;
+        allocations.reserve(operationCount);
+
+        VariableSizeAllocationsManager variableSizeManager(maxSize);
+        TLSFAllocationsManager tlsfManager(maxSize);
+
+        for (int it = 0; it < iterations; ++it)
+        {
+            result.VariableSizeMilliseconds += RunAllocationsManager(variableSizeManager, allocations, operationCount, it + 1);
+            result.TLSFMilliseconds += RunAllocationsManager(tlsfManager, allocations, operationCount, it + 1);
+        }
+        result.VariableSizeMilliseconds /= iterations;
+        result.TLSFMilliseconds /= iterations;
+
+        // Managerִͬķ䡢ͷУڻڴ汻ʹʱͳƬ
+        UINT32 seed = 1;
+        std::vector<VariableSizeAllocationsManager::Allocation> variableSizeAllocations;
+        std::vector<VariableSizeAllocationsManager::Allocation> tlsfAllocations;
+        for (int i = 0; i < operationCount; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+
+            if (variableSizeAllocations.empty() || (seed >> 31) != 0)
+            {
+                auto variableSizeAllocation = variableSizeManager.Allocate(1 + (seed >> 8) % 64, 1);
+                auto tlsfAllocation = tlsfManager.Allocate(1 + (seed >> 8) % 64, 1);
+                if (variableSizeAllocation.IsValid() && tlsfAllocation.IsValid())
+                {
+                    variableSizeAllocations.push_back(variableSizeAllocation);
+                    tlsfAllocations.push_back(tlsfAllocation);
+                }
+                else
+                {
+                    if (variableSizeAllocation.IsValid())
+                        variableSizeManager.Free(std::move(variableSizeAllocation));
+                    if (tlsfAllocation.IsValid())
+                        tlsfManager.Free(std::move(tlsfAllocation));
+                }
+            }
+            else
+            {
+                size_t index = (seed >> 8) % variableSizeAllocations.size();
+                variableSizeManager.Free(std::move(variableSizeAllocations[index]));
+                tlsfManager.Free(std::move(tlsfAllocations[index]));
+                variableSizeAllocations[index] = variableSizeAllocations.back();
+                variableSizeAllocations.pop_back();
+                tlsfAllocations[index] = tlsfAllocations.back();
+                tlsfAllocations.pop_back();
+            }
+        }
+
+        result.VariableSizeFragmentation = variableSizeManager.GetFragmentation();
+        result.TLSFFragmentation = tlsfManager.GetFragmentation();
+
+        for (auto& allocation : variableSizeAllocations)
+            variableSizeManager.Free(std::move(allocation));
+        for (auto& allocation : tlsfAllocations)
+            tlsfManager.Free(std::move(allocation));
+
+        return result;
+    }
+
+    // ִķ䡢ͷţڴ鲻صȷдСȷ
+    // Ŀڴ㹻ʱɹȫͷźϲΪһڴ飬ش
+    template <typename AllocationsManagerType>
+    static int FuzzAllocationsManager(AllocationsManagerType& manager, int operationCount, UINT32 seed)
+    {
+        const size_t maxSize = manager.GetMaxSize();
+
+        std::vector<VariableSizeAllocationsManager::Allocation> allocations;
+        // ÿλǷѾ䣬ص
+        std::vector<bool> used(maxSize, false);
+        size_t usedSize = 0;
+
+        int errors = 0;
+        for (int i = 0; i < operationCount; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            UINT32 operation = (seed >> 28) % 8;
+
+            seed = seed * 1664525u + 1013904223u;
+            if (operation < 4 || allocations.empty())
+            {
+                size_t size = 1 + (seed >> 8) % std::max<size_t>(maxSize / 8, 1);
+                size_t alignment = operation == 3 ? static_cast<size_t>(1) << ((seed >> 4) % 4) : 1;
+                size_t largestFreeBlockSize = manager.GetLargestFreeBlockSize();
+
+                auto allocation = manager.Allocate(size, alignment);
+                if (!allocation.IsValid())
+                {
+                    if (largestFreeBlockSize >= Align(size, alignment) + alignment - 1)
+                        errors++;
+                    continue;
+                }
+
+                size_t alignedOffset = Align(allocation.unalignedOffset, alignment);
+                if (allocation.size != Align(size, alignment) + (alignedOffset - allocation.unalignedOffset) ||
+                    allocation.unalignedOffset + allocation.size > maxSize)
+                {
+                    errors++;
+                    continue;
+                }
+
+                for (size_t u = allocation.unalignedOffset; u < allocation.unalignedOffset + allocation.size; ++u)
+                {
+                    if (used[u])
+                        errors++;
+                    used[u] = true;
+                }
+                usedSize += allocation.size;
+                allocations.push_back(allocation);
+            }
+            else
+            {
+                size_t index = (seed >> 8) % allocations.size();
+                for (size_t u = allocations[index].unalignedOffset; u < allocations[index].unalignedOffset + allocations[index].size; ++u)
+                    used[u] = false;
+                usedSize -= allocations[index].size;
+
+                manager.Free(std::move(allocations[index]));
+                allocations[index] = allocations.back();
+                allocations.pop_back();
+            }
+
+            if (manager.GetUsedSize() != usedSize || manager.GetLargestFreeBlockSize() > manager.GetFreeSize())
+                errors++;
+        }
+
+        for (auto& allocation : allocations)
+            manager.Free(std::move(allocation));
+
+        if (!manager.IsEmpty() || manager.GetFreeBlocksNum() != 1 || manager.GetLargestFreeBlockSize() != maxSize)
+            errors++;
+
+        return errors;
+    }
+
+    bool FuzzTestTLSFAllocationsManager(size_t maxSize, int operationCount, UINT32 seed)
+    {
+        VariableSizeAllocationsManager variableSizeManager(maxSize);
+        TLSFAllocationsManager tlsfManager(maxSize);
+
+        int variableSizeErrors = FuzzAllocationsManager(variableSizeManager, operationCount, seed);
+        int tlsfErrors = FuzzAllocationsManager(tlsfManager, operationCount, seed);
+
+        if (variableSizeErrors > 0 || tlsfErrors > 0)
+        {
+            LOG_ERROR("Allocations manager fuzz test failed: " + std::to_string(variableSizeErrors) + " errors in VariableSizeAllocationsManager, " +
+                std::to_string(tlsfErrors) + " errors in TLSFAllocationsManager");
+            return false;
+        }
+        return true;
+    }
+}
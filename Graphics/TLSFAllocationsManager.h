@@ -0,0 +1,363 @@
+#pragma once
+#include "VariableSizeAllocationsManager.h"
+#include <intrin.h>
+
+namespace Graphics
+{
+    /**
+    * Two-Level Segregated FitVariableSizeAllocationsManagerĽӿڡAllocationͶֱͬ滻
+    * ֻͬٿڴ飬¼ʹõڴ棬Freeʱͷһʹõڴ档
+    *   ڴ鰴СֵУһ2ݻ֣ڶÿ2پΪSL_COUNTݣ
+    *   һbitmap¼ЩΪգλɨָҺʵAllocateFreeO(1)
+    *   ڴϢڰoffsetУֻڹExtendʱڴ棬AllocateFreeڴ
+    * ĴСmaxSizeȣʺϹDescriptorԴʺϰֽڹܴڴ
+    */
+    class TLSFAllocationsManager
+    {
+    public:
+        using Allocation = VariableSizeAllocationsManager::Allocation;
+
+        TLSFAllocationsManager(size_t maxSize) :
+            m_MaxSize(0),
+            m_FreeSize(0)
+        {
+            for (auto& heads : m_FreeHeads)
+                for (auto& head : heads)
+                    head = InvalidBlock;
+
+            Extend(maxSize);
+        }
+
+        ~TLSFAllocationsManager()
+        {
+
+        }
+
+        TLSFAllocationsManager(TLSFAllocationsManager&& rhs) noexcept :
+            m_Blocks           {std::move(rhs.m_Blocks)},
+            m_BlockStartByEnd  {std::move(rhs.m_BlockStartByEnd)},
+            m_FLBitmap         {rhs.m_FLBitmap},
+            m_MaxSize          {rhs.m_MaxSize},
+            m_FreeSize         {rhs.m_FreeSize},
+            m_FreeBlocksNum    {rhs.m_FreeBlocksNum}
+        {
+            memcpy(m_SLBitmap, rhs.m_SLBitmap, sizeof(m_SLBitmap));
+            memcpy(m_FreeHeads, rhs.m_FreeHeads, sizeof(m_FreeHeads));
+
+            rhs.m_FLBitmap = 0;
+            memset(rhs.m_SLBitmap, 0, sizeof(rhs.m_SLBitmap));
+            rhs.m_MaxSize = 0;
+            rhs.m_FreeSize = 0;
+            rhs.m_FreeBlocksNum = 0;
+        }
+
+        TLSFAllocationsManager& operator = (TLSFAllocationsManager&& rhs)  = delete;
+        TLSFAllocationsManager(const TLSFAllocationsManager&)              = delete;
+        TLSFAllocationsManager& operator = (const TLSFAllocationsManager&) = delete;
+
+        Allocation Allocate(size_t size, size_t alignment)
+        {
+            assert(size > 0);
+            assert(IsPowerOfTwoD(alignment));
+
+            size = Align(size, alignment);
+            if (m_FreeSize < size)
+                return Allocation::InvalidAllocation();
+
+            // ڴoffsetһ룬ԤҪռ
+            size_t alignmentReserve = alignment - 1;
+
+            UINT32 block = FindFreeBlock(size, alignment, alignmentReserve);
+            if (block == InvalidBlock)
+                return Allocation::InvalidAllocation();
+
+            //     Block.Offset
+            //        |                                  |
+            //        |<----------Block.Size------------>|
+            //        |<------Size------>|<---NewSize--->|
+            //        |                  |
+            //      Offset              NewOffset
+            //
+
+            size_t offset = block;
+            size_t blockSize = m_Blocks[block].size;
+            size_t adjustedSize = size + (Align(offset, alignment) - offset);
+            assert(adjustedSize <= blockSize);
+
+            RemoveBlock(block);
+
+            if (blockSize > adjustedSize)
+                AddNewBlock(offset + adjustedSize, blockSize - adjustedSize);
+
+            m_FreeSize -= adjustedSize;
+
+            return Allocation(offset, adjustedSize);
+        }
+
+        void Free(Allocation&& allocation)
+        {
+            Free(allocation.unalignedOffset, allocation.size);
+            allocation = Allocation{};
+        }
+
+        void Free(size_t offset, size_t size)
+        {
+            assert(size > 0 && offset + size <= m_MaxSize);
+            // Ҫͷŵڴ鲻ܺͿڴص
+            assert(m_Blocks[offset].size == 0 && m_BlockStartByEnd[offset + size] == InvalidBlock);
+
+            size_t newOffset = offset;
+            size_t newSize = size;
+
+            // ǰһڴڣϲ
+            UINT32 previousBlock = m_BlockStartByEnd[offset];
+            if (previousBlock != InvalidBlock)
+            {
+                newOffset = previousBlock;
+                newSize += m_Blocks[previousBlock].size;
+                RemoveBlock(previousBlock);
+            }
+
+            // һڴڣϲ
+            if (offset + size < m_MaxSize && m_Blocks[offset + size].size > 0)
+            {
+                UINT32 nextBlock = static_cast<UINT32>(offset + size);
+                newSize += m_Blocks[nextBlock].size;
+                RemoveBlock(nextBlock);
+            }
+
+            AddNewBlock(newOffset, newSize);
+
+            m_FreeSize += size;
+        }
+
+        bool IsFull() const { return m_FreeSize == 0; }
+        bool IsEmpty() const { return m_FreeSize == m_MaxSize; }
+        size_t GetMaxSize() const { return m_MaxSize; }
+        size_t GetFreeSize() const { return m_FreeSize; }
+        size_t GetUsedSize() const { return m_MaxSize - m_FreeSize; }
+
+        size_t GetFreeBlocksNum() const
+        {
+            return m_FreeBlocksNum;
+        }
+
+        // ĿڴߵķǿУֻҪһ
+        size_t GetLargestFreeBlockSize() const
+        {
+            if (m_FLBitmap == 0)
+                return 0;
+
+            UINT32 fl = BitScanReverse(m_FLBitmap);
+            UINT32 sl = BitScanReverse(m_SLBitmap[fl]);
+
+            size_t largest = 0;
+            for (UINT32 block = m_FreeHeads[fl][sl]; block != InvalidBlock; block = m_Blocks[block].nextFree)
+                largest = std::max(largest, m_Blocks[block].size);
+            return largest;
+        }
+
+        // Ƭʣ0ʾڴһ飬ӽ1ʾڴ汻ֳ˺ܶС
+        float GetFragmentation() const
+        {
+            if (m_FreeSize == 0)
+                return 0.0f;
+            return 1.0f - static_cast<float>(GetLargestFreeBlockSize()) / static_cast<float>(m_FreeSize);
+        }
+
+        void Extend(size_t extraSize)
+        {
+            assert(m_MaxSize + extraSize < InvalidBlock);
+
+            size_t newBlockOffset = m_MaxSize;
+            size_t newBlockSize = extraSize;
+
+            m_MaxSize += extraSize;
+            m_Blocks.resize(m_MaxSize);
+            m_BlockStartByEnd.resize(m_MaxSize + 1, InvalidBlock);
+
+            if (extraSize == 0)
+                return;
+
+            // һڴĩˣһڴϲ
+            UINT32 lastBlock = m_BlockStartByEnd[newBlockOffset];
+            if (lastBlock != InvalidBlock)
+            {
+                newBlockOffset = lastBlock;
+                newBlockSize += m_Blocks[lastBlock].size;
+                RemoveBlock(lastBlock);
+            }
+
+            AddNewBlock(newBlockOffset, newBlockSize);
+
+            m_FreeSize += extraSize;
+        }
+
+    private:
+        static constexpr UINT32 InvalidBlock = static_cast<UINT32>(-1);
+
+        // ڶÿ2ݾΪ16ݣ˷1/16Ŀռ
+        static constexpr UINT32 SL_BITS = 4;
+        static constexpr UINT32 SL_COUNT = 1 << SL_BITS;
+        // СSL_COUNTĴСڵһĵ0УÿСһ
+        static constexpr UINT32 FL_COUNT = 32 - SL_BITS + 1;
+
+        // ֻпڴʼoffsetϵЧsizeΪ0ʾﲻǿڴ
+        struct FreeBlock
+        {
+            size_t size = 0;
+            UINT32 previousFree = InvalidBlock;
+            UINT32 nextFree = InvalidBlock;
+        };
+
+        static UINT32 BitScanForward(UINT32 mask)
+        {
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return index;
+        }
+
+        static UINT32 BitScanReverse(UINT64 mask)
+        {
+            unsigned long index;
+            _BitScanReverse64(&index, mask);
+            return index;
+        }
+
+        static void Mapping(size_t size, UINT32& fl, UINT32& sl)
+        {
+            if (size < SL_COUNT)
+            {
+                fl = 0;
+                sl = static_cast<UINT32>(size);
+            }
+            else
+            {
+                UINT32 msb = BitScanReverse(size);
+                fl = msb - SL_BITS + 1;
+                sl = static_cast<UINT32>(size >> (msb - SL_BITS)) ^ SL_COUNT;
+            }
+        }
+
+        // sizeȡһ㣬֮еڴ鶼㹻
+        static size_t RoundUpSize(size_t size)
+        {
+            if (size < SL_COUNT)
+                return size;
+            size_t round = (static_cast<size_t>(1) << (BitScanReverse(size) - SL_BITS)) - 1;
+            return size + round;
+        }
+
+        UINT32 FindFreeBlock(size_t size, size_t alignment, size_t alignmentReserve)
+        {
+            UINT32 fl, sl;
+            Mapping(RoundUpSize(size + alignmentReserve), fl, sl);
+
+            if (fl < FL_COUNT)
+            {
+                UINT32 slMap = m_SLBitmap[fl] & (~0u << sl);
+                if (slMap == 0)
+                {
+                    UINT32 flMap = fl + 1 < 32 ? m_FLBitmap & (~0u << (fl + 1)) : 0;
+                    if (flMap != 0)
+                    {
+                        fl = BitScanForward(flMap);
+                        slMap = m_SLBitmap[fl];
+                    }
+                }
+
+                if (slMap != 0)
+                    return m_FreeHeads[fl][BitScanForward(slMap)];
+            }
+
+            // ȡûҵʱȡǰڵпܻ㹻ڴ飬ֻڴ治ʱŻ
+            Mapping(size + alignmentReserve, fl, sl);
+            for (UINT32 block = m_FreeHeads[fl][sl]; block != InvalidBlock; block = m_Blocks[block].nextFree)
+            {
+                if (size + (Align(static_cast<size_t>(block), alignment) - block) <= m_Blocks[block].size)
+                    return block;
+            }
+
+            return InvalidBlock;
+        }
+
+        void AddNewBlock(size_t offset, size_t size)
+        {
+            UINT32 fl, sl;
+            Mapping(size, fl, sl);
+
+            UINT32 block = static_cast<UINT32>(offset);
+            UINT32 head = m_FreeHeads[fl][sl];
+
+            m_Blocks[block].size = size;
+            m_Blocks[block].previousFree = InvalidBlock;
+            m_Blocks[block].nextFree = head;
+            if (head != InvalidBlock)
+                m_Blocks[head].previousFree = block;
+
+            m_FreeHeads[fl][sl] = block;
+            m_FLBitmap |= 1u << fl;
+            m_SLBitmap[fl] |= 1u << sl;
+
+            m_BlockStartByEnd[offset + size] = block;
+            ++m_FreeBlocksNum;
+        }
+
+        void RemoveBlock(UINT32 block)
+        {
+            FreeBlock& freeBlock = m_Blocks[block];
+
+            UINT32 fl, sl;
+            Mapping(freeBlock.size, fl, sl);
+
+            if (freeBlock.previousFree != InvalidBlock)
+                m_Blocks[freeBlock.previousFree].nextFree = freeBlock.nextFree;
+            else
+                m_FreeHeads[fl][sl] = freeBlock.nextFree;
+
+            if (freeBlock.nextFree != InvalidBlock)
+                m_Blocks[freeBlock.nextFree].previousFree = freeBlock.previousFree;
+
+            if (m_FreeHeads[fl][sl] == InvalidBlock)
+            {
+                m_SLBitmap[fl] &= ~(1u << sl);
+                if (m_SLBitmap[fl] == 0)
+                    m_FLBitmap &= ~(1u << fl);
+            }
+
+            m_BlockStartByEnd[block + freeBlock.size] = InvalidBlock;
+            freeBlock = FreeBlock{};
+            --m_FreeBlocksNum;
+        }
+
+        // offset
+        std::vector<FreeBlock> m_Blocks;
+        // ڴĽλʼoffsetںǰһڴϲ
+        std::vector<UINT32> m_BlockStartByEnd;
+
+        UINT32 m_FLBitmap = 0;
+        UINT32 m_SLBitmap[FL_COUNT] = {};
+        UINT32 m_FreeHeads[FL_COUNT][SL_COUNT];
+
+        size_t m_MaxSize       = 0;
+        size_t m_FreeSize      = 0;
+        size_t m_FreeBlocksNum = 0;
+    };
+
+    struct AllocationsManagerBenchmark
+    {
+        double VariableSizeMilliseconds = 0.0;
+        double TLSFMilliseconds = 0.0;
+
+        // ԽʱƬ
+        float VariableSizeFragmentation = 0.0f;
+        float TLSFFragmentation = 0.0f;
+    };
+
+    // Managerִͬ䡢ͷУƽÿεʱ
+    AllocationsManagerBenchmark BenchmarkAllocationsManagers(size_t maxSize, int operationCount, int iterations);
+
+    // Managerִͬ䡢ͷУڴ鲻صȷ
+    // Ŀڴ㹻ʱɹִʱfalse
+    bool FuzzTestTLSFAllocationsManager(size_t maxSize, int operationCount, UINT32 seed);
+}
@@ -269,6 +269,19 @@ namespace Graphics
             return m_FreeBlocksByOffset.size();
         }
 
+        size_t GetLargestFreeBlockSize() const
+        {
+            return m_FreeBlocksBySize.empty() ? 0 : m_FreeBlocksBySize.rbegin()->first;
+        }
+
+        // Ƭʣ0ʾڴһ飬ӽ1ʾڴ汻ֳ˺ܶС
+        float GetFragmentation() const
+        {
+            if (m_FreeSize == 0)
+                return 0.0f;
+            return 1.0f - static_cast<float>(GetLargestFreeBlockSize()) / static_cast<float>(m_FreeSize);
+        }
+
         void Extend(size_t extraSize)
         {
             size_t newBlockOffset = m_MaxSize;
@@ -9,12 +9,6 @@ struct ObjectConstants
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 Obejct = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4 Color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	DirectX::XMFLOAT4X4 BoneTransforms[96];
-};
-
-struct SkinnedConstants
-{
-    DirectX::XMFLOAT4X4 BoneTransforms[96];
 };
 
 struct PassConstants
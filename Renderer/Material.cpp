@@ -22,19 +22,25 @@ void Material::CreateSRB(Graphics::PipelineState* PSO)
 {
 	assert(PSO != nullptr);
 
-	//if (m_SRB == nullptr)
+	if (m_SRBs.find(PSO) != m_SRBs.end())
+		return;
+
+	// The constant buffer and the views are shared by the SRBs of every PSO
+	if (m_ConstantBuffer == nullptr)
 	{
-		//LOG("111");
 		m_ConstantBuffer = std::make_shared<Graphics::GpuDefaultBuffer>(1, sizeof(PBRMaterialConstants), &m_ConstantsData);
 		m_BaseColorTextureDescriptor = m_BaseColorTexture != nullptr ? m_BaseColorTexture->CreateSRV() : nullptr;
 		m_MetallicRoughnessTextureDescriptor = m_MetallicRoughnessTexture != nullptr ? m_MetallicRoughnessTexture->CreateSRV() : nullptr;
 		m_NormalTextureDescriptor = m_NormalTexture != nullptr ? m_NormalTexture->CreateSRV() : nullptr;
 		m_OcclusionTextureDescriptor = m_OcclusionTexture != nullptr ? m_OcclusionTexture->CreateSRV() : nullptr;
 		m_EmissiveTextureDescriptor = m_EmissiveTexture != nullptr ? m_EmissiveTexture->CreateSRV() : nullptr;
+	}
 
-		m_SRB = PSO->CreateShaderResourceBinding();
+	{
+		m_SRBs[PSO] = PSO->CreateShaderResourceBinding();
+		Graphics::ShaderResourceBinding* SRB = m_SRBs[PSO].get();
 
-		Graphics::ShaderVariable* materialCB = m_SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "cbMaterial");
+		Graphics::ShaderVariable* materialCB = SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "cbMaterial");
 		if (materialCB != nullptr)
 		{
 			materialCB->Set(m_ConstantBuffer);
@@ -44,11 +50,11 @@ void Material::CreateSRB(Graphics::PipelineState* PSO)
 			LOG_ERROR("Shader variable: cbMaterial not found.");
 		}*/
 		
-		Graphics::ShaderVariable* baseColorTexVar = m_SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "BaseColorTex");
-		Graphics::ShaderVariable* metallicRoughnessTexVar = m_SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "MetallicRoughnessTex");
-		Graphics::ShaderVariable* normalTexVar = m_SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "NormalTex");
-		Graphics::ShaderVariable* occlusionTexVar = m_SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "OcclusionTex");
-		Graphics::ShaderVariable* emissiveTexVar = m_SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "EmissiveTex");
+		Graphics::ShaderVariable* baseColorTexVar = SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "BaseColorTex");
+		Graphics::ShaderVariable* metallicRoughnessTexVar = SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "MetallicRoughnessTex");
+		Graphics::ShaderVariable* normalTexVar = SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "NormalTex");
+		Graphics::ShaderVariable* occlusionTexVar = SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "OcclusionTex");
+		Graphics::ShaderVariable* emissiveTexVar = SRB->GetVariableByName(Graphics::SHADER_TYPE_PIXEL, "EmissiveTex");
 
 		int i = 0;
 		auto bindTex = [](Graphics::ShaderVariable* variable, std::shared_ptr<Graphics::GpuResourceDescriptor> texDescriptor)
@@ -74,4 +80,16 @@ void Material::CreateSRB(Graphics::PipelineState* PSO)
 		if (m_EmissiveTextureDescriptor != nullptr)
 			bindTex(emissiveTexVar, m_EmissiveTextureDescriptor);
 	}
-}
\ No newline at end of file
+}
+
+Graphics::ShaderResourceBinding* Material::GetSRB(Graphics::PipelineState* PSO)
+{
+	auto it = m_SRBs.find(PSO);
+	if (it == m_SRBs.end())
+	{
+		CreateSRB(PSO);
+		it = m_SRBs.find(PSO);
+	}
+
+	return it->second.get();
+}
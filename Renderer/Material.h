@@ -22,8 +22,9 @@ public:
 		std::shared_ptr<Graphics::GpuTexture2D> baseColorTex, std::shared_ptr<Graphics::GpuTexture2D> metallicRoughnessTex,
 		std::shared_ptr<Graphics::GpuTexture2D> normalTex, std::shared_ptr<Graphics::GpuTexture2D> occlusionTex, std::shared_ptr<Graphics::GpuTexture2D> emissiveTex);
 
+	// SRBs are created once per PSO the material is drawn with.
 	void CreateSRB(Graphics::PipelineState* PSO);
-	Graphics::ShaderResourceBinding* GetSRB() { assert(m_SRB != nullptr); return m_SRB.get(); }
+	Graphics::ShaderResourceBinding* GetSRB(Graphics::PipelineState* PSO);
 
 private:
 	enum ALPHA_MODE
@@ -51,5 +52,5 @@ private:
 	std::shared_ptr<Graphics::GpuResourceDescriptor> m_EmissiveTextureDescriptor;
 
 	std::shared_ptr<Graphics::GpuDefaultBuffer> m_ConstantBuffer;
-	std::unique_ptr<Graphics::ShaderResourceBinding> m_SRB = nullptr;
+	std::unordered_map<Graphics::PipelineState*, std::unique_ptr<Graphics::ShaderResourceBinding>> m_SRBs;
 };
\ No newline at end of file
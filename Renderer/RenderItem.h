@@ -38,7 +38,13 @@ struct RenderItem
 	// nullptr if this render-item is not animated by skinned mesh.
 	bool IsSkinned = false;
 
-	SkinnedConstants skinnedConstant;
+	// Palette of the character, packed in the palette format of the skinned
+	// shaders. Shared by the render items of the character, so that it is
+	// only uploaded once per frame.
+	const float* SkinnedPalette = nullptr;
+
+	// In floats
+	UINT SkinnedPaletteSize = 0;
 
 	Vector4 Color = Vector4::One;
 	//PBRMaterialConstants* materialCB = nullptr;
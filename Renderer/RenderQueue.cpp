@@ -0,0 +1,186 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <chrono>
+
+static inline uint64_t render_key_field(uint32_t value, int bits)
+{
+	return value & ((1ull << bits) - 1);
+}
+
+void RenderQueue::Clear()
+{
+	m_Entries.clear();
+	m_Stats = RenderQueueStats();
+}
+
+void RenderQueue::Reserve(size_t count)
+{
+	m_Entries.reserve(count);
+	m_Sorted.reserve(count);
+	m_Keys.reserve(count);
+	m_KeysScratch.reserve(count);
+}
+
+void RenderQueue::Submit(uint32_t pass, const void* pipeline, const void* material, const void* geometry,
+	uint32_t topology, float depth, uint32_t item)
+{
+	RenderQueueEntry entry;
+	entry.key = MakeKey(pass,
+		GetStateId(m_PipelineIds, pipeline),
+		GetStateId(m_MaterialIds, material),
+		GetStateId(m_GeometryIds, geometry),
+		depth);
+	entry.pipeline = pipeline;
+	entry.material = material;
+	entry.geometry = geometry;
+	entry.topology = topology;
+	entry.item = item;
+	entry.changes = 0;
+
+	m_Entries.push_back(entry);
+}
+
+uint64_t RenderQueue::MakeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t geometry, float depth)
+{
+	const uint32_t depthMax = (1u << RENDER_KEY_DEPTH_BITS) - 1;
+	uint32_t quantizedDepth = (uint32_t)(std::min(std::max(depth, 0.0f), 1.0f) * depthMax);
+
+	uint64_t key = render_key_field(pass, RENDER_KEY_PASS_BITS);
+	key = (key << RENDER_KEY_PIPELINE_BITS) | render_key_field(pipeline, RENDER_KEY_PIPELINE_BITS);
+	key = (key << RENDER_KEY_MATERIAL_BITS) | render_key_field(material, RENDER_KEY_MATERIAL_BITS);
+	key = (key << RENDER_KEY_GEOMETRY_BITS) | render_key_field(geometry, RENDER_KEY_GEOMETRY_BITS);
+	key = (key << RENDER_KEY_DEPTH_BITS) | render_key_field(quantizedDepth, RENDER_KEY_DEPTH_BITS);
+	return key;
+}
+
+uint32_t RenderQueue::GetStateId(std::unordered_map<const void*, uint32_t>& ids, const void* state)
+{
+	auto it = ids.find(state);
+	if (it != ids.end())
+		return it->second;
+
+	uint32_t id = (uint32_t)ids.size();
+	ids.emplace(state, id);
+	return id;
+}
+
+void RenderQueue::Sort()
+{
+	const size_t count = m_Entries.size();
+
+	m_Stats = RenderQueueStats();
+	if (count == 0)
+		return;
+
+	m_Keys.resize(count);
+	m_KeysScratch.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		m_Keys[i] = SortItem{ m_Entries[i].key, (uint32_t)i };
+	}
+
+	// LSD radix sort on bytes. All the histograms are built in one pass, the
+	// bytes shared by every key (same pass, same pipeline...) are skipped.
+	uint32_t histograms[8][256] = {};
+	for (const SortItem& item : m_Keys)
+	{
+		for (int d = 0; d < 8; d++)
+			histograms[d][(item.key >> (d * 8)) & 0xFF]++;
+	}
+
+	for (int d = 0; d < 8; d++)
+	{
+		uint32_t* histogram = histograms[d];
+		if (histogram[(m_Keys[0].key >> (d * 8)) & 0xFF] == count)
+			continue;
+
+		uint32_t offset = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			uint32_t c = histogram[b];
+			histogram[b] = offset;
+			offset += c;
+		}
+
+		for (const SortItem& item : m_Keys)
+		{
+			m_KeysScratch[histogram[(item.key >> (d * 8)) & 0xFF]++] = item;
+		}
+		m_Keys.swap(m_KeysScratch);
+	}
+
+	m_Sorted.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		m_Sorted[i] = m_Entries[m_Keys[i].index];
+	}
+	m_Entries.swap(m_Sorted);
+
+	// Flag what each draw has to bind. Switching pipeline invalidates the
+	// bindings, so everything is bound again after it.
+	m_Stats.drawCount = (int)count;
+
+	const RenderQueueEntry* prev = nullptr;
+	for (RenderQueueEntry& entry : m_Entries)
+	{
+		if (!prev || entry.pipeline != prev->pipeline)
+		{
+			entry.changes = RENDER_CHANGE_ALL;
+		}
+		else
+		{
+			entry.changes = 0;
+			if (entry.material != prev->material)
+				entry.changes |= RENDER_CHANGE_MATERIAL;
+			if (entry.geometry != prev->geometry)
+				entry.changes |= RENDER_CHANGE_GEOMETRY;
+			if (entry.topology != prev->topology)
+				entry.changes |= RENDER_CHANGE_TOPOLOGY;
+		}
+
+		m_Stats.pipelineChanges += (entry.changes & RENDER_CHANGE_PIPELINE) != 0;
+		m_Stats.materialChanges += (entry.changes & RENDER_CHANGE_MATERIAL) != 0;
+		m_Stats.geometryChanges += (entry.changes & RENDER_CHANGE_GEOMETRY) != 0;
+		m_Stats.topologyChanges += (entry.changes & RENDER_CHANGE_TOPOLOGY) != 0;
+
+		prev = &entry;
+	}
+}
+
+double BenchmarkRenderQueue(int itemCount, int iterations)
+{
+	// Fake states, only their addresses matter
+	static const char pipelines[4] = {};
+	static const char materials[64] = {};
+	static const char geometries[256] = {};
+	// Any topology value, the queue only compares them
+	const uint32_t triangleList = 4;
+
+	RenderQueue queue;
+	queue.Reserve(itemCount);
+
+	double milliseconds = 0.0;
+	uint32_t seed = 1;
+	for (int it = 0; it < iterations; it++)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		queue.Clear();
+		for (int i = 0; i < itemCount; i++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			queue.Submit(0,
+				&pipelines[(seed >> 8) % 4],
+				&materials[(seed >> 12) % 64],
+				&geometries[(seed >> 20) % 256],
+				triangleList,
+				(seed & 0xFF) / 255.0f,
+				i);
+		}
+		queue.Sort();
+
+		milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	return iterations > 0 ? milliseconds / iterations : 0.0;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Only std types here: topologies and states are opaque to the queue, so it
+// builds without the D3D headers, as GraphicDebug does.
+
+// Bits of the sort key, from the most significant: pass, pipeline, material,
+// geometry, then depth. Draws are grouped by the most expensive state first,
+// and drawn front to back inside a group.
+enum
+{
+	RENDER_KEY_PASS_BITS = 4,
+	RENDER_KEY_PIPELINE_BITS = 8,
+	RENDER_KEY_MATERIAL_BITS = 14,
+	RENDER_KEY_GEOMETRY_BITS = 14,
+	RENDER_KEY_DEPTH_BITS = 24
+};
+
+// States an entry binds that differ from the entry drawn before it.
+enum RenderStateChange : uint32_t
+{
+	RENDER_CHANGE_PIPELINE = 1 << 0,
+	RENDER_CHANGE_MATERIAL = 1 << 1,
+	RENDER_CHANGE_GEOMETRY = 1 << 2,
+	RENDER_CHANGE_TOPOLOGY = 1 << 3,
+	RENDER_CHANGE_ALL = 0xF
+};
+
+struct RenderQueueEntry
+{
+	uint64_t key;
+
+	// States are only compared, never dereferenced
+	const void* pipeline;
+
+	const void* material;
+
+	const void* geometry;
+
+	uint32_t topology;
+
+	// Index of the draw in the caller's data
+	uint32_t item;
+
+	// RenderStateChange flags, set by Sort
+	uint32_t changes;
+};
+
+struct RenderQueueStats
+{
+	int drawCount = 0;
+
+	int pipelineChanges = 0;
+
+	int materialChanges = 0;
+
+	int geometryChanges = 0;
+
+	int topologyChanges = 0;
+};
+
+///<summary>
+/// Draws of a frame, sorted on a 64 bits key so that draws sharing states
+/// are submitted together. The queue doesn't touch the GPU: states are
+/// opaque pointers given small ids on first use, and the renderer only binds
+/// the states an entry flags as changed.
+///</summary>
+class RenderQueue
+{
+public:
+	void Clear();
+
+	void Reserve(size_t count);
+
+	// depth is the view depth normalized to [0, 1], it is clamped.
+	void Submit(uint32_t pass, const void* pipeline, const void* material, const void* geometry,
+		uint32_t topology, float depth, uint32_t item);
+
+	// Radix sorts the entries on their key and flags the state changes.
+	void Sort();
+
+	const std::vector<RenderQueueEntry>& GetEntries() const { return m_Entries; }
+
+	const RenderQueueStats& GetStats() const { return m_Stats; }
+
+	static uint64_t MakeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t geometry, float depth);
+
+private:
+	struct SortItem
+	{
+		uint64_t key;
+
+		uint32_t index;
+	};
+
+	// Ids wrap around past the bits of their field, which only costs some
+	// state changes
+	static uint32_t GetStateId(std::unordered_map<const void*, uint32_t>& ids, const void* state);
+
+	std::vector<RenderQueueEntry> m_Entries;
+
+	std::vector<RenderQueueEntry> m_Sorted;
+
+	std::vector<SortItem> m_Keys;
+
+	std::vector<SortItem> m_KeysScratch;
+
+	std::unordered_map<const void*, uint32_t> m_PipelineIds;
+
+	std::unordered_map<const void*, uint32_t> m_MaterialIds;
+
+	std::unordered_map<const void*, uint32_t> m_GeometryIds;
+
+	RenderQueueStats m_Stats;
+};
+
+// Average time in milliseconds to submit and sort itemCount draws spread over
+// a few pipelines, materials and geometries.
+double BenchmarkRenderQueue(int itemCount, int iterations);
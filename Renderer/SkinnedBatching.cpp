@@ -0,0 +1,156 @@
+#include "SkinnedBatching.h"
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+SkinnedInstanceBatcher::SkinnedInstanceBatcher(uint32_t maxInstances, uint32_t maxPaletteVectors, uint32_t objectSize)
+	: m_MaxInstances(maxInstances), m_MaxPaletteVectors(maxPaletteVectors), m_ObjectSize(objectSize) {}
+
+void SkinnedInstanceBatcher::Clear()
+{
+	m_Draws.clear();
+	m_DrawBatches.clear();
+	m_DrawPalettes.clear();
+	m_Batches.clear();
+	m_Instances.clear();
+	m_Palettes.clear();
+	m_BatchIds.clear();
+	m_PaletteOffsets.clear();
+	m_Stats = SkinnedInstancingStats();
+}
+
+void SkinnedInstanceBatcher::Add(const SkinnedDraw& draw)
+{
+	assert(draw.paletteSize % 4 == 0);
+
+	m_Draws.push_back(draw);
+}
+
+void SkinnedInstanceBatcher::Build()
+{
+	const size_t count = m_Draws.size();
+
+	m_DrawBatches.resize(count);
+	m_DrawPalettes.resize(count);
+	m_Stats.drawCount = (int)count;
+
+	// Assign the draws to their batch and pack the palettes
+	uint32_t instanceCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const SkinnedDraw& draw = m_Draws[i];
+
+		uint32_t paletteOffset = (uint32_t)m_Palettes.size() / 4;
+		auto palette = m_PaletteOffsets.find(draw.palette);
+		if (palette != m_PaletteOffsets.end())
+		{
+			paletteOffset = palette->second;
+		}
+		else if (instanceCount < m_MaxInstances && paletteOffset + draw.paletteSize / 4 <= m_MaxPaletteVectors)
+		{
+			m_Palettes.resize((size_t)paletteOffset * 4 + draw.paletteSize);
+			memcpy(&m_Palettes[(size_t)paletteOffset * 4], draw.palette, draw.paletteSize * sizeof(float));
+			m_PaletteOffsets.emplace(draw.palette, paletteOffset);
+		}
+		else
+		{
+			paletteOffset = DROPPED;
+		}
+
+		if (paletteOffset == DROPPED || instanceCount == m_MaxInstances)
+		{
+			m_DrawBatches[i] = DROPPED;
+			m_Stats.droppedDrawCount++;
+			continue;
+		}
+
+		BatchKey key{ draw.pipeline, draw.material, draw.geometry, draw.indexCount, draw.startIndexLocation, draw.baseVertexLocation };
+		auto batch = m_BatchIds.find(key);
+		if (batch == m_BatchIds.end())
+		{
+			batch = m_BatchIds.emplace(key, (uint32_t)m_Batches.size()).first;
+			m_Batches.push_back(SkinnedInstanceBatch{ draw.pipeline, draw.material, draw.geometry,
+				draw.indexCount, draw.startIndexLocation, draw.baseVertexLocation, draw.item, 0, 0 });
+		}
+
+		m_DrawBatches[i] = batch->second;
+		m_DrawPalettes[i] = paletteOffset;
+		m_Batches[batch->second].instanceCount++;
+		instanceCount++;
+	}
+
+	// Instances of a batch are contiguous
+	uint32_t firstInstance = 0;
+	for (SkinnedInstanceBatch& batch : m_Batches)
+	{
+		batch.firstInstance = firstInstance;
+		firstInstance += batch.instanceCount;
+		batch.instanceCount = 0;
+	}
+
+	const uint32_t stride = GetInstanceStride();
+	const uint32_t paletteOffsetOffset = GetPaletteOffsetOffset(m_ObjectSize);
+
+	// Padding stays zeroed
+	m_Instances.assign((size_t)instanceCount * stride, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (m_DrawBatches[i] == DROPPED)
+			continue;
+
+		SkinnedInstanceBatch& batch = m_Batches[m_DrawBatches[i]];
+		uint8_t* instance = &m_Instances[(size_t)(batch.firstInstance + batch.instanceCount++) * stride];
+		memcpy(instance, m_Draws[i].object, m_ObjectSize);
+		memcpy(instance + paletteOffsetOffset, &m_DrawPalettes[i], sizeof(uint32_t));
+	}
+
+	m_Stats.batchCount = (int)m_Batches.size();
+	m_Stats.paletteCount = (int)m_PaletteOffsets.size();
+	m_Stats.uploadSize = m_Instances.size() + m_Palettes.size() * sizeof(float);
+}
+
+double BenchmarkSkinnedInstancing(int characterCount, int submeshCount, int iterations)
+{
+	// Fake states, only their addresses matter
+	static const char pipelines[1] = {};
+	static const char materials[8] = {};
+	static const char geometries[4] = {};
+
+	const uint32_t paletteSize = 96 * 12;
+	std::vector<float> palettes((size_t)characterCount * paletteSize, 1.0f);
+	// Same size as ObjectConstants: two matrices and a color
+	struct FakeObject { float data[36]; };
+	std::vector<FakeObject> objects(characterCount);
+
+	SkinnedInstanceBatcher batcher((uint32_t)(characterCount * submeshCount), (uint32_t)palettes.size() / 4, sizeof(FakeObject));
+
+	double milliseconds = 0.0;
+	for (int it = 0; it < iterations; it++)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		batcher.Clear();
+		for (int c = 0; c < characterCount; c++)
+		{
+			for (int s = 0; s < submeshCount; s++)
+			{
+				SkinnedDraw draw;
+				draw.pipeline = &pipelines[0];
+				draw.material = &materials[s % 8];
+				draw.geometry = &geometries[c % 4];
+				draw.indexCount = 3000;
+				draw.startIndexLocation = s * 3000;
+				draw.object = &objects[c];
+				draw.palette = &palettes[(size_t)c * paletteSize];
+				draw.paletteSize = paletteSize;
+				draw.item = c * submeshCount + s;
+				batcher.Add(draw);
+			}
+		}
+		batcher.Build();
+
+		milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	return iterations > 0 ? milliseconds / iterations : 0.0;
+}
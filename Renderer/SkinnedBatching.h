@@ -0,0 +1,199 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "../Common/HashUtils.hpp"
+
+// Batching and packing of the skinned draws. Only std types here: draw
+// states and object constants are opaque, so this builds without the D3D
+// headers, as GraphicDebug does. SkinnedInstancing.h maps the packed
+// instances on the shader's structure.
+
+// cbSkinnedBatch, SV_InstanceID doesn't include the start instance location.
+struct SkinnedBatchConstants
+{
+	uint32_t BaseInstance = 0;
+
+	uint32_t Pad[3] = {};
+};
+
+// A skinned draw of the frame, as it would be drawn without instancing.
+struct SkinnedDraw
+{
+	// States are only compared, never dereferenced
+	const void* pipeline = nullptr;
+
+	const void* material = nullptr;
+
+	const void* geometry = nullptr;
+
+	uint32_t indexCount = 0;
+
+	uint32_t startIndexLocation = 0;
+
+	int32_t baseVertexLocation = 0;
+
+	// Object constants of the draw, objectSize bytes as given to the batcher
+	const void* object = nullptr;
+
+	// Packed palette of the character. The draws of a character's submeshes
+	// point to the same palette, it is only packed once.
+	const float* palette = nullptr;
+
+	// In floats, a multiple of 4
+	uint32_t paletteSize = 0;
+
+	// Index of the draw in the caller's data
+	uint32_t item = 0;
+};
+
+// Draws sharing pipeline, material, geometry and submesh, drawn with one
+// instanced draw of instanceCount instances.
+struct SkinnedInstanceBatch
+{
+	const void* pipeline;
+
+	const void* material;
+
+	const void* geometry;
+
+	uint32_t indexCount;
+
+	uint32_t startIndexLocation;
+
+	int32_t baseVertexLocation;
+
+	// Item of the first draw of the batch, the states are bound from it
+	uint32_t item;
+
+	uint32_t firstInstance;
+
+	uint32_t instanceCount;
+};
+
+struct SkinnedInstancingStats
+{
+	int drawCount = 0;
+
+	int batchCount = 0;
+
+	int paletteCount = 0;
+
+	// Draws that didn't fit in the instance or palette buffers
+	int droppedDrawCount = 0;
+
+	// Bytes of instances and palettes uploaded for the frame
+	size_t uploadSize = 0;
+};
+
+///<summary>
+/// Groups the skinned draws of a frame into instanced draws. Instance data is
+/// packed into one array indexed by instance, and the palettes one after
+/// another into another array, so a frame uploads two contiguous buffers
+/// instead of a palette constant buffer per draw. Nothing here touches the GPU.
+///
+/// An instance is the object constants of its draw, padded to 16 bytes,
+/// followed by the offset of its palette in float4 and 12 bytes of padding.
+///
+/// The buffers the arrays are uploaded to have a fixed size, given at
+/// construction. Draws that don't fit anymore are dropped.
+///</summary>
+class SkinnedInstanceBatcher
+{
+public:
+	SkinnedInstanceBatcher(uint32_t maxInstances, uint32_t maxPaletteVectors, uint32_t objectSize);
+
+	void Clear();
+
+	void Add(const SkinnedDraw& draw);
+
+	// Builds the batches, in the order their first draw was added so that
+	// the order of a sorted render queue is kept, then packs the instances
+	// of each batch contiguously.
+	void Build();
+
+	const std::vector<SkinnedInstanceBatch>& GetBatches() const { return m_Batches; }
+
+	// Instances of every batch, GetInstanceStride() bytes each
+	const std::vector<uint8_t>& GetInstances() const { return m_Instances; }
+
+	// Palettes of the instances, 4 floats per vector
+	const std::vector<float>& GetPalettes() const { return m_Palettes; }
+
+	const SkinnedInstancingStats& GetStats() const { return m_Stats; }
+
+	uint32_t GetMaxInstances() const { return m_MaxInstances; }
+
+	uint32_t GetMaxPaletteVectors() const { return m_MaxPaletteVectors; }
+
+	uint32_t GetInstanceStride() const { return GetInstanceStride(m_ObjectSize); }
+
+	// Offset of the palette offset in an instance
+	static constexpr uint32_t GetPaletteOffsetOffset(uint32_t objectSize) { return (objectSize + 15) / 16 * 16; }
+
+	static constexpr uint32_t GetInstanceStride(uint32_t objectSize) { return GetPaletteOffsetOffset(objectSize) + 16; }
+
+private:
+	struct BatchKey
+	{
+		const void* pipeline;
+
+		const void* material;
+
+		const void* geometry;
+
+		uint32_t indexCount;
+
+		uint32_t startIndexLocation;
+
+		int32_t baseVertexLocation;
+
+		bool operator==(const BatchKey& rhs) const
+		{
+			return pipeline == rhs.pipeline && material == rhs.material && geometry == rhs.geometry &&
+				indexCount == rhs.indexCount && startIndexLocation == rhs.startIndexLocation &&
+				baseVertexLocation == rhs.baseVertexLocation;
+		}
+	};
+
+	struct BatchKeyHasher
+	{
+		size_t operator()(const BatchKey& key) const
+		{
+			return ComputeHash(key.pipeline, key.material, key.geometry, key.indexCount, key.startIndexLocation, key.baseVertexLocation);
+		}
+	};
+
+	static constexpr uint32_t DROPPED = 0xFFFFFFFF;
+
+	uint32_t m_MaxInstances;
+
+	uint32_t m_MaxPaletteVectors;
+
+	uint32_t m_ObjectSize;
+
+	std::vector<SkinnedDraw> m_Draws;
+
+	// Batch of each draw, DROPPED if it didn't fit
+	std::vector<uint32_t> m_DrawBatches;
+
+	// Palette offset of each draw
+	std::vector<uint32_t> m_DrawPalettes;
+
+	std::vector<SkinnedInstanceBatch> m_Batches;
+
+	std::vector<uint8_t> m_Instances;
+
+	std::vector<float> m_Palettes;
+
+	std::unordered_map<BatchKey, uint32_t, BatchKeyHasher> m_BatchIds;
+
+	std::unordered_map<const float*, uint32_t> m_PaletteOffsets;
+
+	SkinnedInstancingStats m_Stats;
+};
+
+// Average time in milliseconds to batch and pack characterCount characters of
+// submeshCount submeshes each, spread over a few meshes.
+double BenchmarkSkinnedInstancing(int characterCount, int submeshCount, int iterations);
@@ -0,0 +1,22 @@
+#pragma once
+#include "../pch.h"
+#include "FrameResource.h"
+#include "SkinnedBatching.h"
+
+// Instance data of the SKINNED_INSTANCED shaders, SkinnedInstance in
+// Shaders/Skinning.hlsl. SkinnedInstanceBatcher packs its instances in this
+// layout, given sizeof(ObjectConstants).
+struct SkinnedInstanceConstants
+{
+	ObjectConstants Object;
+
+	// First float4 of the instance's palette in the palette buffer
+	uint32_t PaletteOffset = 0;
+
+	uint32_t Pad[3] = {};
+};
+
+static_assert(offsetof(SkinnedInstanceConstants, PaletteOffset) == SkinnedInstanceBatcher::GetPaletteOffsetOffset(sizeof(ObjectConstants)),
+	"SkinnedInstanceBatcher packs the palette offset elsewhere");
+static_assert(sizeof(SkinnedInstanceConstants) == SkinnedInstanceBatcher::GetInstanceStride(sizeof(ObjectConstants)),
+	"SkinnedInstanceBatcher packs instances of another size");
@@ -0,0 +1,51 @@
+// Lines of GraphicDebug, drawn with one instanced draw: each instance is a
+// line and its two vertices are generated from SV_VertexID.
+
+cbuffer cbPass
+{
+	float4x4 gView;
+	float4x4 gInvView;
+	float4x4 gProj;
+	float4x4 gInvProj;
+	float4x4 gViewProj;
+	float4x4 gInvViewProj;
+	float4x4 gViewProjTex;
+	float4x4 gShadowTransform;
+	float3 gEyePosW;
+	float cbPerObjectPad1;
+	float2 gRenderTargetSize;
+	float2 gInvRenderTargetSize;
+	float gNearZ;
+	float gFarZ;
+	float gTotalTime;
+	float gDeltaTime;
+};
+
+struct LineIn
+{
+	float3 P1    : POSITION0;
+	float3 P2    : POSITION1;
+	float4 Color : COLOR;
+};
+
+struct VertexOut
+{
+	float4 PosH  : SV_POSITION;
+	float4 Color : COLOR;
+};
+
+VertexOut VS(LineIn vin, uint vertexID : SV_VertexID)
+{
+	VertexOut vout;
+
+	float3 posW = vertexID == 0 ? vin.P1 : vin.P2;
+	vout.PosH = mul(float4(posW, 1.0f), gViewProj);
+	vout.Color = vin.Color;
+
+	return vout;
+}
+
+float4 PS(VertexOut pin) : SV_Target
+{
+	return pin.Color;
+}
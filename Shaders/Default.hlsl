@@ -69,10 +69,9 @@ cbuffer cbLight
 	Light gLights[MaxLights];
 }
 
-cbuffer cbSkinned
-{
-	float4x4 gBoneTransforms[96];
-};
+#ifdef SKINNED
+#include "Skinning.hlsl"
+#endif
 
 cbuffer cbMaterial
 {
@@ -302,44 +301,34 @@ struct VertexOut
 	float4 Color : POSITION2; // TODO
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout = (VertexOut)0.0f;
 
-#ifdef SKINNED
-	float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	weights[0] = vin.BoneWeights.x;
-	weights[1] = vin.BoneWeights.y;
-	weights[2] = vin.BoneWeights.z;
-	weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
-
-	float3 posL = float3(0.0f, 0.0f, 0.0f);
-	float3 normalL = float3(0.0f, 0.0f, 0.0f);
-	float3 tangentL = float3(0.0f, 0.0f, 0.0f);
-	for (int i = 0; i < 4; ++i)
-	{
-		// Assume no nonuniform scaling when transforming normals, so 
-		// that we do not have to use the inverse-transpose.
-
-		posL += weights[i] * mul(float4(vin.PosL, 1.0f), gBoneTransforms[vin.BoneIndices[i]]).xyz;
-		normalL += weights[i] * mul(vin.NormalL, (float3x3)gBoneTransforms[vin.BoneIndices[i]]);
-		tangentL += weights[i] * mul(vin.TangentL.xyz, (float3x3)gBoneTransforms[vin.BoneIndices[i]]);
-	}
+#ifdef SKINNED_INSTANCED
+	SkinnedInstance instance = LoadSkinnedInstance(instanceID);
+	float4x4 world = instance.World;
+	float4x4 object = instance.Object;
+	float4 color = instance.Color;
+#else
+	float4x4 world = gWorld;
+	float4x4 object = gObject;
+	float4 color = gColor;
+#endif
 
-	vin.PosL = posL;
-	vin.NormalL = normalL;
-	vin.TangentL.xyz = tangentL;
+#ifdef SKINNED
+	SkinVertex(vin.BoneWeights, vin.BoneIndices, vin.PosL, vin.NormalL, vin.TangentL);
 #endif
 
 	// Transform to world space.
-	float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+	float4 posW = mul(float4(vin.PosL, 1.0f), world);
 	vout.PosW = posW.xyz;
 	vout.PosH = mul(posW, gViewProj);
 	
-	vout.NormalW = normalize(mul((float3x3)gObject, vin.NormalL));
-	vout.TangentW = mul(vin.TangentL, (float3x3)gWorld);
+	vout.NormalW = normalize(mul((float3x3)object, vin.NormalL));
+	vout.TangentW = mul(vin.TangentL, (float3x3)world);
 	vout.TexC = vin.TexC;
-	vout.Color = gColor;
+	vout.Color = color;
 
 	// Generate projective tex-coords to project shadow map onto scene.
 	vout.ShadowPosH = mul(posW, gShadowTransform);
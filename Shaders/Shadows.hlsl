@@ -42,10 +42,9 @@ cbuffer cbPass
 	float gDeltaTime;
 };
 
-cbuffer cbSkinned
-{
-	float4x4 gBoneTransforms[96];
-};
+#ifdef SKINNED
+#include "Skinning.hlsl"
+#endif
 
 struct VertexIn
 {
@@ -65,33 +64,24 @@ struct VertexOut
 	float2 TexC    : TEXCOORD;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout = (VertexOut)0.0f;
 
 	//MaterialData matData = gMaterialData[gMaterialIndex];
 	
+#ifdef SKINNED_INSTANCED
+	float4x4 world = LoadSkinnedInstance(instanceID).World;
+#else
+	float4x4 world = gWorld;
+#endif
+
 #ifdef SKINNED
-    float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-    weights[0] = vin.BoneWeights.x;
-    weights[1] = vin.BoneWeights.y;
-    weights[2] = vin.BoneWeights.z;
-    weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
-
-    float3 posL = float3(0.0f, 0.0f, 0.0f);
-    for(int i = 0; i < 4; ++i)
-    {
-        // Assume no nonuniform scaling when transforming normals, so 
-        // that we do not have to use the inverse-transpose.
-
-        posL += weights[i] * mul(float4(vin.PosL, 1.0f), gBoneTransforms[vin.BoneIndices[i]]).xyz;
-    }
-
-    vin.PosL = posL;
+    SkinPosition(vin.BoneWeights, vin.BoneIndices, vin.PosL);
 #endif
 
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
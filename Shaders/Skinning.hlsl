@@ -0,0 +1,210 @@
+//***************************************************************************************
+// Skinning.hlsl
+//
+// Bone palette and skinning functions. The palette layout is selected by the
+// CPU side (SkinningPaletteFormat):
+//   default                  : float4x4 per bone
+//   SKINNING_MATRIX3X4       : affine rows, float3x4 per bone
+//   SKINNING_DUAL_QUATERNION : real and dual parts, 2 float4 per bone
+//
+// With SKINNED_INSTANCED the palettes of every instance drawn in the frame are
+// read from one structured buffer instead of cbSkinned, see
+// Renderer/SkinnedInstancing.h.
+//***************************************************************************************
+
+#ifndef MAX_BONES
+    #define MAX_BONES 96
+#endif
+
+#if defined(SKINNING_DUAL_QUATERNION)
+    #define BONE_PALETTE_STRIDE 2
+#elif defined(SKINNING_MATRIX3X4)
+    #define BONE_PALETTE_STRIDE 3
+#else
+    #define BONE_PALETTE_STRIDE 4
+#endif
+
+#if defined(SKINNED_INSTANCED)
+
+// Matches SkinnedInstanceConstants
+struct SkinnedInstance
+{
+	float4x4 World;
+	float4x4 Object;
+	float4 Color;
+	uint PaletteOffset;
+	uint3 Pad;
+};
+
+StructuredBuffer<SkinnedInstance> gSkinnedInstances;
+
+// Palettes of all the instances, BONE_PALETTE_STRIDE float4 per bone
+StructuredBuffer<float4> gBonePalettes;
+
+cbuffer cbSkinnedBatch
+{
+	// First instance of the draw, SV_InstanceID starts at 0
+	uint gBaseInstance;
+};
+
+// Palette of the instance being skinned, set by the vertex shader
+static uint gBonePaletteOffset = 0;
+
+SkinnedInstance LoadSkinnedInstance(uint instanceID)
+{
+	SkinnedInstance instance = gSkinnedInstances[gBaseInstance + instanceID];
+	gBonePaletteOffset = instance.PaletteOffset;
+	return instance;
+}
+
+float4 LoadBonePalette(uint bone, uint row)
+{
+	return gBonePalettes[gBonePaletteOffset + bone * BONE_PALETTE_STRIDE + row];
+}
+
+#else
+
+cbuffer cbSkinned
+{
+#if defined(SKINNING_DUAL_QUATERNION)
+	float4 gBoneDualQuaternions[MAX_BONES * 2];
+#elif defined(SKINNING_MATRIX3X4)
+	row_major float3x4 gBoneTransforms[MAX_BONES];
+#else
+	float4x4 gBoneTransforms[MAX_BONES];
+#endif
+};
+
+#endif
+
+float4 SkinningWeights(float3 boneWeights)
+{
+	return float4(boneWeights, 1.0f - boneWeights.x - boneWeights.y - boneWeights.z);
+}
+
+#if defined(SKINNING_DUAL_QUATERNION)
+
+float4 LoadBoneReal(uint bone)
+{
+#if defined(SKINNED_INSTANCED)
+	return LoadBonePalette(bone, 0);
+#else
+	return gBoneDualQuaternions[bone * 2];
+#endif
+}
+
+float4 LoadBoneDual(uint bone)
+{
+#if defined(SKINNED_INSTANCED)
+	return LoadBonePalette(bone, 1);
+#else
+	return gBoneDualQuaternions[bone * 2 + 1];
+#endif
+}
+
+float3 QuatRotate(float4 q, float3 v)
+{
+	return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// Linear blend of the dual quaternions, aligned on the hemisphere of the
+// first bone so the blend takes the shortest path.
+void BlendDualQuaternions(float3 boneWeights, uint4 boneIndices, out float4 real, out float4 dual)
+{
+	float4 weights = SkinningWeights(boneWeights);
+	float4 real0 = LoadBoneReal(boneIndices[0]);
+
+	real = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	dual = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 4; ++i)
+	{
+		float4 r = LoadBoneReal(boneIndices[i]);
+		float4 d = LoadBoneDual(boneIndices[i]);
+		float w = dot(r, real0) < 0.0f ? -weights[i] : weights[i];
+
+		real += w * r;
+		dual += w * d;
+	}
+
+	float invLength = rsqrt(dot(real, real));
+	real *= invLength;
+	dual *= invLength;
+}
+
+float3 DualQuaternionTransformPoint(float4 real, float4 dual, float3 p)
+{
+	float3 translation = 2.0f * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+	return QuatRotate(real, p) + translation;
+}
+
+void SkinVertex(float3 boneWeights, uint4 boneIndices, inout float3 posL, inout float3 normalL, inout float3 tangentL)
+{
+	float4 real, dual;
+	BlendDualQuaternions(boneWeights, boneIndices, real, dual);
+
+	posL = DualQuaternionTransformPoint(real, dual, posL);
+	normalL = QuatRotate(real, normalL);
+	tangentL = QuatRotate(real, tangentL);
+}
+
+void SkinPosition(float3 boneWeights, uint4 boneIndices, inout float3 posL)
+{
+	float4 real, dual;
+	BlendDualQuaternions(boneWeights, boneIndices, real, dual);
+
+	posL = DualQuaternionTransformPoint(real, dual, posL);
+}
+
+#else
+
+// Affine rows of the bone, mul(m, float4(p, 1.0f)) transforms a point. The
+// float4x4 palette holds the columns of the row vector matrix, which are the
+// rows here.
+float3x4 LoadBoneMatrix(uint bone)
+{
+#if defined(SKINNED_INSTANCED)
+	return float3x4(LoadBonePalette(bone, 0), LoadBonePalette(bone, 1), LoadBonePalette(bone, 2));
+#elif defined(SKINNING_MATRIX3X4)
+	return gBoneTransforms[bone];
+#else
+	return (float3x4)transpose(gBoneTransforms[bone]);
+#endif
+}
+
+void SkinVertex(float3 boneWeights, uint4 boneIndices, inout float3 posL, inout float3 normalL, inout float3 tangentL)
+{
+	float4 weights = SkinningWeights(boneWeights);
+
+	float3 skinnedPos = float3(0.0f, 0.0f, 0.0f);
+	float3 skinnedNormal = float3(0.0f, 0.0f, 0.0f);
+	float3 skinnedTangent = float3(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 4; ++i)
+	{
+		float3x4 bone = LoadBoneMatrix(boneIndices[i]);
+
+		// Assume no nonuniform scaling when transforming normals, so 
+		// that we do not have to use the inverse-transpose.
+		skinnedPos += weights[i] * mul(bone, float4(posL, 1.0f));
+		skinnedNormal += weights[i] * mul((float3x3)bone, normalL);
+		skinnedTangent += weights[i] * mul((float3x3)bone, tangentL);
+	}
+
+	posL = skinnedPos;
+	normalL = skinnedNormal;
+	tangentL = skinnedTangent;
+}
+
+void SkinPosition(float3 boneWeights, uint4 boneIndices, inout float3 posL)
+{
+	float4 weights = SkinningWeights(boneWeights);
+
+	float3 skinnedPos = float3(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 4; ++i)
+	{
+		skinnedPos += weights[i] * mul(LoadBoneMatrix(boneIndices[i]), float4(posL, 1.0f));
+	}
+
+	posL = skinnedPos;
+}
+
+#endif
@@ -73,6 +73,7 @@
 //#include "Math/Common.h"
 //#include "Math/VectorMath.h"
 #include "Common/Align.h"
+#include "Common/Profiler.h"
 #include "Renderer/FrameResource.h"
 
 // imhui
@@ -88,5 +89,11 @@
 
 // Dynamic ResourcePageСλֽڣ1M
 #define DYNAMIC_RESOURCE_PAGE_SIZE 1048576
+// Dynamic ResourceഴPage
+#define DYNAMIC_RESOURCE_MAX_PAGES 1024
+// ͬʱڵCommandContextGpuDynamicBufferΪÿCommandContextһݷ
+#define MAX_COMMAND_CONTEXTS 16
+// Descriptor HeapʹTLSFAllocationsManagerеDescriptorΪ0ʱʹVariableSizeAllocationsManager
+#define DESCRIPTOR_HEAP_USE_TLSF 1
 
 #endif //PCH_H